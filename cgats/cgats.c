@@ -51,6 +51,7 @@ static int cgats_read(cgats *p, cgatsFile *fp);
 static int find_kword(cgats *p, int table, const char *ksym);
 static int find_field(cgats *p, int table, const char *fsym);
 static int add_table(cgats *p, table_type tt, int oi);
+static void set_real_sigdig(cgats *p, int nsd);
 static int set_table_flags(cgats *p, int table, int sup_id, int sup_kwords, int sup_fields);
 static int set_cgats_type(cgats *p, const char *osym);
 static int add_other(cgats *p, const char *osym);
@@ -59,6 +60,7 @@ static int add_kword(cgats *p, int table, const char *ksym, const char *kdata, c
 static int add_field(cgats *p, int table, const char *fsym, data_type ftype);
 static int add_set(cgats *p, int table, ...);
 static int add_setarr(cgats *p, int table, cgats_set_elem *args);
+static int add_setarrs(cgats *p, int table, int nsets, cgats_set_elem *args);
 static int get_setarr(cgats *p, int table, int set_index, cgats_set_elem *args);
 static int cgats_write(cgats *p, cgatsFile *fp);
 static int cgats_error(cgats *p, char **mes);
@@ -97,6 +99,7 @@ cgatsAlloc *al			/* memory allocator */
 		return NULL;
 	}
 	p->al = al;				/* Heap allocator */
+	p->rsigdig = REAL_SIGDIG;
 
 	/* Initialize the methods */
 	p->find_kword = find_kword;
@@ -104,6 +107,7 @@ cgatsAlloc *al			/* memory allocator */
 	p->read       = cgats_read;
 	p->add_table  = add_table;
 	p->set_table_flags = set_table_flags;
+	p->set_real_sigdig = set_real_sigdig;
 	p->set_cgats_type  = set_cgats_type;
 	p->add_other  = add_other;
 	p->get_oi     = get_oi;
@@ -111,6 +115,7 @@ cgatsAlloc *al			/* memory allocator */
 	p->add_field  = add_field;
 	p->add_set    = add_set;
 	p->add_setarr = add_setarr;
+	p->add_setarrs = add_setarrs;
 	p->get_setarr = get_setarr;
 	p->write      = cgats_write;
 	p->error      = cgats_error;
@@ -802,6 +807,14 @@ static int set_table_flags(cgats *p, int table, int sup_id, int sup_kwords, int
 	return 0;
 }
 
+/* Set the number of significant digits that real values */
+/* are written with, 0 for the default. */
+static void set_real_sigdig(cgats *p, int nsd) {
+	if (nsd <= 0)
+		nsd = REAL_SIGDIG;
+	p->rsigdig = nsd;
+}
+
 
 /* Append a new keyword/value + optional comment pair to the table */
 /* If no comment is provided, kcom should be set to NULL */
@@ -1113,6 +1126,39 @@ add_setarr(cgats *p, int table, cgats_set_elem *args) {
 	return 0;
 }
 
+/* Add nsets sets of data from a void array of nsets * nfields elements. */
+/* The set pointer array is grown once for all of them, rather than */
+/* in groups of 100 as add_setarr() does. */
+/* return 0 normally. */
+/* return -2, -1, errc & err on error */
+static int
+add_setarrs(cgats *p, int table, int nsets, cgats_set_elem *args) {
+	cgatsAlloc *al = p->al;
+	int i, rv;
+	cgats_table *t;
+
+	p->errc = 0;
+	p->err[0] = '\000';
+	if (table < 0 || table >= p->ntables)
+		return err(p,-1,"cgats.add_setarrs(), table parameter out of range");
+	t = &p->t[table];
+
+	if (t->nfields == 0)
+		return err(p,-1,"cgats.add_setarrs(), attempt to add set when no fields are defined");
+
+	if ((t->nsets + nsets) > t->nsetsa) {
+		t->nsetsa = t->nsets + nsets;
+		if ((t->fdata = (void ***)al->realloc(al,t->fdata, t->nsetsa * sizeof(void **))) == NULL)
+			return err(p,-2,"cgats.add_setarrs(), realloc failed!");
+	}
+
+	for (i = 0; i < nsets; i++) {
+		if ((rv = add_setarr(p, table, args + i * t->nfields)) != 0)
+			return rv;
+	}
+	return 0;
+}
+
 /* Fill a suitable set_element with a set of data. */
 /* Note a returned char pointer is to a string in *p */
 /* return 0 normally. */
@@ -1453,7 +1499,7 @@ cgats_write(cgats *p, cgatsFile *fp) {
 				if (t->ftype[field] == r_t) {
 					char fmt[30];
 					double val = *((double *)t->fdata[set][field]);
-					real_format(val, REAL_SIGDIG, fmt);
+					real_format(val, p->rsigdig, fmt);
  					strcat(fmt," ");
 					if (fp->gprintf(fp,fmt,val) < 0)
 						goto write_error;
@@ -1962,7 +2008,7 @@ cgats_dump(cgats *p, cgatsFile *fp) {
 						char fmt[30];
 						double val = *((double *)t->fdata[j][i]);
 						fmt[0] = ' ';
-						real_format(val, REAL_SIGDIG, fmt+1);
+						real_format(val, p->rsigdig, fmt+1);
 						fp->gprintf(fp,fmt,*((double *)t->fdata[j][i]));
 						break;
 					}
@@ -72,6 +72,7 @@ struct _cgats {
 	/* Private */
 	cgatsAlloc *al;		/* Memory allocator */
 	int del_al;			/* Flag to indicate we al->del() */
+	int rsigdig;		/* Significant digits used when writing reals */
 
 	/* Read only Variables */
 	int ntables;		/* Number of tables */
@@ -122,6 +123,9 @@ struct _cgats {
 	int (*set_table_flags)(struct _cgats *p, int table, int sup_id,int sup_kwords,int sup_fields);
 						/* Set or reset table output suppresion flags */
 						/* Return -ve, set errc & err on error */
+	void (*set_real_sigdig)(struct _cgats *p, int nsd);
+						/* Set the number of significant digits reals are written with. */
+						/* 0 sets the default. 17 will preserve a double exactly. */
 	int (*add_kword)(struct _cgats *p, int table, const char *ksym, const char *kdata, const char *kcom);
 						/* Add a new keyword/value pair + optional comment to the table */
 						/* Return index of new keyword, or -1, errc & err on error */
@@ -132,6 +136,9 @@ struct _cgats {
 						/* Return 0 normally, -1, -2, errc & err if error */
 	int (*add_setarr)(struct _cgats *p, int table, cgats_set_elem *ary); /* Add data from array */
 						/* Return 0 normally, -1, -2, errc & err if error */
+	int (*add_setarrs)(struct _cgats *p, int table, int nsets, cgats_set_elem *ary);
+						/* Add nsets sets from array of nsets * nfields elements */
+						/* Return 0 normally, -1, -2, errc & err if error */
 	int (*write)(struct _cgats *p, cgatsFile *fp);	/* Write structure into cgats file */
 										/* return -ve and errc and err set on error */
 
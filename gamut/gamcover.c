@@ -0,0 +1,192 @@
+
+/*
+ * gamcover
+ *
+ * Compare a gamut against a set of reference gamuts.
+ *
+ * Author:  agent <agent@local>
+ * Date:    18/10/2026
+ * Version: 1.00
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+	This program reads a CGATS format gamut surface, and any
+	number of reference gamut surfaces, and prints the volume
+	of each, the volume of their intersection, and how much
+	of each one is covered by the other. This is intended for
+	choosing the best matching standard gamut from a library.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include "copyright.h"
+#include "config.h"
+#include "numlib.h"
+#include "conv.h"
+#include "gamut.h"
+#include "gcover.h"
+
+void usage(char *diag, ...) {
+	fprintf(stderr,"Compare a gamut with reference gamuts, Version %s\n",ARGYLL_VERSION_STR);
+	if (diag != NULL) {
+		va_list args;
+		fprintf(stderr,"Diagnostic: ");
+		va_start(args, diag);
+		vfprintf(stderr, diag, args);
+		va_end(args);
+		fprintf(stderr,"\n");
+	}
+	fprintf(stderr,"usage: gamcover [-options] gamut.gam ref1.gam [ref2.gam ...]\n");
+	fprintf(stderr," -v             Verbose\n");
+	fprintf(stderr," -n nsamp       Number of sample points for the intersection (default 100000)\n");
+	fprintf(stderr," -s             Sort the references by how much of the gamut they cover\n");
+	fprintf(stderr," -j n           Use n threads (default number of processors)\n");
+	fprintf(stderr," gamut.gam      Gamut to compare\n");
+	fprintf(stderr," ref.gam        Reference gamuts to compare it with\n");
+	exit(1);
+}
+
+static gcover *s_res;		/* Results for sort */
+
+/* Decreasing coverage of the gamut, then of the reference */
+static int cmp_cover(const void *a, const void *b) {
+	gcover *ra = &s_res[*((int *)a)];
+	gcover *rb = &s_res[*((int *)b)];
+
+	if (ra->ok != rb->ok)
+		return rb->ok - ra->ok;
+	if (ra->cover != rb->cover)
+		return ra->cover < rb->cover ? 1 : -1;
+	if (ra->rcover != rb->rcover)
+		return ra->rcover < rb->rcover ? 1 : -1;
+	return 0;
+}
+
+int
+main(int argc, char *argv[]) {
+	int fa, nfa;				/* argument we're looking at */
+	int verb = 0;
+	int nsamp = 0;				/* Default */
+	int dosort = 0;
+	int nthr = system_ncpus();	/* Number of threads to use */
+	char **names;				/* Gamut file names, gamut first */
+	int nref;					/* Number of references */
+	gamut *s, **refs;
+	gcover *res;
+	int *order;
+	double vol;
+	int i;
+
+	error_program = argv[0];
+
+	if (argc < 3)
+		usage("Too few arguments, got %d expect at least 2",argc-1);
+
+	/* Process the arguments */
+	for(fa = 1;fa < argc;fa++) {
+		nfa = fa;					/* skip to nfa if next argument is used */
+		if (argv[fa][0] == '-')	{	/* Look for any flags */
+			char *na = NULL;		/* next argument after flag, null if none */
+
+			if (argv[fa][2] != '\000')
+				na = &argv[fa][2];		/* next is directly after flag */
+			else {
+				if ((fa+1) < argc) {
+					if (argv[fa+1][0] != '-') {
+						nfa = fa + 1;
+						na = argv[nfa];		/* next is seperate non-flag argument */
+					}
+				}
+			}
+
+			if (argv[fa][1] == '?')
+				usage(NULL);
+
+			else if (argv[fa][1] == 'v' || argv[fa][1] == 'V')
+				verb = 1;
+
+			else if (argv[fa][1] == 'n' || argv[fa][1] == 'N') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -n");
+				nsamp = atoi(na);
+				if (nsamp < 1) usage("Number of samples %d is out of range",nsamp);
+			}
+
+			else if (argv[fa][1] == 's' || argv[fa][1] == 'S')
+				dosort = 1;
+
+			else if (argv[fa][1] == 'j') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -j");
+				nthr = atoi(na);
+				if (nthr < 1) usage("Number of threads %d is out of range",nthr);
+			}
+
+			else
+				usage("Unknown flag '%c'",argv[fa][1]);
+		} else
+			break;
+	}
+
+	if ((argc - fa) < 2)
+		usage("Expect a gamut and at least one reference gamut");
+	names = &argv[fa];
+	nref = argc - fa - 1;
+
+	if ((s = new_gamut(0.0, 0, 0)) == NULL)
+		error("Creating gamut object failed");
+	if (s->read_gam(s, names[0]))
+		error("Reading gamut file '%s' failed",names[0]);
+
+	if ((refs = (gamut **)malloc(sizeof(gamut *) * nref)) == NULL)
+		error("Malloc failed");
+	if ((res = (gcover *)malloc(sizeof(gcover) * nref)) == NULL)
+		error("Malloc failed");
+	if ((order = (int *)malloc(sizeof(int) * nref)) == NULL)
+		error("Malloc failed");
+
+	for (i = 0; i < nref; i++) {
+		if ((refs[i] = new_gamut(0.0, 0, 0)) == NULL)
+			error("Creating gamut object failed");
+		if (refs[i]->read_gam(refs[i], names[1 + i]))
+			error("Reading gamut file '%s' failed",names[1 + i]);
+		order[i] = i;
+	}
+	if (verb)
+		printf("Read %d reference gamuts, comparing using %d threads\n",nref,nthr);
+
+	vol = gamut_cover(s, refs, res, nref, nsamp, nthr);
+
+	if (dosort) {
+		s_res = res;
+		qsort(order, nref, sizeof(int), cmp_cover);
+	}
+
+	printf("'%s' volume = %.1f cubic units\n",names[0],vol);
+	for (i = 0; i < nref; i++) {
+		int ix = order[i];
+
+		if (!res[ix].ok) {
+			printf("'%s' is not compatible (Colorspace, gamut center ?)\n",names[1 + ix]);
+			continue;
+		}
+		printf("'%s' volume = %.1f, intersect = %.1f, covers %.2f%%, covered %.2f%%\n",
+		       names[1 + ix], res[ix].rvol, res[ix].ivol,
+		       100.0 * res[ix].cover, 100.0 * res[ix].rcover);
+	}
+
+	for (i = 0; i < nref; i++)
+		refs[i]->del(refs[i]);
+	free(order);
+	free(res);
+	free(refs);
+	s->del(s);
+
+	return 0;
+}
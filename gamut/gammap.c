@@ -115,12 +115,14 @@ struct {
 #include <fcntl.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 #include "counters.h"
 #include "icc.h"
 #include "numlib.h"
 #include "xicc.h"
 #include "gamut.h"
 #include "rspl.h"
+#include "cgats.h"
 #include "gammap.h"
 #include "nearsmth.h"
 #include "vrml.h"
@@ -461,6 +463,7 @@ double ssmooth = 7.0;		/* Level of RSPL smoothing for saturation */
 
 static void del_gammap(gammap *s);
 static void domap(gammap *s, double *out, double *in);
+static int write_gammap(gammap *s, char *filename);
 #ifdef PLOT_GAMUTS
 static void map_trans(void *cntx, double out[3], double in[3]);
 #endif
@@ -549,6 +552,7 @@ gammap *new_gammap(
 	/* Setup methods */
 	s->del = del_gammap;
 	s->domap = domap;
+	s->write = write_gammap;
 
 	/* Now create everything */
 
@@ -1550,8 +1554,6 @@ typedef struct {
 #endif
 			if (diagname != NULL)
 				wrl = new_vrml(diagname, doaxes);
-			else
-				wrl = new_vrml("gammap.wrl", doaxes);
 		}
 
 		if (wrl != NULL) {
@@ -2402,6 +2404,248 @@ double *in
 	}
 }
 
+/* ----------------------------------- */
+/* Gamut map file support */
+
+/* Context for copying rspl grid values to or from a flat array */
+typedef struct {
+	rspl *r;
+	double *a;		/* fdi values per grid point, in grid index order */
+} gmgrid;
+
+/* Return the flat array index of the grid point supplied to an rspl callback */
+static int gmgrid_ix(gmgrid *p, double *in) {
+	int e, ix = 0;
+
+	for (e = p->r->di-1; e >= 0; e--)
+		ix = ix * p->r->g.res[e] + *((int *)&in[-e-1]);
+	return ix * p->r->fdi;
+}
+
+/* rspl scan_rspl() function to copy the grid values out */
+static void gmgrid_get(void *cntx, double *out, double *in) {
+	gmgrid *p = (gmgrid *)cntx;
+	int f, ix = gmgrid_ix(p, in);
+
+	for (f = 0; f < p->r->fdi; f++)
+		p->a[ix + f] = out[f];
+}
+
+/* rspl set_rspl() function to copy the grid values in */
+static void gmgrid_set(void *cntx, double *out, double *in) {
+	gmgrid *p = (gmgrid *)cntx;
+	int f, ix = gmgrid_ix(p, in);
+
+	for (f = 0; f < p->r->fdi; f++)
+		out[f] = p->a[ix + f];
+}
+
+/* Format n doubles into a keyword value string */
+static char *gm_kvals(char *buf, double *v, int n) {
+	int i;
+	char *bp = buf;
+
+	for (i = 0; i < n; i++)
+		bp += sprintf(bp, i == 0 ? "%.17g" : " %.17g", v[i]);
+	return buf;
+}
+
+/* Parse n doubles from a keyword value. Return nz on error. */
+static int gm_kparse(cgats *cg, int table, char *kw, double *v, int n) {
+	int i, ki;
+	char *cp;
+
+	if ((ki = cg->find_kword(cg, table, kw)) < 0)
+		return 1;
+	cp = cg->t[table].kdata[ki];
+	for (i = 0; i < n; i++) {
+		char *ep;
+		v[i] = strtod(cp, &ep);
+		if (ep == cp)
+			return 1;
+		cp = ep;
+	}
+	return 0;
+}
+
+/* Add an rspl's grid to the given table */
+static void gm_write_grid(cgats *cg, int table, rspl *r) {
+	gmgrid cx;
+	datai gl, gh;
+	double gres[MXDI];
+	char buf[500], fname[20];
+	int e, f, i, no;
+
+	r->get_in_range(r, gl, gh);
+	for (no = 1, e = 0; e < r->di; e++) {
+		gres[e] = (double)r->g.res[e];
+		no *= r->g.res[e];
+	}
+	cg->add_kword(cg, table, "GRID_RES", gm_kvals(buf, gres, r->di), NULL);
+	cg->add_kword(cg, table, "GRID_LOW", gm_kvals(buf, gl, r->di), NULL);
+	cg->add_kword(cg, table, "GRID_HIGH", gm_kvals(buf, gh, r->di), NULL);
+
+	for (f = 0; f < r->fdi; f++) {
+		sprintf(fname, "VALUE_%d", f);
+		cg->add_field(cg, table, fname, r_t);
+	}
+
+	cx.r = r;
+	if ((cx.a = (double *)malloc(sizeof(double) * no * r->fdi)) == NULL)
+		error("gammap: malloc failed on grid values");
+	r->scan_rspl(r, RSPL_NOFLAGS, (void *)&cx, gmgrid_get);
+
+	for (i = 0; i < no; i++) {
+		cgats_set_elem ary[MXDO];
+		for (f = 0; f < r->fdi; f++)
+			ary[f].d = cx.a[i * r->fdi + f];
+		cg->add_setarr(cg, table, ary);
+	}
+	free(cx.a);
+}
+
+/* Create an rspl from a grid table. Return NULL on error. */
+static rspl *gm_read_grid(cgats *cg, int table, int di, int fdi) {
+	gmgrid cx;
+	datai gl, gh;
+	double gres[MXDI];
+	int ires[MXDI];
+	char fname[20];
+	int e, f, i, no, fi[MXDO];
+
+	if (gm_kparse(cg, table, "GRID_RES", gres, di)
+	 || gm_kparse(cg, table, "GRID_LOW", gl, di)
+	 || gm_kparse(cg, table, "GRID_HIGH", gh, di))
+		return NULL;
+	for (no = 1, e = 0; e < di; e++) {
+		ires[e] = (int)gres[e];
+		if (ires[e] < 2)
+			return NULL;
+		no *= ires[e];
+	}
+	if (cg->t[table].nsets != no)
+		return NULL;
+	for (f = 0; f < fdi; f++) {
+		sprintf(fname, "VALUE_%d", f);
+		if ((fi[f] = cg->find_field(cg, table, fname)) < 0
+		 || cg->t[table].ftype[fi[f]] != r_t)
+			return NULL;
+	}
+
+	if ((cx.r = new_rspl(RSPL_NOFLAGS, di, fdi)) == NULL)
+		error("gammap: new_rspl failed");
+	if ((cx.a = (double *)malloc(sizeof(double) * no * fdi)) == NULL)
+		error("gammap: malloc failed on grid values");
+	for (i = 0; i < no; i++) {
+		for (f = 0; f < fdi; f++)
+			cx.a[i * fdi + f] = *((double *)cg->t[table].fdata[i][fi[f]]);
+	}
+	cx.r->set_rspl(cx.r, RSPL_NOFLAGS, (void *)&cx, gmgrid_set, gl, gh, ires, NULL, NULL);
+	free(cx.a);
+
+	return cx.r;
+}
+
+/* Write the gamut map to a CGATS file, from which */
+/* read_gammap() can re-create it exactly. */
+/* Return non-zero on error */
+static int write_gammap(
+gammap *s,
+char *filename
+) {
+	time_t clk = time(0);
+	struct tm *tsp = localtime(&clk);
+	char *atm = asctime(tsp); /* Ascii time */
+	cgats *cg;
+	char buf[500];
+
+	cg = new_cgats();	/* Create a CGATS structure */
+	cg->set_real_sigdig(cg, 17);
+	cg->add_other(cg, "GAMMAP");
+
+	cg->add_table(cg, tt_other, 0);	/* Start the first table as type "GAMMAP" */
+
+	cg->add_kword(cg, 0, "DESCRIPTOR", "Argyll Gamut mapping transform", NULL);
+	cg->add_kword(cg, 0, "ORIGINATOR", "Argyll CMS gamut mapping library", NULL);
+	atm[strlen(atm)-1] = '\000';	/* Remove \n from end */
+	cg->add_kword(cg, 0, "CREATED",atm, NULL);
+
+	cg->add_kword(cg, 0, "GREY_ROT", gm_kvals(buf, &s->grot[0][0], 12), NULL);
+	cg->add_kword(cg, 0, "INV_GREY_ROT", gm_kvals(buf, &s->igrot[0][0], 12), NULL);
+	if (s->map != NULL) {
+		cg->add_kword(cg, 0, "MAP_IN_MIN", gm_kvals(buf, s->imin, 3), NULL);
+		cg->add_kword(cg, 0, "MAP_IN_MAX", gm_kvals(buf, s->imax, 3), NULL);
+	}
+
+	cg->add_kword(cg, 0, NULL, NULL, "First comes the grey axis L map grid");
+	gm_write_grid(cg, 0, s->grey);
+
+	if (s->map != NULL) {
+		cg->add_table(cg, tt_other, 0);		/* Start the second table */
+		cg->set_table_flags(cg, 1, 1, 0, 0);	/* Suppress id */
+		cg->add_kword(cg, 1, NULL, NULL, "And then the 3D gamut map grid");
+		gm_write_grid(cg, 1, s->map);
+	}
+
+	if (cg->write_name(cg, filename)) {
+		fprintf(stderr,"Error writing to file '%s' : '%s'\n",filename, cg->err);
+		cg->del(cg);
+		return 2;
+	}
+
+	cg->del(cg);		/* Clean up */
+	return 0;
+}
+
+/* Create a gamut mapping object from a file written */
+/* by the write() method. Return NULL on error. */
+gammap *read_gammap(
+char *filename
+) {
+	gammap *s;
+	cgats *cg;
+
+	cg = new_cgats();	/* Create a CGATS structure */
+	cg->add_other(cg, "GAMMAP");
+
+	if (cg->read_name(cg, filename)) {
+		fprintf(stderr,"Input file '%s' error : %s\n",filename, cg->err);
+		cg->del(cg);
+		return NULL;
+	}
+	if (cg->t[0].tt != tt_other || cg->t[0].oi != 0
+	 || (cg->ntables != 1 && cg->ntables != 2)) {
+		fprintf(stderr,"Input file '%s' isn't a GAMMAP format file\n",filename);
+		cg->del(cg);
+		return NULL;
+	}
+
+	if ((s = (gammap *)calloc(1, sizeof(gammap))) == NULL)
+		error("gammap: calloc failed on gammap object");
+
+	s->del = del_gammap;
+	s->domap = domap;
+	s->write = write_gammap;
+
+	if (gm_kparse(cg, 0, "GREY_ROT", &s->grot[0][0], 12)
+	 || gm_kparse(cg, 0, "INV_GREY_ROT", &s->igrot[0][0], 12)
+	 || (s->grey = gm_read_grid(cg, 0, 1, 1)) == NULL
+	 || (cg->ntables == 2
+	  && (gm_kparse(cg, 0, "MAP_IN_MIN", s->imin, 3)
+	   || gm_kparse(cg, 0, "MAP_IN_MAX", s->imax, 3)
+	   || (s->map = gm_read_grid(cg, 1, 3, 3)) == NULL))) {
+		fprintf(stderr,"Input file '%s' gamut map is not valid\n",filename);
+		s->del(s);
+		cg->del(cg);
+		return NULL;
+	}
+
+	cg->del(cg);
+	return s;
+}
+
+/* ----------------------------------- */
+
 /* Function to pass to rspl to invert grey curve */
 static void inv_grey_func(
 	void *cntx,
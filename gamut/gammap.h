@@ -34,6 +34,7 @@ struct _gammap {
 	/* Methods */
 	void (*del)(struct _gammap *s);			/* Free ourselves */
 	void (*domap)(struct _gammap *s, double *out, double *in);	/* Do the mapping */
+	int (*write)(struct _gammap *s, char *filename);	/* Write to a CGATS file, nz on error */
 
 }; typedef struct _gammap gammap;
 
@@ -62,5 +63,9 @@ gammap *new_gammap(
 	char *diagname		/* If non-NULL, write a gamut mapping diagnostic WRL */
 );
 
+/* Create a gamut map from a file written by the write() method. */
+/* Return NULL on error */
+gammap *read_gammap(char *filename);
+
 
 	
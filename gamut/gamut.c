@@ -134,6 +134,9 @@
 #endif
 
 static void triangulate(gamut *s);
+static void init_lu(gamut *s);
+static void init_ne(gamut *s);
+static void compgawb(gamut *s);
 static void del_gamut(gamut *s);
 static gvert *expand_gamut(gamut *s, double in[3]);
 static double getsres(gamut *s);
@@ -158,10 +161,13 @@ static int write_trans_vrml(gamut *s, char *filename, int doaxes, int docusps,
 	void (*transform)(void *cntx, double out[3], double in[3]), void *cntx);
 static int write_vrml(gamut *s, char *filename, int doaxes, int docusps);
 static int write_gam(gamut *s, char *filename);
+static int write_gam_full(gamut *s, char *filename);
 static int read_gam(gamut *s, char *filename);
 static double radial(gamut *s, double out[3], double in[3]);
 static double nradial(gamut *s, double out[3], double in[3]);
+static void nradials(gamut *s, double *rv, double (*out)[3], double (*in)[3], int n);
 static void nearest(gamut *s, double out[3], double in[3]);
+static void setshared(gamut *s);
 static void setwb(gamut *s, double *wp, double *bp, double *kp);
 static int getwb(gamut *s, double *cswp, double *csbp, double *cskp, double *gawp, double *gabp, double *gakp);
 static void setcusps(gamut *s, int flag, double in[3]);
@@ -462,15 +468,14 @@ static int gquad_quadrant(gquad *q, double p[3]) {
 
 /* ------------------------------------ */
 /* Allocate a BSP decision node structure */
-gbspn *new_gbspn(void) {
+gbspn *new_gbspn(gamut *s) {
 	gbspn *t;
-	static int n = 0; 		/* Serial number */
 	if ((t = (gbspn *) calloc(1, sizeof(gbspn))) == NULL) {
 		fprintf(stderr,"gamut: malloc failed - bspn node\n");
 		exit(-1);
 	}
 	t->tag = 1;		/* bspn decision node */
-	t->n = n++;
+	t->n = s->bspn_sn++;	/* Serial number */
 
 	return t;
 }
@@ -483,18 +488,18 @@ void del_gbspn(gbspn *t) {
 /* ------------------------------------ */
 /* Allocate a BSP tree triangle list node structure */
 gbspl *new_gbspl(
+gamut *s,
 int nt,			/* Number of triangles in the list */
 gtri **t		/* List of triangles to copy into structure */
 ) {
 	gbspl *l;
 	int i;
-	static int n = 0; 		/* Serial number */
 	if ((l = (gbspl *) calloc(1, sizeof(gbspl) + nt * sizeof(gtri *))) == NULL) {
 		fprintf(stderr,"gamut: malloc failed - bspl triangle tree node\n");
 		exit(-1);
 	}
 	l->tag = 3;		/* bspl triangle list node */
-	l->n = n++;
+	l->n = s->bspl_sn++;	/* Serial number */
 	l->nt = nt;
 	for (i = 0; i < nt; i++)
 		l->t[i] = t[i];
@@ -509,15 +514,14 @@ void del_gbspl(gbspl *l) {
 
 /* ------------------------------------ */
 /* Allocate a triangle structure */
-gtri *new_gtri(void) {
+gtri *new_gtri(gamut *s) {
 	gtri *t;
-	static int n = 0; 		/* Serial number */
 	if ((t = (gtri *) calloc(1, sizeof(gtri))) == NULL) {
 		fprintf(stderr,"gamut: malloc failed - gamut surface triangle\n");
 		exit(-1);
 	}
 	t->tag = 2;		/* Triangle */
-	t->n = n++;
+	t->n = s->tri_sn++;		/* Serial number */
 
 	return t;
 }
@@ -529,14 +533,13 @@ void del_gtri(gtri *t) {
 
 /* ------------------------------------ */
 /* Allocate an edge structure */
-gedge *new_gedge(void) {
+gedge *new_gedge(gamut *s) {
 	gedge *t;
-	static int n = 0; 		/* Serial number */
 	if ((t = (gedge *) calloc(1, sizeof(gedge))) == NULL) {
 		fprintf(stderr,"gamut: malloc failed - triangle edge\n");
 		exit(-1);
 	}
-	t->n = n++;
+	t->n = s->edge_sn++;	/* Serial number */
 	return t;
 }
 
@@ -651,8 +654,10 @@ int isRast				/* Flag indicating Raster rather than colorspace */
 	s->expandbydiff = expandbydiff;
 	s->radial      = radial;
 	s->nradial     = nradial;
+	s->nradials    = nradials;
 	s->nearest     = nearest;
 	s->vector_isect = compute_vector_isect;
+	s->setshared   = setshared;
 	s->setwb       = setwb;
 	s->getwb       = getwb;
 	s->setcusps    = setcusps;
@@ -660,11 +665,13 @@ int isRast				/* Flag indicating Raster rather than colorspace */
 	s->write_vrml  = write_vrml;
 	s->write_trans_vrml = write_trans_vrml;
 	s->write_gam   = write_gam;
+	s->write_gam_full = write_gam_full;
 	s->read_gam    = read_gam;
 
 	return s;
 }
 
+static void del_glu(glu *p);
 static void del_gnn(gnn *p);
 static void del_gbsp(gbsp *n);
 
@@ -682,6 +689,8 @@ static void del_triang(gamut *s) {
 		del_gbsp(s->lutree);
 		s->lutree = NULL;
 	}
+	del_glu(s->luf);
+	s->luf = NULL;
 
 	if (s->tris != NULL) {
 		tp = s->tris; 					/* Delete all the triangles */
@@ -1059,6 +1068,7 @@ double pp[3]		/* rectangular coordinate of point */
 static int intersect(gamut *s, gamut *sa, gamut *sb) {
 	int i, j, k;
 	gamut *s1, *s2;
+	char *isos;			/* Flag per s1 vertex, nz if it is outside s2 */
 
 	if (sa->compatible(sa, sb) == 0)
 		return 1;
@@ -1068,6 +1078,12 @@ static int intersect(gamut *s, gamut *sa, gamut *sb) {
 	if IS_LIST_EMPTY(sb->tris)
 		triangulate(sb);
 
+	/* Make sure the triangle bounding boxes are valid */
+	if (sa->ne_inited == 0)
+		init_ne(sa);
+	if (sb->ne_inited == 0)
+		init_ne(sb);
+
 	s->isJab = sa->isJab;
 
 	if (sa->isRast || sb->isRast)
@@ -1102,6 +1118,12 @@ static int intersect(gamut *s, gamut *sa, gamut *sb) {
 			s1 = sb;
 			s2 = sa;
 		}
+
+		/* (We keep the outside flags to ourselves rather than marking */
+		/*  the vertices, so that the source gamuts aren't modified.) */
+		if ((isos = (char *)calloc(s1->nv, sizeof(char))) == NULL)
+			error("gamut: calloc failed - intersect vertex flags");
+
 		for (i = 0; i < s1->nv; i++) {
 			double pl;
 	
@@ -1111,9 +1133,8 @@ static int intersect(gamut *s, gamut *sa, gamut *sb) {
 			pl = s2->nradial(s2, NULL, s1->verts[i]->p);
 			if (pl <= (1.0 + 1e-9)) {
 				expand_gamut(s, s1->verts[i]->p);
-				s1->verts[i]->f &= ~GVERT_ISOS;		/* s1 vert is not outside s2 */
 			} else {
-				s1->verts[i]->f |= GVERT_ISOS;		/* s1 vert is outside s2 */
+				isos[i] = 1;		/* s1 vert is outside s2 */
 			}
 		}
 
@@ -1123,7 +1144,7 @@ static int intersect(gamut *s, gamut *sa, gamut *sb) {
 
 			for (j = 0; j < 3; j++) {	/* For all edges in s1 triangle */
 				/* If edge passes through the other gamut */
-				if ((tp1->e[j]->v[0]->f ^ tp1->e[j]->v[1]->f) & GVERT_ISOS) {
+				if (isos[tp1->e[j]->v[0]->n] != isos[tp1->e[j]->v[1]->n]) {
 
 					/* Exhaustive search of other triangles in s2, */
 					/* to find the one that the edge intersects with. */
@@ -1150,6 +1171,7 @@ static int intersect(gamut *s, gamut *sa, gamut *sb) {
 			}
 
 		} END_FOR_ALL_ITEMS(tp1);
+		free(isos);
 	}
 
 	s->nofilter = 0;
@@ -1167,6 +1189,7 @@ static int intersect(gamut *s, gamut *sa, gamut *sb) {
 static int expandbydiff(gamut *s, gamut *s1, gamut *s2, gamut *s3, int docomp) {
 	int i, j, k;
 	gamut *ss[3];
+	char *isos;			/* Flag per sa vertex, nz if it is outside sb */
 
 	if (s1->compatible(s1, s2) == 0
 	 || s1->compatible(s2, s3) == 0)
@@ -1179,6 +1202,12 @@ static int expandbydiff(gamut *s, gamut *s1, gamut *s2, gamut *s3, int docomp) {
 	if IS_LIST_EMPTY(s3->tris)
 		triangulate(s3);
 
+	/* Make sure the triangle bounding boxes are valid */
+	if (s2->ne_inited == 0)
+		init_ne(s2);
+	if (s3->ne_inited == 0)
+		init_ne(s3);
+
 	s->isJab = s1->isJab;
 	s->isRast = s1->isRast;
 
@@ -1246,12 +1275,23 @@ static int expandbydiff(gamut *s, gamut *s1, gamut *s2, gamut *s3, int docomp) {
 			sb = ss[1];
 		}
 
+		/* Mark the sa vertices that are outside sb */
+		if ((isos = (char *)calloc(sa->nv, sizeof(char))) == NULL)
+			error("gamut: calloc failed - expandbydiff vertex flags");
+
+		for (i = 0; i < sa->nv; i++) {
+			if (!(sa->verts[i]->f & GVERT_TRI))
+				continue;
+			if (sb->nradial(sb, NULL, sa->verts[i]->p) > (1.0 + 1e-9))
+				isos[i] = 1;
+		}
+
 		/* Now find the edges that intersect the other gamut */
 		tpa = sa->tris;
 		FOR_ALL_ITEMS(gtri, tpa) {
 
 			for (j = 0; j < 3; j++) {
-				if ((tpa->e[j]->v[0]->f ^ tpa->e[j]->v[1]->f) & GVERT_ISOS) {
+				if (isos[tpa->e[j]->v[0]->n] != isos[tpa->e[j]->v[1]->n]) {
 
 					/* Exhaustive search of other triangles */
 					tpb = sb->tris;
@@ -1292,6 +1332,7 @@ static int expandbydiff(gamut *s, gamut *s1, gamut *s2, gamut *s3, int docomp) {
 			}
 
 		} END_FOR_ALL_ITEMS(tpa);
+		free(isos);
 	}
 
 	s->nofilter = 0;
@@ -1994,7 +2035,7 @@ gtri *tp		/* Triangle faces to be added */
 	/* The edges adjacency info remains valid for the three faces, */
 	/* as does the edge plane equation. */
 	DEL_LINK(s->tris, tp);		/* Delete it from the triangulation list */
-	t1 = new_gtri();
+	t1 = new_gtri(s);
 	t1->v[0] = tp->v[1];		/* Duplicate with rotated faces */
 	t1->v[1] = tp->v[2];
 	t1->e[0] = tp->e[1];		/* Edge adjacency for this edge */
@@ -2005,7 +2046,7 @@ gtri *tp		/* Triangle faces to be added */
 	for (j = 0; j < 4; j++)		/* Copy edge plane equation */
 		t1->ee[2][j] = tp->ee[0][j];
 
-	t2 = new_gtri();
+	t2 = new_gtri(s);
 	t2->v[0] = tp->v[2];		/* Duplicate with rotated faces */
 	t2->v[1] = tp->v[0];
 	t2->e[0] = tp->e[2];		/* Edge adjacency for this edge */
@@ -2186,7 +2227,7 @@ if (!intri) printf("~1 ###### vertex didn't land in any triangle! ########\n");
 			FOR_ALL_ITEMS(gtri, tp2) {
 				if (tp2->v[0] == tp->v[1]) {	/* Found 1/2 tp/tp2 edge adjacency */
 					gedge *e;
-					e = new_gedge();
+					e = new_gedge(s);
 					ADD_ITEM_TO_BOT(s->edges, e);	/* Append to edge list */
 					tp->e[1] = e;			/* Point to edge */
 					tp->ei[1] = 0;			/* edges 0th triangle */
@@ -2300,11 +2341,11 @@ gamut *s
 #endif
 		/* Setup the initial triangulation */
 		for (i = 0; i < 4; i++) {
-			tr[i] = new_gtri();
+			tr[i] = new_gtri(s);
 		}
 
 		for (i = 0; i < 6; i++) {
-			ed[i] = new_gedge();
+			ed[i] = new_gedge(s);
 			ADD_ITEM_TO_BOT(s->edges, ed[i]);
 		}
 
@@ -3091,8 +3132,8 @@ gamut *s
 /* return the distance to the gamut surface. */
 
 static void init_lu(gamut *s);
-static gtri *radial_point_triang(gamut *s, gbsp *np, double in[3]);
-static double radial_point(gamut *s, gbsp *np, double in[3]);
+static gbspt *radial_point_triang(glu *p, double in[3]);
+static double radial_point(gamut *s, glu *p, double in[3]);
 
 /* Given a point, return the point in that direction */
 /* that lies on the gamut surface. Return the radial */
@@ -3173,7 +3214,7 @@ double *in		/* input point (absolute)*/
 	}
 
 //if (trace) printf("~1 Normalised in = %f %f %f\n", nin[0], nin[1], nin[2]);
-	rv = radial_point(s, s->lutree, nin);
+	rv = radial_point(s, s->luf, nin);
 
 	if (rv < 0.0) {
 		error("gamut: radial internal error - failed to find triangle\n");
@@ -3226,15 +3267,183 @@ double *in		/* input point (absolute)*/
 	return rv;
 }
 
+/* Given n points, return the points in those directions */
+/* that lie on the gamut surface, and the normalised radial */
+/* radius to each surface point. */
+static void
+nradials(
+gamut *s,
+double *rv,			/* return normalised radial radii */
+double (*out)[3],	/* result points (absolute) (May be NULL) */
+double (*in)[3],	/* input points (absolute)*/
+int n				/* Number of points */
+) {
+	int i;
+	double ss, or;
+
+	for (i = 0; i < n; i++) {
+		_radial(s, &ss, &or, out != NULL ? out[i] : NULL, in[i]);
+		rv[i] = ss/or;
+	}
+}
+
 void lu_split(gamut *s, gbsp **np, int rdepth, gtri **list, int llen);
 
+/* Count the decision nodes and leaf triangles in a BSP tree */
+static void count_lu(gbsp *np, int *nn, int *nt) {
+	if (np == NULL)
+		return;
+	if (np->tag == 1) {			/* BSP node */
+		(*nn)++;
+		count_lu(((gbspn *)np)->po, nn, nt);
+		count_lu(((gbspn *)np)->ne, nn, nt);
+	} else if (np->tag == 2) {	/* Triangle */
+		(*nt)++;
+	} else {					/* Triangle list */
+		(*nt) += ((gbspl *)np)->nt;
+	}
+}
+
+/* Append a BSP (sub) tree to the flattened tree in depth first */
+/* order, and return its branch value. */
+static int flatten_lu(glu *p, gbsp *np) {
+	int i, j, ix;
+
+	if (np == NULL)
+		return 0;
+
+	if (np->tag == 1) {			/* BSP node */
+		gbspn *n = (gbspn *)np;
+		int po;
+
+		ix = p->nn++;
+		for (j = 0; j < 4; j++)
+			p->n[ix].pe[j] = n->pe[j];
+		po = flatten_lu(p, n->po);
+		p->n[ix].po = po;
+		p->n[ix].ne = flatten_lu(p, n->ne);
+		return ix + 1;
+
+	} else {					/* Triangle or list of triangles */
+		gtri **tpp;
+		int nt;
+
+		if (np->tag == 2) {
+			tpp = (gtri **)&np;
+			nt = 1;
+		} else {
+			tpp = ((gbspl *)np)->t;
+			nt = ((gbspl *)np)->nt;
+		}
+		if (nt <= 0)
+			return 0;
+
+		ix = p->nt;
+		for (i = 0; i < nt; i++) {
+			gbspt *t = &p->t[p->nt++];
+			for (j = 0; j < 4; j++) {
+				t->ee[0][j] = tpp[i]->ee[0][j];
+				t->ee[1][j] = tpp[i]->ee[1][j];
+				t->ee[2][j] = tpp[i]->ee[2][j];
+				t->pe[j] = tpp[i]->pe[j];
+			}
+			t->last = (i == (nt-1));
+			t->t = tpp[i];
+		}
+		return -1 - ix;
+	}
+}
+
+/* Free a flattened BSP tree */
+static void del_glu(glu *p) {
+	if (p != NULL) {
+		free(p->n);
+		free(p->t);
+		free(p);
+	}
+}
+
+/* Check that the branch values of a flattened BSP tree */
+/* that has been read in are consistent. Return nz if not. */
+static int check_glu(glu *p) {
+	int i;
+
+	if (p->root > p->nn || p->root < -p->nt)
+		return 1;
+	for (i = 0; i < p->nn; i++) {
+		if (p->n[i].po > p->nn || p->n[i].po < -p->nt
+		 || p->n[i].ne > p->nn || p->n[i].ne < -p->nt)
+			return 1;
+	}
+	if (p->nt > 0 && p->t[p->nt-1].last == 0)
+		return 1;
+	return 0;
+}
+
+/* Re-create the pointer linked BSP (sub) tree for a */
+/* flattened tree branch value. Return NULL if the branch is empty. */
+static gbsp *unflatten_lu(gamut *s, glu *p, int b) {
+	int i, j;
+
+	if (b > 0) {				/* BSP node */
+		gbspf *f = &p->n[b-1];
+		gbspn *n = new_gbspn(s);
+
+		for (j = 0; j < 4; j++)
+			n->pe[j] = f->pe[j];
+		n->po = unflatten_lu(s, p, f->po);
+		n->ne = unflatten_lu(s, p, f->ne);
+
+		/* Radius squared range of everything below */
+		n->rs0 = 1e120;
+		n->rs1 = -1.0;
+		for (i = 0; i < 2; i++) {
+			gbsp *c = i == 0 ? n->po : n->ne;
+			if (c == NULL)
+				continue;
+			if (c->rs0 < n->rs0)
+				n->rs0 = c->rs0;
+			if (c->rs1 > n->rs1)
+				n->rs1 = c->rs1;
+		}
+		return (gbsp *)n;
+
+	} else if (b < 0) {			/* Triangle or list of triangles */
+		int ix = -1 - b, nt;
+		gtri **tl;
+		gbspl *l;
+
+		for (nt = 1; p->t[ix + nt - 1].last == 0; nt++)
+			;
+		if (nt == 1)
+			return (gbsp *)p->t[ix].t;
+
+		if ((tl = (gtri **) malloc(nt * sizeof(gtri *))) == NULL)
+			error("gamut: malloc failed - BSP leaf triangle list");
+		for (i = 0; i < nt; i++)
+			tl[i] = p->t[ix + i].t;
+		l = new_gbspl(s, nt, tl);
+		free(tl);
+
+		l->rs0 = 1e120;
+		l->rs1 = -1.0;
+		for (i = 0; i < nt; i++) {
+			if (l->t[i]->rs0 < l->rs0)
+				l->rs0 = l->t[i]->rs0;
+			if (l->t[i]->rs1 > l->rs1)
+				l->rs1 = l->t[i]->rs1;
+		}
+		return (gbsp *)l;
+	}
+	return NULL;
+}
+
 /* Setup the radial lookup function acceleration structure */
 static void
 init_lu(
 gamut *s
 ) {
 	static double v0[3] = {0.0, 0.0, 0.0};
-	static 
 	gedge *ep;		/* Edge pointer */
 	gtri *tp;		/* Triangle pointer */
 	gtri **tlist;
@@ -3275,6 +3484,17 @@ gamut *s
 
 	free(tlist);
 
+	/* Create the flattened copy of the tree used by radial() */
+	if ((s->luf = (glu *) calloc(1, sizeof(glu))) == NULL)
+		error("gamut: calloc failed - flattened BSP tree");
+	count_lu(s->lutree, &s->luf->nn, &s->luf->nt);
+	if ((s->luf->n = (gbspf *) malloc((s->luf->nn + 1) * sizeof(gbspf))) == NULL
+	 || (s->luf->t = (gbspt *) malloc((s->luf->nt + 1) * sizeof(gbspt))) == NULL)
+		error("gamut: malloc failed - flattened BSP tree (%d nodes, %d triangles)",
+		                                                  s->luf->nn, s->luf->nt);
+	s->luf->nn = s->luf->nt = 0;
+	s->luf->root = flatten_lu(s->luf, s->lutree);
+
 //printf("~1 init_lu done\n");
 	s->lu_inited = 1;
 }
@@ -3446,7 +3666,7 @@ int llen		/* Number of triangles in the list */
 		/* Instead leave our list of triangles as the leaf node, */
 		/* and let the search algorithms deal with this. */
 
-		*np = (gbsp *)new_gbspl(llen, list);
+		*np = (gbsp *)new_gbspl(s, llen, list);
 		(*np)->rs0 = rs0;		/* Radius squared range */
 		(*np)->rs1 = rs1;
 //printf("~1 lu_split returning with a non split list of %d triangles\n",llen);
@@ -3454,7 +3674,7 @@ int llen		/* Number of triangles in the list */
 	}
 
 	/* Divide the triangles into two lists */
-	bspn = new_gbspn();				/* Next node */
+	bspn = new_gbspn(s);				/* Next node */
 	*np = (gbsp *)bspn;				/* Put it in place */
 	bspn->rs0 = rs0;				/* Radius squared range */
 	bspn->rs1 = rs1;
@@ -3507,72 +3727,65 @@ int llen		/* Number of triangles in the list */
 //printf("~1 lu_split returning\n");
 }
 
-/* Given a point and a node in the BSP tree, recurse down */
-/* the tree, or return the triangle it lies in. */
+/* Given a point, search down the flattened BSP tree, */
+/* and return the leaf triangle it lies in. */
 /* Return NULL if it wasn't in any triangle (shouldn't happen with a closed gamut ?). */
-static gtri *radial_point_triang(
-gamut *s,
-gbsp *np,		/* BSP node pointer we're at */
+static gbspt *radial_point_triang(
+glu *p,			/* Flattened BSP tree */
 double *nin		/* Normalised center relative point */
 ) {
-	gtri *rv;
-//if (trace) printf("~1 rad_pnt_tri: BSP 0x%x tag = %d, point %f %f %f\n", np,np->tag,nin[0],nin[1],nin[2]);
-	if (np->tag == 1) {		/* It's a BSP node */
-		gbspn *n = (gbspn *)np;
-		double ds;
+	int stack[BSPDEPTH];	/* Branches still to be tried */
+	int sp = 0;
+	int b = p->root;		/* Current branch */
 
-		ds = n->pe[0] * nin[0]
-		   + n->pe[1] * nin[1]
-	       + n->pe[2] * nin[2]
-		   + n->pe[3];
+	for (;;) {
+		if (b > 0) {		/* It's a BSP node */
+			gbspf *n = &p->n[b-1];
+			double ds;
 
-//if (trace) printf("~1 checking against BSP plane, ds = %e\n",ds);
-		/* Recurse down both sides it might be in */
-		if (ds > -1e-12) {
-			if ((rv = radial_point_triang(s, n->po, nin)) != NULL)
-				return rv;
-		}
-		if (ds <  1e-12) {
-			if ((rv = radial_point_triang(s, n->ne, nin)) != NULL)
-				return rv;
+			ds = n->pe[0] * nin[0]
+			   + n->pe[1] * nin[1]
+		       + n->pe[2] * nin[2]
+			   + n->pe[3];
+
+			/* Go down the side it's in, and remember the other */
+			/* side if it might be in that too. */
+			if (ds > -1e-12) {
+				if (ds < 1e-12 && n->ne != 0)
+					stack[sp++] = n->ne;
+				b = n->po;
+			} else {
+				b = n->ne;
+			}
+			continue;
 		}
-		return NULL;		/* Hmm */
 
-	} else {			/* It's a triangle or list of triangles */
-		int nt;			/* Number of triangles in list */
-		gtri **tpp;		/* Pointer to list of triangles */
-		int i, j;
+		if (b < 0) {		/* It's a leaf list of triangles */
+			gbspt *t;
 
-		if (np->tag == 2) {			/* It's a triangle */
-			tpp = (gtri **)&np;
-			nt = 1;
-		} else if (np->tag == 3) {	/* It's a triangle list */
-			gbspl *n = (gbspl *)np;
-			tpp = n->t;
-			nt = n->nt;
-		}
+			/* Go through the list and stop at the first triangle */
+			/* that the node lies in. */
+			for (t = &p->t[-1 - b];; t++) {
+				double ds0, ds1, ds2;
 
-		/* Go through the list and stop at the first triangle */
-		/* that the node lies in. */
-		for (i = 0; i < nt; i++, tpp++) {
-			gtri *t = *tpp;
+				ds0 = t->ee[0][0] * nin[0] + t->ee[0][1] * nin[1]
+				    + t->ee[0][2] * nin[2] + t->ee[0][3];
+				ds1 = t->ee[1][0] * nin[0] + t->ee[1][1] * nin[1]
+				    + t->ee[1][2] * nin[2] + t->ee[1][3];
+				ds2 = t->ee[2][0] * nin[0] + t->ee[2][1] * nin[1]
+				    + t->ee[2][2] * nin[2] + t->ee[2][3];
 
-			/* Check if the point is within this triangle */
-			for (j = 0; j < 3; j++) {
-				double ds;
-				ds = t->ee[j][0] * nin[0]
-				   + t->ee[j][1] * nin[1]
-			       + t->ee[j][2] * nin[2]
-				   + t->ee[j][3];
-				if (ds > 1e-10)
-					break;			/* Not within triangle */
-			}
-			if (j >= 3) {
-//if (trace) printf("~1 located triangle from list that we're in %d\n",n->t[i]->n);
-				return t;
+				if (ds0 <= 1e-10 && ds1 <= 1e-10 && ds2 <= 1e-10)
+					return t;		/* Within this triangle */
+				if (t->last)
+					break;
 			}
 		}
-		/* Hmm. */
+
+		/* Back track to the next side to be tried */
+		if (sp <= 0)
+			break;
+		b = stack[--sp];
 	}
 
 //if (trace) printf("~1 failed to find a triangle\n");
@@ -3585,15 +3798,15 @@ double *nin		/* Normalised center relative point */
 /* the gamut surface. */
 static double radial_point(
 gamut *s,
-gbsp *np,		/* BSP node pointer we're at */
+glu *p,			/* Flattened BSP tree */
 double *nin		/* Normalised center relative point */
 ) {
-	gtri *t;
+	gbspt *t;
 	double rv;
 
-//if (trace) printf("~1 radial_point: BSP 0x%x tag = %d, point %f %f %f\n", np,np->tag,nin[0],nin[1],nin[2]);
+//if (trace) printf("~1 radial_point: point %f %f %f\n", nin[0],nin[1],nin[2]);
 
-	t = radial_point_triang(s, np, nin);
+	t = radial_point_triang(p, nin);
 
 	/* If we failed to find a triangle, or the result was incorrect, do a */
 	/* brute force search to be sure of the result. */
@@ -3670,6 +3883,8 @@ static void del_gbsp(gbsp *n) {
 /* return the nearest point on the gamut surface. */
 
 #define GNN_INF 1e307
+#define GNN_LEAF 4			/* Maximum triangles in a bounding box tree leaf */
+#define GNN_DEPTH 128		/* Maximum nearest search stack depth */
 static void init_ne(gamut *s);
 
 /* Given an absolute point, return the point on the gamut */
@@ -3707,8 +3922,35 @@ double *q		/* Target point (absolute) */
 
 /* Using nearest neighbourhood accelleration structure: */
 
+/* Return the distance squared from a point to a bounding box */
+static double ne_box_dist(double mix[2][3], double *q) {
+	double d0, d1, bd;
+
+	d0 = mix[0][0] - q[0];
+	d1 = q[0] - mix[1][0];
+	d0 = d0 > d1 ? d0 : d1;
+	d0 = d0 > 0.0 ? d0 : 0.0;
+	bd = d0 * d0;
+	d0 = mix[0][1] - q[1];
+	d1 = q[1] - mix[1][1];
+	d0 = d0 > d1 ? d0 : d1;
+	d0 = d0 > 0.0 ? d0 : 0.0;
+	bd += d0 * d0;
+	d0 = mix[0][2] - q[2];
+	d1 = q[2] - mix[1][2];
+	d0 = d0 > d1 ? d0 : d1;
+	d0 = d0 > 0.0 ? d0 : 0.0;
+	bd += d0 * d0;
+
+	return bd;
+}
+
 /* Given an absolute point, return the point on the gamut */
 /* surface that is closest to it. */
+/* The distance to a triangle can't be less than the distance to */
+/* its bounding box, so the bounding box tree is searched nearest */
+/* branch first, and any branch whose box is further away than the */
+/* best triangle found so far is pruned. */
 static void
 nearest(
 gamut *s,
@@ -3716,259 +3958,74 @@ double *rout,	/* result point (absolute) */
 double *q		/* Target point (absolute) */
 ) {
 	gnn *p;				/* Pointer to nearest neighbor structure */
-	int e, i;
-	double r[3] = {0.0, 0.0, 0.0 };		/* Possible solution point */
+	int stack[GNN_DEPTH];		/* Nodes still to be searched */
+	double sdist[GNN_DEPTH];	/* Their bounding box distances */
+	int sp = 0;
+	double r[3];		/* Possible solution point */
 	double out[3] = {0.0, 0.0, 0.0};	/* Current best output value */
-	int wex[3 * 2];		/* Current window edge indexes */
-	double wed[3 * 2];	/* Current window edge distances */
-						/* Indexes are axis * 2 +0 for lower edge, */
-						/* +1 for upper edge of search box. */
-						/* We are comparing lower edge of search box */
-						/* with upper edge of bounding box etc. */ 
+	double bdist = GNN_INF;	/* Best distance squared so far */
 
 //printf("~1 nearest called\n");
 	if IS_LIST_EMPTY(s->tris)
 		triangulate(s);
 
-	/* We have to find out which triangle the point will be nearest */
 	if (s->ne_inited == 0) {
 		init_ne(s);				/* Init nn structure */
 	}
 	p = s->nns;
 
-	if ((p->tbase + 3) < p->tbase) {	/* Overflow of touch count */
-		for (i = 0; i < p->n; i++)
-			p->sax[0][i]->touch = 0;		/* reset it in all the objects */
-		p->tbase = 0;
-	}
-	p->ttarget = p->tbase + 3;		/* Target touch value */
-
-//printf("\n");
-//printf("Query point is %f %f %f\n",q[0], q[1], q[2]);
-
-	/* Find starting indexes within axis arrays */
-	for (e = 0; e < (2 * 3); e++) {	/* For all axes min & max */
-		int f = e/2;			/* Axis */
-		int mm = (e ^ 1) & 1;	/* Min/Max index used for edges */
-		int i0, i1, i2;
-		double v0, v1, v2;
-		double qf, ww;
-
-		/* Binary search this edge */
-		qf = q[f]; 		/* strength reduced q[f] */
-
-//printf("\n");
-//printf("isearching axis %d %s for %f\n",f, e & 1 ? "max" : "min", qf);
-		i0 = 0;
-		i2 = p->n - 1;
-		v0 = p->sax[e][i0]->mix[mm][f];
-		v2 = p->sax[e][i2]->mix[mm][f];
-//printf("start points %d - %d, bound %f - %f\n",i0, i2, v0, v2);
-
-		if (qf <= v0) {
-			i2 = i0;
-			v2 = v0;
-		} else if (qf >= v2) {
-			i0 = i2;
-			v0 = v2;
-		} else {
-			do {
-				i1 = (i2 + i0)/2;		/* Trial point */
-				v1 = p->sax[e][i1]->mix[mm][f];	/* Value at trial */
-				if (v1 < qf) {
-					i0 = i1;			/* Take top half */
-					v0 = v1;
-				} else {
-					i2 = i1;			/* Take bottom half */
-					v2 = v1;
-				}
-//printf("current point %d - %d, bound %f - %f\n",i0, i2, v0, v2);
-			} while ((i2 - i0) > 1);
-		}
-
-		if (e & 1) {			/* Max side of window */
-			int tc;				/* total object count */
-
-			ww = v2 - qf;
-			wed[e] = fabs(ww) * ww;
-			wex[e] = i2;
-
-			/* Check that min and max together will cover at least p->n objects */
-			tc = p->n - i2 + wex[e ^ 1] + 1;
-//printf("got %d, expected %d\n",tc, p->n);
-
-			/* (I don't really understand why this works!) */
-			if (tc < p->n) {		/* We haven't accounted for all the objects */
-				int el = e ^ 1;		/* Low side sax */
-				int ti0, ti2;
-				double tv0, tv2;
-
-				ti0 = wex[el];
-				ti2 = i2;
-//printf("We have straddling objects, initial indexes are %d - %d\n",ti0, ti2);
-
-				/* While straddling objects remain undiscovered: */
-				while (tc < p->n) {
-					tv0 =  GNN_INF;		/* Guard values */
-					tv2 = -GNN_INF;
-
-					/* Increment low side until we find a straddler */
-					while (ti0 < (p->n-1)) {
-						ww = p->sax[el][++ti0]->mix[0][f];	/* Position of the other end */
-						if (ww < qf) {
-//printf("found low object %d at index %d that straddles\n",p->sax[el][ti0]-p->base,ti0);
-							tv0 = qf - p->sax[el][ti0]->mix[1][f];
-							break;
-						}
-					}
-
-					/* Decrement high side until we find a straddler */
-					while (ti2 > 0) {
-						ww = p->sax[e][--ti2]->mix[1][f];	/* Position of the other end */
-						if (ww > qf) {
-//printf("found high object %d at index %d that straddles\n",p->sax[e][ti2]-p->base,ti2);
-							tv2 = p->sax[e][ti2]->mix[0][f] - qf;
-							break;
-						}
-					}
-					/* Choose the closest */
-					if (tv0 > tv2) {
-						wed[el] = fabs(tv0) * tv0;
-						wex[el] = ti0;
-						tc++;
-					} else {
-						wed[e] = fabs(tv2) * tv2;
-						wex[e] = ti2;
-						tc++;
-					}
-				}
-//printf("After correction we have %d - %d\n",wex[e^1], wex[e]);
-			}
-		} else {				/* Min side of window */
-			ww = q[f] - v0;
-			wed[e] = fabs(ww) * ww;
-			wex[e] = i0;
-		}
-	}
-
-	/* Expand a 3 dimenstional cube centered on the target point, */
-	/* jumping to the next nearest point on any axis, discovering */
-	/* any bounding boxes that are within the expanding window */
-	/* by checking their touch count. */
-
-	/* The first point found establishes the initial best distance. */
-	/* When the window expands beyond the point where it can improve */
-	/* the best distance, stop */
-
-	{
-		double bw = 0.0;		/* Current window distance */
-		double bdist = 1e308;	/* Best possible distance to an object outside the window */
-		gtri *bobj = NULL;
-		int ptested = 0;		/* Stats */
-		int pcalced = 0;		/* Stats */
-
-		/* Until we're done */
-		for (;;ptested++) {
-			int ee;				/* Axis & expanding box edge */
-			int ff;				/* Axis */
-			int ii;				/* Index of chosen point */
-			gtri *ob;			/* Current object */
-			unsigned int ctv;	/* Current touch value */
-//printf("\n");
-//printf("wwidth = %f, bdist = %f, window = %d-%d, %d-%d, %d-%d\n",
-//bw, bobj == NULL ? 0.0 : bdist, wex[0], wex[1], wex[2], wex[3], wex[4], wex[5]);
-//printf("window edge distances are = %f-%f, %f-%f, %f-%f\n",
-//wed[0], wed[1], wed[2], wed[3], wed[4], wed[5]);
-
-			/* find next (smallest) window increment axis and direction */
-			ee = 0;
-			ii = wex[ee];
-			bw = wed[ee];
-			for (e = 1; e < (2 * 3); e++) {
-				if (wed[e] < bw) {
-					ee = e;
-					ii = wex[e];
-					bw = wed[e];
-				}
-			}
-//printf("Next best is axisdir %d, object %d, axis index %d, best possible dist %f\n",
-//ee, p->sax[ee][ii] - p->base, ii, bw);
-
-			if (bw == GNN_INF || bw > bdist) {
-				break;		/* Can't got any further, or further points will be worse */
-			}
-
-#ifdef ASSERTS
-if (ii < 0 || ii >= p->n) {
-printf("Assert: went out of bounds of sorted axis array\n");
-exit(0);
-}
-#endif
-			/* Chosen point on ee axis/direction, index ii */
-			ff = ee / 2;			/* Axis only */
-
-			ob = p->sax[ee][ii];
+	stack[sp] = 0;
+	sdist[sp++] = 0.0;
 
-			/* Touch value of current object */
-			ctv = ob->touch;
+	while (sp > 0) {
+		gnnb *b;
 
-			if (ctv < p->ttarget) {		/* Not been dealt with before */
+		if (sdist[--sp] >= bdist)
+			continue;				/* Can't be any closer */
+		b = &p->b[stack[sp]];
 
-				/* Touch this new window boundary point */
-				ob->touch = ctv = ((ctv < p->tbase) ? p->tbase : ctv) + 1;
+		if (b->ch[0] < 0) {			/* Leaf */
+			int i;
 
-//printf("New touch count on %d is %d, target %d\n",
-//ob - p->base, p->sax[ee][ii]->touch, p->ttarget);
+			for (i = b->t0; i < (b->t0 + b->nt); i++) {
+				gtri *tp = p->t[i];
+				double tdist;
 
-				/* Check the point out */
-				if (ctv == (p->tbase + 3)) {	/* Is within window on all axes */
-					double tdist;
-
-					pcalced++;		/* Stats */
+				if (ne_box_dist(tp->mix, q) >= bdist)
+					continue;
 
-					/* Compute distance from query point to this object */
-					tdist = ne_point_on_tri(s, ob, r, q);
+				/* Compute distance from query point to this object */
+				tdist = ne_point_on_tri(s, tp, r, q);
 
-//printf("Got new best point %d, dist %f\n",i,tdist);
-					if (tdist < bdist) {	/* New best point */
-						bobj = ob;
-						bdist = tdist;
-						out[0] = r[0];
-						out[1] = r[1];
-						out[2] = r[2];
-					}
+				if (tdist < bdist) {	/* New best point */
+					bdist = tdist;
+					out[0] = r[0];
+					out[1] = r[1];
+					out[2] = r[2];
 				}
 			}
-
-			/* Increment next window edge candidate, and figure new edge distance */
-			if (ee & 1) {					/* Top */
-				if (++wex[ee] >= p->n) {
-					wed[ee] = GNN_INF;
-					wex[ee]--;
-				} else {
-					double ww = p->sax[ee][wex[ee]]->mix[0][ff] - q[ff];
-					wed[ee] = fabs(ww) * ww;
-				}
+		} else {					/* Node, so push the nearer child last */
+			double d0, d1;
+
+			d0 = ne_box_dist(p->b[b->ch[0]].mix, q);
+			d1 = ne_box_dist(p->b[b->ch[1]].mix, q);
+			if (d0 < d1) {
+				stack[sp] = b->ch[1];
+				sdist[sp++] = d1;
+				stack[sp] = b->ch[0];
+				sdist[sp++] = d0;
 			} else {
-				if (--wex[ee] < 0) {
-					wed[ee] = GNN_INF;
-					wex[ee]++;
-				} else {
-					double ww = q[ff] - p->sax[ee][wex[ee]]->mix[1][ff];
-					wed[ee] = fabs(ww) * ww;
-				}
+				stack[sp] = b->ch[0];
+				sdist[sp++] = d0;
+				stack[sp] = b->ch[1];
+				sdist[sp++] = d1;
 			}
 		}
-
-//printf("Searched %d points out of %d = %f%%\n",ptested, p->n, 100.0 * ptested/p->n);
-
-		p->tbase += 3;		/* Next touch */
-
-		rout[0] = out[0];	/* Copy results to output */
-		rout[1] = out[1];
-		rout[2] = out[2];
-		return;
 	}
+
+	rout[0] = out[0];	/* Copy results to output */
+	rout[1] = out[1];
+	rout[2] = out[2];
 }
 
 /* Perturb the containment points to avoid */
@@ -3983,13 +4040,85 @@ double perturb[21] = {
 	9.2709981544886391e+122, 3.7958270103353899e-153, 7.1366083837501666e-154
 };
 
+/* Split the triangles t[t0..t0+nt-1] into a bounding box tree below */
+/* node bix. Each node is split in two at the median of the triangle */
+/* box centers along the longest axis of its box. */
+static void ne_split(gnn *p, int bix, int t0, int nt) {
+	gnnb *b = &p->b[bix];
+	int i, j, ax, lo, hi, md;
+	double ww;
+
+	for (j = 0; j < 3; j++) {
+		b->mix[0][j] = GNN_INF;
+		b->mix[1][j] = -GNN_INF;
+	}
+	for (i = t0; i < (t0 + nt); i++) {
+		for (j = 0; j < 3; j++) {
+			if (p->t[i]->mix[0][j] < b->mix[0][j])
+				b->mix[0][j] = p->t[i]->mix[0][j];
+			if (p->t[i]->mix[1][j] > b->mix[1][j])
+				b->mix[1][j] = p->t[i]->mix[1][j];
+		}
+	}
+	b->t0 = t0;
+	b->nt = nt;
+	b->ch[0] = b->ch[1] = -1;
+
+	if (nt <= GNN_LEAF)
+		return;
+
+	/* Longest axis */
+	for (ax = 0, ww = -1.0, j = 0; j < 3; j++) {
+		if ((b->mix[1][j] - b->mix[0][j]) > ww) {
+			ww = b->mix[1][j] - b->mix[0][j];
+			ax = j;
+		}
+	}
+
+	/* Partially sort the triangles so that the lower half */
+	/* has the smaller box centers along that axis. */
+	md = t0 + nt/2;
+	lo = t0;
+	hi = t0 + nt - 1;
+	while (lo < hi) {
+		double pv = p->t[(lo + hi)/2]->mix[0][ax] + p->t[(lo + hi)/2]->mix[1][ax];
+		int i0 = lo, i1 = hi;
+
+		while (i0 <= i1) {
+			gtri *tt;
+			while ((p->t[i0]->mix[0][ax] + p->t[i0]->mix[1][ax]) < pv)
+				i0++;
+			while ((p->t[i1]->mix[0][ax] + p->t[i1]->mix[1][ax]) > pv)
+				i1--;
+			if (i0 <= i1) {
+				tt = p->t[i0];
+				p->t[i0] = p->t[i1];
+				p->t[i1] = tt;
+				i0++;
+				i1--;
+			}
+		}
+		if (md <= i1)
+			hi = i1;
+		else if (md >= i0)
+			lo = i0;
+		else
+			break;
+	}
+
+	b->ch[0] = p->nb++;
+	b->ch[1] = p->nb++;
+	ne_split(p, b->ch[0], t0, md - t0);
+	ne_split(p, b->ch[1], md, t0 + nt - md);
+}
+
 /* Setup the nearest function acceleration structure */
 static void
 init_ne(
 gamut *s
 ) {
 	gnn *p;
-	int i, k;
+	int i, j, k;
 	gtri *tp;		/* Triangle pointer */
 	int ntris;
 	double psf;
@@ -4001,6 +4130,7 @@ gamut *s
 		fprintf(stderr,"gamut: calloc failed - gnn structure\n");
 		exit(-1);
 	}
+	p->s = s;
 
 	/* Count triangles */
 	ntris = 0;
@@ -4010,25 +4140,23 @@ gamut *s
 	} END_FOR_ALL_ITEMS(tp);
 
 	p->n = ntris;
-	p->tbase = 0;		/* Initialse touch flag */
 
-	/* Allocate the arrays spaces */
-	for (k = 0; k < (3 * 2); k++) {
-		if ((p->sax[k] = (gtri **)malloc(sizeof(gtri *) * ntris)) == NULL)
-			error("Failed to allocate sorted index array");
-	}
+	/* Allocate the arrays spaces. A tree with leaves of one */
+	/* or more triangles has less than 2 * ntris nodes. */
+	if ((p->t = (gtri **)malloc(sizeof(gtri *) * ntris)) == NULL)
+		error("Failed to allocate nearest triangle array");
+	if ((p->b = (gnnb *)malloc(sizeof(gnnb) * 2 * (ntris + 1))) == NULL)
+		error("Failed to allocate nearest bounding box tree");
 
 	/* Compute pertbation factor */
 	for (psf = 0.0, i = 1; i < 21; i++)
 		psf += perturb[i];
 	psf *= perturb[0];
 
-	/* For each triangle, create the triangle bounding box values, */
-	/* and add them to the axis lists. */
+	/* For each triangle, create the triangle bounding box values */
 	tp = s->tris; 
 	i = 0;
 	FOR_ALL_ITEMS(gtri, tp) {
-		int j;
 		for (j = 0; j < 3; j++) {	/* Init */
 			tp->mix[0][j] = 1e38;
 			tp->mix[1][j] = -1e38;
@@ -4040,26 +4168,14 @@ gamut *s
 				if (tp->v[k]->p[j] > tp->mix[1][j])		/* New max */
 					tp->mix[1][j] = psf * tp->v[k]->p[j];
 			}
-			p->sax[k * 2 + 0][i] = tp;
-			p->sax[k * 2 + 1][i] = tp;
 		}
-		i++;
+		p->t[i++] = tp;
 	} END_FOR_ALL_ITEMS(tp);
 
+	/* Create the bounding box tree */
+	p->nb = 1;
+	ne_split(p, 0, 0, ntris);
 
-	/* Sort the axis arrays */
-	for (k = 0; k < 3; k++) {
-
-			/* Sort upper edges of bounding box */
-#define 	HEAP_COMPARE(A,B) (A->mix[1][k] < B->mix[1][k])
-			HEAPSORT(gtri *, &p->sax[k * 2 + 0][0], ntris)
-#undef HEAP_COMPARE
-
-			/* Sort lower edges of bounding box */
-#define 	HEAP_COMPARE(A,B) (A->mix[0][k] < B->mix[0][k])
-			HEAPSORT(gtri *, &p->sax[k * 2 + 1][0], ntris)
-#undef HEAP_COMPARE
-	}
 	s->ne_inited = 1;
 
 //printf("~1 init_ne done\n");
@@ -4067,12 +4183,9 @@ gamut *s
 
 /* Free everything */
 static void del_gnn(gnn *p) {
-	int k;
-
-	for (k = 0; k < (3 * 2); k++) {
-		free (p->sax[k]);
-	}
 
+	free(p->t);
+	free(p->b);
 	free(p);
 }
 
@@ -4175,6 +4288,27 @@ static void compgawb(gamut *s) {
 	s->gawbset = 1;
 }
 
+/* ===================================================== */
+/* Make this gamut ready to be queried from several threads at once. */
+/* All the lazily created lookup structures are created now, */
+/* so that radial(), nradials(), vector_isect(), nearest() and */
+/* getwb() don't modify the gamut. */
+static void setshared(gamut *s) {
+
+	if IS_LIST_EMPTY(s->tris)
+		triangulate(s);
+
+	if (s->lu_inited == 0)
+		init_lu(s);				/* radial(), vector_isect() */
+
+	if (s->ne_inited == 0)
+		init_ne(s);				/* nearest() */
+
+	compgawb(s);				/* getwb() */
+
+	s->shared = 1;
+}
+
 /* Get the colorspace and gamut white & black points. */
 /* Return pointers may be NULL */
 /* Return non-zero if not possible. */
@@ -5467,11 +5601,16 @@ void *cntx
 
 
 /* ----------------------------------- */
-/* Write to a CGATS .gam file */
+/* Write to a CGATS .gam file. */
+/* If full is set, write the values to full precision, and */
+/* add the radial lookup BSP tree as two extra tables, so */
+/* that reading it back gives a gamut that is identical */
+/* to this one, without having to re-create the BSP tree. */
 /* Return non-zero on error */
-static int write_gam(
+static int write_gam_imp(
 gamut *s,
-char *filename
+char *filename,
+int full
 ) {
 	time_t clk = time(0);
 	struct tm *tsp = localtime(&clk);
@@ -5480,11 +5619,17 @@ char *filename
 	gtri *tp;		/* Triangle pointer */
 	cgats *gam;
 	char buf[100];
+	char *vfmt = full ? "%.17g %.17g %.17g" : "%f %f %f";
 
 	if IS_LIST_EMPTY(s->tris)
 		triangulate(s);
 		
+	if (full && s->lu_inited == 0)
+		init_lu(s);
+
 	gam = new_cgats();	/* Create a CGATS structure */
+	if (full)
+		gam->set_real_sigdig(gam, 17);
 	gam->add_other(gam, "GAMUT");
 
 	gam->add_table(gam, tt_other, 0);	/* Start the first table as type "GAMUT" */
@@ -5506,7 +5651,7 @@ char *filename
 	if (s->isRast)
 		gam->add_kword(gam, 0, "SURF_TYPE","RASTER", NULL);
 
-	sprintf(buf,"%f %f %f", s->cent[0], s->cent[1], s->cent[2]);
+	sprintf(buf, vfmt, s->cent[0], s->cent[1], s->cent[2]);
 	gam->add_kword(gam, 0, "GAMUT_CENTER",buf, NULL);
 
 	/* If the white and black points are known, put them in the file */
@@ -5514,17 +5659,23 @@ char *filename
 
 		compgawb(s);		/* make sure we have gamut white/black available */
 
-		sprintf(buf,"%f %f %f", s->cs_wp[0], s->cs_wp[1], s->cs_wp[2]);
+		sprintf(buf, vfmt, s->cs_wp[0], s->cs_wp[1], s->cs_wp[2]);
 		gam->add_kword(gam, 0, "CSPACE_WHITE",buf, NULL);
 
-		sprintf(buf,"%f %f %f", s->ga_wp[0], s->ga_wp[1], s->ga_wp[2]);
+		sprintf(buf, vfmt, s->ga_wp[0], s->ga_wp[1], s->ga_wp[2]);
 		gam->add_kword(gam, 0, "GAMUT_WHITE",buf, NULL);
 
-		sprintf(buf,"%f %f %f", s->cs_bp[0], s->cs_bp[1], s->cs_bp[2]);
+		sprintf(buf, vfmt, s->cs_bp[0], s->cs_bp[1], s->cs_bp[2]);
 		gam->add_kword(gam, 0, "CSPACE_BLACK",buf, NULL);
 
-		sprintf(buf,"%f %f %f", s->ga_bp[0], s->ga_bp[1], s->ga_bp[2]);
+		sprintf(buf, vfmt, s->ga_bp[0], s->ga_bp[1], s->ga_bp[2]);
 		gam->add_kword(gam, 0, "GAMUT_BLACK",buf, NULL);
+
+		sprintf(buf, vfmt, s->cs_kp[0], s->cs_kp[1], s->cs_kp[2]);
+		gam->add_kword(gam, 0, "CSPACE_KBLACK",buf, NULL);
+
+		sprintf(buf, vfmt, s->ga_kp[0], s->ga_kp[1], s->ga_kp[2]);
+		gam->add_kword(gam, 0, "GAMUT_KBLACK",buf, NULL);
 	}
 
 	/* If cusp values are known, put them in the file */
@@ -5534,24 +5685,51 @@ char *filename
 
 		for (i = 0; i < 6; i++) {
 			sprintf(buf1,"CUSP_%s", cnames[i]);
-			sprintf(buf2,"%f %f %f", s->cusps[i][0], s->cusps[i][1], s->cusps[i][2]);
+			sprintf(buf2, vfmt, s->cusps[i][0], s->cusps[i][1], s->cusps[i][2]);
 			gam->add_kword(gam, 0, buf1, buf2, NULL);
 		}
 	}
 
+	/* If we're writing the BSP tree, note its root branch, */
+	/* and the range of all the points added to the gamut */
+	if (full) {
+		sprintf(buf, vfmt, s->mn[0], s->mn[1], s->mn[2]);
+		gam->add_kword(gam, 0, "GAMUT_MIN", buf, NULL);
+
+		sprintf(buf, vfmt, s->mx[0], s->mx[1], s->mx[2]);
+		gam->add_kword(gam, 0, "GAMUT_MAX", buf, NULL);
+
+		sprintf(buf,"%d", s->luf->root);
+		gam->add_kword(gam, 0, "BSP_ROOT", buf, NULL);
+	}
+
 	gam->add_kword(gam, 0, NULL, NULL, "First come the triangle verticy location");
 
 	gam->add_field(gam, 0, "VERTEX_NO", i_t);
 	gam->add_field(gam, 0, "LAB_L", r_t);
 	gam->add_field(gam, 0, "LAB_A", r_t);
 	gam->add_field(gam, 0, "LAB_B", r_t);
+	if (full) {
+		gam->add_field(gam, 0, "VERTEX_FLAGS", i_t);
+		gam->add_field(gam, 0, "VERTEX_K0", i_t);
+		gam->add_field(gam, 0, "VERTEX_LR0", r_t);
+	}
 
 	/* Spit out the vertex values, in order. */
+	/* If full, include the raw verticies that aren't part */
+	/* of the triangulation too, since gamut mapping uses them. */
 	for (i = 0; i < s->nv; i++) {
-		if (!(s->verts[i]->f & GVERT_TRI))
-			continue;
-		gam->add_set(gam, 0, s->verts[i]->tn,
-		             s->verts[i]->p[0], s->verts[i]->p[1], s->verts[i]->p[2]);
+		gvert *v = s->verts[i];
+		if (full) {
+			if (!(v->f & GVERT_SET))
+				continue;
+			gam->add_set(gam, 0, (v->f & GVERT_TRI) ? v->tn : -1,
+			             v->p[0], v->p[1], v->p[2], v->f, v->k0, v->lr0);
+		} else {
+			if (!(v->f & GVERT_TRI))
+				continue;
+			gam->add_set(gam, 0, v->tn, v->p[0], v->p[1], v->p[2]);
+		}
 	}
 
 	gam->add_table(gam, tt_other, 0);	/* Start the second table */
@@ -5561,12 +5739,73 @@ char *filename
 	gam->add_field(gam, 1, "VERTEX_0", i_t);
 	gam->add_field(gam, 1, "VERTEX_1", i_t);
 	gam->add_field(gam, 1, "VERTEX_2", i_t);
+	if (full)
+		gam->add_field(gam, 1, "EDGE_FLAGS", i_t);
 
 	tp = s->tris; 
 	FOR_ALL_ITEMS(gtri, tp) {
-		gam->add_set(gam, 1, tp->v[0]->tn, tp->v[1]->tn, tp->v[2]->tn);
+		if (full) {
+			int ef = 0;
+
+			/* Note which edges this is triangle 0 of, and */
+			/* whether they run the same way as the triangle. */
+			for (i = 0; i < 3; i++) {
+				if (tp->ei[i] == 0) {
+					ef |= 8 << i;
+					if (tp->e[i]->v[0] == tp->v[i])
+						ef |= 1 << i;
+				}
+			}
+			gam->add_set(gam, 1, tp->v[0]->tn, tp->v[1]->tn, tp->v[2]->tn, ef);
+		} else {
+			gam->add_set(gam, 1, tp->v[0]->tn, tp->v[1]->tn, tp->v[2]->tn);
+		}
 	} END_FOR_ALL_ITEMS(tp);
 
+	if (full) {
+		glu *p = s->luf;
+		int *tix;			/* Triangle list index by triangle serial number */
+
+		if ((tix = (int *)malloc(s->tri_sn * sizeof(int))) == NULL) {
+			fprintf(stderr,"gamut: malloc failed on triangle index\n");
+			gam->del(gam);
+			return 2;
+		}
+		i = 0;
+		tp = s->tris; 
+		FOR_ALL_ITEMS(gtri, tp) {
+			tix[tp->n] = i++;
+		} END_FOR_ALL_ITEMS(tp);
+
+		gam->add_table(gam, tt_other, 0);	/* Start the third table */
+		gam->set_table_flags(gam, 2, 1, 1, 0);	/* Suppress id & kwords */
+		gam->add_kword(gam, 2, NULL, NULL, "Then the radial lookup BSP tree decision nodes");
+
+		gam->add_field(gam, 2, "PLANE_0", r_t);
+		gam->add_field(gam, 2, "PLANE_1", r_t);
+		gam->add_field(gam, 2, "PLANE_2", r_t);
+		gam->add_field(gam, 2, "PLANE_3", r_t);
+		gam->add_field(gam, 2, "POSITIVE", i_t);
+		gam->add_field(gam, 2, "NEGATIVE", i_t);
+
+		for (i = 0; i < p->nn; i++) {
+			gam->add_set(gam, 2, p->n[i].pe[0], p->n[i].pe[1], p->n[i].pe[2], p->n[i].pe[3],
+			                     p->n[i].po, p->n[i].ne);
+		}
+
+		gam->add_table(gam, tt_other, 0);	/* Start the fourth table */
+		gam->set_table_flags(gam, 3, 1, 1, 0);	/* Suppress id & kwords */
+		gam->add_kword(gam, 3, NULL, NULL, "And the BSP tree leaf triangles");
+
+		gam->add_field(gam, 3, "TRIANGLE", i_t);
+		gam->add_field(gam, 3, "LAST", i_t);
+
+		for (i = 0; i < p->nt; i++)
+			gam->add_set(gam, 3, tix[p->t[i].t->n], p->t[i].last);
+
+		free(tix);
+	}
+
 
 	if (gam->write_name(gam, filename)) {
 		fprintf(stderr,"Error writing to file '%s' : '%s'\n",filename, gam->err);
@@ -5577,6 +5816,25 @@ char *filename
 	return 0;
 }
 
+/* Write to a CGATS .gam file */
+/* Return non-zero on error */
+static int write_gam(
+gamut *s,
+char *filename
+) {
+	return write_gam_imp(s, filename, 0);
+}
+
+/* Write to a CGATS .gam file, with full precision values */
+/* and the radial lookup BSP tree. */
+/* Return non-zero on error */
+static int write_gam_full(
+gamut *s,
+char *filename
+) {
+	return write_gam_imp(s, filename, 1);
+}
+
 /* ----------------------------------- */
 /* Read from a CGATS .gam file */
 /* Return non-zero on error */
@@ -5584,15 +5842,24 @@ static int read_gam(
 gamut *s,
 char *filename
 ) {
-	int i;
+	int i, j;
 	cgats *gam;
 	gtri *tp;
 	int nverts;
 	int ntris;
 	int Lf, af, bf;			/* Fields holding L, a & b data */
 	int v0f, v1f, v2f;		/* Fields holding verticies 0, 1 & 2 */
-	int cw, cb;				/* Colorspace white, black keyword indexes */
+	int tef;				/* Field holding triangle edge flags */
+	int vnf, vff, vkf, vlf;	/* Fields holding vertex number, flags, k0 count and lr0 */
+	int cw, cb, ck;			/* Colorspace white, black, K black keyword indexes */
 	int gw, gb;				/* Gamut white, black keyword indexes */
+	int *tnix;				/* Vertex index by triangulation number */
+	gtri **tlist;			/* Triangles in file order */
+	struct _hedge {
+		int v0, v1;			/* Vertex numbers of the edge, in triangle order */
+		gtri *t;			/* Triangle it belongs to */
+		int en;				/* Edge number in that triangle */
+	} *hes;					/* Half edges sorted by vertex numbers */
 
 	if (s->tris != NULL || s->read_inited || s->lu_inited || s->ne_inited) {
 		fprintf(stderr,"Can't add read into gamut after it is initialised!\n");
@@ -5612,8 +5879,8 @@ char *filename
 		fprintf(stderr,"Input file isn't a GAMUT format file");
 		return 1;
 	}
-	if (gam->ntables != 2) {
-		fprintf(stderr,"Input file doesn't contain exactly two tables");
+	if (gam->ntables != 2 && gam->ntables != 4) {
+		fprintf(stderr,"Input file doesn't contain two or four tables");
 		return 1;
 	}
 
@@ -5638,6 +5905,17 @@ char *filename
 		s->no2pass = 0;				/* Do two passes */
 	}
 
+	/* If we can find the gamut center, use it */
+	if ((cw = gam->find_kword(gam, 0, "GAMUT_CENTER")) >= 0) {
+		double cent[3];
+		if (sscanf(gam->t[0].kdata[cw], "%lf %lf %lf",
+		           &cent[0], &cent[1], &cent[2]) == 3) {
+			s->cent[0] = cent[0];
+			s->cent[1] = cent[1];
+			s->cent[2] = cent[2];
+		}
+	}
+
 	/* If we can find the the colorspace white and black points, add them to the gamut */
 	cw = gam->find_kword(gam, 0, "CSPACE_WHITE");
 	cb = gam->find_kword(gam, 0, "CSPACE_BLACK");
@@ -5653,6 +5931,16 @@ char *filename
 			ok = 0;
 		}
 
+		/* K only black is optional */
+		s->cs_kp[0] = s->cs_bp[0];
+		s->cs_kp[1] = s->cs_bp[1];
+		s->cs_kp[2] = s->cs_bp[2];
+		if ((ck = gam->find_kword(gam, 0, "CSPACE_KBLACK")) >= 0
+		 && sscanf(gam->t[0].kdata[ck], "%lf %lf %lf",
+		           &s->cs_kp[0], &s->cs_kp[1], &s->cs_kp[2]) != 3) {
+			ok = 0;
+		}
+
 		if (ok) {
 			s->cswbset = 1;
 		}
@@ -5673,6 +5961,15 @@ char *filename
 			ok = 0;
 		}
 
+		s->ga_kp[0] = s->ga_bp[0];
+		s->ga_kp[1] = s->ga_bp[1];
+		s->ga_kp[2] = s->ga_bp[2];
+		if ((ck = gam->find_kword(gam, 0, "GAMUT_KBLACK")) >= 0
+		 && sscanf(gam->t[0].kdata[ck], "%lf %lf %lf",
+		           &s->ga_kp[0], &s->ga_kp[1], &s->ga_kp[2]) != 3) {
+			ok = 0;
+		}
+
 		if (ok) {
 			s->gawbset = 1;
 		}
@@ -5734,13 +6031,32 @@ char *filename
 		return 1;
 	}
 
-	/* Allocate an array to point at the verts */
-	if ((s->verts = (gvert **)malloc(nverts * sizeof(gvert *))) == NULL) {
+	/* Optional vertex number, and full .gam flags and k0 count */
+	if ((vnf = gam->find_field(gam, 0, "VERTEX_NO")) >= 0
+	 && gam->t[0].ftype[vnf] != i_t)
+		vnf = -1;
+	if ((vff = gam->find_field(gam, 0, "VERTEX_FLAGS")) >= 0
+	 && gam->t[0].ftype[vff] != i_t)
+		vff = -1;
+	if ((vkf = gam->find_field(gam, 0, "VERTEX_K0")) >= 0
+	 && gam->t[0].ftype[vkf] != i_t)
+		vkf = -1;
+	if ((vlf = gam->find_field(gam, 0, "VERTEX_LR0")) >= 0
+	 && gam->t[0].ftype[vlf] != r_t)
+		vlf = -1;
+
+	/* Allocate an array to point at the verts, */
+	/* and one to lookup verticies by triangulation number */
+	if ((s->verts = (gvert **)malloc(nverts * sizeof(gvert *))) == NULL
+	 || (tnix = (int *)malloc(nverts * sizeof(int))) == NULL) {
 		fprintf(stderr,"gamut: malloc failed on gvert pointer\n");
 		return 2;
 	}
 	s->nv = s->na = nverts;
+	for (i = 0; i < nverts; i++)
+		tnix[i] = -1;
 	
+	s->ntv = 0;
 	for (i = 0; i < nverts; i++) {
 		gvert *v;
 
@@ -5753,18 +6069,65 @@ char *filename
 		v->tag = 1;
 		v->tn = v->n = i;
 		v->f = GVERT_SET | GVERT_TRI;		/* Will be part of the triangulation */
+		if (vff >= 0)
+			v->f = *((int *)gam->t[0].fdata[i][vff]) | GVERT_SET;
+		if (vkf >= 0)
+			v->k0 = *((int *)gam->t[0].fdata[i][vkf]);
+
+		if (v->f & GVERT_TRI) {
+			if (vnf >= 0)
+				v->tn = *((int *)gam->t[0].fdata[i][vnf]);
+			if (v->tn < 0 || v->tn >= nverts || tnix[v->tn] >= 0) {
+				fprintf(stderr,".gam file vertex numbers are not consistent\n");
+				return 1;
+			}
+			tnix[v->tn] = i;
+			s->ntv++;
+		} else {
+			v->tn = -1;
+		}
 
 		v->p[0] = *((double *)gam->t[0].fdata[i][Lf]);
 		v->p[1] = *((double *)gam->t[0].fdata[i][af]);
 		v->p[2] = *((double *)gam->t[0].fdata[i][bf]);
 
+		for (j = 0; j < 3; j++) {
+			if (v->p[j] > s->mx[j])
+				s->mx[j] = v->p[j];
+			if (v->p[j] < s->mn[j])
+				s->mn[j] = v->p[j];
+		}
+
 		gamut_rect2radial(s, v->r, v->p);
 	}
-	s->ntv = i;
+
+	/* The range of the points the gamut was created from, if known */
+	if ((cw = gam->find_kword(gam, 0, "GAMUT_MIN")) >= 0
+	 && (cb = gam->find_kword(gam, 0, "GAMUT_MAX")) >= 0) {
+		double mn[3], mx[3];
+		if (sscanf(gam->t[0].kdata[cw], "%lf %lf %lf", &mn[0], &mn[1], &mn[2]) == 3
+		 && sscanf(gam->t[0].kdata[cb], "%lf %lf %lf", &mx[0], &mx[1], &mx[2]) == 3) {
+			for (j = 0; j < 3; j++) {
+				s->mn[j] = mn[j];
+				s->mx[j] = mx[j];
+			}
+		}
+	}
 
 	/* Compute the other vertex values */
 	compute_vertex_coords(s);
 
+	/* Restore any filtered hull radius, since the vertex order depends on it */
+	if (vlf >= 0) {
+		for (i = 0; i < nverts; i++) {
+			gvert *v = s->verts[i];
+			v->lr0 = *((double *)gam->t[0].fdata[i][vlf]);
+			v->ch[0] = v->sp[0] * v->lr0;
+			v->ch[1] = v->sp[1] * v->lr0;
+			v->ch[2] = v->sp[2] * v->lr0;
+		}
+	}
+
 	/* Get ready to read the triangle data */
 	if ((v0f = gam->find_field(gam, 1, "VERTEX_0")) < 0) {
 		fprintf(stderr,"Input file doesn't contain field VERTEX_0");
@@ -5791,29 +6154,68 @@ char *filename
 		return 1;
 	}
 
+	/* Optional full .gam edge ownership and direction */
+	if ((tef = gam->find_field(gam, 1, "EDGE_FLAGS")) >= 0
+	 && gam->t[1].ftype[tef] != i_t)
+		tef = -1;
+
+	if ((tlist = (gtri **)malloc(ntris * sizeof(gtri *))) == NULL
+	 || (hes = (struct _hedge *)malloc(3 * ntris * sizeof(struct _hedge))) == NULL) {
+		fprintf(stderr,"gamut: malloc failed on triangle lists\n");
+		return 2;
+	}
+
 	/* Create all the triangles */
 	for (i = 0; i < ntris; i++) {
 		gtri *t;
 		int v0, v1, v2;
 
-		t = new_gtri();
+		t = new_gtri(s);
 		ADD_ITEM_TO_BOT(s->tris, t);	/* Append to triangulation list */
 
 		v0 = *((int *)gam->t[1].fdata[i][v0f]);
 		v1 = *((int *)gam->t[1].fdata[i][v1f]);
 		v2 = *((int *)gam->t[1].fdata[i][v2f]);
 
-		t->v[0] = s->verts[v0];
-		t->v[1] = s->verts[v1];
-		t->v[2] = s->verts[v2];
+		if (v0 < 0 || v0 >= nverts || v1 < 0 || v1 >= nverts || v2 < 0 || v2 >= nverts
+		 || tnix[v0] < 0 || tnix[v1] < 0 || tnix[v2] < 0) {
+			fprintf(stderr,".gam file triangle verticies are out of range\n");
+			return 1;
+		}
+
+		t->v[0] = s->verts[tnix[v0]];
+		t->v[1] = s->verts[tnix[v1]];
+		t->v[2] = s->verts[tnix[v2]];
 
 		comptriattr(s, t);		/* Compute triangle attributes */
+		tlist[i] = t;
+	}
+
+	/* Sort the triangle edges by their verticies, so that the */
+	/* other triangle sharing an edge can be found quickly. */
+	for (i = 0; i < ntris; i++) {
+		int en;
+		for (en = 0; en < 3; en++) {
+			struct _hedge *h = &hes[3 * i + en];
+			h->v0 = tlist[i]->v[en]->n;
+			h->v1 = tlist[i]->v[en < 2 ? en+1 : 0]->n;
+			h->t = tlist[i];
+			h->en = en;
+		}
 	}
+#define 	HEAP_COMPARE(A,B) (A.v0 < B.v0 || (A.v0 == B.v0 && A.v1 < B.v1))
+	HEAPSORT(struct _hedge, hes, 3 * ntris)
+#undef HEAP_COMPARE
 
 	/* Connect edge information */
+	i = 0;
 	tp = s->tris; 
 	FOR_ALL_ITEMS(gtri, tp) {
-		int en;
+		int en, ef = 0;
+
+		if (tef >= 0)
+			ef = *((int *)gam->t[1].fdata[i][tef]);
+		i++;
 
 		for (en = 0; en < 3; en++) {	/* For each edge */
 			gedge *e;
@@ -5825,22 +6227,35 @@ char *filename
 			v0 = tp->v[en];
 			v1 = tp->v[en < 2 ? en+1 : 0];
 		
-			if (v0->n > v1->n)
+			if (tef >= 0) {
+				if ((ef & (8 << en)) == 0)
+					continue;			/* Other triangle is edge triangle 0 */
+			} else if (v0->n > v1->n)
 				continue;				/* Skip every other edge */
 
-			/* Find the corresponding edge of the other triangle */
+			/* Find the corresponding edge of the other triangle, */
+			/* which goes the other way. */
 			w0 = w1 = NULL;
-			tp2 = s->tris; 
-			FOR_ALL_ITEMS(gtri, tp2) {
-				for (em = 0; em < 3; em++) {	/* For each edge */
-					w0 = tp2->v[em];
-					w1 = tp2->v[em < 2 ? em+1 : 0];
-					if (v0 == w1 && v1 == w0)	/* Found it */
+			tp2 = NULL;
+			em = 0;
+			{
+				int i0 = 0, i1 = 3 * ntris - 1;
+				while (i0 <= i1) {
+					int im = (i0 + i1)/2;
+					struct _hedge *h = &hes[im];
+					if (h->v0 == v1->n && h->v1 == v0->n) {
+						tp2 = h->t;
+						em = h->en;
+						w0 = v1;
+						w1 = v0;
 						break;
+					}
+					if (h->v0 < v1->n || (h->v0 == v1->n && h->v1 < v0->n))
+						i0 = im + 1;
+					else
+						i1 = im - 1;
 				}
-				if (em < 3)
-					break;
-			} END_FOR_ALL_ITEMS(tp2);
+			}
 			if (w0 == NULL) {
 				/* Should clean up ? */
 				fprintf(stderr,".gam file triangle data is not consistent\n");
@@ -5856,7 +6271,7 @@ char *filename
 			}
 
 			/* Creat the edge structure */
-			e = new_gedge();
+			e = new_gedge(s);
 			ADD_ITEM_TO_BOT(s->edges, e);	/* Append to edge list */
 			tp->e[en] = e;			/* This edge */
 			tp->ei[en] = 0;			/* 0th triangle in edge */
@@ -5866,11 +6281,92 @@ char *filename
 			tp2->ei[em] = 1;		/* 1st triangle in edge */
 			e->t[1] = tp2;			/* 1st triangle is tp2 */
 			e->ti[1] = em;			/* 1st triangles em edge */
-			e->v[0] = v0;			/* The two verticies */
-			e->v[1] = v1;
+			if (tef >= 0 && (ef & (1 << en)) == 0) {
+				e->v[0] = v1;		/* Original direction */
+				e->v[1] = v0;
+			} else {
+				e->v[0] = v0;		/* The two verticies */
+				e->v[1] = v1;
+			}
 		}
 	} END_FOR_ALL_ITEMS(tp);
 
+	free(hes);
+	free(tnix);
+
+	/* If the radial lookup BSP tree is present, re-create it */
+	if (gam->ntables == 4) {
+		glu *p;
+		int kk, pf[4], pof, nef, tf, lf;
+
+		if ((p = (glu *) calloc(1, sizeof(glu))) == NULL
+		 || (p->n = (gbspf *) malloc((gam->t[2].nsets + 1) * sizeof(gbspf))) == NULL
+		 || (p->t = (gbspt *) malloc((gam->t[3].nsets + 1) * sizeof(gbspt))) == NULL) {
+			fprintf(stderr,"gamut: malloc failed on flattened BSP tree\n");
+			return 2;
+		}
+		p->nn = gam->t[2].nsets;
+		p->nt = gam->t[3].nsets;
+
+		if ((kk = gam->find_kword(gam, 0, "BSP_ROOT")) < 0) {
+			fprintf(stderr,"Input file doesn't contain keyword BSP_ROOT");
+			return 1;
+		}
+		p->root = atoi(gam->t[0].kdata[kk]);
+
+		if ((pf[0] = gam->find_field(gam, 2, "PLANE_0")) < 0
+		 || (pf[1] = gam->find_field(gam, 2, "PLANE_1")) < 0
+		 || (pf[2] = gam->find_field(gam, 2, "PLANE_2")) < 0
+		 || (pf[3] = gam->find_field(gam, 2, "PLANE_3")) < 0
+		 || (pof = gam->find_field(gam, 2, "POSITIVE")) < 0
+		 || (nef = gam->find_field(gam, 2, "NEGATIVE")) < 0
+		 || (tf = gam->find_field(gam, 3, "TRIANGLE")) < 0
+		 || (lf = gam->find_field(gam, 3, "LAST")) < 0) {
+			fprintf(stderr,"Input file doesn't contain the BSP tree fields");
+			return 1;
+		}
+		if (gam->t[2].ftype[pf[0]] != r_t || gam->t[2].ftype[pf[1]] != r_t
+		 || gam->t[2].ftype[pf[2]] != r_t || gam->t[2].ftype[pf[3]] != r_t
+		 || gam->t[2].ftype[pof] != i_t || gam->t[2].ftype[nef] != i_t
+		 || gam->t[3].ftype[tf] != i_t || gam->t[3].ftype[lf] != i_t) {
+			fprintf(stderr,"BSP tree fields are the wrong type");
+			return 1;
+		}
+
+		for (i = 0; i < p->nn; i++) {
+			int j;
+			for (j = 0; j < 4; j++)
+				p->n[i].pe[j] = *((double *)gam->t[2].fdata[i][pf[j]]);
+			p->n[i].po = *((int *)gam->t[2].fdata[i][pof]);
+			p->n[i].ne = *((int *)gam->t[2].fdata[i][nef]);
+		}
+		for (i = 0; i < p->nt; i++) {
+			int j, ix;
+			ix = *((int *)gam->t[3].fdata[i][tf]);
+			if (ix < 0 || ix >= ntris) {
+				fprintf(stderr,".gam file BSP triangle index is out of range\n");
+				return 1;
+			}
+			p->t[i].t = tlist[ix];
+			p->t[i].last = *((int *)gam->t[3].fdata[i][lf]);
+			for (j = 0; j < 4; j++) {
+				p->t[i].ee[0][j] = tlist[ix]->ee[0][j];
+				p->t[i].ee[1][j] = tlist[ix]->ee[1][j];
+				p->t[i].ee[2][j] = tlist[ix]->ee[2][j];
+				p->t[i].pe[j] = tlist[ix]->pe[j];
+			}
+		}
+		if (check_glu(p)) {
+			fprintf(stderr,".gam file BSP tree is not consistent\n");
+			return 1;
+		}
+
+		s->luf = p;
+		s->lutree = unflatten_lu(s, p, p->root);
+		s->lu_inited = 1;
+	}
+	free(tlist);
+
 	gam->del(gam);			/* Clean up */
 
 	s->read_inited = 1;			/* It's now valid */
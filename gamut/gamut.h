@@ -61,7 +61,6 @@ struct _gvert {
 #define GVERT_SET  0x0001		/* Value has been set */
 #define GVERT_TRI  0x0002		/* Vertex has been added to triangulation (Exclsv with _INSIDE) */
 #define GVERT_INSIDE  0x0004	/* Vertex is inside the log hull (Exclusive with _TRI) */
-#define GVERT_ISOS  0x0008		/* Intersecting gamuts "outside other gamut" flag */
 #define GVERT_ESTP  0x0010		/* Non-fake establishment point */
 #define GVERT_FAKE  0x0020		/* Fake establishment point */
 	int k0;			/* k0 direction reference count */
@@ -129,6 +128,36 @@ struct _gbspl {
 
 /* ------------------------------------ */
 
+/* A node of the flattened radial lookup BSP tree. */
+/* Branch values > 0 are node index + 1, < 0 are -1 - leaf triangle index, */
+/* and 0 is no branch. */
+struct _gbspf {
+	double pe[4];			/* Plane equation values (center relative) */
+	int po, ne;				/* Positive and negative branch */
+}; typedef struct _gbspf gbspf;
+
+/* A leaf triangle of the flattened radial lookup BSP tree, */
+/* holding just what's needed to test and intersect it. */
+struct _gbspt {
+	double ee[3][4];		/* sphere sp[] Edge triangle plane equations (relative) */
+	double pe[4];			/* Vertex plane equation (absolute) */
+	int last;				/* nz if last triangle of this leaf */
+	struct _gtri *t;		/* Triangle this came from */
+}; typedef struct _gbspt gbspt;
+
+/* The flattened radial lookup BSP tree, created from the */
+/* pointer linked tree so that radial() queries traverse */
+/* contiguous memory. */
+struct _glu {
+	int root;				/* Root branch value */
+	int nn;					/* Number of nodes */
+	gbspf *n;				/* Nodes */
+	int nt;					/* Number of leaf triangles */
+	gbspt *t;				/* Leaf triangles, each leaf being a run ending in last != 0 */
+}; typedef struct _glu glu;
+
+/* ------------------------------------ */
+
 /* A triangle in the surface mesh */
 struct _gtri {
 	BSP_STRUCT
@@ -147,7 +176,6 @@ struct _gtri {
 	int sort;			/* lookup: Plane sorting result for each try */
 	int bsort;			/* lookup: Current best tries sort */
 
-	unsigned int touch;	/* nn: Per value touch count */
 	double mix[2][3];	/* nn: Bounding box min and max */
 
 	double area;		/* Area - computed by nssverts() */
@@ -174,12 +202,19 @@ struct _gedge {
 /* ------------------------------------ */
 
 /* The gamut nearest neighbor search structure */
+/* A node of the nearest neighbor bounding box tree */
+struct _gnnb {
+	double mix[2][3];		/* Bounding box min and max of all the triangles below */
+	int ch[2];				/* Child node indexes, -1 if this is a leaf */
+	int t0, nt;				/* Index and number of the triangles below in gnn t[] */
+}; typedef struct _gnnb gnnb;
+
 struct _gnn {
 	struct _gamut *s;		/* Base gamut object */
 	int n;					/* Number of points stored */
-	gtri **sax[3 * 2];		/* Sorted axis pointers, one for each direction */
-	unsigned int tbase;		/* Touch base value for this pass */
-	unsigned int ttarget;	/* Touch target value for this pass */
+	gtri **t;				/* Triangle pointers, in tree leaf order */
+	int nb;					/* Number of tree nodes */
+	gnnb *b;				/* Bounding box tree nodes, [0] being the root */
 }; typedef struct _gnn gnn; 
 
 /* ------------------------------------ */
@@ -205,6 +240,7 @@ struct _gamut {
 	int lu_inited;		/* Flag set if radial surface lookup is inited */
 	int ne_inited;		/* Flag set if nearest lookup is inited */
 	int cu_inited;		/* Flag set if cusp values inited */
+	int shared;			/* Flag set if query methods may be called from several threads */
 	int nofilter;		/* Flag, skip segmented maxima filtering */
 	int no2pass;		/* Flag, do only one pass of convex hull */
 	int doingfake;		/* Internal transient state */
@@ -217,6 +253,7 @@ struct _gamut {
 	gedge *edges;		/* Edges between the triangles linked list */
 
 	gbsp  *lutree;		/* Lookup function BSP tree root */
+	glu   *luf;			/* Flattened lookup function BSP tree */
 	gnn   *nns;			/* nearest neighbor acceleration structure */
 
 	int cswbset;		/* Flag to indicate that the cs white & black points are set */
@@ -242,6 +279,11 @@ struct _gamut {
 
 	gtri *nexttri;		/* Context for getnexttri() */
 
+	int tri_sn;			/* Triangle serial number counter */
+	int edge_sn;		/* Edge serial number counter */
+	int bspn_sn;		/* BSP node serial number counter */
+	int bspl_sn;		/* BSP triangle list serial number counter */
+
 /* Public: */
 	/* Methods */
 	void (*del)(struct _gamut *s);						/* Free ourselves */
@@ -317,6 +359,10 @@ struct _gamut {
 								/* and normalised radial radius. This will be <= 1.0 if within */
 								/* gamut, and > 1.0 if out of gamut. out[] may be NULL */
 
+	void (*nradials)(struct _gamut *s, double *rv, double (*out)[3], double (*in)[3], int n);
+								/* Batch form of nradial() for n points. rv[] returns */
+								/* the normalised radial radii, and out[] may be NULL */
+
 	void (*nearest)(struct _gamut *s, double out[3], double in[3]);
 	                          /* return point on surface closest to input */
 
@@ -332,6 +378,13 @@ struct _gamut {
 							/* mintri & maxtri  may be NULL */
 							/* Return 0 if there is no intersection with the gamut. */
 
+	void (*setshared)(struct _gamut *s);
+							/* Create all the lazily initialised lookup structures, */
+							/* so that the query methods (radial, nradial, nradials, nearest, */
+							/* vector_isect, getwb, nverts, getcusps) can then be */
+							/* called on this gamut from several threads at once. */
+							/* The gamut must not be modified after this. */
+
 	void (*setwb)(struct _gamut *s, double *wp, double *bp, double *kp);
 							/* Define the colorspaces white, black and K only black points. */
 							/* May be NULL if unknown, and will be set to a default. */
@@ -357,6 +410,10 @@ struct _gamut {
 	int (*write_vrml)(struct _gamut *s, char *filename,
 	                              int doaxes, int docusps); /* Write to a VRML .wrl file */
 	int (*write_gam)(struct _gamut *s, char *filename);		/* Write to a CGATS .gam file */
+	int (*write_gam_full)(struct _gamut *s, char *filename);	/* Write to a CGATS .gam file */
+																/* at full precision, with the */
+																/* radial lookup BSP tree, so that */
+																/* read_gam() re-creates it exactly. */
 	int (*read_gam)(struct _gamut *s, char *filename);		/* Read from a CGATS .gam file */
 
 	int (*write_trans_vrml)(struct _gamut *s, char *filename, /* Write transformed VRML .wrl */
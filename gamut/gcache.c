@@ -0,0 +1,318 @@
+
+/*
+ * gcache
+ *
+ * Gamut surface and gamut map disk cache.
+ *
+ * Author:  agent <agent@local>
+ * Date:    18/10/2026
+ * Version: 1.00
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * Each cached object is a file in the cache directory named
+ * <key>.gam (gamut surface) or <key>.gmp (gamut map), where the
+ * key is the hex MD5 of everything that went into making it.
+ * Files are written under a temporary name and then renamed,
+ * so that several processes can share a cache directory, and
+ * a partly written file is never seen as a hit.
+ *
+ * Numbers are added to the key as "%.17g" text rather than
+ * as raw bytes, so that keys are the same on all platforms.
+ *
+ * Every key includes GCACHE_VERSION, and the keys of lookup and
+ * gamut mapping parameters include the Argyll version, so that
+ * a change in the file formats or in the code that computes a
+ * cached object doesn't return a stale one.
+ *
+ * TTBD:
+ *      There is no limit on the size of the cache directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "icc.h"
+#include "numlib.h"
+#include "xicc.h"
+#include "gamut.h"
+#include "rspl.h"
+#include "gammap.h"
+#include "gcache.h"
+
+#define MAXGCPATH 2000		/* Maximum length of a cache file path */
+#define GCACHE_VERSION "gcache 2"	/* Cache file format and key layout version */
+
+/* Create the path of a cache file */
+static int gc_path(gcache *p, char *path, char *key, char *ext) {
+	if ((strlen(p->dir) + strlen(key) + strlen(ext) + 30) > MAXGCPATH)
+		return 1;
+	sprintf(path, "%s/%s%s", p->dir, key, ext);
+	return 0;
+}
+
+/* Create a unique temporary name to write a cache file to */
+static void gc_tpath(gcache *p, char *tpath, char *path) {
+	static unsigned int count = 0;
+	sprintf(tpath, "%s.%lx%lx%x", path, (unsigned long)time(NULL),
+	        (unsigned long)clock() ^ (unsigned long)(size_t)p, count++);
+}
+
+/* Return nz if the file exists */
+static int gc_exists(char *path) {
+	FILE *fp;
+
+	if ((fp = fopen(path, "r")) == NULL)
+		return 0;
+	fclose(fp);
+	return 1;
+}
+
+/* Move a written temporary file to its final name */
+static int gc_rename(char *tpath, char *path) {
+	if (rename(tpath, path) != 0) {
+		/* MSWindows won't rename over an existing file. */
+		/* Someone else has put it in the cache, so we're done. */
+		remove(tpath);
+		if (!gc_exists(path))
+			return 1;
+	}
+	return 0;
+}
+
+static void del_gcache(gcache *p) {
+	if (p != NULL) {
+		if (p->md5 != NULL)
+			p->md5->del(p->md5);
+		if (p->al != NULL)
+			p->al->del(p->al);
+		free(p->dir);
+		free(p);
+	}
+}
+
+static void gc_reset(gcache *p, char *kind) {
+	p->md5->reset(p->md5);
+	p->md5->add(p->md5, (ORD8 *)GCACHE_VERSION, strlen(GCACHE_VERSION) + 1);
+	p->md5->add(p->md5, (ORD8 *)kind, strlen(kind) + 1);
+}
+
+static int gc_add_file(gcache *p, char *filename) {
+	FILE *fp;
+	ORD8 buf[8192];
+	size_t len;
+
+	if ((fp = fopen(filename, "rb")) == NULL)
+		return 1;
+
+	while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+		p->md5->add(p->md5, buf, (unsigned int)len);
+
+	if (ferror(fp)) {
+		fclose(fp);
+		return 1;
+	}
+	fclose(fp);
+	return 0;
+}
+
+static void gc_add(gcache *p, char *fmt, ...) {
+	va_list args;
+	char buf[1000];
+
+	va_start(args, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	/* Include the nul, so that "1" "23" isn't the same as "12" "3" */
+	p->md5->add(p->md5, (ORD8 *)buf, strlen(buf) + 1);
+}
+
+/* Add a list of doubles */
+static void gc_addv(gcache *p, double *v, int n) {
+	int i;
+	for (i = 0; i < n; i++)
+		gc_add(p, "%.17g", v[i]);
+}
+
+static void gc_add_luo(gcache *p, icxLuBase *luo) {
+	icColorSpaceSignature ins, outs, pcs;
+	int inn, outn;
+	icmLuAlgType alg;
+	icRenderingIntent intt;
+	icmLookupFunc fnc;
+
+	luo->spaces(luo, &ins, &inn, &outs, &outn, &alg, &intt, &fnc, &pcs);
+
+	gc_add(p, "xicc %s", ARGYLL_VERSION_STR);
+	gc_add(p, "%x %x %x %d %d %d %d %d %d", ins, outs, pcs, inn, outn, alg, intt, fnc, luo->flags);
+	gc_add(p, "%x %x %x", luo->natis, luo->natos, luo->natpcs);
+	gc_addv(p, luo->inmin, luo->inputChan);
+	gc_addv(p, luo->inmax, luo->inputChan);
+	gc_addv(p, luo->outmin, luo->outputChan);
+	gc_addv(p, luo->outmax, luo->outputChan);
+
+	gc_add(p, "%d", luo->vc.Ev);
+	gc_addv(p, luo->vc.Wxyz, 3);
+	gc_addv(p, &luo->vc.La, 1);
+	gc_addv(p, &luo->vc.Yb, 1);
+	gc_addv(p, &luo->vc.Lv, 1);
+	gc_addv(p, &luo->vc.Yf, 1);
+	gc_addv(p, luo->vc.Fxyz, 3);
+
+	gc_add(p, "%d %d %d %d %d %d %d %d", luo->noisluts, luo->noipluts, luo->nooluts,
+	       luo->nearclip, luo->mergeclut, luo->camclip, luo->intsep, luo->fastsetup);
+
+	/* The ink limits clip a Lut gamut */
+	if (alg == icmLutType) {
+		icxLuLut *lu = (icxLuLut *)luo;		/* Safe to coerce */
+		gc_addv(p, &lu->ink.tlimit, 1);
+		gc_addv(p, &lu->ink.klimit, 1);
+	}
+}
+
+static void gc_add_gmi(gcache *p, icxGMappingIntent *gmi) {
+	gc_add(p, "gammap %s", ARGYLL_VERSION_STR);
+	gc_add(p, "%d %d %d", gmi->usecas, gmi->usemap, gmi->icci);
+	gc_addv(p, &gmi->greymf, 1);
+	gc_addv(p, &gmi->glumwcpf, 1);
+	gc_addv(p, &gmi->glumwexf, 1);
+	gc_addv(p, &gmi->glumbcpf, 1);
+	gc_addv(p, &gmi->glumbexf, 1);
+	gc_addv(p, &gmi->glumknf, 1);
+	gc_addv(p, &gmi->gamcpf, 1);
+	gc_addv(p, &gmi->gamexf, 1);
+	gc_addv(p, &gmi->gamcknf, 1);
+	gc_addv(p, &gmi->gamxknf, 1);
+	gc_addv(p, &gmi->gampwf, 1);
+	gc_addv(p, &gmi->gamswf, 1);
+	gc_addv(p, &gmi->satenh, 1);
+}
+
+static void gc_key(gcache *p, char key[GCACHE_KEYLEN]) {
+	ORD8 chsum[16];
+	int i;
+
+	p->md5->get(p->md5, chsum);
+	for (i = 0; i < 16; i++)
+		sprintf(key + 2 * i, "%02x", chsum[i]);
+}
+
+static int gc_gam_key(gcache *p, char key[GCACHE_KEYLEN], char *pname,
+                      icxLuBase *luo, double gres) {
+	gc_reset(p, "gamut");
+	if (gc_add_file(p, pname))
+		return 1;
+	gc_add_luo(p, luo);
+	gc_add(p, "%.17g", gres);
+	gc_key(p, key);
+	return 0;
+}
+
+static gamut *gc_get_gamut(gcache *p, char *key, double sres) {
+	char path[MAXGCPATH];
+	gamut *gam;
+
+	if (gc_path(p, path, key, ".gam") || !gc_exists(path))
+		return NULL;
+
+	gam = new_gamut(sres, 0, 0);		/* isJab & isRast will be set by the file */
+	if (gam->read_gam(gam, path)) {
+		if (p->verb)
+			printf(" (Ignoring bad cached gamut '%s')\n",path);
+		gam->del(gam);
+		return NULL;
+	}
+	if (p->verb)
+		printf(" (Using cached gamut '%s')\n",path);
+	return gam;
+}
+
+static int gc_put_gamut(gcache *p, char *key, gamut *gam) {
+	char path[MAXGCPATH], tpath[MAXGCPATH + 50];
+
+	if (gc_path(p, path, key, ".gam"))
+		return 1;
+	gc_tpath(p, tpath, path);
+
+	if (gam->write_gam_full(gam, tpath)) {
+		remove(tpath);
+		return 1;
+	}
+	return gc_rename(tpath, path);
+}
+
+static gammap *gc_get_gammap(gcache *p, char *key) {
+	char path[MAXGCPATH];
+	gammap *map;
+
+	if (gc_path(p, path, key, ".gmp") || !gc_exists(path))
+		return NULL;
+
+	if ((map = read_gammap(path)) == NULL) {
+		if (p->verb)
+			printf(" (Ignoring bad cached gamut map '%s')\n",path);
+		return NULL;
+	}
+	if (p->verb)
+		printf(" (Using cached gamut map '%s')\n",path);
+	return map;
+}
+
+static int gc_put_gammap(gcache *p, char *key, gammap *map) {
+	char path[MAXGCPATH], tpath[MAXGCPATH + 50];
+
+	if (gc_path(p, path, key, ".gmp"))
+		return 1;
+	gc_tpath(p, tpath, path);
+
+	if (map->write(map, tpath)) {
+		remove(tpath);
+		return 1;
+	}
+	return gc_rename(tpath, path);
+}
+
+/* Create a cache for the given directory. */
+/* If dir is NULL, the ARGYLL_GAMUT_CACHE environment variable is used. */
+/* Return NULL if no cache directory is set. */
+gcache *new_gcache(char *dir, int verb) {
+	gcache *p;
+
+	if (dir == NULL)
+		dir = getenv("ARGYLL_GAMUT_CACHE");
+	if (dir == NULL || dir[0] == '\000')
+		return NULL;
+
+	if ((p = (gcache *)calloc(1, sizeof(gcache))) == NULL)
+		error("gcache: calloc failed on gcache object");
+
+	if ((p->dir = strdup(dir)) == NULL)
+		error("gcache: strdup failed on directory name");
+
+	if ((p->al = new_icmAllocStd()) == NULL
+	 || (p->md5 = new_icmMD5(p->al)) == NULL)
+		error("gcache: new_icmMD5 failed");
+	p->verb = verb;
+
+	p->del = del_gcache;
+	p->reset = gc_reset;
+	p->add_file = gc_add_file;
+	p->add = gc_add;
+	p->add_luo = gc_add_luo;
+	p->add_gmi = gc_add_gmi;
+	p->key = gc_key;
+	p->gam_key = gc_gam_key;
+	p->get_gamut = gc_get_gamut;
+	p->put_gamut = gc_put_gamut;
+	p->get_gammap = gc_get_gammap;
+	p->put_gammap = gc_put_gammap;
+
+	return p;
+}
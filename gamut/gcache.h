@@ -0,0 +1,85 @@
+#ifndef GCACHE_H
+#define GCACHE_H
+
+/* 
+ * gcache
+ *
+ * Gamut surface and gamut map disk cache.
+ *
+ * Author:  agent <agent@local>
+ * Date:    18/10/2026
+ * Version: 1.00
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * The cache is a directory of files, each named by the MD5 of
+ * everything that determines its content (the profile file contents,
+ * the lookup parameters and the gamut or gamut mapping parameters).
+ * Gamut surfaces are stored as full .gam files, and gamut maps in
+ * the gammap write() format, so that a cache hit gives an identical
+ * result to re-computing them.
+ *
+ * (xicc.h, gamut.h and gammap.h must be #included before this file)
+ */
+
+#define GCACHE_KEYLEN 33		/* Length of a key string, including nul */
+
+struct _gcache {
+
+/* Private: */
+	char *dir;				/* Cache directory */
+	int verb;				/* Verbose flag */
+	icmAlloc *al;			/* Heap allocator for md5 */
+	icmMD5 *md5;			/* Current key checksum */
+
+/* Public: */
+
+	/* Methods */
+	void (*del)(struct _gcache *p);				/* Free ourselves */
+
+	/* Start a new key, for the given kind of object */
+	void (*reset)(struct _gcache *p, char *kind);
+
+	/* Add the contents of a file to the key. Return nz on error */
+	int (*add_file)(struct _gcache *p, char *filename);
+
+	/* Add printf formatted parameters to the key */
+	void (*add)(struct _gcache *p, char *fmt, ...);
+
+	/* Add the parameters of an xicc lookup object to the key */
+	void (*add_luo)(struct _gcache *p, icxLuBase *luo);
+
+	/* Add a gamut mapping intent to the key */
+	void (*add_gmi)(struct _gcache *p, icxGMappingIntent *gmi);
+
+	/* Finish the current key, and return it in key[] */
+	void (*key)(struct _gcache *p, char key[GCACHE_KEYLEN]);
+
+	/* Compute the key for the gamut surface of the profile file pname, */
+	/* made using luo with surface resolution gres. Return nz on error */
+	int (*gam_key)(struct _gcache *p, char key[GCACHE_KEYLEN], char *pname,
+	               icxLuBase *luo, double gres);
+
+	/* Return the cached gamut for the key, NULL if there isn't one */
+	gamut *(*get_gamut)(struct _gcache *p, char *key, double sres);
+
+	/* Save a gamut under the key. Return nz on error */
+	int (*put_gamut)(struct _gcache *p, char *key, gamut *gam);
+
+	/* Return the cached gamut map for the key, NULL if there isn't one */
+	gammap *(*get_gammap)(struct _gcache *p, char *key);
+
+	/* Save a gamut map under the key. Return nz on error */
+	int (*put_gammap)(struct _gcache *p, char *key, gammap *map);
+
+}; typedef struct _gcache gcache;
+
+/* Create a cache for the given directory. */
+/* If dir is NULL, the ARGYLL_GAMUT_CACHE environment variable is used. */
+/* Return NULL if no cache directory is set. */
+gcache *new_gcache(char *dir, int verb);
+
+#endif /* GCACHE_H */
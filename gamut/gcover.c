@@ -0,0 +1,245 @@
+
+/*
+ * gcover
+ *
+ * Batch comparison of a gamut against a set of reference gamuts.
+ *
+ * Author:  agent <agent@local>
+ * Date:    18/10/2026
+ * Version: 1.00
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "numlib.h"
+#include "sobol.h"
+#include "conv.h"
+#include "gamut.h"
+#include "gcover.h"
+
+#define DEF_NSAMP 100000		/* Default number of sample points within the gamut */
+#define SAMP_BATCH 4096			/* Candidate sample points per classification job */
+
+/* A thread job to generate a batch of candidate points */
+/* and find which of them are within the gamut */
+typedef struct {
+	gamut *s;
+	sobol *so;				/* This jobs Sobol sequence */
+	unsigned int six;		/* Sequence index of the first candidate */
+	double *min, *max;		/* Bounding box of s */
+	double (*in)[3];		/* Candidate points */
+	double *rv;				/* Their normalised radii */
+	int n;					/* Number of candidates, < SAMP_BATCH if run out */
+} gcjob;
+
+static int gc_classify(void *cntx, int ix) {
+	gcjob *jb = (gcjob *)cntx + ix;
+	int j, k;
+
+	jb->so->reset(jb->so);
+	if (jb->so->skip(jb->so, jb->six))
+		jb->n = 0;
+	else
+		jb->n = jb->so->nextn(jb->so, jb->in[0], SAMP_BATCH);
+
+	for (k = 0; k < jb->n; k++) {
+		for (j = 0; j < 3; j++)
+			jb->in[k][j] = jb->min[j] + jb->in[k][j] * (jb->max[j] - jb->min[j]);
+	}
+
+	jb->s->nradials(jb->s, jb->rv, NULL, jb->in, jb->n);
+	return 0;
+}
+
+/* A thread job to compare with every inc'th reference gamut */
+typedef struct {
+	gamut *s;
+	gamut **refs;
+	gcover *res;
+	int nref;
+	int six, inc;			/* Start index and increment */
+	double (*samp)[3];		/* Sample points within s */
+	int nsamp;
+	double vol;				/* Volume of s */
+	double smin[3], smax[3];	/* Bounding box of the samples */
+} gcrjob;
+
+static int gc_compare(void *cntx, int ix) {
+	gcrjob *jb = (gcrjob *)cntx + ix;
+	double (*in)[3];
+	double *rv;
+	int i, j, k, n, nin;
+
+	if ((in = (double (*)[3])malloc(sizeof(double) * 3 * jb->nsamp)) == NULL)
+		error("gamut_cover: malloc failed");
+	if ((rv = (double *)malloc(sizeof(double) * jb->nsamp)) == NULL)
+		error("gamut_cover: malloc failed");
+
+	for (i = jb->six; i < jb->nref; i += jb->inc) {
+		gamut *r = jb->refs[i];
+		gcover *rp = &jb->res[i];
+		double rmin[3], rmax[3];
+
+		memset((void *)rp, 0, sizeof(gcover));
+		if (jb->s->compatible(jb->s, r) == 0)
+			continue;
+		rp->ok = 1;
+		rp->rvol = r->volume(r);
+
+		/* Skip the reference if its bounding box misses the samples */
+		r->getrange(r, rmin, rmax);
+		for (j = 0; j < 3; j++) {
+			if (rmin[j] > jb->smax[j] || rmax[j] < jb->smin[j])
+				break;
+		}
+		if (j < 3)
+			continue;
+
+		/* Only look up the samples that are within the bounding box */
+		for (n = k = 0; k < jb->nsamp; k++) {
+			for (j = 0; j < 3; j++) {
+				if (jb->samp[k][j] < rmin[j] || jb->samp[k][j] > rmax[j])
+					break;
+			}
+			if (j < 3)
+				continue;
+			in[n][0] = jb->samp[k][0];
+			in[n][1] = jb->samp[k][1];
+			in[n][2] = jb->samp[k][2];
+			n++;
+		}
+		r->nradials(r, rv, NULL, in, n);
+		for (nin = k = 0; k < n; k++) {
+			if (rv[k] <= 1.0)
+				nin++;
+		}
+
+		if (jb->nsamp > 0)
+			rp->cover = (double)nin/jb->nsamp;
+		rp->ivol = rp->cover * jb->vol;
+		if (rp->rvol > 0.0) {
+			rp->rcover = rp->ivol/rp->rvol;
+			if (rp->rcover > 1.0)
+				rp->rcover = 1.0;
+		}
+	}
+	free(rv);
+	free(in);
+	return 0;
+}
+
+/* Compare gamut s with each of the nref gamuts refs[], putting the */
+/* results in res[nref]. Return the volume of s. */
+double gamut_cover(gamut *s, gamut **refs, gcover *res, int nref, int nsamp, int nthr) {
+	double vol;
+	double min[3], max[3];
+	double (*samp)[3] = NULL;
+	int i, j, k, nin = 0;
+	gcjob *jbs;
+	gcrjob *rjbs;
+	athreads *ths = NULL;
+
+	if (nsamp <= 0)
+		nsamp = DEF_NSAMP;
+	if (nthr < 1)
+		nthr = 1;
+
+	vol = s->volume(s);
+	s->setshared(s);			/* So that it can be looked up from several threads */
+	s->getrange(s, min, max);
+
+	if ((samp = (double (*)[3])malloc(sizeof(double) * 3 * nsamp)) == NULL)
+		error("gamut_cover: malloc failed");
+	if ((jbs = (gcjob *)malloc(sizeof(gcjob) * nthr)) == NULL)
+		error("gamut_cover: malloc failed");
+	if (nthr > 1 && (ths = new_athreads(nthr)) == NULL)
+		error("gamut_cover: failed to create threads");
+
+	for (i = 0; i < nthr; i++) {
+		jbs[i].s = s;
+		jbs[i].min = min;
+		jbs[i].max = max;
+		if ((jbs[i].so = new_sobol(3)) == NULL)
+			error("gamut_cover: new_sobol failed");
+		if ((jbs[i].in = (double (*)[3])malloc(sizeof(double) * 3 * SAMP_BATCH)) == NULL
+		 || (jbs[i].rv = (double *)malloc(sizeof(double) * SAMP_BATCH)) == NULL)
+			error("gamut_cover: malloc failed");
+	}
+
+	/* Generate quasi-random points within the bounding box of s, */
+	/* and keep the ones that are within the gamut. Each job */
+	/* generates its own consecutive batch of the sequence, so */
+	/* the result doesn't depend on the number of threads. */
+	if (vol > 0.0) {
+		unsigned int six = 0;
+		int done = 0;
+
+		while (!done && nin < nsamp) {
+
+			for (i = 0; i < nthr; i++, six += SAMP_BATCH)
+				jbs[i].six = six;
+
+			if (ths != NULL)
+				ths->run(ths, nthr, gc_classify, (void *)jbs);
+			else
+				gc_classify((void *)jbs, 0);
+
+			for (i = 0; i < nthr && !done && nin < nsamp; i++) {
+				for (k = 0; k < jbs[i].n && nin < nsamp; k++) {
+					if (jbs[i].rv[k] <= 1.0) {
+						for (j = 0; j < 3; j++)
+							samp[nin][j] = jbs[i].in[k][j];
+						nin++;
+					}
+				}
+				if (jbs[i].n < SAMP_BATCH)
+					done = 1;		/* Run out of points */
+			}
+		}
+	}
+	for (i = 0; i < nthr; i++) {
+		free(jbs[i].rv);
+		free(jbs[i].in);
+		jbs[i].so->del(jbs[i].so);
+	}
+	free(jbs);
+
+	/* Compare with each reference, spread across the threads */
+	if (nthr > nref)
+		nthr = nref;
+	if (nthr < 1)
+		nthr = 1;
+	if ((rjbs = (gcrjob *)malloc(sizeof(gcrjob) * nthr)) == NULL)
+		error("gamut_cover: malloc failed");
+	for (i = 0; i < nthr; i++) {
+		rjbs[i].s = s;
+		rjbs[i].refs = refs;
+		rjbs[i].res = res;
+		rjbs[i].nref = nref;
+		rjbs[i].six = i;
+		rjbs[i].inc = nthr;
+		rjbs[i].samp = samp;
+		rjbs[i].nsamp = nin;
+		rjbs[i].vol = vol;
+		for (j = 0; j < 3; j++) {
+			rjbs[i].smin[j] = min[j];
+			rjbs[i].smax[j] = max[j];
+		}
+	}
+	if (ths != NULL)
+		ths->run(ths, nthr, gc_compare, (void *)rjbs);
+	else
+		gc_compare((void *)rjbs, 0);
+
+	if (ths != NULL)
+		ths->del(ths);
+	free(rjbs);
+	free(samp);
+
+	return vol;
+}
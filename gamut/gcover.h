@@ -0,0 +1,46 @@
+#ifndef GCOVER_H
+#define GCOVER_H
+
+/*
+ * gcover
+ *
+ * Batch comparison of a gamut against a set of reference gamuts.
+ *
+ * Author:  agent <agent@local>
+ * Date:    18/10/2026
+ * Version: 1.00
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * The gamut and reference volumes are computed exactly from their
+ * surfaces. The intersection volume is estimated from a single set
+ * of Sobol quasi-random points that lie within the gamut, shared by
+ * all the references, as the fraction of those points that are also
+ * within each reference. Points outside a references bounding box
+ * are counted as outside without doing a lookup, and a reference whose
+ * bounding box doesn't overlap the gamut is skipped entirely.
+ *
+ * (gamut.h must be #included before this file)
+ */
+
+/* The result of comparing with one reference gamut */
+typedef struct {
+	int ok;				/* nz if the reference was compatible and so was compared */
+	double rvol;		/* Volume of the reference gamut */
+	double ivol;		/* Volume of the intersection of the gamut and the reference */
+	double cover;		/* Fraction of the gamut that is within the reference */
+	double rcover;		/* Fraction of the reference that is within the gamut */
+} gcover;
+
+/* Compare gamut s with each of the nref gamuts refs[], putting the */
+/* results in res[nref]. nsamp is the number of sample points within s */
+/* used to estimate the intersections (0 for default), and the work is */
+/* shared between nthr threads. The reference gamuts are only looked */
+/* up by one thread each, but s must not be in refs[]. */
+/* Return the volume of s. */
+double gamut_cover(gamut *s, gamut **refs, gcover *res, int nref, int nsamp, int nthr);
+
+#endif /* GCOVER_H */
@@ -59,7 +59,7 @@
 #undef SAVE_VRMLS		/* Save various vrml's */
 #undef PLOT_MAPPING_INFLUENCE		/* Plot sci_gam colored by dominant guide influence: */ 
 		                /* Absolute = red, Relative = yellow, Radial = blue, Depth = green */
-#define VERB 0 			/* If <= 1, print progress headings */
+#define VERB 0 			/* If <= 1, print progress headings when verbose */
 						/* if  > 1, print information about everything */
 #undef SHOW_NEIGB_WEIGHTS		/* Show the weighting for each point of neighbours */
 
@@ -76,7 +76,7 @@
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 #if defined(VERB)
-# define VA(xxxx) printf xxxx
+# define VA(xxxx) { if (verb) printf xxxx; }
 # if VERB > 1
 #  define VB(xxxx) printf xxxx
 # else
@@ -815,8 +815,6 @@ double d_bp[3]		/* Override destination target black point (may be NULL) */
 	int i, j, k;
 	double cusps[2][8][3];
 
-	VA(("init_ce called\n"));
-	
 	s->docusp = 0;		/* Assume no cusp mapping */
 
 	s->isJab = sc_gam->isJab;
@@ -1095,6 +1093,16 @@ gammapweights *wt	/* If NULL, assume 100% */
 
 /* ============================================ */
 
+/* Return a random double in the range min to max, from our own */
+/* sequence rather than the global one, so that the result doesn't */
+/* depend on what else is running at the same time. */
+static double ns_rand(unsigned int *rs, double min, double max) {
+	*rs = *rs * 1664525 + 1013904223;		/* 32 bit linear congruent generator */
+	return min + (max - min) * (*rs / 4294967295.0);
+}
+
+/* ============================================ */
+
 /* Return the maximum number of points that will be generated */
 int near_smooth_np(
 	gamut *sc_gam,		/* Source colorspace gamut */
@@ -1161,6 +1169,7 @@ double m21fsm		/* Inverse 3D RSPL smoothing level, 0.0 = none */
 	double mxmv;	/* Maximum a point gets moved */
 	int nmxmv;		/* Number of maxmoves less than stopping threshold */
 	int it;
+	unsigned int rs = 0x12345678;	/* Random offset sequence state */
 
 	/* Check gamuts are compatible */
 	if (sc_gam->compatible(sc_gam, d_gam) == 0
@@ -1350,6 +1359,7 @@ double m21fsm		/* Inverse 3D RSPL smoothing level, 0.0 = none */
 
 	/* If cusps are available, figure out the transformations */
 	/* needed to map source cusps to destination cusps */
+	VA(("init_ce called\n"));
 	init_ce(&opts, sc_gam, d_gam, src_kbp, dst_kbp, d_bp);
 
 	VA(("Setting up cusp rotated compression or expansion mappings\n"));
@@ -1682,8 +1692,8 @@ double m21fsm		/* Inverse 3D RSPL smoothing level, 0.0 = none */
 				}
 //else printf("~1 powell failed with rv = %f\n",rv);
 				/* Adjust the starting point with a random offset to avoid local minima */
-				nv[0] = iv[0] + d_rand(-20.0, 20.0);
-				nv[1] = iv[1] + d_rand(-20.0, 20.0);
+				nv[0] = iv[0] + ns_rand(&rs, -20.0, 20.0);
+				nv[1] = iv[1] + ns_rand(&rs, -20.0, 20.0);
 			}
 			if (brv == 1e38) {		/* We failed to get a result */
 				VB(("multiple powells failed to get a result\n"));
@@ -1787,8 +1797,8 @@ double m21fsm		/* Inverse 3D RSPL smoothing level, 0.0 = none */
 				}
 //else printf("~1 powell failed with rv = %f\n",rv);
 				/* Adjust the starting point with a random offset to avoid local minima */
-				nv[0] = iv[0] + d_rand(-20.0, 20.0);
-				nv[1] = iv[1] + d_rand(-20.0, 20.0);
+				nv[0] = iv[0] + ns_rand(&rs, -20.0, 20.0);
+				nv[1] = iv[1] + ns_rand(&rs, -20.0, 20.0);
 			}
 			if (brv == 1e38) {		/* We failed to get a result */
 				VB(("multiple powells failed to get a result\n"));
@@ -2144,9 +2154,9 @@ double m21fsm		/* Inverse 3D RSPL smoothing level, 0.0 = none */
 					}
 //else if (i == 1145) printf("~1 %d: trial %d, powell failed or didn't improve rv = %f\n",i, trial, rv);
 					/* Adjust the starting point with a random offset to avoid local minima */
-					nv[0] = smp[i].dv[0] + d_rand(-10.0, 10.0);
-					nv[1] = smp[i].dv[1] + d_rand(-10.0, 10.0);
-					nv[2] = smp[i].dv[2] + d_rand(-10.0, 10.0);
+					nv[0] = smp[i].dv[0] + ns_rand(&rs, -10.0, 10.0);
+					nv[1] = smp[i].dv[1] + ns_rand(&rs, -10.0, 10.0);
+					nv[2] = smp[i].dv[2] + ns_rand(&rs, -10.0, 10.0);
 
 					/* Make sure the start point is not out of dst gamut. */
 					if (smp[i].dgam->nradial(smp[i].dgam, tmp, nv) > 1.0) {
@@ -2218,10 +2228,10 @@ double m21fsm		/* Inverse 3D RSPL smoothing level, 0.0 = none */
 				printf("."); fflush(stdout);
 			}
 #ifdef VERB
-			if (it > 0)
+			if (verb && it > 0)
 				printf("avch = %f, mxch = %f @ %d, avgdot %f, mindot %f, mxadot %f\n",
 				                                   avch,mxch,mxchix,avdot,mindot,maxdot);
-			else
+			else if (verb)
 				printf("avch = %f, mxch = %f @ %d\n",avch,mxch,mxchix);
 #endif /* VERB */
 			if (mxch <= ITTER_STOP)
@@ -5275,11 +5275,14 @@ double *in		/* Input array[outputChan] */
 /* ----------------------------------------------- */
 /* Pseudo - Hilbert count sequencer */
 
-/* This multi-dimensional count sequence is a distributed */
-/* Gray code sequence, with direction reversal on every */
-/* alternate power of 2 scale. */
+/* This multi-dimensional count sequence is a Hilbert curve */
+/* over the enclosing power of 2 cube, so that each step moves */
+/* to a neighbouring grid point. Sub-cubes of the curve that lie */
+/* entirely outside the grid resolution are skipped over. */
 /* It is intended to aid cache coherence in multi-dimensional */
-/* regular sampling. It approximates the Hilbert curve sequence. */
+/* regular sampling. */
+/* (The Hilbert index to coordinate conversion is from */
+/*  J. Skilling, "Programming the Hilbert curve", AIP 2004) */
 
 /* Initialise, returns total usable count */
 unsigned
@@ -5324,6 +5327,48 @@ psh *p	/* Pointer to structure */
 	p->ix = 0;
 }
 
+/* Convert a di * bits Hilbert index into coordinates */
+static void psh_hilbert(
+unsigned int ix,	/* Hilbert index */
+int di,				/* Dimensionality */
+unsigned int bits,	/* Bits per coordinate, > 0 */
+unsigned int *co	/* Return coordinates */
+) {
+	unsigned int b, m, t, q;
+	int e;
+
+	/* Distribute the index bits into the transposed form */
+	for (e = 0; e < di; e++)
+		co[e] = 0;
+	for (b = 0; b < bits; b++) {
+		for (e = di-1; e >= 0; e--) {
+			co[e] |= (ix & 1) << b;
+			ix >>= 1;
+		}
+	}
+
+	/* Gray decode */
+	t = co[di-1] >> 1;
+	for (e = di-1; e > 0; e--)
+		co[e] ^= co[e-1];
+	co[0] ^= t;
+
+	/* Undo the excess work */
+	m = 2u << (bits-1);
+	for (q = 2; q != m; q <<= 1) {
+		unsigned int p = q - 1;
+		for (e = di-1; e >= 0; e--) {
+			if (co[e] & q) {		/* Invert */
+				co[0] ^= p;
+			} else {				/* Exchange */
+				t = (co[0] ^ co[e]) & p;
+				co[0] ^= t;
+				co[e] ^= t;
+			}
+		}
+	}
+}
+
 /* Increment pseudo-hilbert coordinates */
 /* Return non-zero if count rolls over to 0 */
 int
@@ -5334,49 +5379,45 @@ int co[]		/* Coordinates to return */
 	int di = p->di;
 	unsigned int res = p->res;
 	unsigned int bits = p->bits;
+	unsigned int tco[MAX_CHAN];
 	int e;
 
-	do {
-		unsigned int b;
-		int gix;	/* Gray code index */
-		
+	for (;;) {
+		unsigned int b, sb;
+		int out;
+
 		p->ix = (p->ix + 1) & p->tmask;
 
-		gix = p->ix ^ (p->ix >> 1);		/* Convert to gray code index */
-	
-		for (e = 0; e < di; e++) 
-			co[e] = 0;
-		
-		for (b = 0; b < bits; b++) {	/* Distribute bits */
-			if (b & 1) {
-				for (e = di-1; e >= 0; e--)  {		/* In reverse order */
-					co[e] |= (gix & 1) << b;
-					gix >>= 1;
-				}
-			} else {
-				for (e = 0; e < di; e++)  {			/* In normal order */
-					co[e] |= (gix & 1) << b;
-					gix >>= 1;
-				}
-			}
+		if (p->ix == 0) {			/* Rolled over */
+			for (e = 0; e < di; e++)
+				co[e] = 0;
+			break;
 		}
-	
-		/* Convert from Gray to binary coordinates */
-		for (e = 0; e < di; e++)  {
-			unsigned int sh, tv;
-
-			for(sh = 1, tv = co[e];; sh <<= 1) {
-				unsigned ptv = tv;
-				tv ^= (tv >> sh);
-				if (ptv <= 1 || sh == 16)
+		psh_hilbert(p->ix, di, bits, tco);
+
+		/* See if the point is within the grid, and if it isn't, */
+		/* find the largest sub-cube containing it that lies */
+		/* entirely outside the grid, so that we can skip all of it. */
+		for (out = 0, sb = 0, e = 0; e < di; e++) {
+			if (tco[e] < res)
+				continue;
+			out = 1;
+			for (b = bits-1; b > sb; b--) {
+				if (((tco[e] >> b) << b) >= res) {
+					sb = b;
 					break;
+				}
 			}
-			if (tv >= res)	/* Dumbo filter - increment again if outside cube range */
-				break;
-			co[e] = tv;
 		}
-
-	} while (e < di);
+		if (!out) {
+			for (e = 0; e < di; e++)
+				co[e] = tco[e];
+			break;
+		}
+		/* Skip to the last index of the sub-cube */
+		sb *= di;
+		p->ix = (((p->ix >> sb) + 1) << sb) - 1;
+	}
 	
 	return (p->ix == 0);
 }
@@ -14182,7 +14223,7 @@ static void icmMD5_add(icmMD5 *p, ORD8 *ibuf, unsigned int len) {
 		}
 
 		memcpy(np, ibuf, bs);	/* Now got one full buffer */
-		icmMD5_accume(p, np);
+		icmMD5_accume(p, p->buf);
 		ibuf += bs;
 		len -= bs;
 	}
@@ -109,6 +109,8 @@
 #include "xicc.h"
 #include "gamut.h"
 #include "gammap.h"
+#include "gcache.h"
+#include "conv.h"
 // ~~~99
 #include "vrml.h"
 
@@ -133,6 +135,7 @@ void usage(char *diag, ...) {
 	fprintf(stderr," -V              Verify existing profile, rather than link\n");
 	fprintf(stderr," -q lmhu         Quality - Low, Medium (def), High, Ultra\n");
 	fprintf(stderr," -r res          Override clut res. set by -q\n");
+	fprintf(stderr," -e              Adapt the clut grid spacing to the link\n");
 	fprintf(stderr," -n              Don't preserve device linearization curves in result\n");
 	fprintf(stderr," -f              Special :- Force neutral colors to be K only output\n");
 	fprintf(stderr," -fk             Special :- Force K only neutral colors to be K only output\n");
@@ -233,6 +236,7 @@ struct _link {
 	int mode;		/* 0 = simple mode, 1 = mapping mode, 2 = mapping mode with inverse A2B */
 	int quality;	/* 0 = low, 1 = medium, 2 = high, 3 = ultra */
 	int clutres;	/* 0 = quality default, !0 = override, then actual during link */
+	int adapt;		/* nz = adapt the clut grid spacing to the link */
 	int src_kbp;	/* nz = Use K only black point as src gamut black point */
 	int dst_kbp;	/* nz = Use K only black point as dst gamut black point */
 	int dst_cmymap;	/* masks C = 1, M = 2, Y = 4 to force 100% cusp map */
@@ -261,7 +265,10 @@ struct _link {
 	icxGMappingIntent gmi;
 	gammap *map;	/* Gamut mapping */
 	gammap *Kmap;	/* Gamut mapping K in to K out nhack == 2 and K in to K out */
-	
+
+	int fused;			/* nz if the stages between the device' values are fused */
+	double fmx[3][3];	/* DevIn' -> DevOut' matrix they are fused into */
+	gridcurve *gcurve;	/* DevIn' -> clut grid spacing curves, NULL if none */
 
 	/* Per profile setup information */
 	profinfo in;
@@ -392,6 +399,9 @@ void devi_devip(void *cntx, double *out, double *in) {
 		y2l_curve(out, out, p->in.lcurve == 2);
 	}
 
+	if (p->gcurve != NULL)		/* Apply the grid spacing curves */
+		p->gcurve->fwd(p->gcurve, out, out);
+
 #ifdef DEBUG
 #ifdef DEBUGC
 	DEBUGC
@@ -404,6 +414,7 @@ void devi_devip(void *cntx, double *out, double *in) {
 /* - - - - - - - - - - - - */
 /* clut, DevIn' -> DevOut' */
 void devip_devop(void *cntx, double *out, double *in) {
+	double gin[MAX_CHAN];			/* input values without grid spacing curves */
 	double win[MAX_CHAN];			/* working input values */
 	double pcsv[MAX_CHAN];			/* PCS intermediate value, pre-gamut map */
 	double pcsvm[MAX_CHAN];			/* PCS intermediate value, post-gamut map */
@@ -422,6 +433,15 @@ void devip_devop(void *cntx, double *out, double *in) {
 	printf("DevIn'->DevOut' got %f %f %f %f\n",in[0], in[1], in[2], in[3]); fflush(stdout);
 #endif
 
+	/* The hacks below recognise grid points using the grid index values in[], */
+	/* and everything else uses the values the grid points represent. */
+	if (p->gcurve != NULL)
+		p->gcurve->bwd(p->gcurve, gin, in);
+	else {
+		for (i = 0; i < p->in.chan; i++)
+			gin[i] = in[i];
+	}
+
 #ifdef ENKHACK
 	/* Handle neutral recognition/output K only hack */
 	/* (see discussion at top of file for generalization of this idea) */
@@ -443,21 +463,21 @@ void devip_devop(void *cntx, double *out, double *in) {
 			double maxcmy;		/* Comute a degree of source "K onlyness" */
 			double maxcmyk;
 
-			maxcmy = in[0];			/* Compute minimum of CMY */
-			if (in[1] > maxcmy)
-				maxcmy = in[1];
-			if (in[2] > maxcmy)
-				maxcmy = in[2];
+			maxcmy = gin[0];			/* Compute minimum of CMY */
+			if (gin[1] > maxcmy)
+				maxcmy = gin[1];
+			if (gin[2] > maxcmy)
+				maxcmy = gin[2];
 
 			maxcmyk = maxcmy;		/* Compute minimum of all inks */
-			if (in[3] > maxcmyk)
-				maxcmyk = in[3];
+			if (gin[3] > maxcmyk)
+				maxcmyk = gin[3];
 
-//printf("~1 maxcmy = %f, maxcmyk = %f, in[3] = %f\n",maxcmy,maxcmyk,in[3]);
-			if (in[3] <= 0.0 || maxcmy > in[3]) {
+//printf("~1 maxcmy = %f, maxcmyk = %f, gin[3] = %f\n",maxcmy,maxcmyk,gin[3]);
+			if (gin[3] <= 0.0 || maxcmy > gin[3]) {
 				konlyness = 0.0;
 			} else {
-				konlyness = (in[3] - maxcmy)/in[3];	
+				konlyness = (gin[3] - maxcmy)/gin[3];	
 			}
 
 			/* As we approach no colorant, blend towards no Konlyness */
@@ -507,7 +527,7 @@ void devip_devop(void *cntx, double *out, double *in) {
 #endif /* ENKHACK */
 
 	if (p->in.lcurve) {	/* Apply L* to Y */
-		l2y_curve(win, in, p->in.lcurve == 2);
+		l2y_curve(win, gin, p->in.lcurve == 2);
 #ifdef DEBUG
 #ifdef DEBUGC
 	DEBUGC
@@ -517,7 +537,7 @@ void devip_devop(void *cntx, double *out, double *in) {
 
 	} else {
 		for (i = 0; i < p->in.chan; i++)
-			win[i] = in[i];
+			win[i] = gin[i];
 #ifdef DEBUG
 #ifdef DEBUGC
 	DEBUGC
@@ -543,13 +563,18 @@ void devip_devop(void *cntx, double *out, double *in) {
 	    case icmMatrixFwdType: {
 			icxLuMatrix *lu = (icxLuMatrix *)p->in.luo;	/* Safe to coerce */
 
+			double *mv = win;
+
 			if (p->in.nocurve) {	/* No explicit curve, so do implicit here */
 				rv |= lu->fwd_curve(lu, pcsv, win);
-				rv |= lu->fwd_matrix(lu, pcsv, pcsv);
+				mv = pcsv;
+			}
+			if (p->fused) {			/* Straight through to DevOut' */
+				icmMulBy3x3(pcsv, p->fmx, mv);
 			} else {
-				rv |= lu->fwd_matrix(lu, pcsv, win);
+				rv |= lu->fwd_matrix(lu, pcsv, mv);
+				rv |= lu->fwd_abs(lu, pcsv, pcsv);
 			}
-			rv |= lu->fwd_abs(lu, pcsv, pcsv);
 			break;
 		}
 	    case icmLutType: {
@@ -864,8 +889,14 @@ void devip_devop(void *cntx, double *out, double *in) {
 		    case icmMatrixBwdType: {
 				icxLuMatrix *lu = (icxLuMatrix *)p->out.luo;	/* Safe to coerce */
 
-				rv |= lu->bwd_abs(lu, pcsvm, pcsvm);
-				rv |= lu->bwd_matrix(lu, out, pcsvm);
+				if (p->fused) {		/* Already DevOut' */
+					out[0] = pcsvm[0];
+					out[1] = pcsvm[1];
+					out[2] = pcsvm[2];
+				} else {
+					rv |= lu->bwd_abs(lu, pcsvm, pcsvm);
+					rv |= lu->bwd_matrix(lu, out, pcsvm);
+				}
 				if (p->out.nocurve) {	/* No explicit curve, so do implicit here */
 					rv |= lu->bwd_curve(lu, out, out);
 				}
@@ -1110,6 +1141,116 @@ static double xyzoptfunc(void *cntx, double *v) {
 	return rv;
 }
 
+/* ------------------------------------------- */
+/* Context for creating a gamut map in a separate thread */
+typedef struct {
+	gamut *sc_gam;			/* Source colorspace gamut */
+	gamut *s_gam;			/* Source image gamut (NULL if none) */
+	gamut *d_gam;			/* Destination colorspace gamut */
+	icxGMappingIntent *gmi;	/* Gamut mapping specification */
+	int src_kbp, dst_kbp;	/* Use K only black points */
+	int cmymap;				/* Force 100% cusp map mask */
+	int rel_oride;			/* Relative override */
+	int mapres;				/* Gamut map resolution */
+	gammap *map;			/* Returned gamut map, NULL on failure */
+} gmapjob;
+
+static int gmap_worker(void *cntx) {
+	gmapjob *jb = (gmapjob *)cntx;
+
+	jb->map = new_gammap(0, jb->sc_gam, jb->s_gam, jb->d_gam, jb->gmi,
+	                     jb->src_kbp, jb->dst_kbp, jb->cmymap, jb->rel_oride,
+	                     jb->mapres, NULL, NULL, NULL);
+	return jb->map == NULL ? 1 : 0;
+}
+
+/* Compute the gamut cache key for a gamut map between two keyed gamuts. */
+/* Return nz if it can't be computed */
+static int gmap_key(gcache *gc, char key[GCACHE_KEYLEN], char *skey, char *iname,
+                    char *dkey, icxGMappingIntent *gmi, int src_kbp, int dst_kbp,
+                    int cmymap, int rel_oride, int mapres) {
+	gc->reset(gc, "gammap");
+	gc->add(gc, "%s %s", skey, dkey);
+	if (iname[0] != '\000' && gc->add_file(gc, iname))
+		return 1;
+	gc->add_gmi(gc, gmi);
+	gc->add(gc, "%d %d %d %d %d", src_kbp, dst_kbp, cmymap, rel_oride, mapres);
+	gc->key(gc, key);
+	return 0;
+}
+
+/* The matrix profile stages between DevIn' and DevOut' */
+static int chain_matrix(link *p, double *out, double *in) {
+	icxLuMatrix *ilu = (icxLuMatrix *)p->in.luo;	/* Safe to coerce */
+	icxLuMatrix *olu = (icxLuMatrix *)p->out.luo;	/* Safe to coerce */
+	int rv = 0;
+
+	rv |= ilu->fwd_matrix(ilu, out, in);
+	rv |= ilu->fwd_abs(ilu, out, out);
+	rv |= olu->bwd_abs(olu, out, out);
+	rv |= olu->bwd_matrix(olu, out, out);
+	return rv;
+}
+
+/* If the only stages between the DevIn' and DevOut' values are */
+/* the source and destination matrix profile matricies and a linear */
+/* (XYZ) PCS, fuse them into a single matrix. */
+static void fuse_chain(link *p) {
+	double mx[3][3], vv[3], tt[3], cc[3];
+	static double tv[3] = { 0.0, 0.3, 1.0 };	/* Test values */
+	int i, j, k;
+
+	p->fused = 0;
+	if (p->in.alg != icmMatrixFwdType || p->out.alg != icmMatrixBwdType
+	 || (p->mode > 0 && p->gmi.usemap) || p->abs_luo != NULL
+	 || p->wphack != 0 || p->xyzscale < 1.0 || p->nhack != 0 || p->cmyhack != 0)
+		return;
+
+	/* The columns are the unit vectors */
+	for (j = 0; j < 3; j++) {
+		for (i = 0; i < 3; i++)
+			vv[i] = i == j ? 1.0 : 0.0;
+		if (chain_matrix(p, tt, vv) >= 2)
+			return;
+		for (i = 0; i < 3; i++)
+			mx[i][j] = tt[i];
+	}
+
+	/* Check that it gives the same result as the stages */
+	for (k = 0; k < 27; k++) {
+		vv[0] = tv[k % 3];
+		vv[1] = tv[(k / 3) % 3];
+		vv[2] = tv[k / 9];
+		if (chain_matrix(p, tt, vv) >= 2)
+			return;
+		icmMulBy3x3(cc, mx, vv);
+		for (i = 0; i < 3; i++) {
+			if (fabs(tt[i] - cc[i]) > 1e-9 * (1.0 + fabs(tt[i])))
+				return;		/* Not linear */
+		}
+	}
+	icmCpy3x3(p->fmx, mx);
+	p->fused = 1;
+}
+
+/* Context for setting up the clut grid spacing curves */
+typedef struct {
+	link *p;
+	icxLuBase *luo;		/* Output profile DevOut -> Lab */
+} adapt_cntx;
+
+/* DevIn' -> output Lab, so that the spacing suits the */
+/* color error rather than the device value error. */
+static void adapt_func(void *cntx, double *out, double *in) {
+	adapt_cntx *cx = (adapt_cntx *)cntx;
+	double dv[MAX_CHAN];
+
+	devip_devop((void *)cx->p, dv, in);
+	devop_devo((void *)cx->p, dv, dv);
+	if (cx->luo->lookup(cx->luo, out, dv) >= 2)
+		error("icc lookup failed: %d, %s",cx->p->out.c->errc,cx->p->out.c->err);
+}
+
 /* ------------------------------------------- */
 
 int
@@ -1133,6 +1274,12 @@ main(int argc, char *argv[]) {
 	int in_curve_res = 0;		/* Input profile A2B input curve resolution (if known) */
 	int out_curve_res = 0;		/* Output profile B2A output curve resolution (if known) */
 	profxinf xpi;				/* Extra profile information */
+	double sgres = 0.0;			/* Source gamut surface feature resolution */
+	double dgres = 0.0;			/* Destination gamut surface feature resolution */
+	int    mapres = 0;			/* Mapping rspl resolution */
+	gcache *gc = NULL;			/* Gamut surface and map cache, NULL if none */
+	char skey[GCACHE_KEYLEN], dkey[GCACHE_KEYLEN];		/* Gamut cache keys */
+	char mkey[GCACHE_KEYLEN], kmkey[GCACHE_KEYLEN];
 	int i;
 
 	error_program = argv[0];
@@ -1156,6 +1303,9 @@ main(int argc, char *argv[]) {
 	li.hwp[0] = li.hwp[1] = li.hwp[2] = 0.0;
 	li.map = NULL;
 	li.Kmap = NULL;
+	li.fused = 0;
+	li.adapt = 0;
+	li.gcurve = NULL;
 	li.in.intent  = icmDefaultIntent;	/* Default */
 	li.in.ink.tlimit = -1.0;			/* Default no total limit */
 	li.in.ink.klimit = -1.0;			/* Default no black limit */
@@ -1331,6 +1481,10 @@ main(int argc, char *argv[]) {
 				li.clutres = rr;
 			}
 
+			/* Adaptive clut grid spacing */
+			else if (argv[fa][1] == 'e' || argv[fa][1] == 'E')
+				li.adapt = 1;
+
 			/* Abstract profile */
 			else if (argv[fa][1] == 'p') {
 				if (na == NULL) usage("Expected abstract profile filename after -a");
@@ -2413,11 +2567,6 @@ main(int argc, char *argv[]) {
 	/* for the latter. The xluo->get_gamut work in the set li.pcsor */
 	/* for each xluo. */
 	if (li.mode > 0 && li.gmi.usemap) {
-		gamut *csgam, *igam, *ogam;
-		double sgres;			/* Source gamut surface feature resolution */
-		double dgres;			/* Destination gamut surface feature resolution */
-		int    mapres;			/* Mapping rspl resolution */
-
 		if (li.verb)
 			printf("Creating Gamut Mapping\n");
 
@@ -2441,13 +2590,42 @@ main(int argc, char *argv[]) {
   	 		mapres = 17;
 		}
 
+		/* See if the gamut maps are in the gamut cache. */
+		/* (Don't use it when a diagnostic plot is wanted) */
+		if (!li.gamdiag && (gc = new_gcache(NULL, li.verb)) != NULL) {
+			if (gc->gam_key(gc, skey, in_name, li.in.luo, sgres)
+			 || gc->gam_key(gc, dkey, out_name, li.out.luo, dgres)
+			 || gmap_key(gc, mkey, skey, sgam_name, dkey, &li.gmi, li.src_kbp, li.dst_kbp,
+			             li.cmyhack, li.rel_oride, mapres)
+			 || gmap_key(gc, kmkey, skey, sgam_name, dkey, &li.gmi, 1, 1,
+			             li.cmyhack, li.rel_oride, mapres)) {
+				gc->del(gc);
+				gc = NULL;
+			} else {
+				li.map = gc->get_gammap(gc, mkey);
+				if (li.nhack == 2)
+					li.Kmap = gc->get_gammap(gc, kmkey);
+			}
+		}
+	}
+
+	if (li.mode > 0 && li.gmi.usemap
+	 && (li.map == NULL || (li.nhack == 2 && li.Kmap == NULL))) {
+		gamut *csgam, *igam, *ogam;
+		gmapjob kjb;			/* K only gamut map job */
+		athread *kth = NULL;	/* K only gamut map thread */
+
 		/* Creat the source colorspace gamut surface */
 		if (li.verb)
 			printf(" Finding Source Colorspace Gamut with res %f\n",sgres);
 
 		/* Creat the source image gamut surface in the selected li.pcsor space */
-		if ((csgam = li.in.luo->get_gamut(li.in.luo, sgres)) == NULL)
-			error ("%d, %s",li.in.x->errc, li.in.x->err);
+		if (gc == NULL || (csgam = gc->get_gamut(gc, skey, sgres)) == NULL) {
+			if ((csgam = li.in.luo->get_gamut(li.in.luo, sgres)) == NULL)
+				error ("%d, %s",li.in.x->errc, li.in.x->err);
+			if (gc != NULL && gc->put_gamut(gc, skey, csgam))
+				warning("Failed to save source gamut to the gamut cache");
+		}
 
 		/* Grab a given source image gamut. */
 		if (sgam_name[0] != '\000') {		/* Optional source gamut - ie. from an images */
@@ -2477,29 +2655,71 @@ main(int argc, char *argv[]) {
 		if (li.verb)
 			printf(" Finding Destination Gamut with res %f\n",dgres);
 
-		if ((ogam = li.out.luo->get_gamut(li.out.luo, dgres)) == NULL)
-			error ("%d, %s",li.out.x->errc, li.out.x->err);
+		if (gc == NULL || (ogam = gc->get_gamut(gc, dkey, dgres)) == NULL) {
+			if ((ogam = li.out.luo->get_gamut(li.out.luo, dgres)) == NULL)
+				error ("%d, %s",li.out.x->errc, li.out.x->err);
+			if (gc != NULL && gc->put_gamut(gc, dkey, ogam))
+				warning("Failed to save destination gamut to the gamut cache");
+		}
 
 		if (li.verb)
 			printf(" Creating Gamut match\n");
 
-		li.map = new_gammap(li.verb, csgam, igam, ogam, &li.gmi,
-		                    li.src_kbp, li.dst_kbp, li.cmyhack, li.rel_oride,
-		                    mapres, NULL, NULL, li.gamdiag ? "gammap.wrl" : NULL
-		);
-		if (li.map == NULL)
-			error ("Failed to make gamut map transform");
-
-		if (li.nhack == 2) {
+		/* If we need a K only map too, create it in another thread */
+		/* while we create the main map. The gamuts they share are */
+		/* only queried once they've been made ready to share. */
+		if (li.nhack == 2 && li.Kmap == NULL && li.map == NULL
+		 && !li.gamdiag && system_ncpus() > 1) {
+			csgam->setshared(csgam);
+			if (igam != NULL)
+				igam->setshared(igam);
+			ogam->setshared(ogam);
+
+			kjb.sc_gam = csgam;
+			kjb.s_gam = igam;
+			kjb.d_gam = ogam;
+			kjb.gmi = &li.gmi;
+			kjb.src_kbp = 1;
+			kjb.dst_kbp = 1;
+			kjb.cmymap = li.cmyhack;
+			kjb.rel_oride = li.rel_oride;
+			kjb.mapres = mapres;
+			kjb.map = NULL;
+			if ((kth = new_athread(gmap_worker, (void *)&kjb)) == NULL)
+				error("Failed to create gamut mapping thread");
 			if (li.verb)
-				printf(" Creating K only black to K only black Gamut match\n");
+				printf(" (Creating K only black to K only black Gamut match in parallel)\n");
+		}
 
-			li.Kmap = new_gammap(li.verb, csgam, igam, ogam, &li.gmi,
-			                    1, 1, li.cmyhack, li.rel_oride,
+		if (li.map == NULL) {
+			li.map = new_gammap(li.verb, csgam, igam, ogam, &li.gmi,
+			                    li.src_kbp, li.dst_kbp, li.cmyhack, li.rel_oride,
 			                    mapres, NULL, NULL, li.gamdiag ? "gammap.wrl" : NULL
 			);
+			if (li.map == NULL)
+				error ("Failed to make gamut map transform");
+			if (gc != NULL && gc->put_gammap(gc, mkey, li.map))
+				warning("Failed to save gamut map to the gamut cache");
+		}
+
+		if (li.nhack == 2 && li.Kmap == NULL) {
+			if (kth != NULL) {
+				kth->wait(kth);
+				kth->del(kth);
+				li.Kmap = kjb.map;
+			} else {
+				if (li.verb)
+					printf(" Creating K only black to K only black Gamut match\n");
+
+				li.Kmap = new_gammap(li.verb, csgam, igam, ogam, &li.gmi,
+				                    1, 1, li.cmyhack, li.rel_oride,
+				                    mapres, NULL, NULL, li.gamdiag ? "gammap.wrl" : NULL
+				);
+			}
 			if (li.Kmap == NULL)
 				error ("Failed to make K only gamut map transform");
+			if (gc != NULL && gc->put_gammap(gc, kmkey, li.Kmap))
+				warning("Failed to save K only gamut map to the gamut cache");
 		}
 
 		ogam->del(ogam);
@@ -2507,6 +2727,10 @@ main(int argc, char *argv[]) {
 			igam->del(igam);
 		csgam->del(csgam);
 	}
+	if (gc != NULL) {
+		gc->del(gc);
+		gc = NULL;
+	}
 
 	/* If we've got a request for Absolute Appearance mode with scaling */
 	/* to avoid clipping the source white point, compute the needed XYZ scaling factor. */
@@ -3013,6 +3237,46 @@ main(int argc, char *argv[]) {
 
 
 
+			/* See if the stages in the middle can be fused */
+			fuse_chain(&li);
+			if (li.verb && li.fused)
+				printf("Fusing the matrix profile stages into one matrix\n");
+
+			/* Space the clut grid points to suit the link. The curves go at */
+			/* the end of the input tables, and their inverse at the start */
+			/* of devip_devop(), so they are computed before either uses them. */
+			if (li.adapt) {
+				if (li.fused || li.in.h->colorSpace == icSigLabData
+				 || li.in.h->colorSpace == icSigXYZData) {
+					if (li.verb)
+						printf("Not adapting the clut grid spacing to a linear or PCS input link\n");
+				} else {
+					double min[MAX_CHAN], max[MAX_CHAN];
+					int sverb = li.verb, wphacked = li.wphacked;
+					adapt_cntx cx;
+
+					if (li.verb)
+						printf("Adapting the clut grid spacing to the link\n");
+					for (i = 0; i < li.in.chan; i++) {
+						min[i] = 0.0;
+						max[i] = 1.0;
+					}
+					cx.p = &li;
+					if ((cx.luo = li.out.x->get_luobj(li.out.x, ICX_CLIP_NEAREST, icmFwd,
+					        icRelativeColorimetric, icSigLabData, icmLuOrdNorm, NULL, NULL)) == NULL)
+						error("get xlookup object failed: %d, %s",li.out.x->errc,li.out.x->err);
+					li.verb = 0;		/* Don't count the probes as progress */
+					/* (The neutral hack needs grid points with equal input values) */
+					if ((li.gcurve = new_gridcurve(li.in.chan, 3, min, max, NULL,
+					        clutPoints, li.nhack == 1 ? GRIDC_COMMON : 0,
+					        (void *)&cx, adapt_func)) == NULL)
+						error("Creating clut grid spacing curves failed");
+					cx.luo->del(cx.luo);
+					li.verb = sverb;
+					li.wphacked = wphacked;
+				}
+			}
+
 			if (li.verb)
 				printf("Filling in Lut table\n");
 #ifdef DEBUG_ONE
@@ -3083,6 +3347,10 @@ main(int argc, char *argv[]) {
 
 #endif	/* !DEBUG_ONE */
 
+			if (li.gcurve != NULL) {
+				li.gcurve->del(li.gcurve);
+				li.gcurve = NULL;
+			}
 		}
 
 		if (li.verb && li.wphack && li.wphacked == 0)
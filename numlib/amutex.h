@@ -0,0 +1,46 @@
+#ifndef AMUTEX_H
+#define AMUTEX_H
+
+/*
+ * A simple mutex, for protecting state shared between threads.
+ *
+ * Author: agent <agent@local>
+ * Date:   18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/* amutex_static() declares one that is ready to use, others need */
+/* amutex_init() before use and amutex_del() afterwards. */
+
+#if defined(NT)
+
+#include <windows.h>
+
+/* There is no documented static initializer for a CRITICAL_SECTION. */
+/* This is the state InitializeCriticalSection() leaves one in, apart */
+/* from the optional debug information: DebugInfo, LockCount, */
+/* RecursionCount, OwningThread, LockSemaphore, SpinCount. */
+/* The semaphore is created on first contention. */
+# define amutex CRITICAL_SECTION
+# define amutex_static(lock) CRITICAL_SECTION lock = { NULL, -1, 0, NULL, NULL, 0 }
+# define amutex_init(lock) InitializeCriticalSection(&(lock))
+# define amutex_del(lock) DeleteCriticalSection(&(lock))
+# define amutex_lock(lock) EnterCriticalSection(&(lock))
+# define amutex_unlock(lock) LeaveCriticalSection(&(lock))
+
+#else	/* !NT */
+
+#include <pthread.h>
+
+# define amutex pthread_mutex_t
+# define amutex_static(lock) pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER
+# define amutex_init(lock) pthread_mutex_init(&(lock), NULL)
+# define amutex_del(lock) pthread_mutex_destroy(&(lock))
+# define amutex_lock(lock) pthread_mutex_lock(&(lock))
+# define amutex_unlock(lock) pthread_mutex_unlock(&(lock))
+
+#endif	/* !NT */
+
+#endif /* AMUTEX_H */
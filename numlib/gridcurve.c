@@ -0,0 +1,271 @@
+
+/*
+ * Interpolation grid spacing curves
+ *
+ * Author:  agent <agent@local>
+ * Date:    18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * The error of linearly interpolating over a cell of width w is about
+ * w^2 * |f''| / 8, so making the grid point density proportional to
+ * sqrt(|f''|) makes the error the same in every cell. The density is
+ * smoothed, and mixed with a uniform density so that the grid isn't
+ * starved anywhere the samples happened to miss some curvature.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include "numsup.h"
+#include "sobol.h"
+#include "gridcurve.h"
+
+#define GRIDC_NLINES 32		/* Number of sample lines along each channel */
+#define GRIDC_UNIF 0.5		/* Proportion of uniform density mixed in */
+#define GRIDC_SMOOTH 2		/* Number of density smoothing passes */
+
+/* Lookup v in the piecewise linear curve x[n] -> y[n] */
+static double gc_interp(double *x, double *y, int n, double v) {
+	int lo, hi, mid;
+	double t;
+
+	if (v <= x[0] || v >= x[n-1])
+		return v;
+
+	for (lo = 0, hi = n-1; (hi - lo) > 1;) {
+		mid = (lo + hi)/2;
+		if (v >= x[mid])
+			lo = mid;
+		else
+			hi = mid;
+	}
+	t = (v - x[lo])/(x[hi] - x[lo]);
+	return y[lo] + t * (y[hi] - y[lo]);
+}
+
+static void gc_fwd(gridcurve *s, double *out, double *in) {
+	int e;
+
+	for (e = 0; e < s->di; e++)
+		out[e] = gc_interp(s->x[e], s->y[e], s->n[e], in[e]);
+}
+
+static void gc_bwd(gridcurve *s, double *out, double *in) {
+	int e;
+
+	for (e = 0; e < s->di; e++)
+		out[e] = gc_interp(s->y[e], s->x[e], s->n[e], in[e]);
+}
+
+static void gc_del(gridcurve *s) {
+	int e;
+
+	if (s != NULL) {
+		for (e = 0; e < s->di; e++) {
+			free(s->x[e]);
+			free(s->y[e]);
+		}
+		free(s->x);
+		free(s->y);
+		free(s->n);
+		free(s);
+	}
+}
+
+/* Turn the curvature estimates cv[ns] into the curve for channel e */
+static void gc_mkcurve(gridcurve *s, int e, double *cv, int ns,
+                       double min, double max, double *pivot) {
+	double *dn, *tt, *x, *y;
+	double sum, py;
+	int k, j, np = ns - 1;		/* Number of sample intervals */
+
+	if ((dn = (double *)malloc(sizeof(double) * np)) == NULL)
+		error("gridcurve: malloc failed");
+	if ((tt = (double *)malloc(sizeof(double) * np)) == NULL)
+		error("gridcurve: malloc failed");
+	if ((x = (double *)malloc(sizeof(double) * (ns + 1))) == NULL)
+		error("gridcurve: malloc failed");
+	if ((y = (double *)malloc(sizeof(double) * (ns + 1))) == NULL)
+		error("gridcurve: malloc failed");
+
+	/* Density of each interval */
+	for (k = 0; k < np; k++)
+		dn[k] = sqrt(0.5 * (cv[k] + cv[k+1]));
+
+	for (j = 0; j < GRIDC_SMOOTH; j++) {
+		for (k = 0; k < np; k++) {
+			int k0 = k > 0 ? k-1 : 0;
+			int k1 = k < (np-1) ? k+1 : np-1;
+			tt[k] = 0.25 * (dn[k0] + 2.0 * dn[k] + dn[k1]);
+		}
+		for (k = 0; k < np; k++)
+			dn[k] = tt[k];
+	}
+
+	for (sum = 0.0, k = 0; k < np; k++)
+		sum += dn[k];
+	for (k = 0; k < np; k++) {
+		if (sum > 0.0)
+			dn[k] = GRIDC_UNIF + (1.0 - GRIDC_UNIF) * dn[k] * np/sum;
+		else
+			dn[k] = 1.0;
+	}
+
+	/* Integrate it */
+	x[0] = 0.0;
+	y[0] = 0.0;
+	for (k = 0; k < np; k++) {
+		x[k+1] = (k + 1.0)/np;
+		y[k+1] = y[k] + dn[k];
+	}
+	for (k = 0; k <= np; k++)
+		y[k] /= y[np];
+	x[np] = y[np] = 1.0;
+
+	/* Insert a breakpoint at the pivot, and scale each */
+	/* side so that it maps to itself. */
+	if (pivot != NULL && pivot[e] > min && pivot[e] < max) {
+		double px = (pivot[e] - min)/(max - min);
+
+		py = gc_interp(x, y, ns, px);
+		for (k = 0; k < ns && x[k] < px; k++)
+			;
+		if (x[k] != px) {
+			for (j = ns; j > k; j--) {
+				x[j] = x[j-1];
+				y[j] = y[j-1];
+			}
+			x[k] = px;
+			y[k] = py;
+			ns++;
+		}
+		for (j = 0; j < ns; j++) {
+			if (x[j] <= px)
+				y[j] *= px/py;
+			else
+				y[j] = px + (y[j] - py) * (1.0 - px)/(1.0 - py);
+		}
+		y[k] = px;
+	}
+
+	for (k = 0; k < ns; k++) {
+		x[k] = min + x[k] * (max - min);
+		y[k] = min + y[k] * (max - min);
+	}
+	y[0] = x[0] = min;
+	y[ns-1] = x[ns-1] = max;
+
+	s->x[e] = x;
+	s->y[e] = y;
+	s->n[e] = ns;
+	free(tt);
+	free(dn);
+}
+
+/* Create the curves for the di input, fdi output function func() */
+/* over the range min[] to max[], for a grid of resolution gres. */
+/* If pivot[] is not NULL, then each pivot[] value that lies within */
+/* its channels range will map to itself, so that a grid point at */
+/* that value stays there. Return NULL on error. */
+gridcurve *new_gridcurve(int di, int fdi, double *min, double *max, double *pivot,
+                         int gres, int flags, void *cntx,
+                         void (*func)(void *cntx, double *out, double *in)) {
+	gridcurve *s;
+	sobol *so = NULL;
+	int ns, nl;				/* Number of samples along each line, number of lines */
+	double *cv, *ov, *in, *pv;
+	int e, f, j, k, l;
+
+	if (di < 1 || fdi < 1 || gres < 2)
+		return NULL;
+
+	if ((s = (gridcurve *)calloc(1, sizeof(gridcurve))) == NULL)
+		error("gridcurve: calloc failed");
+	s->di = di;
+	if ((s->n = (int *)calloc(di, sizeof(int))) == NULL
+	 || (s->x = (double **)calloc(di, sizeof(double *))) == NULL
+	 || (s->y = (double **)calloc(di, sizeof(double *))) == NULL)
+		error("gridcurve: calloc failed");
+
+	s->fwd = gc_fwd;
+	s->bwd = gc_bwd;
+	s->del = gc_del;
+
+	ns = 2 * (gres - 1) + 1;
+	if (ns < 9)
+		ns = 9;
+	nl = di > 1 ? GRIDC_NLINES : 1;
+
+	if ((cv = (double *)calloc(di * ns, sizeof(double))) == NULL)
+		error("gridcurve: malloc failed");
+	if ((ov = (double *)malloc(sizeof(double) * ns * fdi)) == NULL)
+		error("gridcurve: malloc failed");
+	if ((in = (double *)malloc(sizeof(double) * di)) == NULL)
+		error("gridcurve: malloc failed");
+	if ((pv = (double *)malloc(sizeof(double) * di)) == NULL)
+		error("gridcurve: malloc failed");
+
+	if (di > 1 && (so = new_sobol(di - 1)) == NULL) {
+		free(pv); free(in); free(ov); free(cv);
+		gc_del(s);
+		return NULL;
+	}
+
+	/* Sum the second difference magnitudes along each channel */
+	for (l = 0; l < nl; l++) {
+		if (so != NULL)
+			so->next(so, pv);
+
+		for (e = 0; e < di; e++) {
+			double *cve = cv + e * ns;
+
+			for (j = f = 0; j < di; j++) {
+				if (j != e) {
+					in[j] = min[j] + pv[f] * (max[j] - min[j]);
+					f++;
+				}
+			}
+			for (k = 0; k < ns; k++) {
+				in[e] = min[e] + k/(ns - 1.0) * (max[e] - min[e]);
+				func(cntx, ov + k * fdi, in);
+			}
+			for (k = 1; k < (ns-1); k++) {
+				double tt, dd = 0.0;
+				for (f = 0; f < fdi; f++) {
+					tt = ov[(k-1) * fdi + f] - 2.0 * ov[k * fdi + f] + ov[(k+1) * fdi + f];
+					dd += tt * tt;
+				}
+				cve[k] += sqrt(dd);
+			}
+		}
+	}
+
+	if (flags & GRIDC_COMMON) {
+		for (e = 1; e < di; e++) {
+			for (k = 0; k < ns; k++)
+				cv[k] += cv[e * ns + k];
+		}
+	}
+
+	for (e = 0; e < di; e++) {
+		double *cve = cv + e * ns;
+
+		if (flags & GRIDC_COMMON)
+			cve = cv;
+		cve[0] = cve[1];
+		cve[ns-1] = cve[ns-2];
+		gc_mkcurve(s, e, cve, ns, min[e], max[e], pivot);
+	}
+
+	if (so != NULL)
+		so->del(so);
+	free(pv);
+	free(in);
+	free(ov);
+	free(cv);
+
+	return s;
+}
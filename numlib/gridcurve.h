@@ -0,0 +1,73 @@
+#ifndef GRIDCURVE_H
+#define GRIDCURVE_H
+
+/*
+ * Interpolation grid spacing curves
+ *
+ * Author:  agent <agent@local>
+ * Date:    18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * Given a function that is going to be sampled on a regular grid and
+ * then multi-linearly interpolated, this computes a monotonic curve
+ * for each input channel that equalises the interpolation error
+ * along that channel. If the grid is indexed by fwd(input), then the
+ * grid points will be closer together in input space where the function
+ * is more curved, and further apart where it is nearly linear.
+ *
+ * The function is sampled along lines in the direction of each
+ * channel, at Sobol sub-random positions of the other channels,
+ * and the second difference along each line is used as an estimate
+ * of the local interpolation error. The curves are piecewise linear,
+ * and map min[] to min[] and max[] to max[], with values outside
+ * that range passed through unchanged.
+ */
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/* Flags */
+#define GRIDC_COMMON 0x1	/* Use the same curve for every channel */
+
+/* Object definition */
+struct _gridcurve {
+	/* Private: */
+	int di;				/* Number of channels */
+	int *n;				/* [di] Number of breakpoints in each curve */
+	double **x;			/* [di][n] Breakpoint input values */
+	double **y;			/* [di][n] Breakpoint output values */
+
+	/* Public: */
+	/* Methods */
+
+	/* Apply the curves, input value to grid index value */
+	void (*fwd)(struct _gridcurve *s, double *out, double *in);
+
+	/* Apply the inverse curves, grid index value to input value */
+	void (*bwd)(struct _gridcurve *s, double *out, double *in);
+
+	/* We're done with the object */
+	void (*del)(struct _gridcurve *s);
+
+}; typedef struct _gridcurve gridcurve;
+
+/* Create the curves for the di input, fdi output function func() */
+/* over the range min[] to max[], for a grid of resolution gres. */
+/* If pivot[] is not NULL, then each pivot[] value that lies within */
+/* its channels range will map to itself, so that a grid point at */
+/* that value stays there. func() is called at most di * 32 * (2 * gres - 1) */
+/* times. Return NULL on error. */
+gridcurve *new_gridcurve(int di, int fdi, double *min, double *max, double *pivot,
+                         int gres, int flags, void *cntx,
+                         void (*func)(void *cntx, double *out, double *in));
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif /* GRIDCURVE_H */
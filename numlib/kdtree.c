@@ -0,0 +1,137 @@
+
+/*
+ * Incremental k-d tree nearest neighbour index
+ *
+ * Author:  agent <agent@local>
+ * Date:    18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+#include <stdlib.h>
+#include "numsup.h"
+#include "kdtree.h"
+
+static void kd_add(kdtree *s, double *p, int ix) {
+	int di = s->di;
+	int e, n, c, ax = 0;
+	double *np;
+
+	if (s->np >= s->_np) {
+		s->_np = 2 * s->_np + 64;
+		if ((s->nodes = (kdnode *)realloc(s->nodes, sizeof(kdnode) * s->_np)) == NULL
+		 || (s->pts = (double *)realloc(s->pts, sizeof(double) * s->_np * di)) == NULL)
+			error("kdtree: realloc failed");
+	}
+
+	np = s->pts + s->np * di;
+	for (e = 0; e < di; e++)
+		np[e] = p[e];
+
+	/* Descend to the leaf it belongs under */
+	if (s->np > 0) {
+		for (n = 0;;) {
+			kdnode *nd = &s->nodes[n];
+
+			c = p[nd->ax] >= s->pts[n * di + nd->ax];
+			if (nd->ch[c] < 0) {
+				nd->ch[c] = s->np;
+				ax = nd->ax + 1;
+				if (ax >= di)
+					ax = 0;
+				break;
+			}
+			n = nd->ch[c];
+		}
+	}
+
+	s->nodes[s->np].ix = ix;
+	s->nodes[s->np].ax = ax;
+	s->nodes[s->np].ch[0] = s->nodes[s->np].ch[1] = -1;
+	s->np++;
+}
+
+/* Search the sub-tree at node n, updating the best squared */
+/* distance *bdist and its node *bn. */
+static void kd_search(kdtree *s, int n, double *q, double *bdist, int *bn) {
+	int di = s->di;
+
+	while (n >= 0) {
+		kdnode *nd = &s->nodes[n];
+		double *pp = s->pts + n * di;
+		double tt, dd = 0.0;
+		int e, c;
+
+		for (e = 0; e < di; e++) {
+			tt = pp[e] - q[e];
+			dd += tt * tt;
+		}
+		if (dd < *bdist) {
+			*bdist = dd;
+			*bn = n;
+		}
+
+		/* Search the side q is on first, then the other side */
+		/* only if it could hold a closer point. */
+		tt = q[nd->ax] - pp[nd->ax];
+		c = tt >= 0.0;
+		if (nd->ch[c] >= 0)
+			kd_search(s, nd->ch[c], q, bdist, bn);
+		if ((tt * tt) >= *bdist)
+			break;
+		n = nd->ch[c ^ 1];
+	}
+}
+
+static int kd_nearest(kdtree *s, double *dist, double *q) {
+	double bdist = 1e300;
+	int bn = -1;
+
+	if (s->np > 0)
+		kd_search(s, 0, q, &bdist, &bn);
+	if (dist != NULL)
+		*dist = bdist;
+	if (bn < 0)
+		return -1;
+	return s->nodes[bn].ix;
+}
+
+static int kd_count(kdtree *s) {
+	return s->np;
+}
+
+static void kd_del(kdtree *s) {
+	if (s != NULL) {
+		free(s->nodes);
+		free(s->pts);
+		free(s);
+	}
+}
+
+/* Create an empty di dimensional tree, with room for at */
+/* least inp points before it needs to grow. */
+kdtree *new_kdtree(int di, int inp) {
+	kdtree *s;
+
+	if (di < 1)
+		error("kdtree: bad dimensionality %d",di);
+
+	if ((s = (kdtree *)calloc(1, sizeof(kdtree))) == NULL)
+		error("kdtree: calloc failed");
+
+	s->di = di;
+	if (inp > 0) {
+		s->_np = inp;
+		if ((s->nodes = (kdnode *)malloc(sizeof(kdnode) * s->_np)) == NULL
+		 || (s->pts = (double *)malloc(sizeof(double) * s->_np * di)) == NULL)
+			error("kdtree: malloc failed");
+	}
+
+	s->add = kd_add;
+	s->nearest = kd_nearest;
+	s->count = kd_count;
+	s->del = kd_del;
+
+	return s;
+}
@@ -0,0 +1,67 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+
+/*
+ * Incremental k-d tree nearest neighbour index
+ *
+ * Author:  agent <agent@local>
+ * Date:    18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * Points can be added at any time, and each one becomes a leaf
+ * of the tree, splitting on the axis given by its depth. This is
+ * not rebalanced, so it works best when the points are added in
+ * a well spread (ie. not sorted) order, such as that of a set of
+ * test points being generated to fill a space.
+ */
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/* A tree node. The point it holds splits its children */
+typedef struct {
+	int ix;				/* Callers index for this point */
+	int ax;				/* Axis this node splits */
+	int ch[2];			/* Index of node below [0] and above [1], -1 if none */
+} kdnode;
+
+/* Object definition */
+struct _kdtree {
+	/* Private: */
+	int di;				/* Dimensionality */
+	int np, _np;		/* Number of points, allocated number */
+	kdnode *nodes;		/* [_np] Nodes, first is the root */
+	double *pts;		/* [_np * di] Point coordinates */
+
+	/* Public: */
+	/* Methods */
+
+	/* Add a point, with an index the caller can identify it by */
+	void (*add)(struct _kdtree *s, double *p, int ix);
+
+	/* Return the callers index of the point closest to q[], */
+	/* and its squared distance in *dist. Return -1 if empty. */
+	int (*nearest)(struct _kdtree *s, double *dist, double *q);
+
+	/* Return the number of points */
+	int (*count)(struct _kdtree *s);
+
+	/* We're done with the object */
+	void (*del)(struct _kdtree *s);
+
+}; typedef struct _kdtree kdtree;
+
+/* Create an empty di dimensional tree, with room for at */
+/* least inp points before it needs to grow. */
+kdtree *new_kdtree(int di, int inp);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif /* KDTREE_H */
@@ -0,0 +1,110 @@
+
+/* Test the k-d tree nearest neighbour index */
+/* against a brute force search. */
+/*
+ * Author: agent <agent@local>
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "numlib.h"
+
+#define MXDI 4			/* Maximum dimensionality tested */
+#define NPTS 2000		/* Number of points added */
+#define NQRY 500		/* Number of queries after each batch of points */
+
+int main() {
+	double pts[NPTS][MXDI];
+	int di, i, j, k, e;
+	int fail = 0;
+
+	printf("Starting k-d tree test\n");
+
+	for (di = 1; di <= MXDI; di++) {
+		kdtree *t;
+		double q[MXDI], dist;
+
+		if ((t = new_kdtree(di, 10)) == NULL) {
+			printf("new_kdtree failed\n");
+			exit(1);
+		}
+
+		if (t->nearest(t, &dist, q) != -1) {
+			printf("Dim %d empty tree didn't return -1\n",di);
+			fail = 1;
+		}
+
+		/* Add the points in batches, with some exact duplicates, */
+		/* and check queries against a brute force search after each batch. */
+		for (i = 0; i < NPTS;) {
+			int ne = i + NPTS/8;
+
+			for (; i < ne; i++) {
+				if (i > 0 && (i % 97) == 0) {
+					for (e = 0; e < di; e++)
+						pts[i][e] = pts[i/2][e];
+				} else {
+					for (e = 0; e < di; e++)
+						pts[i][e] = d_rand(-1.0, 1.0);
+				}
+				t->add(t, pts[i], i);
+			}
+
+			if (t->count(t) != i) {
+				printf("Dim %d count is %d, expected %d\n",di,t->count(t),i);
+				fail = 1;
+			}
+
+			for (k = 0; k < NQRY; k++) {
+				double bdist = 1e300;
+				int ix;
+
+				for (e = 0; e < di; e++)
+					q[e] = d_rand(-1.2, 1.2);
+
+				for (j = 0; j < i; j++) {
+					double dd, tt;
+					for (dd = 0.0, e = 0; e < di; e++) {
+						tt = q[e] - pts[j][e];
+						dd += tt * tt;
+					}
+					if (dd < bdist)
+						bdist = dd;
+				}
+
+				/* Ties may return any of the closest points */
+				ix = t->nearest(t, &dist, q);
+				if (ix < 0 || ix >= i || dist != bdist) {
+					printf("Dim %d, %d points, nearest returned %d dist %f, expected dist %f\n",
+					        di,i,ix,dist,bdist);
+					fail = 1;
+					break;
+				}
+			}
+		}
+
+		/* A point in the tree should find itself, or a duplicate */
+		for (i = 0; i < NPTS; i++) {
+			int ix = t->nearest(t, &dist, pts[i]);
+			if (ix < 0 || dist != 0.0) {
+				printf("Dim %d, point %d not found, got %d dist %f\n",di,i,ix,dist);
+				fail = 1;
+				break;
+			}
+		}
+
+		t->del(t);
+	}
+
+	if (fail) {
+		printf("k-d tree test FAILED\n");
+		return 1;
+	} else {
+		printf("k-d tree test done OK\n");
+		return 0;
+	}
+}
+
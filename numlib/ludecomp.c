@@ -21,6 +21,194 @@
 #undef DO_POLISH
 #undef DO_CHECK
 
+/* Fixed size versions of lu_decomp() and lu_backsub() for the common */
+/* small cases. These do exactly the same operations in the same order */
+/* (and so give identical results), but are unrolled and keep all their */
+/* temporaries on the stack. */
+
+/* Track the largest absolute value in a row */
+#define LU_MAXABS(v) if ((t = fabs(v)) > big) big = t;
+
+/* Record the implicit scaling of row i */
+#define LU_RSCALE(i) \
+	if (fabs(big) <= DBL_MIN) \
+		return 1; \
+	rscale[i] = 1.0/big;
+
+/* Consider row i as the pivot for column j */
+#define LU_CAND(i, j) \
+	if ((t = rscale[i] * fabs(a[i][j])) >= big) { \
+		big = t; \
+		bigi = i; \
+	}
+
+/* Interchange rows to use the chosen pivot for column j */
+#define LU_PIVOT(j) \
+	if (j != bigi) { \
+		double *tp; \
+		tp = a[bigi]; \
+		a[bigi] = a[j]; \
+		a[j] = tp; \
+		*rip = -(*rip); \
+		rscale[bigi] = rscale[j]; \
+	} \
+	pivx[j] = bigi; \
+	if (fabs(a[j][j]) <= DBL_MIN) \
+		return 1;
+
+static int lu_decomp3(double **a, int *pivx, double *rip) {
+	double rscale[3], big, t, s;
+	int bigi;
+
+	big = 0.0; LU_MAXABS(a[0][0]) LU_MAXABS(a[0][1]) LU_MAXABS(a[0][2]) LU_RSCALE(0)
+	big = 0.0; LU_MAXABS(a[1][0]) LU_MAXABS(a[1][1]) LU_MAXABS(a[1][2]) LU_RSCALE(1)
+	big = 0.0; LU_MAXABS(a[2][0]) LU_MAXABS(a[2][1]) LU_MAXABS(a[2][2]) LU_RSCALE(2)
+	*rip = 1.0;
+
+	/* Column 0 */
+	big = 0.0; bigi = 0;
+	LU_CAND(0, 0) LU_CAND(1, 0) LU_CAND(2, 0)
+	LU_PIVOT(0)
+	t = 1.0/a[0][0];
+	a[1][0] *= t;
+	a[2][0] *= t;
+
+	/* Column 1 */
+	a[1][1] -= a[1][0] * a[0][1];
+	a[2][1] -= a[2][0] * a[0][1];
+	big = 0.0; bigi = 0;
+	LU_CAND(1, 1) LU_CAND(2, 1)
+	LU_PIVOT(1)
+	t = 1.0/a[1][1];
+	a[2][1] *= t;
+
+	/* Column 2 */
+	a[1][2] -= a[1][0] * a[0][2];
+	s = a[2][2] - a[2][0] * a[0][2];
+	a[2][2] = s - a[2][1] * a[1][2];
+	big = 0.0; bigi = 0;
+	LU_CAND(2, 2)
+	LU_PIVOT(2)
+
+	return 0;
+}
+
+static int lu_decomp4(double **a, int *pivx, double *rip) {
+	double rscale[4], big, t, s;
+	int bigi;
+
+	big = 0.0; LU_MAXABS(a[0][0]) LU_MAXABS(a[0][1]) LU_MAXABS(a[0][2]) LU_MAXABS(a[0][3])
+	LU_RSCALE(0)
+	big = 0.0; LU_MAXABS(a[1][0]) LU_MAXABS(a[1][1]) LU_MAXABS(a[1][2]) LU_MAXABS(a[1][3])
+	LU_RSCALE(1)
+	big = 0.0; LU_MAXABS(a[2][0]) LU_MAXABS(a[2][1]) LU_MAXABS(a[2][2]) LU_MAXABS(a[2][3])
+	LU_RSCALE(2)
+	big = 0.0; LU_MAXABS(a[3][0]) LU_MAXABS(a[3][1]) LU_MAXABS(a[3][2]) LU_MAXABS(a[3][3])
+	LU_RSCALE(3)
+	*rip = 1.0;
+
+	/* Column 0 */
+	big = 0.0; bigi = 0;
+	LU_CAND(0, 0) LU_CAND(1, 0) LU_CAND(2, 0) LU_CAND(3, 0)
+	LU_PIVOT(0)
+	t = 1.0/a[0][0];
+	a[1][0] *= t;
+	a[2][0] *= t;
+	a[3][0] *= t;
+
+	/* Column 1 */
+	a[1][1] -= a[1][0] * a[0][1];
+	a[2][1] -= a[2][0] * a[0][1];
+	a[3][1] -= a[3][0] * a[0][1];
+	big = 0.0; bigi = 0;
+	LU_CAND(1, 1) LU_CAND(2, 1) LU_CAND(3, 1)
+	LU_PIVOT(1)
+	t = 1.0/a[1][1];
+	a[2][1] *= t;
+	a[3][1] *= t;
+
+	/* Column 2 */
+	a[1][2] -= a[1][0] * a[0][2];
+	s = a[2][2] - a[2][0] * a[0][2];
+	a[2][2] = s - a[2][1] * a[1][2];
+	s = a[3][2] - a[3][0] * a[0][2];
+	a[3][2] = s - a[3][1] * a[1][2];
+	big = 0.0; bigi = 0;
+	LU_CAND(2, 2) LU_CAND(3, 2)
+	LU_PIVOT(2)
+	t = 1.0/a[2][2];
+	a[3][2] *= t;
+
+	/* Column 3 */
+	a[1][3] -= a[1][0] * a[0][3];
+	s = a[2][3] - a[2][0] * a[0][3];
+	a[2][3] = s - a[2][1] * a[1][3];
+	s = a[3][3] - a[3][0] * a[0][3];
+	s -= a[3][1] * a[1][3];
+	a[3][3] = s - a[3][2] * a[2][3];
+	big = 0.0; bigi = 0;
+	LU_CAND(3, 3)
+	LU_PIVOT(3)
+
+	return 0;
+}
+
+#undef LU_MAXABS
+#undef LU_RSCALE
+#undef LU_CAND
+#undef LU_PIVOT
+
+/* Forward substitution, undoing the pivoting on the fly */
+#define LU_FWDSUB(N) \
+	for (nvi = -1, i = 0; i < N; i++) { \
+		int px; \
+		px = pivx[i]; \
+		s = b[px]; \
+		b[px] = b[i]; \
+		if (nvi >= 0) { \
+			for (j = nvi; j < i; j++) \
+				s -= a[i][j] * b[j]; \
+		} else { \
+			if (s != 0.0) \
+				nvi = i; \
+		} \
+		b[i] = s; \
+	}
+
+static void lu_backsub3(double **a, int *pivx, double *b) {
+	int i, j, nvi;
+	double s;
+
+	LU_FWDSUB(3)
+
+	b[2] = b[2]/a[2][2];
+	s = b[1] - a[1][2] * b[2];
+	b[1] = s/a[1][1];
+	s = b[0] - a[0][1] * b[1];
+	s -= a[0][2] * b[2];
+	b[0] = s/a[0][0];
+}
+
+static void lu_backsub4(double **a, int *pivx, double *b) {
+	int i, j, nvi;
+	double s;
+
+	LU_FWDSUB(4)
+
+	b[3] = b[3]/a[3][3];
+	s = b[2] - a[2][3] * b[3];
+	b[2] = s/a[2][2];
+	s = b[1] - a[1][2] * b[2];
+	s -= a[1][3] * b[3];
+	b[1] = s/a[1][1];
+	s = b[0] - a[0][1] * b[1];
+	s -= a[0][2] * b[2];
+	s -= a[0][3] * b[3];
+	b[0] = s/a[0][0];
+}
+
+#undef LU_FWDSUB
+
 /* Solve the simultaneous linear equations A.X = B */
 /* Return 1 if the matrix is singular, 0 if OK */
 int
@@ -107,6 +295,11 @@ double  *rip	/* Row interchange parity, +/- 1.0, used for determinant */
 	int    i, j;
 	double *rscale, RSCALE[10];		/* Implicit scaling of each row */
 
+	if (n == 3)
+		return lu_decomp3(a, pivx, rip);
+	if (n == 4)
+		return lu_decomp4(a, pivx, rip);
+
 	if (n <= 10)
 		rscale = RSCALE;
 	else
@@ -204,6 +397,15 @@ double  *b		/* Input B[] vecor, return X[] */
 	int i, j;
 	int nvi;		/* When >= 0, indicates non-vanishing B[] index */
 
+	if (n == 3) {
+		lu_backsub3(a, pivx, b);
+		return;
+	}
+	if (n == 4) {
+		lu_backsub4(a, pivx, b);
+		return;
+	}
+
 	/* Forward substitution, undo pivoting on the fly */
 	for (nvi = -1, i = 0; i < n; i++) {
 		int px;
@@ -282,21 +484,27 @@ int      n	/* Dimensionality */
 	int i, j;
 	double rip;		/* Row interchange parity */
 	int *pivx, PIVX[10];
-	double **y;
+	double **y, *YP[10], Y[10][10];
 
-	if (n <= 10)
+	if (n <= 10) {
 		pivx = PIVX;
-	else
+		for (i = 0; i < n; i++)
+			YP[i] = Y[i];
+		y = YP;
+	} else {
 		pivx = ivector(0, n-1);
+		y = dmatrix(0, n-1, 0, n-1);
+	}
 
 	if (lu_decomp(a, n, pivx, &rip)) {
-		if (pivx != PIVX)
+		if (pivx != PIVX) {
 			free_ivector(pivx, 0, n-1);
+			free_dmatrix(y, 0, n-1, 0, n-1);
+		}
 		return 1;
 	}
 
 	/* Copy lu decomp. to y[][] */
-	y = dmatrix(0, n-1, 0, n-1);
 	for (i = 0; i < n; i++) {
 		for (j = 0; j < n; j++) {
 			y[i][j] = a[i][j];
@@ -312,9 +520,10 @@ int      n	/* Dimensionality */
 	}
 
 	/* Clean up */
-	free_dmatrix(y, 0, n-1, 0, n-1);
-	if (pivx != PIVX)
+	if (pivx != PIVX) {
 		free_ivector(pivx, 0, n-1);
+		free_dmatrix(y, 0, n-1, 0, n-1);
+	}
 
 	return 0;
 }
@@ -14,5 +14,7 @@
 #include "rand.h"		/* Random number generators */
 #include "sobol.h"		/* Sub-random vector generators */
 #include "aatree.h"		/* Anderson balanced binary tree */
+#include "kdtree.h"		/* k-d tree nearest neighbour index */
+#include "gridcurve.h"	/* Interpolation grid spacing curves */
 
 #endif /* NUMLIB_H */
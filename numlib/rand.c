@@ -100,9 +100,99 @@ double norm_rand(void) {
 	}
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Counter based random number stream */
+
+/* 32 bit integer hash with good avalanche. */
+/* (It's a bijection, so a stream won't repeat values */
+/* until its counter wraps.) */
+static unsigned int rs_mix(unsigned int x) {
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+/* Value at index ix */
+#define RS_VAL(s, ix) rs_mix(rs_mix((ix) ^ (s)->k0) + (s)->k1)
+
+static unsigned int rs_rand32(rstream *s) {
+	unsigned int rv = RS_VAL(s, s->ctr);
+	s->ctr++;
+	return rv;
+}
+
+static double rs_d_rand(rstream *s, double min, double max) {
+	double tt = rs_rand32(s) / 4294967295.0;
+	return min + (max - min) * tt;
+}
+
+static int rs_i_rand(rstream *s, int min, int max) {
+	double tt = rs_rand32(s) / 4294967295.0;
+	return min + (int)floor(0.5 + ((double)(max - min)) * tt);
+}
+
+/* This uses the Box-Muller transformation, like norm_rand() */
+static double rs_norm_rand(rstream *s) {
+	if (s->r2 == 0) {
+		double v1, v2, t1, t2;
+		do {
+			v1 = rs_d_rand(s, -1.0, 1.0);
+			v2 = rs_d_rand(s, -1.0, 1.0);
+			t1 = v1 * v1 + v2 * v2;
+		} while (t1 == 0.0 || t1 >= 1.0);
+		t2 = sqrt(-2.0 * log(t1)/t1);
+		s->nr2 = v2 * t2;
+		s->r2 = 1;
+		return v1 * t2;
+	} else {
+		s->r2 = 0;
+		return s->nr2;
+	}
+}
 
+/* Since each value only depends on its index, */
+/* the compiler is free to vectorize this loop. */
+static void rs_fill(rstream *s, double *v, int n, double min, double max) {
+	unsigned int ctr = s->ctr;
+	double range = max - min;
+	int i;
 
+	for (i = 0; i < n; i++)
+		v[i] = min + range * (RS_VAL(s, ctr + (unsigned int)i) / 4294967295.0);
+	s->ctr = ctr + (unsigned int)n;
+}
 
+static void rs_seek(rstream *s, unsigned int ix) {
+	s->ctr = ix;
+	s->r2 = 0;
+}
+
+static void rs_del(rstream *s) {
+	if (s != NULL)
+		free(s);
+}
 
+/* Create a stream given a seed and stream number. */
+/* Return NULL on error */
+rstream *new_rstream(unsigned int seed, unsigned int stream) {
+	rstream *s;
 
+	if ((s = (rstream *)calloc(1, sizeof(rstream))) == NULL)
+		return NULL;
 
+	s->k0 = rs_mix(seed ^ 0x9e3779b9);
+	s->k1 = rs_mix(stream + s->k0);
+
+	s->rand32    = rs_rand32;
+	s->d_rand    = rs_d_rand;
+	s->i_rand    = rs_i_rand;
+	s->norm_rand = rs_norm_rand;
+	s->fill      = rs_fill;
+	s->seek      = rs_seek;
+	s->del       = rs_del;
+
+	return s;
+}
@@ -29,6 +29,51 @@ double d_rand(double min, double max);
 /* and an average deviation of 0.564 */
 double norm_rand(void);
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* A counter based pseudo random number stream. Each value is a hash */
+/* of the seed, stream number and its index in the stream, so there is */
+/* no shared state. Threads can each use their own stream number, or */
+/* seek to their own part of a stream, and get reproducible results. */
+struct _rstream {
+	/* Private: */
+	unsigned int k0, k1;	/* Key from seed and stream number */
+	unsigned int ctr;		/* Index of next value */
+	int r2;					/* nz if nr2 is valid */
+	double nr2;				/* Second norm_rand() value */
+
+	/* Public: */
+	/* Methods */
+
+	/* Return a 32 bit number between 0 and 4294967295 */
+	unsigned int (*rand32)(struct _rstream *s);
+
+	/* Return a random double in the range min to max */
+	double (*d_rand)(struct _rstream *s, double min, double max);
+
+	/* Return a random integer in the range min to max inclusive */
+	int (*i_rand)(struct _rstream *s, int min, int max);
+
+	/* Return a random number with a gausian/normal distribution, */
+	/* centered about 0.0, with standard deviation 1.0 */
+	double (*norm_rand)(struct _rstream *s);
+
+	/* Fill v[n] with random doubles in the range min to max. */
+	/* This gives the same values as n calls of d_rand(). */
+	void (*fill)(struct _rstream *s, double *v, int n, double min, double max);
+
+	/* Set the index of the next value in the stream */
+	void (*seek)(struct _rstream *s, unsigned int ix);
+
+	/* We're done with the object */
+	void (*del)(struct _rstream *s);
+
+}; typedef struct _rstream rstream;
+
+/* Create a stream given a seed and stream number. */
+/* Return NULL on error */
+rstream *new_rstream(unsigned int seed, unsigned int stream);
+
 #ifdef __cplusplus
 	}
 #endif
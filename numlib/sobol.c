@@ -124,6 +124,47 @@ static int next_sobol(sobol *s, double * v)
 	return 0;
 }
 
+/* Get the next n sobol vectors */
+/* Return the number returned */
+static int nextn_sobol(sobol *s, double *v, int n) {
+	int k;
+
+	for (k = 0; k < n; k++, v += s->dim) {
+		if (next_sobol(s, v))
+			break;
+	}
+	return k;
+}
+
+/* Skip forward n vectors */
+/* return nz if we've run out */
+static int skip_sobol(sobol *s, unsigned int n)
+{
+	int i, p;
+	unsigned int c, g;
+
+	if (n == 0)
+		return 0;
+
+	c = s->count + n;
+	if (c < s->count || c >= (1u << SOBOL_MAXBIT))
+		return 1;	/* Run out */
+	s->count = c;
+
+	/* After count vectors, lastq[] is the combination of the */
+	/* directions for the bits set in the gray code of count. */
+	g = c ^ (c >> 1);
+	for (i = 0; i < s->dim; i++)
+		s->lastq[i] = 0;
+	for (p = 0; g != 0; p++, g >>= 1) {
+		if (g & 1) {
+			for (i = 0; i < s->dim; i++)
+				s->lastq[i] ^= s->dir[p][i];
+		}
+	}
+	return 0;
+}
+
 /* Free up the object */
 static void del_sobol(sobol *s) {
 	if (s != NULL)
@@ -155,6 +196,8 @@ sobol *new_sobol(int dim) {
 
 	s->dim  = dim;
 	s->next  = next_sobol;
+	s->nextn = nextn_sobol;
+	s->skip  = skip_sobol;
 	s->reset = reset_sobol;
 	s->del   = del_sobol;
 
@@ -24,6 +24,15 @@ struct _sobol {
 	/* Values are between 0.0 and 1.0 */
 	int (*next)(struct _sobol *s, double *v);
 
+	/* Get the next n sobol vectors into v[n * dim], and return */
+	/* the number returned, which is less than n if we've run out. */
+	int (*nextn)(struct _sobol *s, double *v, int n);
+
+	/* Skip forward over n vectors, return nz if we've run out. */
+	/* This lets several threads each generate their own part */
+	/* of the sequence from their own object. */
+	int (*skip)(struct _sobol *s, unsigned int n);
+
 	/* Rest to the begining of the sequence */
 	void (*reset)(struct _sobol *s);
 
@@ -50,6 +50,7 @@
 #include "copyright.h"
 #include "config.h"
 #include "numlib.h"
+#include "conv.h"
 #include "cgats.h"
 #include "xicc.h"
 #include "prof.h"
@@ -81,6 +82,7 @@ void usage(char *diag, ...) {
 	fprintf(stderr," -ni             Don't create input (Device) shaper curves\n");
 	fprintf(stderr," -np             Don't create input (Device) grid position curves\n");
 	fprintf(stderr," -no             Don't create output (PCS) shaper curves\n");
+	fprintf(stderr," -e              Adapt the B2A clut grid spacing to the profile\n");
 	fprintf(stderr," -nc             Don't put the input .ti3 data in the profile\n");
 	fprintf(stderr," -k zhxr         Black value target: z = zero K,\n");
 	fprintf(stderr,"                 h = 0.5 K, x = max K, r = ramp K (def.)\n");
@@ -117,6 +119,7 @@ void usage(char *diag, ...) {
 	fprintf(stderr," -nS             Use colormetric source gamut to make output profile saturation table\n");
 	fprintf(stderr," -g src.gam      Use source image gamut as well for output profile gamut mapping\n");
 	fprintf(stderr," -p absprof      Incorporate abstract profile into output tables\n");
+	fprintf(stderr," -R prev%s     Reuse B2A values of a previous output profile\n",ICC_FILE_EXT);
 	fprintf(stderr," -t intent       Override gamut mapping intent for output profile perceptual table:\n");
 	fprintf(stderr," -T intent       Override gamut mapping intent for output profile saturation table:\n");
 	for (i = 0; ; i++) {
@@ -139,6 +142,7 @@ void usage(char *diag, ...) {
 		fprintf(stderr,"             %s\n",vc.desc);
 	}
 	fprintf(stderr," -P              Create gamut gammap_p.wrl and gammap_s.wrl diagostics\n");
+	fprintf(stderr," -j n            Use up to n threads (default number of processors)\n");
 	fprintf(stderr," -O outputfile   Override the default output filename.\n");
 	fprintf(stderr," inoutfile       Base name for input.ti3/output%s file\n",ICC_FILE_EXT);
 	exit(1);
@@ -151,12 +155,14 @@ int main(int argc, char *argv[]) {
 	clock_t stime, ttime;		/* Start and total times */
 #endif
 	int verb = 0;
+	int nthr = system_ncpus();	/* Number of threads to use */
 	int iquality = 1;			/* A2B quality */
 	int oquality = -1;			/* B2A quality same as A2B */
 	int verify = 0;
 	int noisluts = 0;			/* No input shaper luts */
 	int noipluts = 0;			/* No input position luts */
 	int nooluts = 0;			/* No output shaper luts */
+	int adb2a = 0;				/* Adapt the B2A clut grid spacing */
 	int nocied = 0;				/* No .ti3 CIE data in profile */
 	int noptop = 0;				/* Use colormetric source gamut to make perceptual table */
 	int nostos = 0;				/* Use colormetric source gamut to make saturation table */
@@ -179,6 +185,7 @@ int main(int argc, char *argv[]) {
 	char ipname[MAXNAMEL+1] = "";	/* Input icc profile - enables gamut map */
 	char sgname[MAXNAMEL+1] = "";	/* Image source gamut name */
 	char absname[MAXNAMEL+1] = "";	/* Abstract profile name */
+	char prevname[MAXNAMEL+1] = "";	/* Previous profile to reuse B2A values from */
 	int sepsat = 0;				/* Create separate saturation B2A table */
 	icxViewCond ivc_p;			/* Input Viewing Parameters for CAM */
 	icxViewCond ovc_p;			/* Output Viewing Parameters for CAM (enables CAM clip) */
@@ -345,6 +352,10 @@ int main(int argc, char *argv[]) {
 			else if (argv[fa][1] == 'y' || argv[fa][1] == 'Y')
 				verify = 1;
 
+			/* Adaptive B2A clut grid spacing */
+			else if (argv[fa][1] == 'e' || argv[fa][1] == 'E')
+				adb2a = 1;
+
 			/* Disable input or output luts */
 			else if (argv[fa][1] == 'n' || argv[fa][1] == 'N') {
 				fa = nfa;
@@ -597,6 +608,13 @@ int main(int argc, char *argv[]) {
 				strncpy(absname,na,MAXNAMEL); absname[MAXNAMEL] = '\000';
 			}
 
+			/* Previous profile */
+			else if (argv[fa][1] == 'R') {
+				if (na == NULL) usage("Expected previous profile filename after -R");
+				fa = nfa;
+				strncpy(prevname,na,MAXNAMEL); prevname[MAXNAMEL] = '\000';
+			}
+
 			/* Perceptual Mapping intent override */
 			else if (argv[fa][1] == 't') {
 				fa = nfa;
@@ -682,6 +700,14 @@ int main(int argc, char *argv[]) {
 			else if (argv[fa][1] == 'P')
 				gamdiag = 1;
 
+			/* Number of threads */
+			else if (argv[fa][1] == 'j') {
+				fa = nfa;
+				if (na == NULL) usage("Number of threads (-j) needs an argument");
+				nthr = atoi(na);
+				if (nthr < 1) usage("Number of threads %d is out of range",nthr);
+			}
+
 			/* Output file name */
 			else if (argv[fa][1] == 'O') {
 				fa = nfa;
@@ -874,21 +900,25 @@ int main(int argc, char *argv[]) {
 			error ("Output profile can only be a cLUT algorithm");
 		}
 
-		make_output_icc(ptype, 0, iccver, verb, iquality, oquality,
-		                noisluts, noipluts, nooluts, nocied, noptop, nostos,
+		make_output_icc(ptype, 0, iccver, verb, nthr, iquality, oquality,
+		                noisluts, noipluts, nooluts, adb2a, nocied, noptop, nostos,
 		                gamdiag, verify, &ink, inname, outname, icg, spec,
 		                illum, &cust_illum, observ, fwacomp, smooth, avgdev,
 		                ipname[0] != '\000' ? ipname : NULL,
 		                sgname[0] != '\000' ? sgname : NULL,
 		                absname[0] != '\000' ? absname : NULL,
+		                prevname[0] != '\000' ? prevname : NULL,
 						sepsat, &ivc_p, &ovc_p, ivc_e, ovc_e,
 						&pgmi, &sgmi, &xpi);
 
 	} else if (strcmp(icg->t[0].kdata[ti],"INPUT") == 0) {
 
+		if (prevname[0] != '\000')
+			error ("Reusing the B2A of a previous profile isn't applicable to an input device");
+
 		if (ptype == prof_default)
 			ptype = prof_clutLab;		/* For best possible quality */
-		make_input_icc(ptype, iccver, verb, iquality, oquality, noisluts, noipluts, nooluts, nocied,
+		make_input_icc(ptype, iccver, verb, nthr, iquality, oquality, noisluts, noipluts, nooluts, nocied,
 		               verify, nsabs, iwpscale, doinb2a, inname, outname, icg,
 		               spec, illum, &cust_illum, observ, smooth, avgdev, &xpi);
 
@@ -901,13 +931,14 @@ int main(int argc, char *argv[]) {
 			ptype = prof_clutLab;		/* ?? or should it default to prof_shamat ?? */
 
 		/* If a source gamut is provided for a Display, then a V2.4.0 profile will be created */
-		make_output_icc(ptype, mtxtoo, iccver, verb, iquality, oquality,
-		                noisluts, noipluts, nooluts, nocied, noptop, nostos,
+		make_output_icc(ptype, mtxtoo, iccver, verb, nthr, iquality, oquality,
+		                noisluts, noipluts, nooluts, adb2a, nocied, noptop, nostos,
 		                gamdiag, verify, NULL, inname, outname, icg, spec,
 		                illum, &cust_illum, observ, 0, smooth, avgdev,
 		                ipname[0] != '\000' ? ipname : NULL,
 		                sgname[0] != '\000' ? sgname : NULL,
 		                absname[0] != '\000' ? absname : NULL,
+		                prevname[0] != '\000' ? prevname : NULL,
 						sepsat, &ivc_p, &ovc_p, ivc_e, ovc_e,
 						&pgmi, &sgmi, &xpi);
 
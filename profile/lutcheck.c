@@ -0,0 +1,807 @@
+
+/*
+ * Argyll Color Correction System
+ * Dense clut table accuracy checker.
+ *
+ * Author:  agent <agent@local>
+ * Date:    18/10/2026
+ * Version: 1.00
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+	This program checks how accurately the clut table of a device
+	link, or the B2A table of an output profile, reproduces the
+	colorimetric result it was made to approximate. A large number of
+	quasi-random device values are looked up, on several threads, both
+	through the table the way an application would use it, and
+	through the full precision xicc lookups, and the delta E between
+	the two is accumulated into a histogram and a map of L* by hue.
+
+	For a profile, the device value is converted to PCS through the
+	A2B, then back through the B2A table being checked, and then
+	through the A2B again, so the error is the round trip error
+	(as invprofcheck), but sampled much more densely.
+
+	For a link, the device value is converted to PCS through the source
+	profile, and the result of the link is converted to PCS through the
+	destination profile. Targets that are outside the destination gamut
+	are skipped, or if requested, clipped with an inverse lookup of the
+	destination profile and reported separately, since their error
+	depends on how the link was clipped, rather than on how well its
+	table interpolates. Targets near the gamut surface are tested with
+	an inverse lookup, to tell which side of it they are on.
+	This is only a meaningful check of a colorimetric link, made without
+	gamut mapping or any of the black generation hacks.
+ */
+
+/* TTBD:
+ *
+ *	Could emulate the imdi integer kernels exactly, rather than
+ *	just their input and output quantization.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include "copyright.h"
+#include "config.h"
+#include "numlib.h"
+#include "sobol.h"
+#include "conv.h"
+#include "icc.h"
+#include "xicc.h"
+#include "gamut.h"
+
+#define DEF_NSAMP 1000000		/* Default number of sample points */
+#define CHK_BATCH 4096			/* Sample points per batch */
+#define HIST_RES 0.001			/* Delta E histogram bin width */
+#define HIST_N 50000			/* Number of histogram bins, last one is overflow */
+#define CLIP_RAD 0.9			/* Gamut radius beyond which a link target may be clipped */
+#define OUT_RAD 1.05			/* Gamut radius beyond which a link target is clipped */
+#define HM_LBINS 10				/* Number of heat map L* rows */
+#define HM_HBINS 12				/* Number of heat map hue columns, plus one neutral */
+#define HM_NEUTC 5.0			/* Chroma below which a color is counted as neutral */
+
+void usage(char *diag, ...) {
+	fprintf(stderr,"Check the accuracy of a clut table, Version %s\n",ARGYLL_VERSION_STR);
+	if (diag != NULL) {
+		va_list args;
+		fprintf(stderr,"Diagnostic: ");
+		va_start(args, diag);
+		vfprintf(stderr, diag, args);
+		va_end(args);
+		fprintf(stderr,"\n");
+	}
+	fprintf(stderr,"usage: lutcheck [-options] profile.icm\n");
+	fprintf(stderr,"   or: lutcheck [-options] link.icm inprof.icm outprof.icm\n");
+	fprintf(stderr," -v             Verbose\n");
+	fprintf(stderr," -n nsamp       Number of sample points (default %d)\n",DEF_NSAMP);
+	fprintf(stderr," -i intent      p = perceptual, r = relative colorimetric (def.),\n");
+	fprintf(stderr,"                s = saturation, a = absolute\n");
+	fprintf(stderr," -b bits        Quantize the table input and output to 8 or 16 bits\n");
+	fprintf(stderr," -l tlimit      Set total ink limit, 0 - 400%% (estimate by default)\n");
+	fprintf(stderr," -L klimit      Set black ink limit, 0 - 100%% (estimate by default)\n");
+	fprintf(stderr," -c             Use CIE94 delta E\n");
+	fprintf(stderr," -k             Use CIEDE2000 delta E\n");
+	fprintf(stderr," -m             Show the maximum rather than average delta E heat map\n");
+	fprintf(stderr," -o             Also check link targets outside the destination gamut\n");
+	fprintf(stderr," -t de          Fail if the 99th percentile in gamut delta E exceeds de\n");
+	fprintf(stderr," -j n           Use n threads (default number of processors)\n");
+	fprintf(stderr," profile.icm    Output profile with a B2A table to check\n");
+	fprintf(stderr," link.icm       Device link to check\n");
+	fprintf(stderr," inprof.icm     Source profile the link was made from\n");
+	fprintf(stderr," outprof.icm    Destination profile the link was made from\n");
+	exit(1);
+}
+
+/* Delta E statistics of one class of samples */
+typedef struct {
+	int n;						/* Number of samples */
+	double sum;					/* Sum of delta E */
+	double max;					/* Maximum delta E */
+	double mxin[MAX_CHAN];		/* Device value of the maximum */
+	double mxref[3], mxtst[3];	/* Reference and table PCS of the maximum */
+	unsigned int *hist;			/* [HIST_N] Delta E histogram */
+} ckstats;
+
+/* Heat map of delta E by L* and hue */
+typedef struct {
+	int n[HM_LBINS][HM_HBINS+1];
+	double sum[HM_LBINS][HM_HBINS+1];
+	double max[HM_LBINS][HM_HBINS+1];
+} ckheat;
+
+/* Things that are shared by all the jobs */
+typedef struct {
+	int link;				/* nz if checking a link, else a profile B2A */
+	int din;				/* Sampled device space channels */
+	int tin, tout;			/* Table input and output channels */
+	icxLuBase *sluo;		/* Sampled device space -> PCS */
+	icmLuBase *tluo;		/* Table being checked */
+	icxLuBase *dluo;		/* Table output device space -> PCS */
+	gamut *dgam;			/* Destination gamut if link */
+	int doout;				/* nz to check targets outside the destination gamut */
+	double timin[MAX_CHAN], timax[MAX_CHAN];	/* Table input range */
+	double tomin[MAX_CHAN], tomax[MAX_CHAN];	/* Table output range */
+	double qscale;			/* Quantization scale, 0.0 for none */
+	int detype;				/* 0 = CIE76, 1 = CIE94, 2 = CIEDE2000 */
+	xcal *cal;				/* Sampled device calibration, NULL if none */
+	double tlimit, klimit;	/* Sampled device ink limits, < 0 if none */
+	int kch;				/* Sampled device black channel, -1 if none */
+} ckctx;
+
+/* A thread job to check a consecutive part of the sequence */
+typedef struct {
+	ckctx *x;
+	sobol *so;				/* This jobs Sobol sequence */
+	unsigned int six;		/* Sequence index of the first sample */
+	int n;					/* Number of samples */
+	icxLuBase *iluo;		/* This jobs destination inverse lookup if link */
+	int nrej;				/* Number rejected as over the ink limit */
+	int nout;				/* Number skipped as outside the destination gamut */
+	ckstats st[2];			/* In gamut, clipped */
+	ckheat hm;
+} ckjob;
+
+/* Quantize the v[n] values in the range min[] to max[] */
+static void ck_quant(ckctx *x, double *v, int n, double *min, double *max) {
+	int e;
+
+	if (x->qscale <= 0.0)
+		return;
+	for (e = 0; e < n; e++) {
+		double tt = (v[e] - min[e])/(max[e] - min[e]);
+		if (tt < 0.0)
+			tt = 0.0;
+		else if (tt > 1.0)
+			tt = 1.0;
+		tt = floor(tt * x->qscale + 0.5)/x->qscale;
+		v[e] = min[e] + tt * (max[e] - min[e]);
+	}
+}
+
+/* Return nz if the device value is over the ink limits */
+static int ck_overlimit(ckctx *x, double *dev) {
+	double cdev[MAX_CHAN], sum;
+	int e;
+
+	if (x->tlimit < 0.0 && x->klimit < 0.0)
+		return 0;
+	if (x->cal != NULL)
+		x->cal->interp(x->cal, cdev, dev);
+	else {
+		for (e = 0; e < x->din; e++)
+			cdev[e] = dev[e];
+	}
+	for (sum = 0.0, e = 0; e < x->din; e++)
+		sum += cdev[e];
+	if (x->tlimit >= 0.0 && sum > (x->tlimit + 1e-6))
+		return 1;
+	if (x->klimit >= 0.0 && x->kch >= 0 && cdev[x->kch] > (x->klimit + 1e-6))
+		return 1;
+	return 0;
+}
+
+/* Add a sample to a set of statistics */
+static void ck_add(ckctx *x, ckstats *s, double de, double *in, double *ref, double *tst) {
+	int e, ix;
+
+	s->n++;
+	s->sum += de;
+	if (de > s->max || s->n == 1) {
+		s->max = de;
+		for (e = 0; e < x->din; e++)
+			s->mxin[e] = in[e];
+		for (e = 0; e < 3; e++) {
+			s->mxref[e] = ref[e];
+			s->mxtst[e] = tst[e];
+		}
+	}
+	ix = (int)(de/HIST_RES);
+	if (ix >= HIST_N || ix < 0)
+		ix = HIST_N-1;
+	s->hist[ix]++;
+}
+
+/* Add a sample to the heat map, by the L* and hue of its reference */
+static void ck_heat(ckheat *h, double de, double *ref) {
+	int li, hi;
+	double cc;
+
+	li = (int)(ref[0] * HM_LBINS/100.0);
+	if (li < 0)
+		li = 0;
+	else if (li >= HM_LBINS)
+		li = HM_LBINS-1;
+
+	cc = sqrt(ref[1] * ref[1] + ref[2] * ref[2]);
+	if (cc < HM_NEUTC)
+		hi = 0;
+	else {
+		double hh = atan2(ref[2], ref[1]) * 180.0/3.14159265358979323846;
+		if (hh < 0.0)
+			hh += 360.0;
+		hi = 1 + (int)(hh * HM_HBINS/360.0);
+		if (hi > HM_HBINS)
+			hi = HM_HBINS;
+	}
+	h->n[li][hi]++;
+	h->sum[li][hi] += de;
+	if (de > h->max[li][hi])
+		h->max[li][hi] = de;
+}
+
+static int ck_check(void *cntx, int ix) {
+	ckjob *jb = (ckjob *)cntx + ix;
+	ckctx *x = jb->x;
+	double *sv;						/* Sobol values */
+	double (*samp)[MAX_CHAN];		/* Sampled device values */
+	double (*ref)[3], (*tst)[3];	/* Reference and table PCS values */
+	double *rad;					/* Reference destination gamut radius */
+	int done, nb, ns, i, e;
+
+	if ((sv = (double *)malloc(sizeof(double) * x->din * CHK_BATCH)) == NULL)
+		error("lutcheck: malloc failed");
+	if ((samp = (double (*)[MAX_CHAN])malloc(sizeof(double) * MAX_CHAN * CHK_BATCH)) == NULL)
+		error("lutcheck: malloc failed");
+	if ((ref = (double (*)[3])malloc(sizeof(double) * 3 * CHK_BATCH)) == NULL)
+		error("lutcheck: malloc failed");
+	if ((tst = (double (*)[3])malloc(sizeof(double) * 3 * CHK_BATCH)) == NULL)
+		error("lutcheck: malloc failed");
+	if ((rad = (double *)malloc(sizeof(double) * CHK_BATCH)) == NULL)
+		error("lutcheck: malloc failed");
+
+	jb->so->reset(jb->so);
+	if (jb->so->skip(jb->so, jb->six))
+		jb->n = 0;
+
+	for (done = 0; done < jb->n; done += nb) {
+
+		nb = jb->n - done;
+		if (nb > CHK_BATCH)
+			nb = CHK_BATCH;
+		if ((nb = jb->so->nextn(jb->so, sv, nb)) <= 0)
+			break;
+
+		/* Look each sample up through the table and the reference */
+		for (ns = i = 0; i < nb; i++) {
+			double *dev = sv + i * x->din;
+			double tin[MAX_CHAN], tout[MAX_CHAN];
+
+			if (ck_overlimit(x, dev)) {
+				jb->nrej++;
+				continue;
+			}
+
+			if (x->link) {		/* Device -> link -> device */
+				for (e = 0; e < x->tin; e++)
+					tin[e] = x->timin[e] + dev[e] * (x->timax[e] - x->timin[e]);
+				ck_quant(x, tin, x->tin, x->timin, x->timax);
+				if (x->sluo->lookup(x->sluo, ref[ns], tin) > 1)
+					error("%d, %s",x->sluo->pp->errc,x->sluo->pp->err);
+				for (e = 0; e < x->din; e++)
+					samp[ns][e] = tin[e];
+
+			} else {			/* PCS -> B2A -> device */
+				if (x->sluo->lookup(x->sluo, tin, dev) > 1)
+					error("%d, %s",x->sluo->pp->errc,x->sluo->pp->err);
+				ck_quant(x, tin, x->tin, x->timin, x->timax);
+				for (e = 0; e < 3; e++)
+					ref[ns][e] = tin[e];
+				for (e = 0; e < x->din; e++)
+					samp[ns][e] = dev[e];
+			}
+
+			if (x->tluo->lookup(x->tluo, tout, tin) > 1)
+				error("%d, %s",x->tluo->icp->errc,x->tluo->icp->err);
+			ck_quant(x, tout, x->tout, x->tomin, x->tomax);
+			if (x->dluo->lookup(x->dluo, tst[ns], tout) > 1)
+				error("%d, %s",x->dluo->pp->errc,x->dluo->pp->err);
+			rad[ns] = 0.0;
+			ns++;
+		}
+
+		/* Targets near the surface of the destination gamut are clipped */
+		/* to it by an inverse lookup. */
+		if (x->dgam != NULL && ns > 0)
+			x->dgam->nradials(x->dgam, rad, NULL, ref, ns);
+
+		for (i = 0; i < ns; i++) {
+			int cl = 0;
+			double de;
+
+			if (rad[i] > OUT_RAD && !x->doout) {
+				jb->nout++;
+				continue;
+			}
+			if (rad[i] > CLIP_RAD) {
+				double ddev[MAX_CHAN];
+				int rv;
+
+				if ((rv = jb->iluo->inv_lookup(jb->iluo, ddev, ref[i])) > 1)
+					error("%d, %s",jb->iluo->pp->errc,jb->iluo->pp->err);
+				if (rv & 1) {
+					if (!x->doout) {
+						jb->nout++;
+						continue;
+					}
+					if (x->dluo->lookup(x->dluo, ref[i], ddev) > 1)
+						error("%d, %s",x->dluo->pp->errc,x->dluo->pp->err);
+					cl = 1;
+				}
+			}
+
+			if (x->detype == 2)
+				de = icmCIE2K(ref[i], tst[i]);
+			else if (x->detype == 1)
+				de = icmCIE94(ref[i], tst[i]);
+			else
+				de = icmLabDE(ref[i], tst[i]);
+
+			ck_add(x, &jb->st[cl], de, samp[i], ref[i], tst[i]);
+			if (cl == 0)
+				ck_heat(&jb->hm, de, ref[i]);
+		}
+	}
+
+	free(rad);
+	free(tst);
+	free(ref);
+	free(samp);
+	free(sv);
+	return 0;
+}
+
+/* Merge the statistics s into d */
+static void ck_merge(int din, ckstats *d, ckstats *s) {
+	int e, i;
+
+	if (s->n > 0 && (d->n == 0 || s->max > d->max)) {
+		d->max = s->max;
+		for (e = 0; e < din; e++)
+			d->mxin[e] = s->mxin[e];
+		for (e = 0; e < 3; e++) {
+			d->mxref[e] = s->mxref[e];
+			d->mxtst[e] = s->mxtst[e];
+		}
+	}
+	d->n += s->n;
+	d->sum += s->sum;
+	for (i = 0; i < HIST_N; i++)
+		d->hist[i] += s->hist[i];
+}
+
+/* Return the delta E that the proportion p of the samples are at or below */
+static double ck_pct(ckstats *s, double p) {
+	double tt = 0.0, targ = p * s->n;
+	int i;
+
+	for (i = 0; i < (HIST_N-1); i++) {
+		tt += s->hist[i];
+		if (tt >= targ)
+			break;
+	}
+	if (i >= (HIST_N-1))
+		return s->max;
+	tt = (i + 0.5) * HIST_RES;
+	if (tt > s->max)
+		tt = s->max;
+	return tt;
+}
+
+static void ck_print(char *name, int din, ckstats *s) {
+	int e;
+
+	if (s->n == 0)
+		return;
+	printf("%s %d points, avg. = %f, 50%% = %f, 90%% = %f, 99%% = %f, 99.9%% = %f, max. = %f\n",
+	       name, s->n, s->sum/s->n, ck_pct(s, 0.5), ck_pct(s, 0.9), ck_pct(s, 0.99),
+	       ck_pct(s, 0.999), s->max);
+	printf("  Worst at device");
+	for (e = 0; e < din; e++)
+		printf(" %f",s->mxin[e]);
+	printf(", ref. %f %f %f, table %f %f %f\n",
+	       s->mxref[0], s->mxref[1], s->mxref[2], s->mxtst[0], s->mxtst[1], s->mxtst[2]);
+}
+
+/* Open and read an ICC profile */
+static icc *read_icc(char *name, icmFile **fpp) {
+	icmFile *fp;
+	icc *icco;
+	int rv;
+
+	if ((fp = new_icmFileStd_name(name,"r")) == NULL)
+		error ("Can't open file '%s'",name);
+	if ((icco = new_icc()) == NULL)
+		error ("Creation of ICC object failed");
+	if ((rv = icco->read(icco,fp,0)) != 0)
+		error ("%d, %s",rv,icco->err);
+	*fpp = fp;
+	return icco;
+}
+
+int
+main(int argc, char *argv[]) {
+	int fa, nfa;				/* argument we're looking at */
+	int verb = 0;
+	int nsamp = DEF_NSAMP;
+	icRenderingIntent intent = icRelativeColorimetric;
+	int bits = 0;
+	double tlimit = -1.0, klimit = -1.0;
+	int detype = 0;
+	int showmax = 0;
+	int doout = 0;
+	double thresh = -1.0;
+	int nthr = system_ncpus();	/* Number of threads to use */
+	char *names[3];
+	int nnames;
+	icmFile *fp[3];
+	icc *icco[3];
+	xicc *xicco[3];
+	icxInk ink;
+	ckctx x;
+	ckjob *jbs;
+	ckstats st[2];
+	ckheat *hm;
+	int nrej = 0, nout = 0;
+	icColorSpaceSignature ins, outs;
+	int inn, outn;
+	icmLuAlgType alg;
+	int i, j, k;
+
+	error_program = argv[0];
+
+	if (argc < 2)
+		usage("Too few arguments, got %d expect at least 1",argc-1);
+
+	/* Process the arguments */
+	for(fa = 1;fa < argc;fa++) {
+		nfa = fa;					/* skip to nfa if next argument is used */
+		if (argv[fa][0] == '-')	{	/* Look for any flags */
+			char *na = NULL;		/* next argument after flag, null if none */
+
+			if (argv[fa][2] != '\000')
+				na = &argv[fa][2];		/* next is directly after flag */
+			else {
+				if ((fa+1) < argc) {
+					if (argv[fa+1][0] != '-') {
+						nfa = fa + 1;
+						na = argv[nfa];		/* next is seperate non-flag argument */
+					}
+				}
+			}
+
+			if (argv[fa][1] == '?')
+				usage(NULL);
+
+			else if (argv[fa][1] == 'v' || argv[fa][1] == 'V')
+				verb = 1;
+
+			else if (argv[fa][1] == 'n' || argv[fa][1] == 'N') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -n");
+				nsamp = atoi(na);
+				if (nsamp < 1) usage("Number of samples %d is out of range",nsamp);
+			}
+
+			else if (argv[fa][1] == 'i' || argv[fa][1] == 'I') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -i");
+    			switch (na[0]) {
+					case 'p':
+					case 'P':
+						intent = icPerceptual;
+						break;
+					case 'r':
+					case 'R':
+						intent = icRelativeColorimetric;
+						break;
+					case 's':
+					case 'S':
+						intent = icSaturation;
+						break;
+					case 'a':
+					case 'A':
+						intent = icAbsoluteColorimetric;
+						break;
+					default:
+						usage("Unknown intent '%c'",na[0]);
+				}
+			}
+
+			else if (argv[fa][1] == 'b' || argv[fa][1] == 'B') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -b");
+				bits = atoi(na);
+				if (bits != 8 && bits != 16) usage("Quantization bits %d must be 8 or 16",bits);
+			}
+
+			else if (argv[fa][1] == 'l') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -l");
+				tlimit = atoi(na)/100.0;
+				if (tlimit < 0.01) tlimit = 0.01;
+			}
+
+			else if (argv[fa][1] == 'L') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -L");
+				klimit = atoi(na)/100.0;
+				if (klimit < 0.01) klimit = 0.01;
+			}
+
+			else if (argv[fa][1] == 'c' || argv[fa][1] == 'C')
+				detype = 1;
+
+			else if (argv[fa][1] == 'k' || argv[fa][1] == 'K')
+				detype = 2;
+
+			else if (argv[fa][1] == 'm' || argv[fa][1] == 'M')
+				showmax = 1;
+
+			else if (argv[fa][1] == 'o' || argv[fa][1] == 'O')
+				doout = 1;
+
+			else if (argv[fa][1] == 't' || argv[fa][1] == 'T') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -t");
+				thresh = atof(na);
+				if (thresh <= 0.0) usage("Delta E threshold %f is out of range",thresh);
+			}
+
+			else if (argv[fa][1] == 'j') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -j");
+				nthr = atoi(na);
+				if (nthr < 1) usage("Number of threads %d is out of range",nthr);
+			}
+
+			else
+				usage("Unknown flag '%c'",argv[fa][1]);
+		} else
+			break;
+	}
+
+	for (nnames = 0; fa < argc && nnames < 3; fa++)
+		names[nnames++] = argv[fa];
+	if (fa < argc || (nnames != 1 && nnames != 3))
+		usage("Expect a profile, or a link and two profiles");
+
+	for (i = 0; i < nnames; i++) {
+		icco[i] = read_icc(names[i], &fp[i]);
+		if ((xicco[i] = new_xicc(icco[i])) == NULL)
+			error ("Creation of xicc failed");
+	}
+
+	memset((void *)&x, 0, sizeof(ckctx));
+	x.detype = detype;
+	if (bits > 0)
+		x.qscale = (double)((1 << bits) - 1);
+	x.link = nnames == 3;
+	x.doout = doout;
+
+	x.tlimit = x.klimit = -1.0;
+	x.kch = -1;
+
+	/* Inking for the destination inverse lookups */
+	memset((void *)&ink, 0, sizeof(icxInk));
+	icxDefaultLimits(xicco[nnames-1], &ink.tlimit, tlimit, &ink.klimit, klimit);
+	ink.KonlyLmin = 0;
+	ink.k_rule = icxKluma5k;		/* Ramp K */
+	ink.c.Ksmth = ICXINKDEFSMTH;
+	ink.c.Kskew = ICXINKDEFSKEW;
+	ink.c.Kstle = 0.0;
+	ink.c.Kstpo = 0.0;
+	ink.c.Kenpo = 1.0;
+	ink.c.Kenle = 1.0;
+	ink.c.Kshap = 1.0;
+	ink.x = ink.c;
+
+	if (x.link) {
+		if (icco[0]->header->deviceClass != icSigLinkClass)
+			error("'%s' isn't a device link profile",names[0]);
+
+		if ((x.tluo = icco[0]->get_luobj(icco[0], icmFwd, icmDefaultIntent,
+		                                 icmSigDefaultData, icmLuOrdNorm)) == NULL)
+			error ("%d, %s",icco[0]->errc, icco[0]->err);
+		x.tluo->spaces(x.tluo, &ins, &inn, &outs, &outn, &alg, NULL, NULL, NULL, NULL);
+		if (alg != icmLutType)
+			error("Device link '%s' doesn't have a Lut",names[0]);
+
+		if (icco[1]->header->colorSpace != ins)
+			error("Link input space doesn't match the source profile '%s'",names[1]);
+		if (icco[2]->header->colorSpace != outs)
+			error("Link output space doesn't match the destination profile '%s'",names[2]);
+
+		if ((x.sluo = xicco[1]->get_luobj(xicco[1], ICX_CLIP_NEAREST, icmFwd, intent,
+		                                  icSigLabData, icmLuOrdNorm, NULL, NULL)) == NULL)
+			error ("%d, %s",xicco[1]->errc, xicco[1]->err);
+		if ((x.dluo = xicco[2]->get_luobj(xicco[2], ICX_CLIP_NEAREST, icmFwd, intent,
+		                                  icSigLabData, icmLuOrdNorm, NULL, &ink)) == NULL)
+			error ("%d, %s",xicco[2]->errc, xicco[2]->err);
+
+		if ((x.dgam = x.dluo->get_gamut(x.dluo, 10.0)) == NULL)
+			error ("%d, %s",xicco[2]->errc, xicco[2]->err);
+		x.dgam->setshared(x.dgam);
+
+	} else {
+		if (icco[0]->header->deviceClass == icSigLinkClass)
+			error("Need the source and destination profiles to check link '%s'",names[0]);
+
+		if ((x.tluo = icco[0]->get_luobj(icco[0], icmBwd, intent,
+		                                 icSigLabData, icmLuOrdNorm)) == NULL)
+			error ("%d, %s",icco[0]->errc, icco[0]->err);
+		x.tluo->spaces(x.tluo, &ins, &inn, &outs, &outn, &alg, NULL, NULL, NULL, NULL);
+		if (alg != icmLutType)
+			error("Profile '%s' doesn't have a B2A table",names[0]);
+
+		if ((x.sluo = xicco[0]->get_luobj(xicco[0], ICX_CLIP_NEAREST, icmFwd, intent,
+		                                  icSigLabData, icmLuOrdNorm, NULL, NULL)) == NULL)
+			error ("%d, %s",xicco[0]->errc, xicco[0]->err);
+		x.dluo = x.sluo;
+
+		/* Device values over the ink limits aren't sampled */
+		x.cal = xiccReadCalTag(icco[0]);
+		x.kch = icxGuessBlackChan(icco[0]);
+		x.tlimit = ink.tlimit;
+		x.klimit = ink.klimit;
+	}
+	x.tin = inn;
+	x.tout = outn;
+	x.sluo->spaces(x.sluo, NULL, &x.din, NULL, NULL, NULL, NULL, NULL, NULL);
+	x.tluo->get_ranges(x.tluo, x.timin, x.timax, x.tomin, x.tomax);
+	if (x.din > SOBOL_MAXDIM)
+		error("Too many device channels");
+
+	if (nthr > (nsamp/CHK_BATCH))
+		nthr = nsamp/CHK_BATCH;
+	if (nthr < 1)
+		nthr = 1;
+
+	if (verb) {
+		if (x.link)
+			printf("Checking link '%s' from '%s' to '%s'\n",names[0],names[1],names[2]);
+		else
+			printf("Checking the B2A table of '%s'\n",names[0]);
+		if (x.tlimit >= 0.0)
+			printf("Total ink limit assumed is %3.0f%%\n",100.0 * x.tlimit);
+		if (x.klimit >= 0.0)
+			printf("Black ink limit assumed is %3.0f%%\n",100.0 * x.klimit);
+		if (bits > 0)
+			printf("Table input and output quantized to %d bits\n",bits);
+		printf("Using %d points and %d threads\n",nsamp,nthr);
+	}
+
+	if ((jbs = (ckjob *)calloc(nthr, sizeof(ckjob))) == NULL)
+		error("Malloc failed");
+
+	/* Each job checks its own consecutive part of the sequence, */
+	/* so the result doesn't depend on the number of threads. */
+	for (i = 0; i < nthr; i++) {
+		ckjob *jb = &jbs[i];
+
+		jb->x = &x;
+		jb->six = (unsigned int)((double)nsamp * i/nthr + 0.5);
+		jb->n = (int)((double)nsamp * (i+1)/nthr + 0.5) - jb->six;
+		if ((jb->so = new_sobol(x.din)) == NULL)
+			error("new_sobol failed");
+		for (j = 0; j < 2; j++) {
+			if ((jb->st[j].hist = (unsigned int *)calloc(HIST_N, sizeof(unsigned int))) == NULL)
+				error("Malloc failed");
+		}
+
+		/* Inverse lookups aren't thread safe, so each job has its own */
+		if (x.link) {
+			if ((jb->iluo = xicco[2]->get_luobj(xicco[2], ICX_CLIP_NEAREST, icmFwd, intent,
+			                             icSigLabData, icmLuOrdNorm, NULL, &ink)) == NULL)
+				error ("%d, %s",xicco[2]->errc, xicco[2]->err);
+		}
+	}
+
+	/* Do a lookup of each before starting any threads, so that */
+	/* anything the lookups set up on first use is done. */
+	{
+		double in[MAX_CHAN], out[MAX_CHAN], pcs[3];
+
+		for (j = 0; j < x.din; j++)
+			in[j] = 0.5;
+		x.sluo->lookup(x.sluo, pcs, in);
+		if (x.link) {
+			x.tluo->lookup(x.tluo, out, in);
+			for (i = 0; i < nthr; i++)
+				jbs[i].iluo->inv_lookup(jbs[i].iluo, out, pcs);
+		} else
+			x.tluo->lookup(x.tluo, out, pcs);
+		x.dluo->lookup(x.dluo, pcs, out);
+	}
+
+	athreads_for(nthr, nthr, ck_check, (void *)jbs);
+
+	/* Merge the results of the jobs */
+	memset((void *)st, 0, sizeof(st));
+	for (j = 0; j < 2; j++) {
+		if ((st[j].hist = (unsigned int *)calloc(HIST_N, sizeof(unsigned int))) == NULL)
+			error("Malloc failed");
+	}
+	if ((hm = (ckheat *)calloc(1, sizeof(ckheat))) == NULL)
+		error("Malloc failed");
+	for (i = 0; i < nthr; i++) {
+		for (j = 0; j < 2; j++)
+			ck_merge(x.din, &st[j], &jbs[i].st[j]);
+		for (j = 0; j < HM_LBINS; j++) {
+			for (k = 0; k <= HM_HBINS; k++) {
+				hm->n[j][k] += jbs[i].hm.n[j][k];
+				hm->sum[j][k] += jbs[i].hm.sum[j][k];
+				if (jbs[i].hm.max[j][k] > hm->max[j][k])
+					hm->max[j][k] = jbs[i].hm.max[j][k];
+			}
+		}
+		nrej += jbs[i].nrej;
+		nout += jbs[i].nout;
+	}
+
+	printf("Checked %d points",st[0].n + st[1].n);
+	if (nrej > 0)
+		printf(", %d over the ink limit were skipped",nrej);
+	if (nout > 0)
+		printf(", %d outside the destination gamut were skipped",nout);
+	printf("\nErrors%s:\n", detype == 2 ? " (CIEDE2000)" : detype == 1 ? " (CIE94)" : "");
+	ck_print(x.link ? "In gamut:" : "Table:", x.din, &st[0]);
+	ck_print("Clipped: ", x.din, &st[1]);
+
+	/* Print the heat map */
+	printf("\n%s%s delta E by L* and hue angle:\n", showmax ? "Maximum" : "Average",
+	       x.link ? " in gamut" : "");
+	printf("  L*    neut.");
+	for (k = 0; k < HM_HBINS; k++)
+		printf(" %5d",k * 360/HM_HBINS);
+	printf("\n");
+	for (j = HM_LBINS-1; j >= 0; j--) {
+		printf("%3d-%-3d",j * 100/HM_LBINS, (j+1) * 100/HM_LBINS);
+		for (k = 0; k <= HM_HBINS; k++) {
+			if (hm->n[j][k] == 0)
+				printf("     -");
+			else if (showmax)
+				printf(" %5.2f",hm->max[j][k]);
+			else
+				printf(" %5.2f",hm->sum[j][k]/hm->n[j][k]);
+		}
+		printf("\n");
+	}
+
+	if (thresh > 0.0 && st[0].n > 0 && ck_pct(&st[0], 0.99) > thresh)
+		error("99th percentile delta E %f exceeds %f",ck_pct(&st[0], 0.99),thresh);
+
+	for (i = 0; i < nthr; i++) {
+		if (jbs[i].iluo != NULL)
+			jbs[i].iluo->del(jbs[i].iluo);
+		for (j = 0; j < 2; j++)
+			free(jbs[i].st[j].hist);
+		jbs[i].so->del(jbs[i].so);
+	}
+	for (j = 0; j < 2; j++)
+		free(st[j].hist);
+	free(hm);
+	free(jbs);
+
+	if (x.dgam != NULL)
+		x.dgam->del(x.dgam);
+	if (x.dluo != x.sluo)
+		x.dluo->del(x.dluo);
+	x.sluo->del(x.sluo);
+	x.tluo->del(x.tluo);
+	if (x.cal != NULL)
+		x.cal->del(x.cal);
+	for (i = 0; i < nnames; i++) {
+		xicco[i]->del(xicco[i]);
+		icco[i]->del(icco[i]);
+		fp[i]->del(fp[i]);
+	}
+
+	return 0;
+}
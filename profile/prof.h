@@ -38,11 +38,13 @@ void make_output_icc(
 	int mtxtoo,				/* NZ if matrix tags should be created for Display XYZ cLUT */
 	icmICCVersion iccver,	/* ICC profile version to create */
 	int verb,				/* Vebosity level, 0 = none */
+	int nthr,				/* Maximum number of threads to use */
 	int iquality,			/* A2B table quality, 0..2 */
 	int oquality,			/* B2A table quality, 0..2 */
 	int noiluts,			/* nz to supress creation of input (Device) shaper luts */
 	int noisluts,			/* nz to supress creation of input sub-grid (Device) shaper luts */
 	int nooluts,			/* nz to supress creation of output (PCS) shaper luts */
+	int adb2a,				/* nz to adapt the B2A clut grid spacing to the profile */
 	int nocied,				/* nz to supress inclusion of .ti3 data in profile */
 	int noptop,				/* nz to use colorimetic source gamut to make perceptual table */ 
 	int nostos,				/* nz to use colorimetic source gamut to make perceptual table */
@@ -62,6 +64,7 @@ void make_output_icc(
 	char *ipname,			/* input icc profile - enables gamut map, NULL if none */
 	char *sgname,			/* source image gamut - NULL if none */
 	char *absname,			/* abstract profile name - NULL if none */
+	char *prevname,			/* previous profile to reuse B2A values from, NULL if none */
 	int sepsat,				/* Create separate Saturation B2A */
 	icxViewCond *ivc_p,		/* Input Viewing Parameters for CIECAM97s */
 	icxViewCond *ovc_p,		/* Output Viewing Parameters for CIECAM97s (enables CAM clip) */
@@ -77,6 +80,7 @@ void make_input_icc(
 	prof_atype ptype,		/* Profile output type */
 	icmICCVersion iccver,	/* ICC profile version to create */
 	int verb,				/* Vebosity level, 0 = none */
+	int nthr,				/* Maximum number of threads to use */
 	int iquality,			/* A2B table quality, 0..2 */
 	int oquality,			/* B2A table quality, 0..2 */
 	int noiluts,			/* nz to supress creation of input (Device) shaper luts */
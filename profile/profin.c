@@ -251,6 +251,7 @@ make_input_icc(
 	prof_atype ptype,		/* Profile algorithm type */
 	icmICCVersion iccver,	/* ICC profile version to create */
 	int verb,
+	int nthr,				/* Maximum number of threads to use */
 	int iquality,			/* A2B table quality, 0..3 */
 	int oquality,			/* B2A table quality, 0..3 */
 	int noisluts,			/* nz to supress creation of input (Device) shaper luts */
@@ -785,6 +786,7 @@ make_input_icc(
 		/* Wrap with an expanded icc */
 		if ((wr_xicc = new_xicc(wr_icco)) == NULL)
 			error ("Creation of xicc failed");
+		wr_xicc->nthr = nthr;
 
 		flags |= ICX_CLIP_NEAREST;      /* This will avoid clip caused rev setup */
 
@@ -924,6 +926,7 @@ make_input_icc(
 		/* Wrap with an expanded icc */
 		if ((wr_xicc = new_xicc(wr_icco)) == NULL)
 			error("Creation of xicc failed");
+		wr_xicc->nthr = nthr;
 		
 		if (verb)
 			flags |= ICX_VERBOSE;
@@ -71,6 +71,10 @@
 #undef DISABLE_GAMUT_TAG		/* [Undef] To dispable gamut tag */
 #undef WARN_CLUT_CLIPPING		/* [Undef] Print warning if setting clut clips */
 
+#define PREV_CHG_DE 0.5			/* Change in the A2B in delta E that stops previous */
+								/* B2A values nearby being reused */
+#define PREV_REUSE_DE 0.1		/* Maximum error in delta E of a reused B2A value */
+
 #include <stdio.h>
 #include "numlib.h"
 #include "icc.h"
@@ -82,6 +86,9 @@
 #include "prof.h"
 #include "gamut.h"
 #include "gammap.h"
+#include "gcache.h"
+#include "conv.h"
+#include "amutex.h"
 
 #ifndef MAX_CAL_ENT
 #define MAX_CAL_ENT 4096
@@ -144,12 +151,19 @@
 
 /* ---------------------------------------- */
 
+/* Progress count of the B2A tables being set. The tables */
+/* may be set at the same time, so it has a lock. */
+typedef struct {
+	amutex lock;
+	int total, count, last;
+} out_b2a_progress;
+
 /* structure to support output icc B2A Lut initialisation calbacks. */
 /* Note that we don't cope with a LUT matrix - assume it's unity. */
 
 typedef struct {
 	int verb;
-	int total, count, last;	/* Progress count information */
+	out_b2a_progress *prog;	/* Progress count information */
 	int noPCScurves;		/* Flag set if we don't want PCS curves */
 	icColorSpaceSignature pcsspace;	/* The PCS colorspace */
 	icColorSpaceSignature devspace;	/* The device colorspace */
@@ -157,6 +171,7 @@ typedef struct {
 
 	int ntables;			/* Number of tables being set. 1 = colorimetric */
 							/* 2 = colorimetric + saturation, 3 = all intents */
+	int tn0, tn1;			/* Tables tn0 .. tn1-1 are returned by out_b2a_clut() */
 	int ochan;				/* Number of output channels for B2A */
 	gammap *pmap;			/* Perceptual CAM to CAM Gamut mapping, NULL if no mapping */
 	gammap *smap;			/* Saturation CAM to CAM Gamut mapping, NULL if no mapping */
@@ -173,8 +188,28 @@ typedef struct {
 
     gamut *gam;				/* Output gamut object for setting gamut Lut */
 	int wantLab;			/* 0 if want is XYZ PCS, 1 want is Lab PCS */
+
+	icmLuBase *prev[3];		/* Previous profile PCS -> Device for each table, NULL if none */
+	int pres;				/* Device grid resolution of pchg */
+	char *pchg;				/* [(pres-1) ^ di] nz if the A2B has changed near a grid cell */
+	int nreuse;				/* Number of previous B2A values reused */
+	gridcurve *gcurve;		/* PCS'' -> clut grid spacing curves, NULL if none */
 } out_b2a_callback;
 
+/* Add n to the progress count, and print the percentage if it has changed */
+static void out_b2a_count(out_b2a_progress *pg, int n) {
+	int pc;
+
+	amutex_lock(pg->lock);
+	pg->count += n;
+	pc = (int)(pg->count * 100.0/pg->total + 0.5);
+	if (pc != pg->last) {
+		printf("\r%2d%%",pc); fflush(stdout);
+		pg->last = pc;
+	}
+	amutex_unlock(pg->lock);
+}
+
 /* Utility to handle abstract profile application to PCS */
 /* PCS in creating output table is always XYZ or Lab relative colorimetric, */
 /* and abstract profile is absolute or relative, and will be */
@@ -267,6 +302,136 @@ static double gdv2dv(double iv) {
 }
 
 
+/* --------------------------------------------------------- */
+/* Support for reusing the B2A values of a previous profile */
+
+/* Lookup Device -> relative Lab through the A2B being inverted */
+static void out_b2a_fwd(out_b2a_callback *p, double *out, double *in) {
+	double dev[MAX_CHAN];
+
+	p->x->input(p->x, dev, in);
+	p->x->clut(p->x, out, dev);
+	p->x->output(p->x, out, out);
+	if (p->pcsspace == icSigXYZData)
+		icmXYZ2Lab(&icmD50, out, out);
+}
+
+/* Create the mask of device grid cells near where the A2B */
+/* differs from the previous profiles relative Lab A2B pfwd. */
+static void out_b2a_chgmask(out_b2a_callback *p, icmLuBase *pfwd, int res) {
+	int di = p->x->inputChan;
+	int e, i, nv, nc;
+	char *vch;
+	double dev[MAX_CHAN], nlab[3], olab[3];
+
+	for (nv = nc = 1, e = 0; e < di; e++) {
+		nv *= res;
+		nc *= res-1;
+	}
+	if ((vch = (char *)calloc(nv, sizeof(char))) == NULL
+	 || (p->pchg = (char *)calloc(nc, sizeof(char))) == NULL)
+		error("Malloc of A2B change mask failed");
+	p->pres = res;
+
+	/* Mark the grid vertexes that have changed */
+	{
+		DCOUNT(gc, MAX_CHAN, di, 0, 0, res);
+
+		DC_INIT(gc);
+		for (i = 0; !DC_DONE(gc); i++) {
+			for (e = 0; e < di; e++)
+				dev[e] = gc[e]/(res-1.0);
+			out_b2a_fwd(p, nlab, dev);
+			pfwd->lookup(pfwd, olab, dev);
+			if (icmLabDE(nlab, olab) > PREV_CHG_DE)
+				vch[i] = 1;
+			DC_INC(gc);
+		}
+	}
+
+	/* Mark the cells that use a changed vertex, */
+	/* plus one cell either side of them. */
+	{
+		DCOUNT(gc, MAX_CHAN, di, 0, 0, res);
+
+		DC_INIT(gc);
+		for (i = 0; !DC_DONE(gc); i++) {
+			if (vch[i]) {
+				DCOUNT(oc, MAX_CHAN, di, -2, -2, 2);
+
+				DC_INIT(oc);
+				while (!DC_DONE(oc)) {
+					int c, ix;
+					for (ix = 0, e = di-1; e >= 0; e--) {
+						c = gc[e] + oc[e];
+						if (c < 0 || c > (res-2))
+							break;
+						ix = ix * (res-1) + c;
+					}
+					if (e < 0)
+						p->pchg[ix] = 1;
+					DC_INC(oc);
+				}
+			}
+			DC_INC(gc);
+		}
+	}
+	free(vch);
+}
+
+/* See if a previous profile value can be reused for table tn at the */
+/* grid point with PCS value kpcs[], where the table inverts PCS' in[]. */
+/* The previous colorimetric table inverts in[] itself, unless there is */
+/* an abstract profile, which the previous tables include. The previous */
+/* table tn is then looked up at the grid point instead, so that the */
+/* gamut mapping and abstract profile aren't applied twice. A value is */
+/* reused if the A2B hasn't changed nearby, and it inverts in[] accurately */
+/* through the new A2B. (A clipped value is never reused, since only a */
+/* fresh inverse can tell if it is still the nearest one.) */
+/* Return nz and set Dev' out[] if it can be reused. */
+static int out_b2a_reuse(out_b2a_callback *p, double *out, double kpcs[3], double in[3], int tn) {
+	int di = p->x->inputChan;
+	int e, c, ix;
+	double pcs[3], lab[3], chk[3], dev[MAX_CHAN];
+
+	/* PCS' to PCS */
+	if (p->x->output(p->x, pcs, in) > 1)
+		error("%d, %s",p->x->pp->errc,p->x->pp->err);
+
+	if (p->abs_luo == NULL) {
+		if (p->prev[0] == NULL || p->prev[0]->lookup(p->prev[0], dev, pcs) > 1)
+			return 0;
+	} else {
+		if (p->prev[tn] == NULL || p->prev[tn]->lookup(p->prev[tn], dev, kpcs) > 1)
+			return 0;
+	}
+
+	for (ix = 0, e = di-1; e >= 0; e--) {
+		c = (int)floor(dev[e] * (p->pres-1.0));
+		if (c < 0)
+			c = 0;
+		else if (c > (p->pres-2))
+			c = p->pres-2;
+		ix = ix * (p->pres-1) + c;
+	}
+	if (p->pchg[ix])
+		return 0;
+
+	lab[0] = pcs[0]; lab[1] = pcs[1]; lab[2] = pcs[2];
+	if (p->pcsspace == icSigXYZData)
+		icmXYZ2Lab(&icmD50, lab, lab);
+	out_b2a_fwd(p, chk, dev);
+	if (icmLabDE(lab, chk) > PREV_REUSE_DE)
+		return 0;
+
+	/* Dev to Dev' */
+	if (p->x->input(p->x, out, dev) > 1)
+		error("%d, %s",p->x->pp->errc,p->x->pp->err);
+	p->nreuse++;
+
+	return 1;
+}
+
 /* --------------------------------------------------------- */
 /* NOTE :- the assumption that each stage of the BtoA is a mirror */
 /* of the AtoB makes for inflexibility. */
@@ -298,10 +463,13 @@ void out_b2a_input(void *cntx, double out[3], double in[3]) {
 	if (p->pcsspace == icSigXYZData)	/* Apply XYZ non-linearity curve */
 		y2l_curve(out, out);
 
+	if (p->gcurve != NULL)				/* Apply the grid spacing curves */
+		p->gcurve->fwd(p->gcurve, out, out);
+
 	DBG(("out_b2a_input returning PCS'' %f %f %f\n",out[0],out[1],out[2]))
 }
 
-/* clut - multitable */
+/* clut - multitable, tables tn0 .. tn1-1 */
 /* Input PCS' output Dev' */
 /* We're applying any abstract profile after gamut mapping, */
 /* on the assumption is is primarily being used to "correct" the */
@@ -311,13 +479,18 @@ void out_b2a_input(void *cntx, double out[3], double in[3]) {
 void out_b2a_clut(void *cntx, double *out, double in[3]) {
 	out_b2a_callback *p = (out_b2a_callback *)cntx;
 	double inn[3], in1[3];
+	double kpcs[3];		/* PCS of the grid point, for reusing previous values */
 	int tn;
 
 	DBG(("\nout_b2a_clut got      PCS'' %f %f %f\n",in[0],in[1],in[2]))
 
-	in1[0] = in[0];		/* in[] may be aliased with out[] */
-	in1[1] = in[1];		/* so take a copy.  */
-	in1[2] = in[2];
+	if (p->gcurve != NULL)		/* Undo the grid spacing curves */
+		p->gcurve->bwd(p->gcurve, in1, in);
+	else {
+		in1[0] = in[0];		/* in[] may be aliased with out[] */
+		in1[1] = in[1];		/* so take a copy.  */
+		in1[2] = in[2];
+	}
 
 	DBG(("out_b2a_clut got       PCS' %f %f %f\n",in[0],in[1],in[2]))
 
@@ -328,36 +501,51 @@ void out_b2a_clut(void *cntx, double *out, double in[3]) {
 	inn[1] = in1[1];
 	inn[2] = in1[2];
 
-	if (p->abs_luo != NULL) {	/* Abstract profile to apply to first table only. */
-
+	if (p->pchg != NULL) {		/* Reusing previous values */
+		kpcs[0] = inn[0];
+		kpcs[1] = inn[1];
+		kpcs[2] = inn[2];
 		if (!p->noPCScurves) {	/* Convert from PCS' to PCS */
-			if (p->x->output(p->x, in1, in1) > 1)
+			if (p->x->output(p->x, kpcs, kpcs) > 1)
 				error("%d, %s",p->x->pp->errc,p->x->pp->err);
 		}
-		do_abstract(p, in1, in1);		/* Abstract profile to apply to first table */
-		DBG(("through abstract prof   PCS %f %f %f\n",in1[0],in1[1],in1[2]))
-		/* We now have PCS */
 	}
 
-	if (p->noPCScurves || p->abs_luo != NULL) {	/* We were given PCS or have converted to PCS */
+	if (p->tn0 == 0) {		/* Colorimetric table */
 
-		/* PCS to PCS' */
-		if (p->x->inv_output(p->x, in1, in1) > 1)
-			error("%d, %s",p->x->pp->errc,p->x->pp->err);
+		if (p->abs_luo != NULL) {	/* Abstract profile to apply to first table only. */
 
-		DBG(("noPCScurves = %d, abs_luo = 0x%x\n",p->noPCScurves,p->abs_luo))
-		DBG(("convert to PCS' got         %f %f %f\n",in1[0],in1[1],in1[2]))
-	}
+			if (!p->noPCScurves) {	/* Convert from PCS' to PCS */
+				if (p->x->output(p->x, in1, in1) > 1)
+					error("%d, %s",p->x->pp->errc,p->x->pp->err);
+			}
+			do_abstract(p, in1, in1);		/* Abstract profile to apply to first table */
+			DBG(("through abstract prof   PCS %f %f %f\n",in1[0],in1[1],in1[2]))
+			/* We now have PCS */
+		}
 
-	/* Invert AtoB clut (PCS' to Dev') Colorimetric */
-	/* to producte the colorimetric tables output. */
-	/* (Note that any aux target if we were using one, would be in Dev space) */
-	if (p->x->inv_clut(p->x, out, in1) > 1)
-		error("%d, %s",p->x->pp->errc,p->x->pp->err);
+		if (p->noPCScurves || p->abs_luo != NULL) {	/* We were given PCS or have converted to PCS */
 
-	DBG(("convert PCS' to DEV' got    %f %f %f %f\n",out[0],out[1],out[2],out[3]))
+			/* PCS to PCS' */
+			if (p->x->inv_output(p->x, in1, in1) > 1)
+				error("%d, %s",p->x->pp->errc,p->x->pp->err);
+
+			DBG(("noPCScurves = %d, abs_luo = 0x%x\n",p->noPCScurves,p->abs_luo))
+			DBG(("convert to PCS' got         %f %f %f\n",in1[0],in1[1],in1[2]))
+		}
 
-	if (p->ntables > 1) {		/* Do first part once for both intents */
+		/* Invert AtoB clut (PCS' to Dev') Colorimetric */
+		/* to producte the colorimetric tables output. */
+		/* (Note that any aux target if we were using one, would be in Dev space) */
+		if (!out_b2a_reuse(p, out, kpcs, in1, 0)
+		 && p->x->inv_clut(p->x, out, in1) > 1)
+			error("%d, %s",p->x->pp->errc,p->x->pp->err);
+
+		DBG(("convert PCS' to DEV' got    %f %f %f %f\n",out[0],out[1],out[2],out[3]))
+		out += p->ochan;		/* next table/intent */
+	}
+
+	if (p->tn1 > 1) {		/* Do first part once for both intents */
 
 		DBG(("\n"))
 
@@ -379,10 +567,9 @@ void out_b2a_clut(void *cntx, double *out, double in[3]) {
 
 		/* Apply gamut mapping in CAM space for remaining tables */
 		/* and create the output values */
-		for (tn = 1; tn < p->ntables; tn++) {
+		for (tn = p->tn0 > 1 ? p->tn0 : 1; tn < p->tn1; tn++, out += p->ochan) {
 			double in2[3];
 
-			out += p->ochan;	/* next table/intent */
 			in2[0] = in1[0];	/* Copy in1[] so it can be used for both tables */
 			in2[1] = in1[1];
 			in2[2] = in1[2];
@@ -437,22 +624,33 @@ void out_b2a_clut(void *cntx, double *out, double in[3]) {
 			/* Invert AtoB clut (PCS' to Dev') */
 			/* to producte the perceptual or saturation tables output. */
 			/* (Note that any aux target if we were using one, would be in Dev space) */
-			if (p->x->inv_clut(p->x, out, in2) > 1)
+			if (!out_b2a_reuse(p, out, kpcs, in2, tn)
+			 && p->x->inv_clut(p->x, out, in2) > 1)
 				error("%d, %s",p->x->pp->errc,p->x->pp->err);
 			DBG(("convert PCS' to DEV' got %f %f %f %f\n",out[0],out[1],out[2],out[3]))
 		}
 	}
 
-	DBG(("out_b2a_clut returning DEV' %f %f %f\n",out[0],out[1],out[2]))
+	if (p->verb)		/* Output percent intervals */
+		out_b2a_count(p->prog, p->tn1 - p->tn0);
+}
 
-	if (p->verb) {		/* Output percent intervals */
-		int pc;
-		p->count++;
-		pc = (int)(p->count * 100.0/p->total + 0.5);
-		if (pc != p->last) {
-			printf("\r%2d%%",pc); fflush(stdout);
-			p->last = pc;
-		}
+/* PCS'' -> the PCS of each tables Dev' value as Lab, so that */
+/* the B2A clut grid spacing can be set to suit the color error. */
+static void out_b2a_adapt(void *cntx, double *out, double in[3]) {
+	out_b2a_callback *p = (out_b2a_callback *)cntx;
+	double dv[3 * MAX_CHAN];
+	int tn;
+
+	out_b2a_clut(cntx, dv, in);
+	for (tn = 0; tn < p->ntables; tn++) {
+		double *pcs = out + 3 * tn;
+
+		if (p->x->clut(p->x, pcs, dv + tn * p->ochan) > 1
+		 || p->x->output(p->x, pcs, pcs) > 1)
+			error("%d, %s",p->x->pp->errc,p->x->pp->err);
+		if (p->pcsspace == icSigXYZData)
+			icmXYZ2Lab(&icmD50, pcs, pcs);
 	}
 }
 
@@ -469,6 +667,37 @@ void out_b2a_output(void *cntx, double out[4], double in[4]) {
 	DBG(("out_b2a_output returning DEV %f %f %f\n",out[0],out[1],out[2]))
 }
 
+/* A B2A table to set, as a stage of making the profile */
+typedef struct {
+	out_b2a_callback cx;	/* Callback context with tn0 .. tn1-1 set to the table */
+	icmLut *wo;				/* The table */
+	int warnc;				/* Returned icc warnc */
+} out_b2a_table;
+
+static int out_b2a_fill(void *cntx) {
+	out_b2a_table *p = (out_b2a_table *)cntx;
+	int rv;
+
+	rv = icmSetMultiLutTables(
+	        1,
+	        &p->wo,
+#ifdef USE_LEASTSQUARES_APROX
+			ICM_CLUT_SET_APXLS,
+#else
+			0,
+#endif
+			(void *)&p->cx,				/* Context */
+			p->cx.pcsspace,				/* Input color space */
+			p->cx.devspace, 			/* Output color space */
+			out_b2a_input,				/* Input transform PCS->PCS' */
+			NULL, NULL,					/* Use default PCS range */
+			out_b2a_clut,				/* Lab' -> Device' transfer function */
+			NULL, NULL,					/* Use default Device' range */
+			out_b2a_output);			/* Output transfer function, Device'->Device */
+	p->warnc = p->wo->icp->warnc;
+	return rv;
+}
+
 /* --------------------------------------------------------- */
 
 /* PCS' -> distance to gamut boundary */
@@ -513,15 +742,8 @@ static void PCSp_bdist(void *cntx, double out[1], double in[3]) {
 	out[0] = (gdist + 20.0)/40.0;
 //printf("~1 bdist returning %f\n",out[0]);
 
-	if (p->verb) {		/* Output percent intervals */
-		int pc;
-		p->count++;
-		pc = (int)(p->count * 100.0/p->total + 0.5);
-		if (pc != p->last) {
-			printf("\r%2d%%",pc); fflush(stdout);
-			p->last = pc;
-		}
-	}
+	if (p->verb)		/* Output percent intervals */
+		out_b2a_count(p->prog, 1);
 }
 
 /* The output table for a Gamut lut is usually a special function, returning */
@@ -582,6 +804,250 @@ static double xyzoptfunc(void *cntx, double *v) {
 	return rv;
 }
 
+/* -------------------------------------------------------------- */
+/* A stage of making the profile, that can be run at the same */
+/* time as others once the stages it depends on are done. */
+typedef struct {
+	char *name;					/* Name for verbose timing */
+	char *msg;					/* Verbose message printed before it starts, NULL if none */
+	int (*func)(void *cntx);	/* Function to run, NULL if the stage isn't needed */
+	void *cntx;					/* Context to call it with */
+	unsigned int deps;			/* Mask of the stages that must be done first */
+
+	/* Private: */
+	int done;					/* nz when it has been run */
+	unsigned int stime, etime;	/* Start and end time in msec */
+	int rv;						/* Return value of func() */
+} pstage;
+
+/* The stages being run at the same time */
+typedef struct {
+	pstage *sts[32];
+	int n;
+} pswave;
+
+static int pstage_run(void *cntx, int i) {
+	pstage *st = ((pswave *)cntx)->sts[i];
+
+	st->stime = msec_time();
+	st->rv = st->func(st->cntx);
+	st->etime = msec_time();
+	return st->rv;
+}
+
+/* Run the nst (<= 32) stages, using up to nthr threads. All the stages */
+/* whose dependencies are done are run together, and then waited for, */
+/* before starting the ones that depended on them. The stages don't */
+/* print anything themselves, so that the verbose messages and timings */
+/* come out in stage order, however many threads are used. */
+/* Return nz if a stage failed, in which case the stages that */
+/* depend on it aren't run. */
+static int run_stages(pstage *sts, int nst, int nthr, int verb) {
+	athreads *ths = NULL;
+	unsigned int done = 0;
+	pswave wv;
+	int i, rv = 0;
+
+	for (i = 0; i < nst; i++) {
+		sts[i].done = sts[i].func == NULL;
+		if (sts[i].done)
+			done |= 1 << i;
+	}
+
+	if (nthr > 1 && (ths = new_athreads(nthr)) == NULL)
+		error("Failed to create threads for the profile stages");
+
+	for (;;) {
+
+		/* Gather up the stages that are ready */
+		for (wv.n = i = 0; i < nst; i++) {
+			if (!sts[i].done && (sts[i].deps & done) == sts[i].deps)
+				wv.sts[wv.n++] = &sts[i];
+		}
+		if (wv.n == 0)
+			break;
+
+		if (verb) {
+			for (i = 0; i < wv.n; i++) {
+				if (wv.sts[i]->msg != NULL)
+					printf(" %s\n",wv.sts[i]->msg);
+			}
+			fflush(stdout);
+		}
+
+		if (ths != NULL) {
+			ths->run(ths, wv.n, pstage_run, (void *)&wv);
+		} else {
+			for (i = 0; i < wv.n; i++)
+				pstage_run((void *)&wv, i);
+		}
+
+		for (i = 0; i < wv.n; i++) {
+			pstage *st = wv.sts[i];
+
+			if (verb)
+				printf(" (%s took %.1f seconds)\n",st->name,(st->etime - st->stime)/1000.0);
+			st->done = 1;
+			if (st->rv != 0)
+				rv = st->rv;
+			else
+				done |= 1 << (st - sts);
+		}
+		if (rv != 0)
+			break;
+	}
+
+	if (ths != NULL)
+		ths->del(ths);
+
+	return rv;
+}
+
+/* The stages of creating the gamut mapping */
+enum {
+	GMS_SRCGAM = 0,			/* Source colorspace gamut(s) */
+	GMS_IMGGAM = 1,			/* Source image gamut */
+	GMS_DSTGAM = 2,			/* Destination gamut */
+	GMS_PMAP   = 3,			/* Perceptual gamut map */
+	GMS_SMAP   = 4,			/* Saturation gamut map */
+	GMS_NO     = 5
+};
+
+/* Context for the gamut mapping stages. The gamut stages only */
+/* make forward lookups, and each one uses separate lookup objects, */
+/* so that they can be run at the same time. */
+typedef struct {
+	int verb;
+	int shared;				/* nz if the maps may be made at the same time */
+	double gres;			/* Gamut surface feature resolution */
+	int mapres;				/* Mapping rspl resolution */
+	int gamdiag;			/* Make diagnostic wrl plots */
+
+	/* Source gamuts */
+	xicc *src_xicc;			/* Source profile */
+	char *ipname;			/* Source profile file name */
+	icxLuBase *ixp;			/* Source perceptual lookup */
+	int sepsat;				/* nz for saturation gamut too */
+	icRenderingIntent intents;	/* Saturation gamut intent */
+	icxViewCond *ivc;		/* Source viewing conditions */
+	icxInk *iink;			/* Source ink limits */
+	gcache *gc;				/* Source gamut cache, NULL if none */
+	gamut *csgamp;			/* Returned perceptual source gamut */
+	gamut *csgams;			/* Returned saturation source gamut */
+
+	/* Image gamut */
+	char *sgname;			/* Image gamut file name */
+	int isJab;				/* nz if it should be Jab */
+	gamut *igam;			/* Returned image gamut */
+
+	/* Destination gamut */
+	xicc *wr_xicc;			/* Destination profile */
+	icxLuBase *ox;			/* Destination lookup */
+	gamut *ogam;			/* Returned destination gamut */
+
+	/* Gamut maps */
+	icxGMappingIntent *pgmi;	/* Perceptual gamut mapping */
+	icxGMappingIntent *sgmi;	/* Saturation gamut mapping */
+	gammap *pmap;			/* Returned perceptual gamut map */
+	gammap *smap;			/* Returned saturation gamut map */
+} gmstages;
+
+static int gms_srcgam(void *cntx) {
+	gmstages *p = (gmstages *)cntx;
+	char key[GCACHE_KEYLEN];
+
+	/* Create the source colorspace gamut surface */
+	if (p->gc != NULL && p->gc->gam_key(p->gc, key, p->ipname, p->ixp, p->gres) == 0) {
+		if ((p->csgamp = p->gc->get_gamut(p->gc, key, p->gres)) == NULL) {
+			if ((p->csgamp = p->ixp->get_gamut(p->ixp, p->gres)) == NULL)
+				error ("%d, %s",p->src_xicc->errc, p->src_xicc->err);
+			if (p->gc->put_gamut(p->gc, key, p->csgamp))
+				warning("Failed to save source gamut to the gamut cache");
+		}
+	} else if ((p->csgamp = p->ixp->get_gamut(p->ixp, p->gres)) == NULL)
+		error ("%d, %s",p->src_xicc->errc, p->src_xicc->err);
+
+	if (p->sepsat) {
+		icxLuBase *ixs = NULL;	/* Source profile saturation lookup for gamut */
+		/* Get lookup object for saturation input gamut shell creation */
+		/* Note that the intent=Appearance will trigger Jab CAM, */
+		/* overriding icSigLabData.. */
+		if ((ixs = p->src_xicc->get_luobj(p->src_xicc, ICX_CLIP_NEAREST
+		   , icmFwd, p->intents, icSigLabData, icmLuOrdNorm, p->ivc, p->iink)) == NULL)
+		error ("%d, %s",p->src_xicc->errc, p->src_xicc->err);
+
+		if (p->gc != NULL && p->gc->gam_key(p->gc, key, p->ipname, ixs, p->gres) == 0) {
+			if ((p->csgams = p->gc->get_gamut(p->gc, key, p->gres)) == NULL) {
+				if ((p->csgams = ixs->get_gamut(ixs, p->gres)) == NULL)
+					error ("%d, %s",p->src_xicc->errc, p->src_xicc->err);
+				if (p->gc->put_gamut(p->gc, key, p->csgams))
+					warning("Failed to save source gamut to the gamut cache");
+			}
+		} else if ((p->csgams = ixs->get_gamut(ixs, p->gres)) == NULL)
+			error ("%d, %s",p->src_xicc->errc, p->src_xicc->err);
+		ixs->del(ixs);
+	}
+	return 0;
+}
+
+/* Read image source gamut - ie. from an image */
+static int gms_imggam(void *cntx) {
+	gmstages *p = (gmstages *)cntx;
+
+	p->igam = new_gamut(p->gres, 0, 0);
+
+	if (p->igam->read_gam(p->igam, p->sgname))
+		error("Reading source gamut '%s' failed",p->sgname);
+
+	if (p->igam->getisjab(p->igam) != p->isJab) {
+		/* Should really convert to/from Jab here! */
+		warning("Image gamut is wrong colorspace for gamut mapping (Lab != Jab)");
+		/* This will actually error in the gamut mapping code */
+		/* Note that we're not checking relative/absolute colorspace here. */
+		/* At the moment it's up to the user to get this right. */
+	}
+	if (p->shared)
+		p->igam->setshared(p->igam);
+	return 0;
+}
+
+/* Create the destination gamut surface */
+static int gms_dstgam(void *cntx) {
+	gmstages *p = (gmstages *)cntx;
+
+	if ((p->ogam = p->ox->get_gamut(p->ox, p->gres)) == NULL)
+		error ("%d, %s",p->wr_xicc->errc, p->wr_xicc->err);
+	if (p->shared)
+		p->ogam->setshared(p->ogam);
+	return 0;
+}
+
+/* The real range of Lab 0..100,-128..128,1-28..128 cube */
+/* when mapped to CAM is ridiculously large (ie. */
+/* 0..100, -288..265, -112..533), so we don't attempt to */
+/* set a gamut mapping grid range based on this. Instead */
+/* rely on the gamut map code to set a reasonable grid range */
+/* around the source gamut, and to cope reasonably with */
+/* values outside the grid range. */
+
+static int gms_pmap(void *cntx) {
+	gmstages *p = (gmstages *)cntx;
+
+	p->pmap = new_gammap(p->verb, p->csgamp, p->igam, p->ogam, p->pgmi, 0, 0, 0, 0,
+	                     p->mapres, NULL, NULL, p->gamdiag ? "gammap_p.wrl" : NULL);
+	return p->pmap == NULL ? 1 : 0;
+}
+
+static int gms_smap(void *cntx) {
+	gmstages *p = (gmstages *)cntx;
+
+	/* (Don't mix its verbose output with the perceptual maps) */
+	p->smap = new_gammap(p->shared ? 0 : p->verb, p->csgams, p->igam, p->ogam, p->sgmi,
+	                     0, 0, 0, 0, p->mapres, NULL, NULL, p->gamdiag ? "gammap_s.wrl" : NULL);
+	return p->smap == NULL ? 1 : 0;
+}
+
+
 /* -------------------------------------------------------------- */
 /* Make an output device profile, where a forward mapping is from */
 /* RGB/CMYK to XYZ/Lab space */
@@ -591,11 +1057,13 @@ make_output_icc(
 	int mtxtoo,				/* NZ if matrix tags should be created for Display XYZ cLUT */
 	icmICCVersion iccver,	/* ICC profile version to create */
 	int verb,				/* Vebosity level, 0 = none */
+	int nthr,				/* Maximum number of threads to use */
 	int iquality,			/* A2B table quality, 0..3 */
 	int oquality,			/* B2A table quality, 0..3 */
 	int noisluts,			/* nz to supress creation of input (Device) shaper luts */
 	int noipluts,			/* nz to supress creation of input (Device) position luts */
 	int nooluts,			/* nz to supress creation of output (PCS) shaper luts */
+	int adb2a,				/* nz to adapt the B2A clut grid spacing to the profile */
 	int nocied,				/* nz to supress inclusion of .ti3 data in profile */
 	int noptop,				/* nz to use colorimetic source gamut to make perceptual table */ 
 	int nostos,				/* nz to use colorimetic source gamut to make saturation table */
@@ -615,6 +1083,7 @@ make_output_icc(
 	char *ipname,			/* input icc profile - enables gamut map, NULL if none */
 	char *sgname,			/* source image gamut - NULL if none */
 	char *absname,			/* abstract profile name - NULL if none */
+	char *prevname,			/* previous profile to reuse B2A values from, NULL if none */
 	int sepsat,				/* Create separate Saturation B2A */
 	icxViewCond *ivc_p,		/* Input Viewing Parameters for CAM */
 	icxViewCond *ovc_p,		/* Output Viewing Parameters for CAM */
@@ -1744,14 +2213,40 @@ make_output_icc(
 	if (isLut) {
 		xicc *wr_xicc;			/* extention object */
 		icxLuBase *AtoB;		/* AtoB ixcLu */
+		icmFile *prev_fp = NULL;	/* Previous profile to reuse B2A values from */
+		icc *prev_icco = NULL;
+
+		/* Open up the previous profile if supplied */
+		if (prevname != NULL) {
+			if ((prev_fp = new_icmFileStd_name(prevname,"r")) == NULL)
+				error ("Can't open previous profile file '%s'",prevname);
+			
+			if ((prev_icco = new_icc()) == NULL)
+				error ("Creation of previous profile ICC object failed");
+	
+			if ((rv = prev_icco->read(prev_icco,prev_fp,0)) != 0)
+				error ("%d, %s",rv,prev_icco->err);
+	
+			if (prev_icco->header->colorSpace != devspace)
+				error("Previous profile '%s' isn't for the same device space",prevname);
+
+			if (prev_icco->find_tag(prev_icco, icSigAToB0Tag) != 0
+			 || prev_icco->find_tag(prev_icco, icSigBToA0Tag) != 0)
+				error("Previous profile '%s' isn't a cLUT profile",prevname);
+
+			if (verb)
+				printf("Reusing B2A values of previous profile '%s'\n",prevname);
+		}
 
 		/* Create A2B clut */
 		{
 			int flags = 0;
+			unsigned int stime = msec_time();
 
 			/* Wrap with an expanded icc */
 			if ((wr_xicc = new_xicc(wr_icco)) == NULL)
 				error("Creation of xicc failed");
+			wr_xicc->nthr = nthr;
 		
 			flags |= ICX_CLIP_NEAREST;		/* This will avoid clip caused rev setup */
 
@@ -1785,6 +2280,9 @@ make_output_icc(
 				error("%d, %s",wr_xicc->errc, wr_xicc->err);
 
 			AtoB->del(AtoB);		/* Done with lookup */
+
+			if (verb)
+				printf(" (A to B table took %.1f seconds)\n",(msec_time() - stime)/1000.0);
 		}
 
 		/* Create B2A clut */
@@ -1799,6 +2297,11 @@ make_output_icc(
 			xicc *abs_xicc = NULL;
 
 			out_b2a_callback cx;
+			out_b2a_progress prog;	/* Progress count of the tables */
+			out_b2a_table bt[3];	/* The tables, to set as stages */
+			pstage bsts[3];
+			int bnthr = nthr;		/* Number of threads to set the tables with */
+			unsigned int stime = msec_time();
 
 			if (verb)
 				printf("Setting up B to A table lookup\n");
@@ -1902,6 +2405,8 @@ make_output_icc(
 
 			/* setup context ready for B2A table setting */
 			cx.verb = verb;
+			cx.prog = &prog;
+			amutex_init(prog.lock);
 			cx.pcsspace = wantLab ? icSigLabData : icSigXYZData;
 #ifdef NO_B2A_PCS_CURVES
 			cx.noPCScurves = 1;		/* Don't use PCS curves */
@@ -1921,6 +2426,10 @@ make_output_icc(
 			cx.xyzscale[1] = 1.0;
 			cx.gam = NULL;
 			cx.wantLab = wantLab;			/* Copy PCS flag over */
+			cx.prev[0] = cx.prev[1] = cx.prev[2] = NULL;
+			cx.pchg = NULL;
+			cx.nreuse = 0;
+			cx.gcurve = NULL;
 
 			/* Open up the abstract profile if supplied, and setup luo */
 			if (absname != NULL) {
@@ -1970,17 +2479,21 @@ make_output_icc(
 
 				if (src_xicc) {		/* Creating separate perceptual and Saturation tables */
 					icRenderingIntent intentp;	/* Gamut mapping space perceptual selection */
-					icRenderingIntent intents;	/* Gamut mapping space saturation selection */
+					icRenderingIntent intents = icAbsoluteColorimetric;	/* Gamut mapping space sat. sel. */
 					icRenderingIntent intento;	/* Gamut mapping space output selection */
-					gamut *csgamp;			/* Incoming colorspace perceptual gamut */
-					gamut *csgams;			/* Incoming colorspace saturation gamut */
-					gamut *igam = NULL;		/* Incoming image gamut */
-					gamut *ogam;			/* Destination colorspace gamut */
 					double gres;			/* Gamut surface feature resolution */
 					int    mapres;			/* Mapping rspl resolution */
+					gcache *gc;				/* Source gamut cache, NULL if none */
+					gmstages gs;			/* Gamut mapping stages context */
+					pstage sts[GMS_NO];		/* Gamut mapping stages */
+					int snthr = nthr;		/* Number of threads for the stages */
 			
 					if (verb)
 						printf("Creating Gamut Mapping\n");
+
+					/* (Only the source gamuts can be cached, since the */
+					/*  destination gamut is of the profile being made.) */
+					gc = new_gcache(NULL, verb);
 			
 					/* Gamut mapping will extend given grid res to encompas */
 					/* source gamut by a margin. */
@@ -2069,54 +2582,6 @@ make_output_icc(
 					       , icmFwd, intentp, icSigLabData, icmLuOrdNorm, &ivc, &iink)) == NULL)
 						error ("%d, %s",src_xicc->errc, src_xicc->err);
 
-					/* Create the source colorspace gamut surface */
-					if (verb)
-						printf(" Finding Source Colorspace Perceptual Gamut\n");
-			
-					if ((csgamp = cx.ixp->get_gamut(cx.ixp, gres)) == NULL)
-						error ("%d, %s",src_xicc->errc, src_xicc->err);
-			
-					if (sepsat) {
-						icxLuBase *ixs = NULL;	/* Source profile saturation lookup for gamut */
-						/* Get lookup object for saturation input gamut shell creation */
-						/* Note that the intent=Appearance will trigger Jab CAM, */
-						/* overriding icSigLabData.. */
-						if ((ixs = src_xicc->get_luobj(src_xicc, ICX_CLIP_NEAREST
-						   , icmFwd, intents, icSigLabData, icmLuOrdNorm, &ivc, &iink)) == NULL)
-						error ("%d, %s",src_xicc->errc, src_xicc->err);
-
-						if (verb)
-							printf(" Finding Source Colorspace Saturation Gamut\n");
-
-						if ((csgams = ixs->get_gamut(ixs, gres)) == NULL)
-							error ("%d, %s",src_xicc->errc, src_xicc->err);
-						ixs->del(ixs);
-					}
-
-					/* Read image source gamut if provided */
-					if (sgname != NULL) {	/* Optional source gamut - ie. from an images */
-						int isJab = 0;
-			
-						if ((pgmi->usecas & 0xff) != 0)
-							isJab = 1;
-
-						if (verb)
-							printf(" Loading Image Source Gamut '%s'\n",sgname);
-			
-						igam = new_gamut(gres, 0, 0);
-			
-						if (igam->read_gam(igam, sgname))
-							error("Reading source gamut '%s' failed",sgname);
-
-						if (igam->getisjab(igam) != isJab) {
-							/* Should really convert to/from Jab here! */
-							warning("Image gamut is wrong colorspace for gamut mapping (Lab != Jab)");
-							/* This will actually error in the gamut mapping code */
-							/* Note that we're not checking relative/absolute colorspace here. */
-							/* At the moment it's up to the user to get this right. */
-						}
-					}
-
 					/* Get lookup object for bwd_outpcs_relpcs(), */
 					/* and output gamut shell creation */
 					/* Note that the intent=Appearance will trigger Jab CAM, */
@@ -2126,30 +2591,70 @@ make_output_icc(
 					                  icSigLabData, icmLuOrdNorm, &ovc, oink)) == NULL)
 						error ("%d, %s",wr_xicc->errc, wr_xicc->err);
 
-					/* Creat the destination gamut surface */
-					if (verb)
-						printf(" Finding Destination Gamut\n");
-			
-					if ((ogam = cx.ox->get_gamut(cx.ox, gres)) == NULL)
-						error ("%d, %s",wr_xicc->errc, wr_xicc->err);
-			
-					if (verb)
-						printf(" Creating Gamut match\n");
-
-					/* The real range of Lab 0..100,-128..128,1-28..128 cube */
-					/* when mapped to CAM is ridiculously large (ie. */
-					/* 0..100, -288..265, -112..533), so we don't attempt to */
-					/* set a gamut mapping grid range based on this. Instead */
-					/* rely on the gamut map code to set a reasonable grid range */
-					/* around the source gamut, and to cope reasonably with */
-					/* values outside the grid range. */
-
-					/* setup perceptual gamut mapping */
-					cx.pmap = new_gammap(verb, csgamp, igam, ogam, pgmi, 0, 0, 0, 0, mapres,
-					                     NULL, NULL, gamdiag ? "gammap_p.wrl" : NULL
-					);
-					if (cx.pmap == NULL)
-						error ("Failed to make perceptual gamut map transform");
+					/* The source gamuts, image gamut and destination gamut */
+					/* are independent, and the two gamut maps only depend */
+					/* on them, so run them as stages using up to nthr threads. */
+					/* (The wrl diagnostic plots can't be created at the same time) */
+					if (gamdiag)
+						snthr = 1;
+
+					gs.verb = verb;
+					gs.shared = sepsat && snthr > 1;
+					gs.gres = gres;
+					gs.mapres = mapres;
+					gs.gamdiag = gamdiag;
+					gs.src_xicc = src_xicc;
+					gs.ipname = ipname;
+					gs.ixp = cx.ixp;
+					gs.sepsat = sepsat;
+					gs.intents = intents;
+					gs.ivc = &ivc;
+					gs.iink = &iink;
+					gs.gc = gc;
+					gs.csgamp = gs.csgams = NULL;
+					gs.sgname = sgname;
+					gs.isJab = (pgmi->usecas & 0xff) != 0 ? 1 : 0;
+					gs.igam = NULL;
+					gs.wr_xicc = wr_xicc;
+					gs.ox = cx.ox;
+					gs.ogam = NULL;
+					gs.pgmi = pgmi;
+					gs.sgmi = sgmi;
+					gs.pmap = gs.smap = NULL;
+
+					memset((void *)sts, 0, sizeof(pstage) * GMS_NO);
+					sts[GMS_SRCGAM].name = "Source colorspace gamut";
+					sts[GMS_SRCGAM].msg = sepsat
+					  ? "Finding Source Colorspace Perceptual and Saturation Gamuts"
+					  : "Finding Source Colorspace Perceptual Gamut";
+					sts[GMS_SRCGAM].func = gms_srcgam;
+					sts[GMS_IMGGAM].name = "Image source gamut";
+					if (sgname != NULL) {
+						if ((sts[GMS_IMGGAM].msg = (char *)malloc(strlen(sgname) + 40)) == NULL)
+							error("Malloc of image gamut message failed");
+						sprintf(sts[GMS_IMGGAM].msg, "Loading Image Source Gamut '%s'",sgname);
+					}
+					sts[GMS_IMGGAM].func = sgname != NULL ? gms_imggam : NULL;
+					sts[GMS_DSTGAM].name = "Destination gamut";
+					sts[GMS_DSTGAM].msg = "Finding Destination Gamut";
+					sts[GMS_DSTGAM].func = gms_dstgam;
+					sts[GMS_PMAP].name = "Perceptual gamut match";
+					sts[GMS_PMAP].func = gms_pmap;
+					sts[GMS_PMAP].deps = (1 << GMS_SRCGAM) | (1 << GMS_IMGGAM) | (1 << GMS_DSTGAM);
+					sts[GMS_SMAP].name = "Saturation gamut match";
+					sts[GMS_SMAP].func = sepsat ? gms_smap : NULL;
+					sts[GMS_SMAP].deps = (1 << GMS_SRCGAM) | (1 << GMS_IMGGAM) | (1 << GMS_DSTGAM);
+					for (i = 0; i < GMS_NO; i++)
+						sts[i].cntx = (void *)&gs;
+
+					if (verb && snthr > 1)
+						printf(" (Using up to %d threads)\n",snthr);
+
+					if (run_stages(sts, GMS_NO, snthr, verb) != 0)
+						error ("Failed to make the gamut map transforms");
+					free(sts[GMS_IMGGAM].msg);
+
+					cx.pmap = gs.pmap;
 
 					/* Intent 0 = perceptual */
 					if ((wo[1] = (icmLut *)wr_icco->read_tag(
@@ -2158,12 +2663,7 @@ make_output_icc(
 					cx.ntables = 2;
 
 					if (sepsat) {
-						/* setup saturation gamut mapping */
-						cx.smap = new_gammap(verb, csgams, igam, ogam, sgmi, 0, 0, 0, 0, mapres,
-						                     NULL, NULL, gamdiag ? "gammap_s.wrl" : NULL
-						);
-						if (cx.smap == NULL)
-							error ("Failed to make saturation gamut map transform");
+						cx.smap = gs.smap;
 
 						/* Intent 2 = saturation */
 						if ((wo[2] = (icmLut *)wr_icco->read_tag(
@@ -2171,21 +2671,19 @@ make_output_icc(
 							error("read_tag failed: %d, %s",wr_icco->errc,wr_icco->err);
 						cx.ntables = 3;
 					}
-					csgamp->del(csgamp);
-					csgamp = NULL;
-					if (sepsat) {
-						csgams->del(csgams);
-						csgams = NULL;
-					}
-					if (igam != NULL) {
-						igam->del(igam);
-						igam = NULL;
-					}
-					ogam->del(ogam);
-					ogam = NULL;
+					gs.csgamp->del(gs.csgamp);
+					if (gs.csgams != NULL)
+						gs.csgams->del(gs.csgams);
+					if (gs.igam != NULL)
+						gs.igam->del(gs.igam);
+					gs.ogam->del(gs.ogam);
+					if (gc != NULL)
+						gc->del(gc);
 				}
 			}
 			cx.ochan = wo[0]->outputChan;
+			cx.tn0 = 0;
+			cx.tn1 = cx.ntables;
 
 			/* If we've got a request for Absolute Appearance mode with scaling */
 			/* to avoid clipping the source white point, compute the needed XYZ scaling factor. */
@@ -2243,7 +2741,7 @@ make_output_icc(
 
 				optcomb tcomb = oc_imo;	/* Create all by default */
 
-				if ((xf = new_xfit()) == NULL) {
+				if ((xf = new_xfit(nthr)) == NULL) {
 					error("profout: Creation of xfit object failed");
 				}
 					
@@ -2402,19 +2900,74 @@ make_output_icc(
 			/* for perceptual and saturation intents */
 			/* Use helper function to do the hard work. */
 
+			/* Setup to reuse the previous profiles B2A values */
+			/* where the A2B hasn't changed. */
+			if (prev_icco != NULL) {
+				icmLut *a2b;
+				icmLuBase *pfwd;
+				int tn;
+
+				if ((a2b = (icmLut *)wr_icco->read_tag(wr_icco, icSigAToB0Tag)) == NULL) 
+					error("read_tag failed: %d, %s",wr_icco->errc,wr_icco->err);
+
+				if ((pfwd = prev_icco->get_luobj(prev_icco, icmFwd, icRelativeColorimetric,
+				                icSigLabData, icmLuOrdNorm)) == NULL)
+					error ("%d, %s",prev_icco->errc, prev_icco->err);
+
+				out_b2a_chgmask(&cx, pfwd, a2b->clutPoints);
+				pfwd->del(pfwd);
+
+				for (tn = 0; tn < cx.ntables; tn++) {
+					icRenderingIntent intent = icmDefaultIntent;
+
+					if (allintents)
+						intent = tn == 0 ? icRelativeColorimetric
+						       : tn == 1 ? icPerceptual : icSaturation;
+
+					/* (No reuse for this table if it's missing) */
+					cx.prev[tn] = prev_icco->get_luobj(prev_icco, icmBwd, intent,
+				                  cx.pcsspace, icmLuOrdNorm);
+				}
+			}
+
+			/* Space the clut grid points to suit the profile. The curves */
+			/* go at the end of the input tables, and their inverse at the */
+			/* start of out_b2a_clut(), so they can be computed from it. */
+			if (adb2a) {
+				double min[3], max[3], pivot[3];
+				int sverb = cx.verb;
+
+				if (verb)
+					printf("Adapting the B to A clut grid spacing\n");
+				if (cx.pcsspace == icSigLabData) {
+					/* Keep the neutral axis on the grid */
+					min[0] = 0.0, min[1] = min[2] = -128.0;
+					max[0] = 100.0, max[1] = max[2] = 127.0 + 255.0/256.0;
+					pivot[0] = -1.0, pivot[1] = pivot[2] = 0.0;
+				} else {
+					min[0] = min[1] = min[2] = 0.0;
+					max[0] = max[1] = max[2] = 65535.0/32768.0;
+					pivot[0] = pivot[1] = pivot[2] = -1.0;
+				}
+				cx.verb = 0;
+				if ((cx.gcurve = new_gridcurve(3, 3 * cx.ntables, min, max, pivot,
+				                        wo[0]->clutPoints, 0, (void *)&cx, out_b2a_adapt)) == NULL)
+					error("Creating B to A clut grid spacing curves failed");
+				cx.verb = sverb;
+				cx.nreuse = 0;
+			}
+
 			if (cx.verb) {
 				unsigned int ui;
 				int extra;
-				cx.count = 0;
-				cx.last = -1;
-				for (cx.total = 1, ui = 0; ui < wo[0]->inputChan; ui++, cx.total *= wo[0]->clutPoints)
+				prog.count = 0;
+				prog.last = -1;
+				for (prog.total = 1, ui = 0; ui < wo[0]->inputChan; ui++, prog.total *= wo[0]->clutPoints)
 					; 
 				/* Add in cell center points */
 				for (extra = 1, ui = 0; ui < wo[0]->inputChan; ui++, extra *= (wo[0]->clutPoints-1))
 					;
-				cx.total += extra;
-				printf("Creating B to A tables\n");
-				printf(" 0%%"); fflush(stdout);
+				prog.total = cx.ntables * (prog.total + extra);
 			}
 
 #ifdef DEBUG_ONE
@@ -2441,32 +2994,103 @@ make_output_icc(
 #ifndef USE_LEASTSQUARES_APROX
 			fprintf(stderr,"!!!!! profile/profout: USE_LEASTSQUARES_APROX undef !!!!!\n");
 #endif
-			if (icmSetMultiLutTables(
-			        cx.ntables,
-			        wo,
-#ifdef USE_LEASTSQUARES_APROX
-					ICM_CLUT_SET_APXLS,
-#else
-					0,
+			/* Each intent table is computed independently of the others, so */
+			/* set them as stages. Inverse lookups aren't thread safe, so each */
+			/* table after the first gets its own A2B lookup to invert when */
+			/* they are set at the same time. The other lookups are only used */
+			/* in the forward direction, and are shared. */
+#ifdef WARN_CLUT_CLIPPING
+			bnthr = 1;		/* (The tables share the icc warnc) */
 #endif
-					&cx,						/* Context */
-					cx.pcsspace,				/* Input color space */
-					devspace, 					/* Output color space */
-					out_b2a_input,				/* Input transform PCS->PCS' */
-					NULL, NULL,					/* Use default PCS range */
-					out_b2a_clut,				/* Lab' -> Device' transfer function */
-					NULL, NULL,					/* Use default Device' range */
-					out_b2a_output) != 0)		/* Output transfer function, Device'->Device */
+			if (bnthr > cx.ntables)
+				bnthr = cx.ntables;
+
+			memset((void *)bsts, 0, sizeof(pstage) * 3);
+			for (i = 0; i < cx.ntables; i++) {
+				bt[i].cx = cx;				/* Structure copy */
+				bt[i].cx.tn0 = i;
+				bt[i].cx.tn1 = i+1;
+				bt[i].cx.nreuse = 0;
+				bt[i].wo = wo[i];
+
+				if (i > 0 && bnthr > 1) {
+					int flags = ICX_CLIP_NEAREST;
+#ifdef USE_CAM_CLIP_OPT
+					flags |= ICX_CAM_CLIP;
+#endif
+					if ((bt[i].cx.x = (icxLuLut *)wr_xicc->get_luobj(wr_xicc, flags, icmFwd,
+					                  !allintents ? icmDefaultIntent : icRelativeColorimetric,
+					                  wantLab ? icSigLabData : icSigXYZData,
+	                                  icmLuOrdNorm, &ovc, oink)) == NULL)
+						error ("%d, %s",wr_xicc->errc, wr_xicc->err);
+				}
+
+				bsts[i].name = i == 0 ? "Colorimetric B to A table"
+				             : i == 1 ? "Perceptual B to A table" : "Saturation B to A table";
+				bsts[i].func = out_b2a_fill;
+				bsts[i].cntx = (void *)&bt[i];
+			}
+
+			/* Do an in gamut and an out of gamut inverse lookup with each */
+			/* before starting any threads, so that anything the lookups */
+			/* set up on first use is done. */
+			{
+				double dv[MAX_CHAN], pcs[3], min[3], max[3];
+
+				for (i = 0; i < cx.x->inputChan; i++)
+					dv[i] = 0.5;
+				if (cx.x->clut(cx.x, pcs, dv) > 1)
+					error("%d, %s",cx.x->pp->errc,cx.x->pp->err);
+				cx.x->clutTable->get_out_range(cx.x->clutTable, min, max);
+				for (i = 0; i < cx.ntables; i++) {
+					if (bt[i].cx.x->inv_clut(bt[i].cx.x, dv, pcs) > 1
+					 || bt[i].cx.x->inv_clut(bt[i].cx.x, dv, max) > 1)
+						error("%d, %s",bt[i].cx.x->pp->errc,bt[i].cx.x->pp->err);
+				}
+			}
+
+			if (cx.verb) {
+				printf("Creating B to A tables\n");
+				if (bnthr > 1)
+					printf(" (Using up to %d threads)\n",bnthr);
+				printf(" 0%%"); fflush(stdout);
+			}
+
+			if (run_stages(bsts, cx.ntables, bnthr, 0) != 0)
 				error("Setting 16 bit PCS->Device Lut failed: %d, %s",wr_icco->errc,wr_icco->err);
+
+			for (cx.nreuse = i = 0; i < cx.ntables; i++) {
+				cx.nreuse += bt[i].cx.nreuse;
+				if (bt[i].cx.x != cx.x)
+					bt[i].cx.x->del((icxLuBase *)bt[i].cx.x);
+			}
 			if (cx.verb) {
 				printf("\n");
+				if (prev_icco != NULL)
+					printf("Reused %d values from the previous profiles B to A tables\n",cx.nreuse);
+			}
+
+			if (prev_icco != NULL) {
+				int tn;
+				for (tn = 0; tn < 3; tn++) {
+					if (cx.prev[tn] != NULL)
+						cx.prev[tn]->del(cx.prev[tn]);
+				}
+				free(cx.pchg);
+			}
+			if (cx.gcurve != NULL) {
+				cx.gcurve->del(cx.gcurve);
+				cx.gcurve = NULL;
 			}
 
 #ifdef WARN_CLUT_CLIPPING	/* Print warning if setting clut clips */
 			/* Ignore clipping of the input table, because this happens */
 			/* anyway due to Lab symetry adjustment. */
-			if (wr_icco->warnc != 0 && wr_icco->warnc != 1) {
-				warning("Values clipped in setting B2A LUT!");
+			for (i = 0; i < cx.ntables; i++) {
+				if (bt[i].warnc != 0 && bt[i].warnc != 1) {
+					warning("Values clipped in setting B2A LUT!");
+					break;
+				}
 			}
 #endif /* WARN_CLUT_CLIPPING */
 #endif /* !DEBUG_ONE */
@@ -2491,9 +3115,12 @@ make_output_icc(
 				src_xicc->del(src_xicc), src_xicc = NULL;
 			if (src_icco != NULL)
 				src_icco->del(src_icco), src_icco = NULL;
+			amutex_del(prog.lock);
 
-			if (verb)
+			if (verb) {
 				printf("Done B to A tables\n");
+				printf(" (B to A tables took %.1f seconds)\n",(msec_time() - stime)/1000.0);
+			}
 		}
 
 		/* Set the ColorantTable PCS values */
@@ -2523,12 +3150,16 @@ make_output_icc(
 		if (allintents) {	
 			icmLut *wo;
 			out_b2a_callback cx;
+			out_b2a_progress prog;
 			double gres = 0.0;
 
 			cx.verb = verb;
+			cx.prog = &prog;
+			amutex_init(prog.lock);
 			cx.pcsspace = wantLab ? icSigLabData : icSigXYZData;
 			cx.devspace = devspace;
 			cx.x = (icxLuLut *)AtoB;		/* A2B icxLuLut */
+			cx.gcurve = NULL;
 
 			if (verb)
 				printf("Creating gamut boundary table\n");
@@ -2566,9 +3197,9 @@ make_output_icc(
 
 			if (cx.verb) {
 				unsigned int ui;
-				cx.count = 0;
-				cx.last = -1;
-				for (cx.total = 1, ui = 0; ui < wo->inputChan; ui++, cx.total *= wo->clutPoints)
+				prog.count = 0;
+				prog.last = -1;
+				for (prog.total = 1, ui = 0; ui < wo->inputChan; ui++, prog.total *= wo->clutPoints)
 					; 
 				printf(" 0%%"); fflush(stdout);
 			}
@@ -2595,6 +3226,7 @@ make_output_icc(
 
 			cx.gam->del(cx.gam);		/* Done with gamut object */
 			cx.gam = NULL;
+			amutex_del(prog.lock);
 
 			if (verb)
 				printf("Done gamut boundary table\n");
@@ -2605,6 +3237,10 @@ make_output_icc(
 		AtoB->del(AtoB); /* Done with device to PCS lookup */
 		wr_xicc->del(wr_xicc);
 
+		if (prev_icco != NULL) {
+			prev_icco->del(prev_icco);
+			prev_fp->del(prev_fp);
+		}
 	}
 	/* Gamma/Shaper + matrix profile */
 	/* or XYZ cLUT with matrix as well. */
@@ -2616,6 +3252,7 @@ make_output_icc(
 		/* Wrap with an expanded icc */
 		if ((wr_xicc = new_xicc(wr_icco)) == NULL)
 			error("Creation of xicc failed");
+		wr_xicc->nthr = nthr;
 		
 		if (verb)
 			flags |= ICX_VERBOSE;
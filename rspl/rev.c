@@ -88,6 +88,7 @@
 
 #include "rspl_imp.h"
 #include "numlib.h"
+#include "amutex.h"
 #include "sort.h"		/* Heap sort */
 #include "counters.h"	/* Counter macros */
 
@@ -245,6 +246,10 @@ size_t g_test_ram = 0;			/* Amount of memory that has been tested to be allocata
 int g_no_rev_cache_instances = 0;
 rev_struct *g_rev_instances = NULL;
 
+/* Lock for the above instance list, and for the reference counts */
+/* of rev[] and nnrev[] lists that are shared between instances. */
+static amutex_static(g_rev_lock);
+
 /* ------------------------------------------------------ */
 /* Retry allocation routines - if the malloc fails,       */
 /* try reducing the cache size and trying again */
@@ -256,12 +261,16 @@ static void rev_reduce_cache(size_t size) {
 	rev_struct *rsi;
 	size_t ram;
 
+	amutex_lock(g_rev_lock);
+
 	/* Compute how much ram is currently allocated */
 	for (ram = 0, rsi = g_rev_instances; rsi != NULL; rsi = rsi->next)
 		ram += rsi->sz;
 
-	if (size > ram)
+	if (size > ram) {
+		amutex_unlock(g_rev_lock);
 		error("rev_reduce_cache: run out of rev  virtual memory!");
+	}
 
 //printf("~1 size = %d, g_test_ram = %d\n",size,g_test_ram);
 //printf("~1 rev: Reducing cache because alloc of %d bytes failed. Reduced from %d to %d MB\n",
@@ -280,6 +289,7 @@ static void rev_reduce_cache(size_t size) {
 		}
 //printf("~1 rev instance ram = %d MB\n",rsi->sz/1000000);
 	}
+	amutex_unlock(g_rev_lock);
 //fprintf(stdout, "\r~~1 There %s %d rev cache instance%s with %d Mbytes limit\n",
 //				g_no_rev_cache_instances > 1 ? "are" : "is",
 //                   g_no_rev_cache_instances,
@@ -4849,6 +4859,8 @@ init_rev(rspl *s) {
 	/* Second section */
 	s->rev.rev_valid = 0;
 	s->rev.nnrev = NULL;
+	s->rev.lsz = 0;
+	s->rev.shared = 0;
 
 	/* Third section */
 	s->rev.cache = NULL;
@@ -4920,14 +4932,16 @@ rspl *s		/* Pointer to rspl grid */
 	}
 
 	/* Free up the Second section */
+	amutex_lock(g_rev_lock);
 	if (s->rev.nnrev != NULL) {
 		/* Free arrays at grid points, taking care of reference count */
 		for (rpp = s->rev.nnrev; rpp < (s->rev.nnrev + s->rev.no); rpp++) {
 			if ((rp = *rpp) != NULL && --rp[2] <= 0) {
-				DECSZ(s, rp[0] * sizeof(int));
+				if (!s->rev.shared)
+					DECSZ(s, rp[0] * sizeof(int));
 				free(*rpp);
-				*rpp = NULL;
 			}
+			*rpp = NULL;
 		}
 		free(s->rev.nnrev);
 		DECSZ(s, s->rev.no * sizeof(int *));
@@ -4968,15 +4982,22 @@ rspl *s		/* Pointer to rspl grid */
 		/* Free arrays at grid points, taking care of reference count */
 		for (rpp = s->rev.rev; rpp < (s->rev.rev + s->rev.no); rpp++) {
 			if ((rp = *rpp) != NULL && --rp[2] <= 0) {
-				DECSZ(s, rp[0] * sizeof(int));
+				if (!s->rev.shared)
+					DECSZ(s, rp[0] * sizeof(int));
 				free(*rpp);
-				*rpp = NULL;
 			}
+			*rpp = NULL;
 		}
 		free(s->rev.rev);
 		DECSZ(s, s->rev.no * sizeof(int *));
 		s->rev.rev = NULL;
 	}
+	if (s->rev.shared) {
+		DECSZ(s, s->rev.lsz);
+		s->rev.shared = 0;
+	}
+	s->rev.lsz = 0;
+	amutex_unlock(g_rev_lock);
 
 	/* If first section has been initialised */
 	if (s->rev.inited != 0)	 {
@@ -5094,6 +5115,159 @@ struct _propvx{
 	struct _propvx *next;		/* Linked list for next seeds */
 }; typedef struct _propvx propvx;
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Instances of rspl that have identical forward grids (e.g. several */
+/* xicc lookups of the same profile table with different intents or */
+/* clip modes) will create identical rev[] and nnrev[] lists. Since */
+/* the lists are reference counted and read only once created, they */
+/* can be shared between the instances rather than re-created. */
+
+/* Compute a hash key of everything the rev[] and nnrev[] lists depend on. */
+/* (Assumes that the fwd vertex ink limit values have been computed) */
+static void rev_share_key(
+rspl *s,
+unsigned int key[2]
+) {
+	int i, e, f, di = s->di, fdi = s->fdi;
+	int uselim = (s->rev.sb != NULL && s->limiten);
+	unsigned int h0 = 2166136261u, h1 = 0x9747b28cu;
+	float *gp;
+
+#define REV_HASH(ww) {									\
+		unsigned int _w = (ww);							\
+		h0 = (h0 ^ _w) * 16777619u;						\
+		h1 = (h1 ^ _w) * 0x5bd1e995u; h1 ^= h1 >> 15;	\
+	}
+#define REV_HASHF(ff) {									\
+		union { float f; unsigned int u; } _c;			\
+		_c.f = (float)(ff);								\
+		REV_HASH(_c.u);									\
+	}
+
+	REV_HASH(di);
+	REV_HASH(fdi);
+	REV_HASH(s->rev.res);
+	REV_HASH(s->rev.fastsetup);
+	REV_HASH(uselim);
+	for (e = 0; e < di; e++) {
+		REV_HASH(s->g.res[e]);
+		REV_HASHF(s->g.l[e]);
+		REV_HASHF(s->g.h[e]);
+	}
+	for (f = 0; f < fdi; f++) {
+		REV_HASHF(s->rev.gl[f]);
+		REV_HASHF(s->rev.gh[f]);
+	}
+	if (uselim)
+		REV_HASHF(s->limitv);
+
+	for (gp = s->g.a, i = 0; i < s->g.no; gp += s->g.pss, i++) {
+		for (f = 0; f < fdi; f++)
+			REV_HASHF(gp[f]);
+		if (uselim)
+			REV_HASHF(gp[-1]);
+	}
+#undef REV_HASHF
+#undef REV_HASH
+
+	key[0] = h0;
+	key[1] = h1;
+}
+
+/* Return nz if the rev[] and nnrev[] lists of rspl o would be */
+/* identical to those of s. The hash key only narrows down the */
+/* candidates, this compares everything the key was computed from. */
+static int rev_share_same(
+rspl *s,
+rspl *o
+) {
+	int i, e, f, di = s->di, fdi = s->fdi;
+	int uselim = (s->rev.sb != NULL && s->limiten);
+	float *gp, *op;
+
+	if (o->di != di
+	 || o->fdi != fdi
+	 || o->rev.res != s->rev.res
+	 || o->rev.fastsetup != s->rev.fastsetup
+	 || (o->rev.sb != NULL && o->limiten) != uselim
+	 || o->g.no != s->g.no)
+		return 0;
+
+	for (e = 0; e < di; e++) {
+		if (o->g.res[e] != s->g.res[e]
+		 || (float)o->g.l[e] != (float)s->g.l[e]
+		 || (float)o->g.h[e] != (float)s->g.h[e])
+			return 0;
+	}
+	for (f = 0; f < fdi; f++) {
+		if ((float)o->rev.gl[f] != (float)s->rev.gl[f]
+		 || (float)o->rev.gh[f] != (float)s->rev.gh[f])
+			return 0;
+	}
+	if (uselim && (float)o->limitv != (float)s->limitv)
+		return 0;
+
+	for (gp = s->g.a, op = o->g.a, i = 0; i < s->g.no; gp += s->g.pss, op += o->g.pss, i++) {
+		for (f = 0; f < fdi; f++) {
+			if (gp[f] != op[f])
+				return 0;
+		}
+		if (uselim && gp[-1] != op[-1])
+			return 0;
+	}
+	return 1;
+}
+
+/* Look for another valid instance with the same rev[] and nnrev[] */
+/* lists, and share its lists if found. Return nz if shared. */
+static int rev_share_lists(
+rspl *s
+) {
+	rev_struct *rsi;
+	int i;
+
+	if (s->rev.fastsetup)	/* nnrev[] is filled in lazily, so can't share */
+		return 0;
+
+	amutex_lock(g_rev_lock);
+	for (rsi = g_rev_instances; rsi != NULL; rsi = rsi->next) {
+		if (rsi != &s->rev
+		 && rsi->rev_valid
+		 && !rsi->fastsetup
+		 && rsi->no == s->rev.no
+		 && rsi->key[0] == s->rev.key[0]
+		 && rsi->key[1] == s->rev.key[1]
+		 && rev_share_same(s, rsi->cache->s))
+			break;
+	}
+	if (rsi == NULL) {
+		amutex_unlock(g_rev_lock);
+		return 0;
+	}
+
+	for (i = 0; i < s->rev.no; i++) {
+		int *rp;
+		if ((rp = rsi->rev[i]) != NULL)
+			rp[2]++;
+		s->rev.rev[i] = rp;
+		if ((rp = rsi->nnrev[i]) != NULL)
+			rp[2]++;
+		s->rev.nnrev[i] = rp;
+	}
+
+	/* Each sharer accounts for the whole of the lists, */
+	/* and discounts them all when it releases them. */
+	rsi->shared = 1;
+	s->rev.shared = 1;
+	s->rev.lsz = rsi->lsz;
+	INCSZ(s, s->rev.lsz);
+	amutex_unlock(g_rev_lock);
+
+	DBG(("init_revaccell shared rev[] and nnrev[] lists with another instance\n"));
+
+	return 1;
+}
+
 /* Initialise the rev Second section acceleration information. */
 /* This is called when it is discovered on a call that s->rev.rev_valid == 0 */
 static void init_revaccell(
@@ -5124,6 +5298,7 @@ rspl *s
 	unsigned hashk;							/* Hash key */
 	nncache *ncp;	/* Hash entry pointer */ 
 	int nskcells = 0;					/* Number of skiped cells (debug) */
+	size_t sz0 = s->rev.sz;				/* Allocation before creating lists */
 #ifdef DEBUG
 	int cellinrevlist = 0;
 	int fwdcells = 0;
@@ -5168,6 +5343,16 @@ rspl *s
 		s->g.limitv_cached = 1;
 	}
 
+	/* If another instance has identical lists, share them */
+	rev_share_key(s, s->rev.key);
+	if (rev_share_lists(s)) {
+		if (vflag != NULL) {
+			DECSZ(s, rgno * sizeof(char));
+			free(vflag);
+		}
+		goto lists_done;
+	}
+
 	/* We then fill in the in-gamut reverse grid lookups, */
 	/* and identify nnrev prime seed verticies */
 
@@ -6124,6 +6309,10 @@ if (prop != NULL) {
 		}
 	}
 
+	s->rev.lsz = s->rev.sz - sz0;
+
+	lists_done:;
+	amutex_lock(g_rev_lock);
 	if (s->rev.rev_valid == 0 && di > 1) {
 		rev_struct *rsi;
 		size_t ram_portion = g_avail_ram;
@@ -6154,6 +6343,7 @@ if (prop != NULL) {
 			                    ram_portion/1000000);
 	}
 	s->rev.rev_valid = 1;
+	amutex_unlock(g_rev_lock);
 
 #ifdef DEBUG
 	if (fdi > 1) printf("%d cells in rev nn list\n",cellinrevlist);
@@ -6175,24 +6365,32 @@ rspl *s		/* Pointer to rspl grid */
 	invalidate_revcache(s->rev.cache);
 
 	/* Free up the contents of rev.rev[] and rev.nnrev[] */
+	amutex_lock(g_rev_lock);
 	if (s->rev.rev != NULL) {
 		for (rpp = s->rev.rev; rpp < (s->rev.rev + s->rev.no); rpp++) {
 			if ((rp = *rpp) != NULL && --rp[2] <= 0) {
-				DECSZ(s, rp[0] * sizeof(int));
+				if (!s->rev.shared)
+					DECSZ(s, rp[0] * sizeof(int));
 				free(*rpp);
-				*rpp = NULL;
 			}
+			*rpp = NULL;
 		}
 	}
 	if (s->rev.nnrev != NULL) {
 		for (rpp = s->rev.nnrev; rpp < (s->rev.nnrev + s->rev.no); rpp++) {
 			if ((rp = *rpp) != NULL && --rp[2] <= 0) {
-				DECSZ(s, rp[0] * sizeof(int));
+				if (!s->rev.shared)
+					DECSZ(s, rp[0] * sizeof(int));
 				free(*rpp);
-				*rpp = NULL;
 			}
+			*rpp = NULL;
 		}
 	}
+	if (s->rev.shared) {
+		DECSZ(s, s->rev.lsz);
+		s->rev.shared = 0;
+	}
+	s->rev.lsz = 0;
 
 	if (di > 1 && s->rev.rev_valid) {
 		rev_struct *rsi, **rsp;
@@ -6222,6 +6420,7 @@ rspl *s		/* Pointer to rspl grid */
 		}
 	}
 	s->rev.rev_valid = 0;
+	amutex_unlock(g_rev_lock);
 }
 
 /* ====================================================== */
@@ -407,6 +407,9 @@ struct _rev_struct {
 						/* [2] is reference count */
 						/* Then follows cube indexes */
 						/* The last entry is marked with -1 */
+	unsigned int key[2];	/* Hash of everything rev[] and nnrev[] depend on */
+	size_t lsz;			/* Memory accounted to rev[] and nnrev[] lists */
+	int shared;			/* NZ if rev[] and nnrev[] lists are shared with another instance */
 
 	/* Third section */
 	revcache *cache;	/* Where cells are allocated and cached */
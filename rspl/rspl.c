@@ -1388,6 +1388,7 @@ int           co[]	/* Coordinates to initialise (May be NULL) */
 
 	p->di = di;
 	p->tbits = 0;
+	p->mbits = 0;
 	for (e = 0; e < di; e++) {
 		p->res[e] = res[e];
 
@@ -1395,6 +1396,17 @@ int           co[]	/* Coordinates to initialise (May be NULL) */
 		for (p->bits[e] = 0; (1u << p->bits[e]) < res[e]; p->bits[e]++)
 			;
 		p->tbits += p->bits[e];
+		if (p->bits[e] > p->mbits)
+			p->mbits = p->bits[e];
+	}
+
+	/* Use a true Hilbert curve over the enclosing 2^mbits cube */
+	/* if its index will fit, else fall back to the Gray code sequence. */
+	if ((di * p->mbits) < (8 * sizeof(unsigned int))) {
+		p->hilb = 1;
+		p->tbits = di * p->mbits;
+	} else {
+		p->hilb = 0;
 	}
 
 	/* Compute the total count mask */
@@ -1423,6 +1435,48 @@ rpsh *p	/* Pointer to structure */
 	p->ix = 0;
 }
 
+/* Convert a di * bits Hilbert index into coordinates */
+/* (From J. Skilling, "Programming the Hilbert curve", AIP 2004) */
+static void rpsh_hilbert(
+unsigned int ix,	/* Hilbert index */
+int di,				/* Dimensionality */
+unsigned int bits,	/* Bits per coordinate, > 0 */
+unsigned int *co	/* Return coordinates */
+) {
+	unsigned int b, m, t, q;
+	int e;
+
+	/* Distribute the index bits into the transposed form */
+	for (e = 0; e < di; e++)
+		co[e] = 0;
+	for (b = 0; b < bits; b++) {
+		for (e = di-1; e >= 0; e--) {
+			co[e] |= (ix & 1) << b;
+			ix >>= 1;
+		}
+	}
+
+	/* Gray decode */
+	t = co[di-1] >> 1;
+	for (e = di-1; e > 0; e--)
+		co[e] ^= co[e-1];
+	co[0] ^= t;
+
+	/* Undo the excess work */
+	m = 2u << (bits-1);
+	for (q = 2; q != m; q <<= 1) {
+		unsigned int p = q - 1;
+		for (e = di-1; e >= 0; e--) {
+			if (co[e] & q) {		/* Invert */
+				co[0] ^= p;
+			} else {				/* Exchange */
+				t = (co[0] ^ co[e]) & p;
+				co[0] ^= t;
+				co[e] ^= t;
+			}
+		}
+	}
+}
 
 /* Increment pseudo-hilbert coordinates */
 /* Return non-zero if count rolls over to 0 */
@@ -1433,6 +1487,49 @@ int coa[]	/* Coordinates to return */
 	int di = p->di;
 	int e;
 
+	if (p->hilb) {
+		unsigned int bits = p->mbits;
+		unsigned int tco[MXDI];
+
+		for (;;) {
+			unsigned int b, sb;
+			int out;
+
+			p->ix = (p->ix + 1) & p->tmask;
+
+			if (p->ix == 0) {			/* Rolled over */
+				for (e = 0; e < di; e++)
+					coa[e] = 0;
+				break;
+			}
+			rpsh_hilbert(p->ix, di, bits, tco);
+
+			/* See if the point is within the grid, and if it isn't, */
+			/* find the largest sub-cube containing it that lies */
+			/* entirely outside the grid, so that we can skip all of it. */
+			for (out = 0, sb = 0, e = 0; e < di; e++) {
+				if (tco[e] < p->res[e])
+					continue;
+				out = 1;
+				for (b = bits-1; b > sb; b--) {
+					if (((tco[e] >> b) << b) >= p->res[e]) {
+						sb = b;
+						break;
+					}
+				}
+			}
+			if (!out) {
+				for (e = 0; e < di; e++)
+					coa[e] = tco[e];
+				break;
+			}
+			/* Skip to the last index of the sub-cube */
+			sb *= di;
+			p->ix = (((p->ix >> sb) + 1) << sb) - 1;
+		}
+		return (p->ix == 0);
+	}
+
 	do {
 		unsigned int b, tb;
 		int gix;	/* Gray code index */
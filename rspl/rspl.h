@@ -591,18 +591,22 @@ rspl *new_rspl(int flags, int di, int fdi);	/* Input and output dimentiality */
 
 /* Utility functions */
 
-/* The multi-dimensional access sequence is a distributed */
-/* Gray code sequence, with direction reversal */
-/* on every alternate power of 2 scale. */
+/* The multi-dimensional access sequence is a Hilbert curve */
+/* over the enclosing power of 2 cube, skipping sub-cubes that */
+/* lie outside the grid, so that each step moves to a neighbouring */
+/* grid point. If the curve index won't fit in an unsigned int, */
+/* a distributed Gray code sequence is used instead. */
 /* It is intended to aid cache access locality in multi-dimensional */
-/* regular sampling. It approximates the Hilbert curve sequence. */
+/* regular sampling. */
 
 /* Structure to hold sequencer info */
 struct _rpsh {
 	int      di;	/* Dimensionality */
 	unsigned res[MXDI];	 /* Resolution per coordinate */
 	unsigned bits[MXDI]; /* Bits per coordinate */
+	unsigned mbits;	/* Maximum bits per coordinate */
 	unsigned tbits;	/* Total bits */
+	int hilb;		/* nz if using Hilbert curve */
 	unsigned ix;	/* Current binary index */
 	unsigned tmask;	/* Total 2^n count mask */
 	unsigned count;	/* Usable count */
@@ -39,6 +39,7 @@
 #include "copyright.h"
 #include "config.h"
 #include "numlib.h"
+#include "amutex.h"
 #include "xspect.h"
 #include "insttypes.h"
 #include "icoms.h"
@@ -182,15 +183,28 @@ athread *p
 	if (p == NULL)
 		return;
 
-	if (p->th != NULL) {		/* Oops. this isn't good. */
-		DBG("athread_del calling TerminateThread() because thread hasn't finished\n");
-		TerminateThread(p->th, -1);		/* But it is worse to leave it hanging around */
+	if (p->th != NULL) {
+		if (!p->finished) {		/* Oops. this isn't good. */
+			DBG("athread_del calling TerminateThread() because thread hasn't finished\n");
+			TerminateThread(p->th, -1);		/* But it is worse to leave it hanging around */
+		}
 		CloseHandle(p->th);
 	}
 
 	free(p);
 }
 
+/* Wait for the thread to finish and return its result */
+static int athread_wait(
+athread *p
+) {
+	DBG("athread_wait called\n");
+
+	if (p->th != NULL)
+		WaitForSingleObject(p->th, INFINITE);
+	return p->result;
+}
+
 /* _beginthread doesn't leak memory, but */
 /* needs to be linked to a different library */
 #ifdef USE_BEGINTHREAD
@@ -206,8 +220,7 @@ DWORD WINAPI threadproc(
 	athread *p = (athread *)lpParameter;
 
 	p->result = p->function(p->context);
-	CloseHandle(p->th);
-	p->th = NULL;
+	p->finished = 1;
 #ifdef USE_BEGINTHREAD
 #else
 	return 0;
@@ -227,6 +240,7 @@ athread *new_athread(
 
 	p->function = function;
 	p->context = context;
+	p->wait = athread_wait;
 	p->del = athread_del;
 
 	/* Create a thread */
@@ -246,6 +260,16 @@ athread *new_athread(
 	return p;
 }
 
+/* Return the number of processors available to the process */
+int system_ncpus(void) {
+	SYSTEM_INFO si;
+
+	GetSystemInfo(&si);
+	if (si.dwNumberOfProcessors < 1)
+		return 1;
+	return (int)si.dwNumberOfProcessors;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - */
 
 /* Delete a file */
@@ -569,18 +593,35 @@ athread *p
 	if (p == NULL)
 		return;
 
-	pthread_cancel(p->thid);
-	pthread_join(p->thid, NULL);
+	if (!p->joined) {
+		if (!p->finished)
+			pthread_cancel(p->thid);
+		pthread_join(p->thid, NULL);
+	}
 
 	free(p);
 }
 
+/* Wait for the thread to finish and return its result */
+static int athread_wait(
+athread *p
+) {
+	DBG("athread_wait called\n");
+
+	if (!p->joined) {
+		pthread_join(p->thid, NULL);
+		p->joined = 1;
+	}
+	return p->result;
+}
+
 static void *threadproc(
 	void *param
 ) {
 	athread *p = (athread *)param;
 
 	p->result = p->function(p->context);
+	p->finished = 1;
 	return 0;
 }
  
@@ -598,13 +639,14 @@ athread *new_athread(
 
 	p->function = function;
 	p->context = context;
+	p->wait = athread_wait;
 	p->del = athread_del;
 
 	/* Create a thread */
 	rv = pthread_create(&p->thid, NULL, threadproc, (void *)p);
 	if (rv != 0) {
 		DBG("Failed to create thread\n");
-		athread_del(p);
+		free(p);				/* There is no thread to cancel */
 		return NULL;
 	}
 
@@ -612,6 +654,15 @@ athread *new_athread(
 	return p;
 }
 
+/* Return the number of processors available to the process */
+int system_ncpus(void) {
+	long rv;
+
+	if ((rv = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		return 1;
+	return (int)rv;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - */
 
 /* Delete a file */
@@ -695,3 +746,228 @@ int kill_nprocess(char *pname) {
 
 /* ============================================================= */
 
+/* Common to all systems */
+
+/* The worker thread set */
+typedef struct {
+	athreads pub;			/* Public part, must be first */
+
+	athread **ths;			/* nthr-1 worker threads */
+	amutex lock;			/* Lock for the following */
+#if defined(NT)
+	HANDLE go;				/* Semaphore released to start the workers */
+	HANDLE done;			/* Event set when the last worker has finished */
+#else
+	pthread_cond_t go;		/* Signalled to start the workers */
+	pthread_cond_t done;	/* Signalled when the last worker has finished */
+#endif
+	int gen;				/* Loop generation, incremented by each run() */
+	int quit;				/* NZ to stop the workers */
+	int n, next;			/* Loop count, next index to be done */
+	int busy;				/* Number of threads doing indexes */
+	int rv;					/* First nz function return value */
+	int (*function)(void *context, int i);
+	void *context;
+} athreads_imp;
+
+/* Do loop indexes until there are none left. */
+/* (Called and returns with the lock held) */
+static void athreads_work(athreads_imp *p) {
+	int i, rv;
+
+	p->busy++;
+	while (p->next < p->n) {
+		i = p->next++;
+		amutex_unlock(p->lock);
+		rv = p->function(p->context, i);
+		amutex_lock(p->lock);
+		if (rv != 0 && p->rv == 0)
+			p->rv = rv;
+	}
+	if (--p->busy == 0) {
+#if defined(NT)
+		SetEvent(p->done);
+#else
+		pthread_cond_signal(&p->done);
+#endif
+	}
+}
+
+/* Worker thread */
+static int athreads_worker(void *cntx) {
+	athreads_imp *p = (athreads_imp *)cntx;
+	int gen;
+
+	amutex_lock(p->lock);
+	for (gen = p->gen;;) {
+		while (!p->quit && p->gen == gen) {
+#if defined(NT)
+			amutex_unlock(p->lock);
+			WaitForSingleObject(p->go, INFINITE);
+			amutex_lock(p->lock);
+#else
+			pthread_cond_wait(&p->go, &p->lock);
+#endif
+		}
+		if (p->quit)
+			break;
+		gen = p->gen;
+		athreads_work(p);
+	}
+	amutex_unlock(p->lock);
+	return 0;
+}
+
+static int athreads_run(
+athreads *pp,
+int n,
+int (*function)(void *context, int i),
+void *context
+) {
+	athreads_imp *p = (athreads_imp *)pp;
+	int rv;
+
+	amutex_lock(p->lock);
+	p->function = function;
+	p->context = context;
+	p->n = n;
+	p->next = 0;
+	p->rv = 0;
+
+	if (n > 1 && p->pub.nthr > 1) {
+		p->gen++;
+#if defined(NT)
+		ReleaseSemaphore(p->go, p->pub.nthr-1, NULL);
+#else
+		pthread_cond_broadcast(&p->go);
+#endif
+	}
+
+	/* Do our share, and wait for any workers still going */
+	athreads_work(p);
+	while (p->busy > 0) {
+#if defined(NT)
+		amutex_unlock(p->lock);
+		WaitForSingleObject(p->done, INFINITE);
+		amutex_lock(p->lock);
+#else
+		pthread_cond_wait(&p->done, &p->lock);
+#endif
+	}
+	rv = p->rv;
+	amutex_unlock(p->lock);
+
+	return rv;
+}
+
+static void athreads_del(athreads *pp) {
+	athreads_imp *p = (athreads_imp *)pp;
+	int i;
+
+	if (p == NULL)
+		return;
+
+	if (p->ths != NULL) {
+		amutex_lock(p->lock);
+		p->quit = 1;
+#if defined(NT)
+		ReleaseSemaphore(p->go, p->pub.nthr-1, NULL);
+#else
+		pthread_cond_broadcast(&p->go);
+#endif
+		amutex_unlock(p->lock);
+
+		for (i = 0; i < (p->pub.nthr-1); i++) {
+			if (p->ths[i] != NULL) {
+				p->ths[i]->wait(p->ths[i]);
+				p->ths[i]->del(p->ths[i]);
+			}
+		}
+		free(p->ths);
+	}
+#if defined(NT)
+	CloseHandle(p->go);
+	CloseHandle(p->done);
+#else
+	pthread_cond_destroy(&p->go);
+	pthread_cond_destroy(&p->done);
+#endif
+	amutex_del(p->lock);
+	free(p);
+}
+
+athreads *new_athreads(int nthr) {
+	athreads_imp *p;
+	int i;
+
+	if ((p = (athreads_imp *)calloc(sizeof(athreads_imp), 1)) == NULL)
+		return NULL;
+
+	if (nthr < 1)
+		nthr = 1;
+	p->pub.nthr = nthr;
+	p->pub.run = athreads_run;
+	p->pub.del = athreads_del;
+
+	amutex_init(p->lock);
+#if defined(NT)
+	p->go = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+	p->done = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (p->go == NULL || p->done == NULL) {
+		if (p->go != NULL)
+			CloseHandle(p->go);
+		if (p->done != NULL)
+			CloseHandle(p->done);
+		amutex_del(p->lock);
+		free(p);
+		return NULL;
+	}
+#else
+	pthread_cond_init(&p->go, NULL);
+	pthread_cond_init(&p->done, NULL);
+#endif
+
+	if (nthr > 1) {
+		if ((p->ths = (athread **)calloc(sizeof(athread *), nthr-1)) == NULL) {
+			athreads_del(&p->pub);
+			return NULL;
+		}
+		for (i = 0; i < (nthr-1); i++) {
+			if ((p->ths[i] = new_athread(athreads_worker, (void *)p)) == NULL) {
+				athreads_del(&p->pub);
+				return NULL;
+			}
+		}
+	}
+
+	return &p->pub;
+}
+
+/* Run a single parallel loop using up to nthr threads */
+int athreads_for(
+int nthr,
+int n,
+int (*function)(void *context, int i),
+void *context
+) {
+	athreads *ths = NULL;
+	int i, rv = 0, rv2;
+
+	if (nthr > n)
+		nthr = n;
+	if (nthr > 1)
+		ths = new_athreads(nthr);
+
+	if (ths != NULL) {
+		rv = ths->run(ths, n, function, context);
+		ths->del(ths);
+	} else {
+		for (i = 0; i < n; i++) {
+			if ((rv2 = function(context, i)) != 0 && rv == 0)
+				rv = rv2;
+		}
+	}
+	return rv;
+}
+
+/* ============================================================= */
@@ -80,7 +80,9 @@ struct _athread {
 #endif
 #if defined (UNIX) || defined(__APPLE__)
 	pthread_t thid;			/* Thread ID */
+	int joined;				/* NZ if the thread has been waited for */
 #endif
+	int finished;			/* NZ if the thread function has returned */
 	int result;				/* Return code from thread function */
 
 	/* Thread function to call */
@@ -89,6 +91,10 @@ struct _athread {
 	/* And the context to call it with */
 	void *context;
 
+	/* Wait for the thread function to return, and */
+	/* return its result. */
+	int (*wait)(struct _athread *p);
+
     /* Kill the thread and delete the object */
 	/* (Killing it may have side effects, so this is a last */
 	/*  resort if the thread hasn't exited) */
@@ -101,6 +107,37 @@ struct _athread {
 /* It should return 0 on completion or exit, nz on error. */
 athread *new_athread(int (*function)(void *context), void *context);
 
+/* Return the number of processors available to the process */
+/* (for deciding how many worker threads to start) */
+int system_ncpus(void);
+
+/* A set of worker threads, kept for running a series of */
+/* parallel loops without creating threads for each one. */
+struct _athreads {
+	int nthr;				/* Number of threads used, including the caller of run() */
+
+	/* Call function(context, i) for i = 0 .. n-1, spread across the worker */
+	/* threads and the calling thread, and return once they have all returned. */
+	/* Return the first nz value returned by function, or 0. */
+	/* run() must not be called from more than one thread at a time. */
+	int (*run)(struct _athreads *p, int n, int (*function)(void *context, int i),
+	           void *context);
+
+	/* Stop the worker threads and delete the object */
+	void (*del)(struct _athreads *p);
+
+}; typedef struct _athreads athreads;
+
+/* Create a set of nthr-1 worker threads, so that run() uses */
+/* nthr threads. Return NULL on error. */
+athreads *new_athreads(int nthr);
+
+/* Run a single parallel loop, calling function(context, i) for */
+/* i = 0 .. n-1 using up to nthr threads, and return the first nz */
+/* value returned by function, or 0. The loop is run in the calling */
+/* thread if nthr <= 1, or if the threads can't be created. */
+int athreads_for(int nthr, int n, int (*function)(void *context, int i), void *context);
+
 #ifdef NEVER
 
 /* Ideas for worker variant on thread: */
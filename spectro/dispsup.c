@@ -32,6 +32,7 @@
 #include "icoms.h"
 #include "inst.h"
 #include "spyd2.h"
+#include "simdisp.h"
 #include "conv.h"
 #include "dispwin.h"
 #include "dispsup.h"
@@ -49,6 +50,10 @@
 #define FAKE_NOISE 0.01		/* Add noise to fake devices XYZ */
 #define FAKE_BITS 9			/* Number of bits of significance of fake device */
 
+#define DISP_MAX_AVG 32		/* Maximum number of readings adaptively averaged */
+#define DISP_DEF_AVG 8		/* Default maximum number of readings averaged */
+#define DISP_MIN_DOF 8		/* Degrees of freedom before noise estimate is trusted */
+
 /* -------------------------------------------------------- */
 
 /* A default calibration user interaction handler using the console. */
@@ -477,6 +482,269 @@ int debug				/* Debug flag */
 	return 0;
 }
 
+/* Set the test window color, and the simulated display color if there is one. */
+/* Return nz on error */
+static int disprd_set_color(disprd *p, double r, double g, double b) {
+	int rv;
+
+	if (p->dw != NULL
+	 && (rv = p->dw->set_color(p->dw, r, g, b)) != 0) {
+		DBG((dbgo,"set_color() returned %d\n",rv))
+		return rv;
+	}
+
+	if (p->sim != NULL) {
+		double rgb[3];
+		int j;
+
+		rgb[0] = r;
+		rgb[1] = g;
+		rgb[2] = b;
+
+		/* If we have a RAMDAC, apply it to the color */
+		if (p->cal[0][0] >= 0.0) {
+			double inputEnt_1 = (double)(p->ncal-1);
+
+			for (j = 0; j < 3; j++) {
+				unsigned int ix;
+				double val, w;
+
+				val = rgb[j] * inputEnt_1;
+				if (val < 0.0) {
+					val = 0.0;
+				} else if (val > inputEnt_1) {
+					val = inputEnt_1;
+				}
+				ix = (unsigned int)floor(val);		/* Coordinate */
+				if (ix > (p->ncal-2))
+					ix = (p->ncal-2);
+				w = val - (double)ix;		/* weight */
+				val = p->cal[j][ix];
+				rgb[j] = val + w * (p->cal[j][ix+1] - val);
+			}
+		}
+		p->sim->set_color(p->sim, rgb);
+	}
+	return 0;
+}
+
+/* Take one reading of the patch currently being displayed, */
+/* dealing with any errors that can be retried. */
+/* Return nz on fail/abort, with the same codes as disprd_read() */
+static int disprd_read_one(
+	disprd *p,
+	col *scb,		/* Patch being read */
+	ipatch *val		/* Return value */
+) {
+	int rv;
+	int ch;			/* Character */
+
+	/* Until we give up retrying */
+	for (;;) {
+		val->XYZ_v = 0;		/* No readings are valid */
+		val->aXYZ_v = 0;
+		val->sp.spec_n = 0;
+		val->duration = 0.0;
+
+		if ((rv = p->it->read_sample(p->it, scb->id, val)) != inst_ok
+		     && (rv & inst_mask) != inst_user_trig) {
+			DBG((dbgo,"read_sample returned '%s' (%s)\n",
+		       p->it->inst_interp_error(p->it, rv), p->it->interp_error(p->it, rv)))
+
+			/* Deal with a user terminate */
+			if ((rv & inst_mask) == inst_user_term) {
+				return 4;
+
+			/* Deal with a user abort */
+			} else if ((rv & inst_mask) == inst_user_abort) {
+				empty_con_chars();
+				printf("\nSample read stopped at user request!\n");
+				printf("Hit Esc or Q to give up, any other key to retry:"); fflush(stdout);
+				if ((ch = next_con_char()) == 0x1b || ch == 0x3 || ch == 'q' || ch == 'Q') {
+					printf("\n");
+					return 1;
+				}
+				printf("\n");
+				continue;
+
+			/* Deal with needing calibration */
+			} else if ((rv & inst_mask) == inst_needs_cal) {
+				disp_win_info dwi;
+				dwi.dw = p->dw;		/* Set window to use */
+				printf("\nSample read failed because instruments needs calibration\n");
+				rv = inst_handle_calibrate(p->it, inst_calt_all, inst_calc_none, &dwi);
+				if (rv != inst_ok) {	/* Abort or fatal error */
+					return 1;
+				}
+				continue;
+
+			/* Deal with a bad sensor position */
+			} else if ((rv & inst_mask) == inst_wrong_sensor_pos) {
+				empty_con_chars();
+				printf("\n\nSpot read failed due to the sensor being in the wrong position\n");
+				printf("(%s)\n",p->it->interp_error(p->it, rv));
+				printf("Correct position then hit Esc or Q to give up, any other key to retry:"); fflush(stdout);
+				if ((ch = next_con_char()) == 0x1b || ch == 0x3 || ch == 'q' || ch == 'Q') {
+					printf("\n");
+					return 1;
+				}
+				printf("\n");
+				continue;
+
+			/* Deal with a misread */
+			} else if ((rv & inst_mask) == inst_misread) {
+				empty_con_chars();
+				printf("\nSample read failed due to misread\n");
+				printf("Hit Esc or Q to give up, any other key to retry:"); fflush(stdout);
+				if ((ch = next_con_char()) == 0x1b || ch == 0x3 || ch == 'q' || ch == 'Q') {
+					printf("\n");
+					return 1;
+				}
+				printf("\n");
+				continue;
+
+			/* Deal with a communications error */
+			} else if ((rv & inst_mask) == inst_coms_fail) {
+				empty_con_chars();
+				printf("\nSample read failed due to communication problem.\n");
+				printf("Hit Esc or Q to give up, any other key to retry:"); fflush(stdout);
+				if ((ch = next_con_char()) == 0x1b || ch == 0x3 || ch == 'q' || ch == 'Q') {
+					printf("\n");
+					return 1;
+				}
+				printf("\n");
+				if (p->it->icom->port_type(p->it->icom) == icomt_serial) {
+					/* Allow retrying at a lower baud rate */
+					int tt = p->it->last_comerr(p->it);
+					if (tt & (ICOM_BRK | ICOM_FER | ICOM_PER | ICOM_OER)) {
+						if (p->br == baud_19200) p->br = baud_9600;
+						else if (p->br == baud_9600) p->br = baud_4800;
+						else if (p->br == baud_2400) p->br = baud_1200;
+						else p->br = baud_1200;
+					}
+					if ((rv = p->it->init_coms(p->it, p->comport, p->br, p->fc, 15.0)) != inst_ok) {
+						DBG((dbgo,"init_coms returned '%s' (%s)\n",
+					       p->it->inst_interp_error(p->it, rv), p->it->interp_error(p->it, rv)))
+						return 2;
+					}
+				}
+			continue;
+			}
+		} else {
+			return 0;		/* Sucesful reading */
+		}
+	}
+}
+
+/* Return the adaptive averaging noise band for a Y value */
+static int disprd_nv_band(double yv) {
+	int bn;
+
+	if (yv <= 1e-3)
+		return 0;
+	bn = (int)floor(log10(yv)) + 3;
+	if (bn >= DISP_NV_BANDS)
+		bn = DISP_NV_BANDS-1;
+	return bn;
+}
+
+/* Average further readings of the patch currently being displayed, */
+/* aiming for a standard error of Y of avg_tol of its value. The number */
+/* of readings needed is predicted from the relative noise variance */
+/* pooled over the previous patches of a similar level (by decade of Y), */
+/* so that patches where the noise is low relative to the value mostly */
+/* get one reading, and those where it is high get more. */
+/* Return nz on fail/abort, with the same codes as disprd_read() */
+static int disprd_average(
+	disprd *p,
+	col *scb,		/* Patch being read */
+	ipatch *val		/* First reading, returns average */
+) {
+	ipatch rd;
+	double yv[DISP_MAX_AVG], ym, ss, nvs;
+	int n, nn, ny, nx, nax, nsp, nvd, bn, j, rv;
+
+	if (!val->aXYZ_v && !val->XYZ_v)
+		return 0;
+	yv[0] = val->aXYZ_v ? val->aXYZ[1] : val->XYZ[1];
+	ny = nx = nax = nsp = 1;
+
+	/* Use the noise estimate of this level if there is enough of it, */
+	/* or else that of all levels. */
+	bn = disprd_nv_band(fabs(yv[0]));
+	nvs = p->nv_sum[bn];
+	nvd = p->nv_dof[bn];
+	if (nvd < DISP_MIN_DOF) {
+		for (nvs = 0.0, nvd = j = 0; j < DISP_NV_BANDS; j++) {
+			nvs += p->nv_sum[j];
+			nvd += p->nv_dof[j];
+		}
+	}
+
+	/* Until we have an idea of the noise, take at least two readings */
+	if (nvd < DISP_MIN_DOF) {
+		nn = 2;
+	} else {
+		double var = nvs/nvd;			/* Relative variance of one reading */
+		double tgt = p->avg_tol * p->avg_tol;
+
+		if ((tgt * p->avg_max) <= var)
+			nn = p->avg_max;
+		else
+			nn = (int)ceil(var/tgt);
+	}
+	if (nn > p->avg_max)
+		nn = p->avg_max;
+
+	for (n = 1; n < nn; n++) {
+		if ((rv = disprd_read_one(p, scb, &rd)) != 0)
+			return rv;
+
+		if (val->XYZ_v && rd.XYZ_v) {
+			for (j = 0; j < 3; j++)
+				val->XYZ[j] += rd.XYZ[j];
+			nx++;
+		}
+		if (val->aXYZ_v && rd.aXYZ_v) {
+			for (j = 0; j < 3; j++)
+				val->aXYZ[j] += rd.aXYZ[j];
+			nax++;
+		}
+		if (val->sp.spec_n > 0 && rd.sp.spec_n == val->sp.spec_n) {
+			for (j = 0; j < val->sp.spec_n; j++)
+				val->sp.spec[j] += rd.sp.spec[j];
+			nsp++;
+		}
+		if (val->aXYZ_v ? rd.aXYZ_v : rd.XYZ_v)
+			yv[ny++] = val->aXYZ_v ? rd.aXYZ[1] : rd.XYZ[1];
+	}
+	if (n <= 1)
+		return 0;
+
+	/* Divide by the number of readings actually summed */
+	for (j = 0; j < 3; j++) {
+		val->XYZ[j] /= (double)nx;
+		val->aXYZ[j] /= (double)nax;
+	}
+	for (j = 0; j < val->sp.spec_n; j++)
+		val->sp.spec[j] /= (double)nsp;
+
+	/* Add the deviations relative to the mean to the pooled noise estimate */
+	for (ym = 0.0, j = 0; j < ny; j++)
+		ym += yv[j];
+	ym /= (double)ny;
+	if (ny > 1 && ym > 1e-6) {
+		for (ss = 0.0, j = 0; j < ny; j++)
+			ss += (yv[j] - ym) * (yv[j] - ym);
+		bn = disprd_nv_band(ym);
+		p->nv_sum[bn] += ss/(ym * ym);
+		p->nv_dof[bn] += ny - 1;
+		DBG((dbgo,"averaged %d readings, relative noise estimate %f\n",n,sqrt(p->nv_sum[bn]/p->nv_dof[bn])))
+	}
+
+	return 0;
+}
+
 /* Take a series of readings from the display */
 /* Return nz on fail/abort */
 /* 1 = user aborted */
@@ -497,7 +765,6 @@ static int disprd_read(
 	int j, rv;
 	int patch;
 	ipatch val;		/* Return value */
-	int ch;			/* Character */
 	int cal_type;
 	char id[CALIDLEN];
 
@@ -517,7 +784,7 @@ static int disprd_read(
 		else
 			calc = inst_calc_disp_white;
 
-		if ((rv = p->dw->set_color(p->dw, 1.0, 1.0, 1.0)) != 0) {
+		if ((rv = disprd_set_color(p, 1.0, 1.0, 1.0)) != 0) {
 			DBG((dbgo,"set_color() returned %s\n",rv))
 			return 3;
 		}
@@ -535,7 +802,7 @@ static int disprd_read(
 			col tc;
 			inst_cal_cond calc = inst_calc_proj_white;
 	
-			if ((rv = p->dw->set_color(p->dw, 1.0, 1.0, 1.0)) != 0) {
+			if ((rv = disprd_set_color(p, 1.0, 1.0, 1.0)) != 0) {
 				DBG((dbgo,"set_color() returned %s\n",rv))
 				return 3;
 			}
@@ -552,7 +819,7 @@ static int disprd_read(
 			col tc;
 			inst_cal_cond calc = inst_calc_disp_white;
 	
-			if ((rv = p->dw->set_color(p->dw, 1.0, 1.0, 1.0)) != 0) {
+			if ((rv = disprd_set_color(p, 1.0, 1.0, 1.0)) != 0) {
 				DBG((dbgo,"set_color() returned %s\n",rv))
 				return 3;
 			}
@@ -578,106 +845,18 @@ static int disprd_read(
 		}
 		DBG((dbgo,"About to read patch %d\n",patch))
 
-		if ((rv = p->dw->set_color(p->dw, scb->r, scb->g, scb->b)) != 0) {
+		if ((rv = disprd_set_color(p, scb->r, scb->g, scb->b)) != 0) {
 			DBG((dbgo,"set_color() returned %s\n",rv))
 			return 3;
 		}
 
-		/* Until we give up retrying */
-		for (;;) {
-			val.XYZ_v = 0;		/* No readings are valid */
-			val.aXYZ_v = 0;
-			val.sp.spec_n = 0;
-			val.duration = 0.0;
-	
-			if ((rv = p->it->read_sample(p->it, scb->id, &val)) != inst_ok
-			     && (rv & inst_mask) != inst_user_trig) {
-				DBG((dbgo,"read_sample returned '%s' (%s)\n",
-			       p->it->inst_interp_error(p->it, rv), p->it->interp_error(p->it, rv)))
+		if ((rv = disprd_read_one(p, scb, &val)) != 0)
+			return rv;
+
+		/* Average more readings if the noise level warrants it */
+		if (p->avg_tol > 0.0 && (rv = disprd_average(p, scb, &val)) != 0)
+			return rv;
 
-				/* Deal with a user terminate */
-				if ((rv & inst_mask) == inst_user_term) {
-					return 4;
-
-				/* Deal with a user abort */
-				} else if ((rv & inst_mask) == inst_user_abort) {
-					empty_con_chars();
-					printf("\nSample read stopped at user request!\n");
-					printf("Hit Esc or Q to give up, any other key to retry:"); fflush(stdout);
-					if ((ch = next_con_char()) == 0x1b || ch == 0x3 || ch == 'q' || ch == 'Q') {
-						printf("\n");
-						return 1;
-					}
-					printf("\n");
-					continue;
-
-				/* Deal with needing calibration */
-				} else if ((rv & inst_mask) == inst_needs_cal) {
-					disp_win_info dwi;
-					dwi.dw = p->dw;		/* Set window to use */
-					printf("\nSample read failed because instruments needs calibration\n");
-					rv = inst_handle_calibrate(p->it, inst_calt_all, inst_calc_none, &dwi);
-					if (rv != inst_ok) {	/* Abort or fatal error */
-						return 1;
-					}
-					continue;
-
-				/* Deal with a bad sensor position */
-				} else if ((rv & inst_mask) == inst_wrong_sensor_pos) {
-					empty_con_chars();
-					printf("\n\nSpot read failed due to the sensor being in the wrong position\n");
-					printf("(%s)\n",p->it->interp_error(p->it, rv));
-					printf("Correct position then hit Esc or Q to give up, any other key to retry:"); fflush(stdout);
-					if ((ch = next_con_char()) == 0x1b || ch == 0x3 || ch == 'q' || ch == 'Q') {
-						printf("\n");
-						return 1;
-					}
-					printf("\n");
-					continue;
-
-				/* Deal with a misread */
-				} else if ((rv & inst_mask) == inst_misread) {
-					empty_con_chars();
-					printf("\nSample read failed due to misread\n");
-					printf("Hit Esc or Q to give up, any other key to retry:"); fflush(stdout);
-					if ((ch = next_con_char()) == 0x1b || ch == 0x3 || ch == 'q' || ch == 'Q') {
-						printf("\n");
-						return 1;
-					}
-					printf("\n");
-					continue;
-
-				/* Deal with a communications error */
-				} else if ((rv & inst_mask) == inst_coms_fail) {
-					empty_con_chars();
-					printf("\nSample read failed due to communication problem.\n");
-					printf("Hit Esc or Q to give up, any other key to retry:"); fflush(stdout);
-					if ((ch = next_con_char()) == 0x1b || ch == 0x3 || ch == 'q' || ch == 'Q') {
-						printf("\n");
-						return 1;
-					}
-					printf("\n");
-					if (p->it->icom->port_type(p->it->icom) == icomt_serial) {
-						/* Allow retrying at a lower baud rate */
-						int tt = p->it->last_comerr(p->it);
-						if (tt & (ICOM_BRK | ICOM_FER | ICOM_PER | ICOM_OER)) {
-							if (p->br == baud_19200) p->br = baud_9600;
-							else if (p->br == baud_9600) p->br = baud_4800;
-							else if (p->br == baud_2400) p->br = baud_1200;
-							else p->br = baud_1200;
-						}
-						if ((rv = p->it->init_coms(p->it, p->comport, p->br, p->fc, 15.0)) != inst_ok) {
-							DBG((dbgo,"init_coms returned '%s' (%s)\n",
-						       p->it->inst_interp_error(p->it, rv), p->it->interp_error(p->it, rv)))
-							return 2;
-						}
-					}
-				continue;
-				}
-			} else {
-				break;		/* Sucesful reading */
-			}
-		}
 		/* We only fall through with a valid reading */
 		DBG((dbgo, "got reading abs. %f %f %f, transfering to col\n",
 		                val.aXYZ[0], val.aXYZ[1], val.aXYZ[2]))
@@ -1261,6 +1440,12 @@ static void disprd_del(disprd *p) {
 	if (p->fake_fp != NULL)
 		p->fake_fp->del(p->fake_fp);
 
+	if (p->sim != NULL && p->verb) {
+		int nread;
+		double tt = p->sim->get_time(p->sim, &nread);
+		fprintf(p->df,"Simulated display took %d readings in %.1f seconds\n",nread,tt);
+	}
+
 	if (p->it != NULL)
 		p->it->del(p->it);
 	if (p->dw != NULL) {
@@ -1438,6 +1623,7 @@ char *fake_name		/* Name of profile to use as a fake device */
 	disprd *p = NULL;
 	int ch;
 	inst_code rv;
+	char *ev, *simopts = NULL;
 	
 	if (errc != NULL) *errc = 0;		/* default return code = no error */
 
@@ -1485,7 +1671,23 @@ char *fake_name		/* Name of profile to use as a fake device */
 		p->ncal = 0;
 	}
 
-	if (comport == -99) {
+	/* See if readings should be averaged according to the noise level */
+	if ((ev = getenv("ARGYLL_DISP_AVERAGE")) != NULL) {
+		p->avg_max = DISP_DEF_AVG;
+		if (sscanf(ev, " %lf , %d", &p->avg_tol, &p->avg_max) < 1 || p->avg_tol <= 0.0)
+			p->avg_tol = 0.0;
+		if (p->avg_max > DISP_MAX_AVG)
+			p->avg_max = DISP_MAX_AVG;
+		else if (p->avg_max < 1)
+			p->avg_max = 1;
+	}
+
+	/* See if the fake device should be the simulated display */
+	if (comport == -99 && p->mcallout == NULL
+	 && (simopts = getenv("ARGYLL_SIMDISP")) != NULL)
+		p->itype = instSimDisp;
+
+	if (comport == -99 && p->itype != instSimDisp) {
 		p->fake = 1;
 
 		p->fake_fp = NULL;
@@ -1534,6 +1736,18 @@ char *fake_name		/* Name of profile to use as a fake device */
 			if (errc != NULL) *errc = 2;
 			return NULL;
 		}
+
+		/* Configure the simulated display */
+		if (p->itype == instSimDisp) {
+			p->sim = (simdisp *)p->it;
+			if ((rv = p->sim->config(p->sim, simopts, p->fake_name)) != inst_ok) {
+				DBG((dbgo,"simdisp config returned '%s' (%s)\n",
+				       p->it->inst_interp_error(p->it, rv), p->it->interp_error(p->it, rv)))
+				p->del(p);
+				if (errc != NULL) *errc = 2;
+				return NULL;
+			}
+		}
 	
 		/* Establish communications */
 		if ((rv = p->it->init_coms(p->it, p->comport, p->br, p->fc, 15.0)) != inst_ok) {
@@ -1564,6 +1778,9 @@ char *fake_name		/* Name of profile to use as a fake device */
 			if (errc != NULL) *errc = rv;
 			return NULL;
 		}
+
+		if (p->sim != NULL && disp == NULL)
+			return p;
 	}
 
 	/* Open display window for positioning (no blackbg) */
@@ -1599,16 +1816,18 @@ char *fake_name		/* Name of profile to use as a fake device */
 	}
 
 	/* Ask user to put instrument on screen */
-	empty_con_chars();
-	printf("Place instrument on test window.\n");
-	printf("Hit Esc or Q to give up, any other key to continue:"); fflush(stdout);
-	if ((ch = next_con_char()) == 0x1b || ch == 0x3 || ch == 'q' || ch == 'Q') {
+	if (p->sim == NULL) {
+		empty_con_chars();
+		printf("Place instrument on test window.\n");
+		printf("Hit Esc or Q to give up, any other key to continue:"); fflush(stdout);
+		if ((ch = next_con_char()) == 0x1b || ch == 0x3 || ch == 'q' || ch == 'Q') {
+			printf("\n");
+			p->del(p);
+			if (errc != NULL) *errc = 1;
+			return NULL;
+		}
 		printf("\n");
-		p->del(p);
-		if (errc != NULL) *errc = 1;
-		return NULL;
 	}
-	printf("\n");
 
 	/* Close the positioning window */
 	if (p->dw != NULL) {
@@ -73,6 +73,9 @@ typedef struct {
 /* Maximum number of entries to setup for calibration */
 #define MAX_CAL_ENT 4096
 
+/* Number of decades of Y the adaptive averaging noise is estimated over */
+#define DISP_NV_BANDS 8
+
 /* Display reading context */
 struct _disprd {
 
@@ -101,6 +104,13 @@ struct _disprd {
 	int highres;		/* Use high res mode if available */
 	dispwin *dw;		/* Window */
 	ramdac *or;			/* Original ramdac if we set one */
+	struct _simdisp *sim;	/* Simulated display, if it is the instrument */
+
+	/* Adaptive averaging */
+	double avg_tol;		/* Target Y standard error as a fraction of Y, 0 if not averaging */
+	int avg_max;		/* Maximum number of readings to average */
+	double nv_sum[DISP_NV_BANDS];	/* Pooled sum of squared relative Y deviations, by decade of Y */
+	int nv_dof[DISP_NV_BANDS];		/* Pooled degrees of freedom, by decade of Y */
 
 /* public: */
 
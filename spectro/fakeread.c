@@ -32,6 +32,9 @@
 #include "cgats.h"
 #include "xicc.h"
 #include "icc.h"
+#include "conv.h"
+
+#define MIN_THR_PATCHES 64		/* Minimum number of patches per thread */
 
 void usage(char *diag, ...) {
 	fprintf(stderr,"Fake test chart reader - lookup values in ICC/MPP profile, Version %s\n",
@@ -57,6 +60,7 @@ void usage(char *diag, ...) {
 	fprintf(stderr," -R level          Add average random deviation of <level>%% to output PCS values\n");
 	fprintf(stderr," -u                Make random deviations have uniform distributions rather than normal\n");
 	fprintf(stderr," -S seed           Set random seed\n");
+	fprintf(stderr," -j n              Use n threads (default number of processors)\n");
 	fprintf(stderr," -b L,a,b          Scale black point to target Lab value\n");
 	fprintf(stderr," [separation.icm]  Device link separation profile\n");
 	fprintf(stderr," profile.[icc|mpp|ti3] ICC, MPP profile or TI3 to use\n");
@@ -64,6 +68,259 @@ void usage(char *diag, ...) {
 	exit(1);
 	}
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Everything needed to fake the reading of a patch. */
+/* This is shared read only between the worker threads. */
+typedef struct {
+	cgats *icg;				/* Input .ti1 */
+	int si;					/* Sample id index */
+	int nchan;				/* Test chart number of device chanels */
+	int chix[ICX_MXINKS];	/* Device chanel indexes */
+	int gfudge;				/* Grey fudge, 1 = W->RGB, 2 = K->xxxK */
+	double *chpow;			/* Device chanel powers */
+	double rdlevel;			/* Random device average deviation level */
+	double rplevel;			/* Random PCS average deviation level */
+	int unidist;			/* Use uniform distribution of errors */
+	unsigned int seed;		/* Random seed value */
+	double *tbp;			/* Target black point */
+	double *wp;				/* ICC profile white point */
+	double (*bpt)[3];		/* Black point transform matrix */
+	int dolab;				/* Output Lab rather than XYZ */
+	int applycal;			/* NZ to apply calibration */
+	xcal *cal;				/* calibration */ 
+
+	int dosep;				/* Use separation before profile */
+	icc *sep_icco;			/* Separation profile */
+	icmLuBase *sep_luo;		/* Separation conversion */
+	int sep_inn;			/* Number of input channels to separation */
+	inkmask sep_nmask;		/* Colorant mask for separation input */
+
+	int inn;				/* Number of channels for conversion input */
+	inkmask cnv_nmask;		/* Conversion input nmask */ 
+	icc *icc_icco;			/* ICC profile */
+	icmLuBase *icc_luo;		/* ICC conversion */
+	mpp *mlu;				/* MPP conversion */
+	int dospec;				/* Do spectral MPP lookup */
+	int spec_n;				/* Number of spectral bands */
+
+	cgats *ti3;				/* TI3 reference */
+	int ti3_npat;			/* Number of patches in reference file */
+	int *ti3_chix;			/* Device chanel indexes */
+	int *ti3_pcsix;			/* PCS chanel indexes */
+	int *ti3_spi;			/* CGATS indexes for each wavelength */
+	int ti3_isLab;			/* Flag indicating PCS for TI3 file */
+
+	int nres;				/* Number of result values per patch */
+	double *res;			/* npat * nres result values */
+} fakectx;
+
+/* Fake the reading of patch i, and return the device (0..100), */
+/* PCS and spectral (0..100) values in rp[]. */
+static void fake_patch(fakectx *c, int i, double *rp) {
+	int j, k = 0;
+	double odev[ICX_MXINKS], dev[ICX_MXINKS], sep[ICX_MXINKS], PCS[3];
+	xspect out;
+	rstream *rr;
+
+	/* Each patch has its own random stream, so that the result doesn't */
+	/* depend on the number of threads or the order patches are done in. */
+	if ((rr = new_rstream(c->seed, i)) == NULL)
+		error("new_rstream failed");
+
+	for (j = 0; j < c->nchan; j++) {
+		double dv = *((double *)c->icg->t[0].fdata[i][c->chix[j]]) / 100.0;
+		odev[j] = dev[j] = sep[j] = dv;
+	}
+
+	if (c->gfudge) {
+		int nch;
+
+		if (c->dosep)		/* Figure number of channels into conversion */
+			nch = c->sep_inn;
+		else
+			nch = c->inn;
+
+		if (c->gfudge == 1) { 	/* Convert W -> RGB */
+			double wval = dev[0];
+			for (j = 0; j < nch; j++)
+				dev[j] = sep[j] = wval; 
+
+		} else {			/* Convert K->xxxK */
+			int kch;
+			int inmask;
+			double kval = dev[0];
+
+			if (c->dosep)		/* Figure number of channels into conversion */
+				inmask = c->sep_nmask;
+			else
+				inmask = c->cnv_nmask;
+
+			if (inmask == 0)
+				error("Input colorspace ambiguous - can't determine if it has black");
+
+			if ((kch = icx_ink2index(inmask, ICX_BLACK)) == -1)
+				error("Can't find black colorant for K fudge");
+			for (j = 0; j < nch; j++) {
+				if (j == kch)
+					dev[j] = sep[j] = kval; 
+				else
+					dev[j] = sep[j] = 0.0; 
+			}
+		}
+	}
+
+	if (c->dosep)
+		if (c->sep_luo->lookup(c->sep_luo, sep, dev) > 1)
+			error ("%d, %s",c->sep_icco->errc,c->sep_icco->err);
+
+	/* Do calibration */
+	if (c->applycal && c->cal != NULL)
+		c->cal->interp(c->cal, sep, sep);
+
+	/* Add randomness and non-linearity to device values. */
+	/* rdlevel = avg. dev. */
+	/* Note dev/sep is 0-1.0 at this stage */
+	for (j = 0; j < c->inn; j++) {
+		double dv = sep[j];
+		if (c->rdlevel > 0.0) {
+			double rv;
+			if (c->unidist)
+				rv =  rr->d_rand(rr, -2.0 * c->rdlevel, 2.0 * c->rdlevel);
+			else
+				rv = 1.2533 * c->rdlevel * rr->norm_rand(rr);
+			dv += rv;
+			if (dv < 0.0)
+				dv = 0.0;
+			else if (dv > 1.0)
+				dv = 1.0;
+		}
+		if (j < 10 && c->chpow[j] != 1.0) {
+			dv = pow(dv, c->chpow[j]);
+		}
+		sep[j] = dv;
+	}
+
+	/* Do color conversion */
+	if (c->icc_luo != NULL) {
+		if (c->icc_luo->lookup(c->icc_luo, PCS, sep) > 1)
+			error ("%d, %s",c->icc_icco->errc,c->icc_icco->err);
+
+		if (c->tbp[0] >= 0) {	/* Doing black point scaling */
+
+			for (j = 0; j < 3; j++)
+				PCS[j] -= c->wp[j];
+			icmMulBy3x3(PCS, c->bpt, PCS);
+			for (j = 0; j < 3; j++)
+				PCS[j] += c->wp[j];
+		}
+
+	} else if (c->mlu != NULL) {
+		c->mlu->lookup(c->mlu, PCS, sep);
+		if (c->dospec && c->spec_n > 0) {
+			c->mlu->lookup_spec(c->mlu, &out, sep);
+		}
+	} else if (c->ti3 != NULL) {
+		int m;
+		double bdif = 1e6;
+		int bix = -1;
+
+		/* Search for the closest device values in TI3 file */
+		for (m = 0; m < c->ti3_npat; m++) {
+			double dif;
+
+			for (dif = 0.0, j = 0; j < c->nchan; j++) {
+				double xx;
+
+				xx = (*((double *)c->ti3->t[0].fdata[m][c->ti3_chix[j]]) / 100.0) - sep[j];
+				dif += xx * xx;
+			}
+			if (dif < bdif) {
+				bdif = dif;
+				bix = m;
+			}
+		}
+		/* Copy best value over */
+		if (!c->dosep)		/* Doesn't make sense for separation */
+			for (j = 0; j < c->nchan; j++) {
+				dev[j] = *((double *)c->ti3->t[0].fdata[bix][c->ti3_chix[j]]) / 100.0;
+			}
+		for (j = 0; j < 3; j++) {
+			PCS[j] = *((double *)c->ti3->t[0].fdata[bix][c->ti3_pcsix[j]]);
+		}
+		if (c->ti3_isLab && !c->dolab) {	/* Convert Lab to XYZ */
+			icmLab2XYZ(&icmD50, PCS, PCS);
+		} else if (!c->ti3_isLab && c->dolab) {	/* Convert XYZ to Lab */
+			icmXYZ2Lab(&icmD50, PCS, PCS);
+		} else if (!c->ti3_isLab) {		/* Convert XYZ100 to XYZ1 */
+			PCS[0] /= 100.0;
+			PCS[1] /= 100.0;
+			PCS[2] /= 100.0;
+		}
+		if (c->dospec && c->spec_n > 0) {
+			for (j = 0; j < c->spec_n; j++) {
+				out.spec[j] = *((double *)c->ti3->t[0].fdata[bix][c->ti3_spi[j]]);
+			}
+		}
+	}
+
+	for (j = 0; j < c->nchan; j++)
+		rp[k++] = 100.0 * odev[j];
+
+	if (c->dolab == 0) {
+		PCS[0] *= 100.0;
+		PCS[1] *= 100.0;
+		PCS[2] *= 100.0;
+	}
+
+	/* Add randomness. rplevel is avg. dev. */
+	/* Note PCS is 0..100 XYZ or Lab at this point */
+	if (c->rplevel > 0.0) {
+		for (j = 0; j < 3; j++) {
+			double dv = PCS[j];
+			double rv;
+			if (c->unidist)
+				rv = 100.0 * rr->d_rand(rr, -2.0 * c->rplevel, 2.0 * c->rplevel);
+			else
+				rv = 100.0 * 1.2533 * c->rplevel * rr->norm_rand(rr);
+			dv += rv;
+
+			/* Don't let L*, X, Y or Z go negative */
+			if ((!c->dolab || j == 0) && dv < 0.0)
+				dv = 0.0;
+			PCS[j] = dv;
+		}
+	}
+
+	rp[k++] = PCS[0];
+	rp[k++] = PCS[1];
+	rp[k++] = PCS[2];
+
+	if (c->dospec && c->spec_n > 0) {
+		for (j = 0; j < c->spec_n; j++) {
+			rp[k++] = 100.0 * out.spec[j];
+		}
+	}
+	rr->del(rr);
+}
+
+/* A worker thread's share of the patches */
+typedef struct {
+	fakectx *c;
+	int sp, ep;			/* Start and end + 1 patch index */
+} fakejob;
+
+static int fake_worker(void *cntx, int ix) {
+	fakejob *jb = (fakejob *)cntx + ix;
+	int i;
+
+	for (i = jb->sp; i < jb->ep; i++)
+		fake_patch(jb->c, i, jb->c->res + i * jb->c->nres);
+	return 0;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 int main(int argc, char *argv[])
 {
 	int j;
@@ -127,6 +384,9 @@ int main(int argc, char *argv[])
 	int ti3_spi[XSPECT_MAX_BANDS];	/* CGATS indexes for each wavelength */
 	int ti3_isLab = 0;	/* Flag indicating PCS for TI3 file */
 
+	int nthr = system_ncpus();	/* Number of threads to use */
+	fakectx c;			/* Per patch context */
+
 	int rv = 0;
 	int inn, outn;		/* Number of channels for conversion input, output */
 	icColorSpaceSignature ins, outs;	/* Type of conversion input and output spaces */
@@ -192,6 +452,14 @@ int main(int argc, char *argv[])
 					usage("Couldn't parse argument to -S");
 			}
 
+			/* Number of threads */
+			else if (argv[fa][1] == 'j') {
+				fa = nfa;
+				if (na == NULL) usage("Expect argument to -j");
+				if ((nthr = atoi(na)) < 1)
+					usage("Argument to -j must be 1 or more");
+			}
+
 			/* calibration to device values */
 			else if (argv[fa][1] == 'k' || argv[fa][1] == 'i') {
 				if (argv[fa][1] == 'k')
@@ -261,7 +529,6 @@ int main(int argc, char *argv[])
 	strcpy(outname,argv[fa]);
 	strcat(outname,".ti3");
 
-	rand32(seed);		/* Init seed */
 	/* Deal with separation */
 	if (dosep) {
 		if ((sep_fp = new_icmFileStd_name(sepname,"r")) == NULL)
@@ -735,200 +1002,89 @@ int main(int argc, char *argv[])
 			ocg->add_kword(ocg, 0, "COLOR_REP", fname, NULL);
 		}
 
-		if ((setel = (cgats_set_elem *)malloc(sizeof(cgats_set_elem) * nsetel)) == NULL)
+		/* Setup the per patch context */
+		c.icg = icg;
+		c.si = si;
+		c.nchan = nchan;
+		for (j = 0; j < nchan; j++)
+			c.chix[j] = chix[j];
+		c.gfudge = gfudge;
+		c.chpow = chpow;
+		c.rdlevel = rdlevel;
+		c.rplevel = rplevel;
+		c.unidist = unidist;
+		c.seed = seed;
+		c.tbp = tbp;
+		c.wp = wp;
+		c.bpt = bpt;
+		c.dolab = dolab;
+		c.applycal = applycal;
+		c.cal = cal;
+		c.dosep = dosep;
+		c.sep_icco = sep_icco;
+		c.sep_luo = sep_luo;
+		c.sep_inn = sep_inn;
+		c.sep_nmask = sep_nmask;
+		c.inn = inn;
+		c.cnv_nmask = cnv_nmask;
+		c.icc_icco = icc_icco;
+		c.icc_luo = icc_luo;
+		c.mlu = mlu;
+		c.dospec = dospec;
+		c.spec_n = spec_n;
+		c.ti3 = ti3;
+		c.ti3_npat = ti3_npat;
+		c.ti3_chix = ti3_chix;
+		c.ti3_pcsix = ti3_pcsix;
+		c.ti3_spi = ti3_spi;
+		c.ti3_isLab = ti3_isLab;
+		c.nres = nsetel - 1;
+
+		if ((c.res = (double *)malloc(sizeof(double) * npat * c.nres)) == NULL)
 			error("Malloc failed!");
 
-		/* Read all the test patches in, convert them, */
-		/* and write them out. */
-		for (i = 0; i < npat; i++) {
-			int k = 0;
-			char *id;
-			double odev[ICX_MXINKS], dev[ICX_MXINKS], sep[ICX_MXINKS], PCS[3];
-			xspect out;
-
-			id = ((char *)icg->t[0].fdata[i][si]);
-			for (j = 0; j < nchan; j++) {
-				double dv = *((double *)icg->t[0].fdata[i][chix[j]]) / 100.0;
-				odev[j] = dev[j] = sep[j] = dv;
-			}
-
-			if (gfudge) {
-				int nch;
-
-				if (dosep)		/* Figure number of channels into conversion */
-					nch = sep_inn;
-				else
-					nch = inn;
-
-				if (gfudge == 1) { 	/* Convert W -> RGB */
-					double wval = dev[0];
-					for (j = 0; j < nch; j++)
-						dev[j] = sep[j] = wval; 
-
-				} else {			/* Convert K->xxxK */
-					int kch;
-					int inmask;
-					double kval = dev[0];
-
-					if (dosep)		/* Figure number of channels into conversion */
-						inmask = sep_nmask;
-					else
-						inmask = cnv_nmask;
-
-					if (inmask == 0)
-						error("Input colorspace ambiguous - can't determine if it has black");
-
-					if ((kch = icx_ink2index(inmask, ICX_BLACK)) == -1)
-						error("Can't find black colorant for K fudge");
-					for (j = 0; j < nch; j++) {
-						if (j == kch)
-							dev[j] = sep[j] = kval; 
-						else
-							dev[j] = sep[j] = 0.0; 
-					}
-				}
-			}
-
-			if (dosep)
-				if (sep_luo->lookup(sep_luo, sep, dev) > 1)
-					error ("%d, %s",icc_icco->errc,icc_icco->err);
-
-			/* Do calibration */
-			if (applycal && cal != NULL)
-				cal->interp(cal, sep, sep);
-
-			/* Add randomness and non-linearity to device values. */
-			/* rdlevel = avg. dev. */
-			/* Note dev/sep is 0-1.0 at this stage */
-			for (j = 0; j < inn; j++) {
-				double dv = sep[j];
-				if (rdlevel > 0.0) {
-					double rr;
-					if (unidist)
-						rr =  d_rand(-2.0 * rdlevel, 2.0 * rdlevel);
-					else
-						rr = 1.2533 * rdlevel * norm_rand();
-					dv += rr;
-					if (dv < 0.0)
-						dv = 0.0;
-					else if (dv > 1.0)
-						dv = 1.0;
-				}
-				if (j < 10 && chpow[j] != 1.0) {
-					dv = pow(dv, chpow[j]);
-				}
-				sep[j] = dv;
-			}
-
-			/* Do color conversion */
-			if (icc_luo != NULL) {
-				if (icc_luo->lookup(icc_luo, PCS, sep) > 1)
-					error ("%d, %s",icc_icco->errc,icc_icco->err);
-
-				if (tbp[0] >= 0) {	/* Doing black point scaling */
-
-					for (j = 0; j < 3; j++)
-						PCS[j] -= wp[j];
-					icmMulBy3x3(PCS, bpt, PCS);
-					for (j = 0; j < 3; j++)
-						PCS[j] += wp[j];
-				}
-	
-			} else if (mlu != NULL) {
-				mlu->lookup(mlu, PCS, sep);
-				if (dospec && spec_n > 0) {
-					mlu->lookup_spec(mlu, &out, sep);
-				}
-			} else if (ti3 != NULL) {
-				int m;
-				double bdif = 1e6;
-				int bix = -1;
-
-				/* Search for the closest device values in TI3 file */
-				for (m = 0; m < ti3_npat; m++) {
-					double dif;
-
-					for (dif = 0.0, j = 0; j < nchan; j++) {
-						double xx;
-
-						xx = (*((double *)ti3->t[0].fdata[m][ti3_chix[j]]) / 100.0) - sep[j];
-						dif += xx * xx;
-					}
-					if (dif < bdif) {
-						bdif = dif;
-						bix = m;
-					}
-				}
-				/* Copy best value over */
-				if (!dosep)		/* Doesn't make sense for separation */
-					for (j = 0; j < nchan; j++) {
-						dev[j] = *((double *)ti3->t[0].fdata[bix][ti3_chix[j]]) / 100.0;
-					}
-				for (j = 0; j < 3; j++) {
-					PCS[j] = *((double *)ti3->t[0].fdata[bix][ti3_pcsix[j]]);
-				}
-				if (ti3_isLab && !dolab) {	/* Convert Lab to XYZ */
-					icmLab2XYZ(&icmD50, PCS, PCS);
-				} else if (!ti3_isLab && dolab) {	/* Convert XYZ to Lab */
-					icmXYZ2Lab(&icmD50, PCS, PCS);
-				} else if (!ti3_isLab) {		/* Convert XYZ100 to XYZ1 */
-					PCS[0] /= 100.0;
-					PCS[1] /= 100.0;
-					PCS[2] /= 100.0;
-				}
-				if (dospec && spec_n > 0) {
-					for (j = 0; j < spec_n; j++) {
-						out.spec[j] = *((double *)ti3->t[0].fdata[bix][ti3_spi[j]]);
-					}
-				}
-			}
-
-			setel[k++].c = id;
-			
-			for (j = 0; j < nchan; j++)
-				setel[k++].d = 100.0 * odev[j];
-
-			if (dolab == 0) {
-				PCS[0] *= 100.0;
-				PCS[1] *= 100.0;
-				PCS[2] *= 100.0;
-			}
-
-			/* Add randomness. rplevel is avg. dev. */
-			/* Note PCS is 0..100 XYZ or Lab at this point */
-			if (rplevel > 0.0) {
-				double opcs[3];
-				for (j = 0; j < 3; j++) {
-					double dv = PCS[j];
-					double rr;
-					opcs[j] = dv;
-					if (unidist)
-						rr = 100.0 * d_rand(-2.0 * rplevel, 2.0 * rplevel);
-					else
-						rr = 100.0 * 1.2533 * rplevel * norm_rand();
-					dv += rr;
-
-					/* Don't let L*, X, Y or Z go negative */
-					if ((!dolab || j == 0) && dv < 0.0)
-						dv = 0.0;
-					PCS[j] = dv;
-				}
-//printf("~1 pcs %f %f %f -> %f %f %f\n", opcs[0], opcs[1], opcs[2], PCS[0], PCS[1], PCS[2]);
+		/* Convert all the test patches, using as many threads */
+		/* as are useful. */
+		if (nthr > (npat / MIN_THR_PATCHES))
+			nthr = npat / MIN_THR_PATCHES;
+		if (nthr <= 1) {
+			fakejob jb;
+			jb.c = &c;
+			jb.sp = 0;
+			jb.ep = npat;
+			fake_worker((void *)&jb, 0);
+		} else {
+			fakejob *jbs;
+
+			if (verb)
+				printf("Using %d threads\n",nthr);
+			if ((jbs = (fakejob *)malloc(sizeof(fakejob) * nthr)) == NULL)
+				error("Malloc failed!");
+			for (i = 0; i < nthr; i++) {
+				jbs[i].c = &c;
+				jbs[i].sp = (int)((double)npat * i/nthr + 0.5);
+				jbs[i].ep = (int)((double)npat * (i+1)/nthr + 0.5);
 			}
+			athreads_for(nthr, nthr, fake_worker, (void *)jbs);
+			free(jbs);
+		}
 
-			setel[k++].d = PCS[0];
-			setel[k++].d = PCS[1];
-			setel[k++].d = PCS[2];
+		/* Write them all out */
+		if ((setel = (cgats_set_elem *)malloc(sizeof(cgats_set_elem) * nsetel * npat)) == NULL)
+			error("Malloc failed!");
 
-			if (dospec && spec_n > 0) {
-				for (j = 0; j < spec_n; j++) {
-					setel[k++].d = 100.0 * out.spec[j];
-				}
-			}
+		for (i = 0; i < npat; i++) {
+			cgats_set_elem *sp = setel + i * nsetel;
+			double *rp = c.res + i * c.nres;
 
-			ocg->add_setarr(ocg, 0, setel);
+			sp[0].c = ((char *)icg->t[0].fdata[i][si]);
+			for (j = 1; j < nsetel; j++)
+				sp[j].d = rp[j-1];
 		}
+		if (ocg->add_setarrs(ocg, 0, npat, setel) != 0)
+			error("Adding sets failed : %s",ocg->err);
 
+		free(c.res);
 		free(setel);
 		free(ident);
 		free(bident);
@@ -4836,34 +4836,78 @@ void i1pro_sub_abssens(
 	}
 }
 
-/* Convert an abssens array from raw wavelengths to output wavelenths */
-/* for the current resolution */
-void i1pro_abssens_to_abswav(
-	i1pro *p,
-	int nummeas,			/* Return number of readings measured */
+/* Apply a raw to output wavelength matrix to a set of measurements. */
+/* The matrix is banded, so it is stored as a starting raw index and */
+/* a number of coefficients for each output wavelength. Measurements */
+/* are done four at a time, so that each coefficient is loaded once */
+/* for four multiply-adds, and the four sums are independent. */
+/* Each sum is accumulated in the same order as a one at a time */
+/* loop, so the results are identical. */
+static void i1pro_abssens_to_abswav_mtx(
+	int nummeas,			/* Number of readings */
 	double **abswav,		/* Desination array [nwav] */
-	double **abssens		/* Source array [nraw] */
+	double **abssens,		/* Source array [nraw] */
+	int nwav,				/* Number of output wavelengths */
+	int *mtx_index,			/* [nwav] Starting raw index */
+	int *mtx_nocoef,		/* [nwav] Number of coefficients */
+	double *mtx_coef		/* Coefficients */
 ) {
-	i1proimp *m = (i1proimp *)p->m;
 	int i, j, k, cx, sx;
 	
-	/* For each measurement */
-	for (i = 0; i < nummeas; i++) {
+	/* For each group of four measurements */
+	for (i = 0; (i + 4) <= nummeas; i += 4) {
+		double *s0 = abssens[i], *s1 = abssens[i+1], *s2 = abssens[i+2], *s3 = abssens[i+3];
 
 		/* For each output wavelength */
-		for (cx = j = 0; j < m->nwav; j++) {
-			double oval = 0.0;
+		for (cx = j = 0; j < nwav; j++) {
+			double o0 = 0.0, o1 = 0.0, o2 = 0.0, o3 = 0.0;
 	
 			/* For each matrix value */
-			sx = m->mtx_index[j];		/* Starting index */
-			for (k = 0; k < m->mtx_nocoef[j]; k++, cx++, sx++) {
-				oval += m->mtx_coef[cx] * abssens[i][sx];
+			sx = mtx_index[j];		/* Starting index */
+			for (k = 0; k < mtx_nocoef[j]; k++, cx++, sx++) {
+				double cf = mtx_coef[cx];
+				o0 += cf * s0[sx];
+				o1 += cf * s1[sx];
+				o2 += cf * s2[sx];
+				o3 += cf * s3[sx];
+			}
+			abswav[i][j]   = o0;
+			abswav[i+1][j] = o1;
+			abswav[i+2][j] = o2;
+			abswav[i+3][j] = o3;
+		}
+	}
+
+	/* The remaining measurements */
+	for (; i < nummeas; i++) {
+		double *s0 = abssens[i];
+
+		for (cx = j = 0; j < nwav; j++) {
+			double oval = 0.0;
+	
+			sx = mtx_index[j];
+			for (k = 0; k < mtx_nocoef[j]; k++, cx++, sx++) {
+				oval += mtx_coef[cx] * s0[sx];
 			}
 			abswav[i][j] = oval;
 		}
 	}
 }
 
+/* Convert an abssens array from raw wavelengths to output wavelenths */
+/* for the current resolution */
+void i1pro_abssens_to_abswav(
+	i1pro *p,
+	int nummeas,			/* Return number of readings measured */
+	double **abswav,		/* Desination array [nwav] */
+	double **abssens		/* Source array [nraw] */
+) {
+	i1proimp *m = (i1proimp *)p->m;
+
+	i1pro_abssens_to_abswav_mtx(nummeas, abswav, abssens,
+	                            m->nwav, m->mtx_index, m->mtx_nocoef, m->mtx_coef);
+}
+
 /* Convert an abssens array from raw wavelengths to output wavelenths */
 /* for the standard resolution */
 void i1pro_abssens_to_abswav1(
@@ -4873,23 +4917,9 @@ void i1pro_abssens_to_abswav1(
 	double **abssens		/* Source array [nraw] */
 ) {
 	i1proimp *m = (i1proimp *)p->m;
-	int i, j, k, cx, sx;
-	
-	/* For each measurement */
-	for (i = 0; i < nummeas; i++) {
 
-		/* For each output wavelength */
-		for (cx = j = 0; j < m->nwav1; j++) {
-			double oval = 0.0;
-	
-			/* For each matrix value */
-			sx = m->mtx_index1[j];		/* Starting index */
-			for (k = 0; k < m->mtx_nocoef1[j]; k++, cx++, sx++) {
-				oval += m->mtx_coef1[cx] * abssens[i][sx];
-			}
-			abswav[i][j] = oval;
-		}
-	}
+	i1pro_abssens_to_abswav_mtx(nummeas, abswav, abssens,
+	                            m->nwav1, m->mtx_index1, m->mtx_nocoef1, m->mtx_coef1);
 }
 
 /* Convert an abssens array from raw wavelengths to output wavelenths */
@@ -4901,23 +4931,9 @@ void i1pro_abssens_to_abswav2(
 	double **abssens		/* Source array [nraw] */
 ) {
 	i1proimp *m = (i1proimp *)p->m;
-	int i, j, k, cx, sx;
-	
-	/* For each measurement */
-	for (i = 0; i < nummeas; i++) {
 
-		/* For each output wavelength */
-		for (cx = j = 0; j < m->nwav2; j++) {
-			double oval = 0.0;
-	
-			/* For each matrix value */
-			sx = m->mtx_index2[j];		/* Starting index */
-			for (k = 0; k < m->mtx_nocoef2[j]; k++, cx++, sx++) {
-				oval += m->mtx_coef2[cx] * abssens[i][sx];
-			}
-			abswav[i][j] = oval;
-		}
-	}
+	i1pro_abssens_to_abswav_mtx(nummeas, abswav, abssens,
+	                            m->nwav2, m->mtx_index2, m->mtx_nocoef2, m->mtx_coef2);
 }
 
 /* Convert an abswav array of output wavelengths to scaled output readings. */
@@ -210,6 +210,9 @@ struct _icoms {
 	/* HID port parameters */
 	struct _hid_device *hidd;	/* HID port, NULL if not HID */
 
+	/* USB record/replay state, NULL if not enabled */
+	struct _usbrec *rec;
+
 #endif /* ENABLE_USB */
 
 	/* General parameters */
@@ -223,6 +226,9 @@ struct _icoms {
 								/* ICOM_OK, ICOM_USER, ICOM_TERM, ICOM_TRIG, ICOM_CMND */
 	int cut;					/* The character that caused the termination */
 
+	/* Serial record/replay state, NULL if not enabled */
+	struct _serrec *srec;
+
 	/* Linked list to automate SIGKILL cleanup */
 	struct _icoms *next;
 	
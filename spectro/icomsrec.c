@@ -0,0 +1,136 @@
+/*
+ * Argyll Color Correction System
+ *
+ * Support shared by the USB and serial traffic recording and replay.
+ *
+ * Author: agent <agent@local>
+ * Date:   18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "copyright.h"
+#include "config.h"
+#include "numsup.h"
+#include "xspect.h"
+#include "insttypes.h"
+#include "icoms.h"
+#include "conv.h"
+#include "icomsrec.h"
+
+/* Write len data bytes to a recording as " hex", or " -" if there are none */
+void icomsrec_hex(FILE *fp, unsigned char *buf, int len) {
+	int i;
+
+	if (buf == NULL || len <= 0) {
+		fprintf(fp," -");
+		return;
+	}
+	fprintf(fp," ");
+	for (i = 0; i < len; i++)
+		fprintf(fp,"%02x",buf[i]);
+}
+
+/* Convert recorded hex (or "-") to a malloced buffer, that is also */
+/* nul terminated. Return the number of bytes. */
+int icomsrec_unhex(unsigned char **data, char *hex) {
+	int i, len = 0;
+
+	if (hex[0] != '-')
+		len = strlen(hex)/2;
+	if ((*data = malloc(len + 1)) == NULL)
+		error("icoms replay: malloc failed");
+	for (i = 0; i < len; i++) {
+		unsigned int v;
+		if (sscanf(hex + 2 * i, "%2x", &v) != 1)
+			error("icoms replay: bad hex data in '%s'",hex);
+		(*data)[i] = (unsigned char)v;
+	}
+	(*data)[len] = '\000';
+	return len;
+}
+
+/* Read a line of any length from a recording. Return NULL at EOF. */
+char *icomsrec_line(FILE *fp, char **buf, int *bsize) {
+	int c, len = 0;
+
+	while ((c = getc(fp)) != EOF && c != '\n') {
+		if ((len + 2) > *bsize) {
+			*bsize = *bsize * 2 + 1000;
+			if ((*buf = realloc(*buf, *bsize)) == NULL)
+				error("icoms replay: realloc failed");
+		}
+		(*buf)[len++] = (char)c;
+	}
+	if (c == EOF && len == 0)
+		return NULL;
+	if (*buf == NULL) {
+		*bsize = 1000;
+		if ((*buf = malloc(*bsize)) == NULL)
+			error("icoms replay: malloc failed");
+	}
+	(*buf)[len] = '\000';
+	return *buf;
+}
+
+/* Warn about the first mismatch between a driver and the recording */
+/* being replayed. *warned is set once a warning has been printed. */
+void icomsrec_mismatch(int *warned, char *fmt, ...) {
+	va_list args;
+	char buf[500];
+
+	if (*warned)
+		return;
+
+	va_start(args, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	buf[sizeof(buf)-1] = '\000';
+
+	warning("%s",buf);
+	*warned = 1;
+}
+
+/* Add any user interrupt to a replayed ICOM return code */
+int icomsrec_checkabort(icoms *p, int rv, int *cut, int checkabort) {
+	int c;
+
+	if (checkabort && (c = poll_con_char()) != 0 && p->uih[c] != ICOM_OK) {
+		*cut = c;
+		rv |= p->uih[c];
+	}
+	return rv;
+}
+
+/* Replace the icoms paths with a single replay path */
+icompath **icomsrec_replay_path(icoms *p, char *name, instType itype) {
+	int i;
+
+	if (p->paths != NULL) {
+		for (i = 0; i < p->npaths; i++) {
+			if (p->paths[i]->path != NULL)
+				free(p->paths[i]->path);
+			free(p->paths[i]);
+		}
+		free(p->paths);
+		p->npaths = 0;
+		p->paths = NULL;
+	}
+
+	if ((p->paths = (icompath **)calloc(sizeof(icompath *), 1 + 1)) == NULL)
+		error("icoms: calloc failed!");
+	if ((p->paths[0] = calloc(sizeof(icompath), 1)) == NULL)
+		error("icoms: malloc failed!");
+	p->paths[0]->itype = itype;
+	if ((p->paths[0]->path = strdup(name)) == NULL)
+		error("icoms: strdup failed!");
+	p->npaths = 1;
+	p->paths[1] = NULL;
+
+	return p->paths;
+}
@@ -0,0 +1,36 @@
+#ifndef ICOMSREC_H
+
+/*
+ * Argyll Color Correction System
+ *
+ * Support shared by the USB and serial traffic recording and replay.
+ *
+ * Author: agent <agent@local>
+ * Date:   18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/* Write len data bytes to a recording as " hex", or " -" if there are none */
+void icomsrec_hex(FILE *fp, unsigned char *buf, int len);
+
+/* Convert recorded hex (or "-") to a malloced buffer, that is also */
+/* nul terminated. Return the number of bytes. */
+int icomsrec_unhex(unsigned char **data, char *hex);
+
+/* Read a line of any length from a recording. Return NULL at EOF. */
+char *icomsrec_line(FILE *fp, char **buf, int *bsize);
+
+/* Warn about the first mismatch between a driver and the recording */
+/* being replayed. *warned is set once a warning has been printed. */
+void icomsrec_mismatch(int *warned, char *fmt, ...);
+
+/* Add any user interrupt to a replayed ICOM return code */
+int icomsrec_checkabort(icoms *p, int rv, int *cut, int checkabort);
+
+/* Replace the icoms paths with a single replay path */
+icompath **icomsrec_replay_path(icoms *p, char *name, instType itype);
+
+#define ICOMSREC_H
+#endif /* ICOMSREC_H */
@@ -369,7 +369,10 @@ int verb			/* Verbosity flag */
 		icom->debug = debug;
 
 	/* Set instrument type from USB port, if not specified */
-	atype = usb_is_usb_portno(icom, comport);		/* Type from USB */
+	if (itype == instSimDisp)						/* Simulation doesn't have a port */
+		atype = itype;
+	else
+		atype = icom->is_usb_portno(icom, comport);	/* Type from USB */
 	if (atype == instUnknown)						/* Not USB */
 		atype = hid_is_hid_portno(icom, comport);	/* Else type from HID */
 	if (atype == instUnknown)
@@ -416,6 +419,8 @@ int verb			/* Verbosity flag */
 		p = (inst *)new_spyd2(icom, debug, verb);
 	else if (itype == instHuey)
 		p = (inst *)new_huey(icom, debug, verb);
+	else if (itype == instSimDisp)
+		p = (inst *)new_simdisp(icom, debug, verb);
 	else {
 		return NULL;
 	}
@@ -13,3 +13,4 @@
 #include "hcfr.h"
 #include "spyd2.h"
 #include "huey.h"
+#include "simdisp.h"
@@ -68,6 +68,8 @@ char *inst_name(instType itype) {
 			return "Datacolor Spyder3";
 		case instHuey:
 			return "GretagMacbeth Huey";
+		case instSimDisp:
+			return "Argyll Simulated Display";
 		default:
 			break;
 	}
@@ -114,6 +116,8 @@ instType inst_enum(char *name) {
 		return instSpyder3;
 	else if (strcmp(name, "GretagMacbeth Huey") == 0)
 		return instHuey;
+	else if (strcmp(name, "Argyll Simulated Display") == 0)
+		return instSimDisp;
 
 	return instUnknown;
 }
@@ -242,6 +246,9 @@ int inst_illuminant(xspect *sp, instType itype) {
 		case instHuey:
 			return 1;										/* Not applicable */
 
+		case instSimDisp:
+			return 1;										/* Not applicable */
+
 		default:
 			break;
 	}
@@ -38,6 +38,7 @@ typedef enum {
 	instSpyder2,				/* Datacolor/ColorVision Spyder2 */
 	instSpyder3,				/* Datacolor Spyder3 */
 	instHuey,					/* GretagMacbeth Huey */
+	instSimDisp,				/* Simulated display & colorimeter */
 } instType;
 
 /* Utility functions in libinsttypes */
@@ -27,6 +27,7 @@
 #include "icoms.h"
 #include "conv.h"
 #include "usbio.h"
+#include "serrec.h"
 
 #undef DEBUG
 
@@ -678,6 +679,9 @@ extern icoms *new_icoms()
 	usb_set_usb_methods(p);
 	hid_set_hid_methods(p);
 
+	/* Wrap the serial methods with recording or replay, if enabled */
+	serrec_set_methods(p);
+
 	return p;
 }
 
@@ -0,0 +1,324 @@
+
+/*
+ * Argyll Color Correction System
+ *
+ * Serial traffic recording and replay.
+ *
+ * Author: agent <agent@local>
+ * Date:   18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * The recording is a text file, one operation per line:
+ *
+ *   P fc baud parity stop word                Port characteristics
+ *   W rv data                                 Write
+ *   R bsize tc ntc rv data                    Read
+ *
+ * where rv is the ICOM error code in hex, tc is the terminating
+ * character in hex, and data is the characters written or read
+ * in hex (or "-" if none). A serial instrument is used by one thread,
+ * so the operations are replayed in the order they were recorded.
+ *
+ * User interrupt codes are not recorded, since the keyboard
+ * is checked as normal during replay.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "copyright.h"
+#include "config.h"
+#include "numsup.h"
+#include "xspect.h"
+#include "insttypes.h"
+#include "icoms.h"
+#include "conv.h"
+#include "serrec.h"
+#include "icomsrec.h"
+
+/* A recorded operation */
+typedef struct {
+	int type;				/* 'P', 'W' or 'R' */
+	int fc, baud, parity, stop, word;	/* Port characteristics */
+	int bsize;				/* Read buffer size */
+	int tc, ntc;			/* Read terminating character and count */
+	int rv;					/* Returned ICOM code */
+	char *data;				/* nul terminated characters */
+} serrec_op;
+
+struct _serrec {
+	int replay;				/* NZ if replaying, else recording */
+	char *fname;			/* File name */
+	FILE *fp;				/* Recording file */
+
+	/* Replay state */
+	serrec_op *ops;
+	int n, _n;				/* Number used, allocated */
+	int next;				/* Next to replay */
+	int warned;				/* NZ if a mismatch has been reported */
+
+	/* The methods we've wrapped */
+	void (*set_ser_port)(icoms *p, int port, flow_control fc, baud_rate baud,
+	                     parity parity, stop_bits stop, word_length word);
+	int (*write)(icoms *p, char *wbuf, double tout);
+	int (*read)(icoms *p, char *rbuf, int bsize, char tc, int ntc, double tout);
+	void (*del)(icoms *p);
+}; typedef struct _serrec serrec;
+
+/* ---------------------------------------------------------------------- */
+/* Recording */
+
+static int rec_write(icoms *p, char *wbuf, double tout) {
+	serrec *r = p->srec;
+	int rv;
+
+	rv = r->write(p, wbuf, tout);
+
+	fprintf(r->fp,"W %x", rv & ~ICOM_USERM);
+	icomsrec_hex(r->fp, (unsigned char *)wbuf, wbuf == NULL ? 0 : strlen(wbuf));
+	fprintf(r->fp,"\n");
+	fflush(r->fp);
+
+	return rv;
+}
+
+static int rec_read(icoms *p, char *rbuf, int bsize, char tc, int ntc, double tout) {
+	serrec *r = p->srec;
+	int rv;
+
+	rv = r->read(p, rbuf, bsize, tc, ntc, tout);
+
+	fprintf(r->fp,"R %d %02x %d %x", bsize, (unsigned char)tc, ntc, rv & ~ICOM_USERM);
+	icomsrec_hex(r->fp, (unsigned char *)rbuf, rbuf == NULL ? 0 : strlen(rbuf));
+	fprintf(r->fp,"\n");
+	fflush(r->fp);
+
+	return rv;
+}
+
+static void rec_set_ser_port(icoms *p, int port, flow_control fc, baud_rate baud,
+                             parity parity, stop_bits stop, word_length word) {
+	serrec *r = p->srec;
+
+	r->set_ser_port(p, port, fc, baud, parity, stop, word);
+
+	/* Not a serial port */
+	if (p->write == NULL || p->is_usb || p->is_hid)
+		return;
+
+	fprintf(r->fp,"P %d %d %d %d %d\n", fc, baud, parity, stop, word);
+	fflush(r->fp);
+
+	/* set_ser_port() sets these each time */
+	if (p->write != rec_write) {
+		r->write = p->write;
+		r->read  = p->read;
+		p->write = rec_write;
+		p->read  = rec_read;
+	}
+}
+
+/* ---------------------------------------------------------------------- */
+/* Replay */
+
+/* Load the recording */
+static void rep_load(serrec *r) {
+	FILE *fp;
+	char *buf = NULL, *hex = NULL;
+	int bsize = 0, lno = 0;
+
+	if ((fp = fopen(r->fname, "r")) == NULL)
+		error("serrec: Can't open serial replay file '%s'",r->fname);
+
+	while (icomsrec_line(fp, &buf, &bsize) != NULL) {
+		serrec_op op;
+
+		lno++;
+		if (buf[0] == '\000' || buf[0] == '#')
+			continue;
+
+		free(hex);
+		if ((hex = malloc(strlen(buf) + 1)) == NULL)
+			error("serrec: malloc failed");
+		memset(&op, 0, sizeof(op));
+		op.type = buf[0];
+
+		if (op.type == 'P') {
+			if (sscanf(buf, "P %d %d %d %d %d", &op.fc, &op.baud, &op.parity,
+			    &op.stop, &op.word) != 5)
+				error("serrec: bad line %d of '%s'",lno,r->fname);
+
+		} else if (op.type == 'W') {
+			if (sscanf(buf, "W %x %s", &op.rv, hex) != 2)
+				error("serrec: bad line %d of '%s'",lno,r->fname);
+			icomsrec_unhex((unsigned char **)&op.data, hex);
+
+		} else if (op.type == 'R') {
+			if (sscanf(buf, "R %d %x %d %x %s", &op.bsize, &op.tc, &op.ntc,
+			    &op.rv, hex) != 5)
+				error("serrec: bad line %d of '%s'",lno,r->fname);
+			icomsrec_unhex((unsigned char **)&op.data, hex);
+
+		} else {
+			error("serrec: unknown line %d of '%s'",lno,r->fname);
+		}
+
+		if (r->n >= r->_n) {
+			r->_n = r->_n * 2 + 100;
+			if ((r->ops = (serrec_op *)realloc(r->ops, r->_n * sizeof(serrec_op))) == NULL)
+				error("serrec: realloc failed");
+		}
+		r->ops[r->n++] = op;
+	}
+	free(hex);
+	free(buf);
+	fclose(fp);
+}
+
+/* Report a mismatch between the driver and the recording */
+static void rep_mismatch(serrec *r, char *what) {
+	icomsrec_mismatch(&r->warned, "Serial replay of '%s' differs from the recording at %s %d",
+	                  r->fname,what,r->next+1);
+}
+
+/* Return the next operation if it is of the given type, */
+/* and move on to the one after. Return NULL if it isn't. */
+static serrec_op *rep_next(serrec *r, int type) {
+	if (r->next >= r->n || r->ops[r->next].type != type)
+		return NULL;
+	return &r->ops[r->next++];
+}
+
+/* Create the one replay path */
+static icompath **rep_get_paths(icoms *p) {
+	return icomsrec_replay_path(p, "replay (serial)", instUnknown);
+}
+
+static instType rep_is_portno(icoms *p, int port) {
+	return instUnknown;
+}
+
+static int rep_write(icoms *p, char *wbuf, double tout) {
+	serrec *r = p->srec;
+	serrec_op *op;
+
+	if (p->debug) fprintf(stderr,"icoms: Replay write '%s'\n",icoms_fix(wbuf));
+
+	if ((op = rep_next(r, 'W')) == NULL || strcmp(op->data, wbuf) != 0) {
+		rep_mismatch(r, "write");
+		return p->lerr = ICOM_SERW;
+	}
+	return p->lerr = icomsrec_checkabort(p, op->rv, &p->cut, 1);
+}
+
+static int rep_read(icoms *p, char *rbuf, int bsize, char tc, int ntc, double tout) {
+	serrec *r = p->srec;
+	serrec_op *op;
+
+	if (bsize < 3)
+		error("icoms_read given too small a buffer");
+	rbuf[0] = '\000';
+
+	if ((op = rep_next(r, 'R')) == NULL
+	 || op->tc != (unsigned char)tc || op->ntc != ntc) {
+		rep_mismatch(r, "read");
+		return p->lerr = ICOM_SERR;
+	}
+	strncpy(rbuf, op->data, bsize-1);
+	rbuf[bsize-1] = '\000';
+
+	if (p->debug) fprintf(stderr,"icoms: Replay read '%s' ICOM err 0x%x\n",icoms_fix(rbuf),op->rv);
+
+	return p->lerr = icomsrec_checkabort(p, op->rv, &p->cut, 1);
+}
+
+static void rep_set_ser_port(icoms *p, int port, flow_control fc, baud_rate baud,
+                             parity parity, stop_bits stop, word_length word) {
+	serrec *r = p->srec;
+	serrec_op *op;
+
+	if (p->debug) fprintf(stderr,"icoms: replaying serial port %d\n",port);
+
+	if (p->paths == NULL)
+		p->get_paths(p);
+	if (port >= 1) {
+		if (port > p->npaths)
+			error("icoms - set_ser_port: port number out of range!");
+		p->port = port;
+	}
+
+	if ((op = rep_next(r, 'P')) == NULL
+	 || op->fc != fc || op->baud != baud || op->parity != parity
+	 || op->stop != stop || op->word != word)
+		rep_mismatch(r, "port setting");
+
+	p->is_open = 1;
+	p->write = rep_write;
+	p->read = rep_read;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Free the recording or replay state, and then the icoms */
+static void serrec_del(icoms *p) {
+	serrec *r = p->srec;
+	int i;
+
+	if (r->fp != NULL)
+		fclose(r->fp);
+	for (i = 0; i < r->n; i++)
+		free(r->ops[i].data);
+	free(r->ops);
+	free(r->fname);
+	p->srec = NULL;
+	p->del = r->del;
+	free(r);
+
+	p->del(p);
+}
+
+/* Wrap the serial icoms methods with recording or replay, */
+/* if either is enabled by the environment. */
+void serrec_set_methods(icoms *p) {
+	serrec *r;
+	char *rec, *rep;
+
+	rec = getenv("ARGYLL_SER_RECORD");
+	rep = getenv("ARGYLL_SER_REPLAY");
+
+	if ((rec == NULL || rec[0] == '\000')
+	 && (rep == NULL || rep[0] == '\000'))
+		return;
+
+	if ((r = (serrec *)calloc(sizeof(serrec), 1)) == NULL)
+		error("serrec: calloc failed");
+
+	r->set_ser_port = p->set_ser_port;
+	r->del          = p->del;
+	p->srec = r;
+	p->del = serrec_del;
+
+	if (rep != NULL && rep[0] != '\000') {
+		r->replay = 1;
+		if ((r->fname = strdup(rep)) == NULL)
+			error("serrec: strdup failed");
+		rep_load(r);
+
+		p->get_paths     = rep_get_paths;
+		p->is_usb_portno = rep_is_portno;
+		p->is_hid_portno = rep_is_portno;
+		p->set_ser_port  = rep_set_ser_port;
+	} else {
+		if ((r->fname = strdup(rec)) == NULL)
+			error("serrec: strdup failed");
+		if ((r->fp = fopen(r->fname, "w")) == NULL)
+			error("serrec: Can't create serial record file '%s'",r->fname);
+
+		p->set_ser_port = rec_set_ser_port;
+	}
+}
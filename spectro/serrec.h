@@ -0,0 +1,38 @@
+
+#ifndef SERREC_H
+
+/*
+ * Argyll Color Correction System
+ *
+ * Serial traffic recording and replay.
+ *
+ * Author: agent <agent@local>
+ * Date:   18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * If ARGYLL_SER_RECORD is set to a file name, every serial port
+ * setting, write and read an instrument driver makes is written
+ * to that file. If ARGYLL_SER_REPLAY is set to such a file, no
+ * real serial port is used, and each operation is instead answered
+ * from the recording, as quickly as the driver asks. A single
+ * "Replay" port is offered, and the instrument type is recognised
+ * from the replayed replies in the usual way, so that an unmodified
+ * serial instrument driver such as the DTP41 or Spectrolino can be
+ * run, timed and debugged without the instrument being present.
+ *
+ * If the driver writes something different to what was recorded,
+ * (ie. because its behaviour depends on the time or on saved
+ * settings), a warning is printed and the operation fails.
+ */
+
+/* Wrap the serial icoms methods with recording or replay, */
+/* if either is enabled by the environment. */
+/* (Called at the end of new_icoms()) */
+void serrec_set_methods(icoms *p);
+
+#define SERREC_H
+#endif /* SERREC_H */
@@ -0,0 +1,603 @@
+
+/*
+ * Argyll Color Correction System
+ *
+ * Simulated display and colorimeter, for testing and
+ * tuning the display calibration and reading tools
+ * without a real display or instrument.
+ *
+ * Author: agent <agent@local>
+ * Date:   18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * The built in display model is the same as the dispsup.c fake
+ * device (matrix, gamma, device offset, flare and 9 bit quantization),
+ * so that results can be compared with the instant fake read.
+ *
+ * The option string is a comma separated list of name=value settings:
+ *
+ *  int=secs		Integration time (default 0.4)
+ *  noise=cd/m^2	Y noise std. dev. for a 1 second integration (default 0.02)
+ *  lat=secs		Display latency (default 0.02)
+ *  settle=secs		Display settle time constant (default 0.01)
+ *  delay=secs		Update delay after setting a color (default 0.06, as dispwin)
+ *  ovhd=secs		Instrument overhead per reading (default 0.05)
+ *  br=cd/m^2		Brightness of a profile display model (default 120.4)
+ *  real			Wait out delays in real time
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <time.h>
+#include <stdarg.h>
+#include <math.h>
+#include "copyright.h"
+#include "config.h"
+#include "numlib.h"
+#include "xspect.h"
+#include "insttypes.h"
+#include "icoms.h"
+#include "conv.h"
+#include "simdisp.h"
+
+#undef DEBUG
+
+#ifdef DEBUG
+#define DBG(xxx) printf xxx ;
+#else
+#define DBG(xxx)
+#endif
+
+#define SIM_BITS 9			/* Number of bits of significance of built in model */
+
+static inst_code simdisp_interp_code(inst *pp, int ec);
+
+static int icoms2simdisp_err(int se) {
+	if (se & ICOM_USERM) {
+		se &= ICOM_USERM;
+		if (se == ICOM_USER)
+			return SIMDISP_USER_ABORT;
+		if (se == ICOM_TERM)
+			return SIMDISP_USER_TERM;
+		if (se == ICOM_TRIG)
+			return SIMDISP_USER_TRIG;
+		if (se == ICOM_CMND)
+			return SIMDISP_USER_CMND;
+	}
+	if (se != ICOM_OK)
+		return SIMDISP_INTERNAL_ERROR;
+	return SIMDISP_OK;
+}
+
+/* Return the current time in seconds */
+static double sd_now(simdisp *p) {
+	if (p->realtime)
+		return (msec_time() - p->stime)/1000.0;
+	return p->clock;
+}
+
+/* Wait until the given time */
+static void sd_wait_until(simdisp *p, double t) {
+	if (p->realtime) {
+		double now = sd_now(p);
+		if (t > now)
+			msec_sleep((unsigned int)(1000.0 * (t - now) + 0.5));
+	} else {
+		if (t > p->clock)
+			p->clock = t;
+	}
+}
+
+/* Return the displays XYZ for a device RGB */
+static void sd_model(simdisp *p, double *XYZ, double *irgb) {
+	double rgb[3];
+	int j;
+
+	for (j = 0; j < 3; j++) {
+		rgb[j] = irgb[j];
+		if (rgb[j] < 0.0)
+			rgb[j] = 0.0;
+		else if (rgb[j] > 1.0)
+			rgb[j] = 1.0;
+	}
+
+	if (p->lu != NULL) {
+		p->lu->lookup(p->lu, XYZ, rgb);
+		for (j = 0; j < 3; j++)
+			XYZ[j] *= p->br;
+		return;
+	}
+
+	/* Built in model */
+	{
+		/* Input offset, equivalent to RGB offsets having various values */
+		double doff[3] = { 0.10, 0.06, 0.08 };
+		/* Output offset - equivalent to flare [range 0.0 - 1.0] */
+		double ooff[3] = { 0.03, 0.04, 0.09 };
+
+		for (j = 0; j < 3; j++) {
+			int vv;
+			vv = (int) (rgb[j] * ((1 << SIM_BITS) - 1.0) + 0.5);
+			rgb[j] =  vv/((1 << SIM_BITS) - 1.0);
+			rgb[j] = doff[j] + (1.0 - doff[j]) * rgb[j];
+			rgb[j] = pow(rgb[j], 2.5);
+		}
+		icmMulBy3x3(XYZ, p->mat, rgb);
+		for (j = 0; j < 3; j++)
+			XYZ[j] += ooff[j];
+	}
+}
+
+/* Return the mean XYZ the display emits over the time a to b */
+static void sd_integrate(simdisp *p, double *XYZ, double a, double b) {
+	double tc = p->tchange;
+	double tau = p->settle;
+	int j;
+
+	if (b <= a) {		/* Instantaneous value */
+		if (a < tc) {
+			icmCpy3(XYZ, p->from);
+		} else {
+			double w = tau > 0.0 ? exp(-(a - tc)/tau) : 0.0;
+			for (j = 0; j < 3; j++)
+				XYZ[j] = p->to[j] + (p->from[j] - p->to[j]) * w;
+		}
+		return;
+	}
+
+	for (j = 0; j < 3; j++)
+		XYZ[j] = 0.0;
+
+	/* Before the change becomes visible */
+	if (a < tc) {
+		double t1 = b < tc ? b : tc;
+		for (j = 0; j < 3; j++)
+			XYZ[j] += p->from[j] * (t1 - a);
+	}
+
+	/* Settling towards the new color */
+	if (b > tc) {
+		double u0 = (a > tc ? a : tc) - tc;
+		double u1 = b - tc;
+		double ee = 0.0;
+
+		if (tau > 0.0)
+			ee = tau * (exp(-u0/tau) - exp(-u1/tau));
+		for (j = 0; j < 3; j++)
+			XYZ[j] += p->to[j] * (u1 - u0) + (p->from[j] - p->to[j]) * ee;
+	}
+
+	for (j = 0; j < 3; j++)
+		XYZ[j] /= (b - a);
+}
+
+/* Display a new device RGB color */
+static void simdisp_set_color(simdisp *p, double rgb[3]) {
+	double now = sd_now(p);
+
+	/* Start from whatever is showing at the moment */
+	sd_integrate(p, p->from, now, now);
+	sd_model(p, p->to, rgb);
+	p->tset = now;
+	p->tchange = now + p->latency;
+}
+
+/* Return the number of readings taken and elapsed time */
+static double simdisp_get_time(simdisp *p, int *nread) {
+	if (nread != NULL)
+		*nread = p->nread;
+	return sd_now(p);
+}
+
+/* Configure the simulation */
+static inst_code simdisp_config(simdisp *p, char *opts, char *profname) {
+
+	if (opts != NULL) {
+		char *buf, *tok, *v;
+
+		if ((buf = strdup(opts)) == NULL)
+			return simdisp_interp_code((inst *)p, SIMDISP_INTERNAL_ERROR);
+
+		for (tok = strtok(buf, ",:"); tok != NULL; tok = strtok(NULL, ",:")) {
+			double val = 0.0;
+
+			if ((v = strchr(tok, '=')) != NULL) {
+				*v++ = '\000';
+				val = atof(v);
+			}
+			if (strcmp(tok, "int") == 0 && v != NULL)
+				p->inttime = val;
+			else if (strcmp(tok, "noise") == 0 && v != NULL)
+				p->noise = val;
+			else if (strcmp(tok, "lat") == 0 && v != NULL)
+				p->latency = val;
+			else if (strcmp(tok, "settle") == 0 && v != NULL)
+				p->settle = val;
+			else if (strcmp(tok, "delay") == 0 && v != NULL)
+				p->udelay = val;
+			else if (strcmp(tok, "ovhd") == 0 && v != NULL)
+				p->overhead = val;
+			else if (strcmp(tok, "br") == 0 && v != NULL)
+				p->br = val;
+			else if (strcmp(tok, "real") == 0)
+				p->realtime = 1;
+			else if (tok[0] != '\000' && strcmp(tok, "1") != 0) {
+				if (p->verb)
+					printf("simdisp: unrecognised option '%s'\n",tok);
+				free(buf);
+				return simdisp_interp_code((inst *)p, SIMDISP_BAD_OPTION);
+			}
+		}
+		free(buf);
+		if (p->inttime < 0.0 || p->noise < 0.0 || p->latency < 0.0 || p->settle < 0.0
+		 || p->udelay < 0.0 || p->overhead < 0.0 || p->br <= 0.0)
+			return simdisp_interp_code((inst *)p, SIMDISP_BAD_OPTION);
+	}
+
+	/* See if there is a profile we should use as the display */
+	if (profname != NULL
+	 && (p->fp = new_icmFileStd_name(profname,"r")) != NULL) {
+		if ((p->icco = new_icc()) != NULL) {
+			if (p->icco->read(p->icco,p->fp,0) == 0) {
+				icColorSpaceSignature ins;
+				p->lu = p->icco->get_luobj(p->icco, icmFwd, icAbsoluteColorimetric,
+				                            icSigXYZData, icmLuOrdNorm);
+				if (p->lu != NULL) {
+					p->lu->spaces(p->lu, &ins, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+					if (ins != icSigRgbData) {
+						p->lu->del(p->lu);
+						p->lu = NULL;
+					}
+				}
+			}
+		}
+		if (p->lu == NULL) {
+			if (p->icco != NULL)
+				p->icco->del(p->icco);
+			p->icco = NULL;
+			p->fp->del(p->fp);
+			p->fp = NULL;
+		} else if (p->verb)
+			printf("Simulated display is using profile '%s'\n",profname);
+	}
+
+	return inst_ok;
+}
+
+/* Establish communications with the simulation */
+static inst_code
+simdisp_init_coms(inst *pp, int port, baud_rate br, flow_control fc, double tout) {
+	simdisp *p = (simdisp *)pp;
+
+	if (p->debug) fprintf(stderr,"simdisp: init coms\n");
+
+	p->gotcoms = 1;
+	return inst_ok;
+}
+
+/* Initialise the simulation */
+static inst_code
+simdisp_init_inst(inst *pp) {
+	simdisp *p = (simdisp *)pp;
+	double black[3] = { 0.0, 0.0, 0.0 };
+
+	if (p->debug) fprintf(stderr,"simdisp: About to init instrument\n");
+
+	if (p->gotcoms == 0)
+		return simdisp_interp_code((inst *)p, SIMDISP_NO_COMS);	/* Must establish coms first */
+
+	p->stime = msec_time();
+	p->clock = 0.0;
+	p->nread = 0;
+
+	/* Start off displaying black */
+	sd_model(p, p->to, black);
+	icmCpy3(p->from, p->to);
+	p->tset = p->tchange = -1e6;
+
+	p->trig = inst_opt_trig_keyb;
+	p->itype = instSimDisp;
+	p->inited = 1;
+
+	return inst_ok;
+}
+
+/* Read a single sample */
+static inst_code
+simdisp_read_sample(
+inst *pp,
+char *name,			/* Strip name (7 chars) */
+ipatch *val) {		/* Pointer to instrument patch value */
+	simdisp *p = (simdisp *)pp;
+	int user_trig = 0;
+	double a, b, sd;
+
+	if (!p->inited)
+		return simdisp_interp_code((inst *)p, SIMDISP_NOT_INITED);
+
+	if (p->trig == inst_opt_trig_keyb) {
+		int se;
+		if ((se = icoms_poll_user(p->icom, 1)) != ICOM_TRIG) {
+			/* Abort, term or command */
+			return simdisp_interp_code((inst *)p, icoms2simdisp_err(se));
+		}
+		user_trig = 1;
+		if (p->trig_return)
+			printf("\n");
+	}
+
+	/* Allow for the display update delay, counted from when */
+	/* the color was set, and then integrate */
+	sd_wait_until(p, p->tset + p->udelay);
+	a = sd_now(p);
+	b = a + p->inttime;
+	sd_integrate(p, val->aXYZ, a, b);
+	sd_wait_until(p, b + p->overhead);
+	p->nread++;
+
+	/* Noise falls with the square root of the integration time */
+	sd = p->noise;
+	if (p->inttime > 0.0)
+		sd /= sqrt(p->inttime);
+	val->aXYZ[0] += 2.0 * sd * norm_rand();
+	val->aXYZ[1] += sd * norm_rand();
+	val->aXYZ[2] += 4.0 * sd * norm_rand();
+	if (val->aXYZ[0] < 0.0)
+		val->aXYZ[0] = 0.0;
+	if (val->aXYZ[1] < 0.0)
+		val->aXYZ[1] = 0.0;
+	if (val->aXYZ[2] < 0.0)
+		val->aXYZ[2] = 0.0;
+
+	DBG(("simdisp: read %f %f %f over %f - %f\n",val->aXYZ[0],val->aXYZ[1],val->aXYZ[2],a,b))
+
+	val->XYZ_v = 0;
+	val->aXYZ_v = 1;		/* These are absolute XYZ readings */
+	val->Lab_v = 0;
+	val->sp.spec_n = 0;
+	val->duration = 0.0;
+
+	if (user_trig)
+		return inst_user_trig;
+	return inst_ok;
+}
+
+/* Determine if a calibration is needed. */
+inst_cal_type simdisp_needs_calibration(inst *pp) {
+	return inst_ok;
+}
+
+/* Request an instrument calibration. */
+inst_code simdisp_calibrate(
+inst *pp,
+inst_cal_type calt,		/* Calibration type. inst_calt_all for all neeeded */
+inst_cal_cond *calc,	/* Current condition/desired condition */
+char id[CALIDLEN]		/* Condition identifier (ie. white reference ID) */
+) {
+	id[0] = '\000';
+
+	return inst_unsupported;
+}
+
+/* Error codes interpretation */
+static char *
+simdisp_interp_error(inst *pp, int ec) {
+	ec &= inst_imask;
+	switch (ec) {
+		case SIMDISP_INTERNAL_ERROR:
+			return "Internal software error";
+		case SIMDISP_USER_ABORT:
+			return "User hit Abort key";
+		case SIMDISP_USER_TERM:
+			return "User hit Terminate key";
+		case SIMDISP_USER_TRIG:
+			return "User hit Trigger key";
+		case SIMDISP_USER_CMND:
+			return "User hit a Command key";
+
+		case SIMDISP_OK:
+			return "No device error";
+
+		/* Internal errors */
+		case SIMDISP_NO_COMS:
+			return "Communications hasn't been established";
+		case SIMDISP_NOT_INITED:
+			return "Insrument hasn't been initialised";
+		case SIMDISP_BAD_OPTION:
+			return "Unrecognised or out of range simulation option";
+		case SIMDISP_BAD_PROFILE:
+			return "Display profile isn't usable";
+		default:
+			return "Unknown error code";
+	}
+}
+
+
+/* Convert a machine specific error code into an abstract dtp code */
+static inst_code
+simdisp_interp_code(inst *pp, int ec) {
+
+	ec &= inst_imask;
+	switch (ec) {
+
+		case SIMDISP_OK:
+			return inst_ok;
+
+		case SIMDISP_INTERNAL_ERROR:
+		case SIMDISP_NO_COMS:
+		case SIMDISP_NOT_INITED:
+		case SIMDISP_BAD_OPTION:
+		case SIMDISP_BAD_PROFILE:
+			return inst_internal_error | ec;
+
+		case SIMDISP_USER_ABORT:
+			return inst_user_abort | ec;
+		case SIMDISP_USER_TERM:
+			return inst_user_term | ec;
+		case SIMDISP_USER_TRIG:
+			return inst_user_trig | ec;
+		case SIMDISP_USER_CMND:
+			return inst_user_cmnd | ec;
+	}
+	return inst_other_error | ec;
+}
+
+/* Destroy ourselves */
+static void
+simdisp_del(inst *pp) {
+	simdisp *p = (simdisp *)pp;
+	if (p->lu != NULL)
+		p->lu->del(p->lu);
+	if (p->icco != NULL)
+		p->icco->del(p->icco);
+	if (p->fp != NULL)
+		p->fp->del(p->fp);
+	if (p->icom != NULL)
+		p->icom->del(p->icom);
+	free(p);
+}
+
+/* Return the instrument capabilities */
+inst_capability simdisp_capabilities(inst *pp) {
+	inst_capability rv;
+
+	rv = inst_emis_spot
+	   | inst_emis_disp
+	   | inst_colorimeter
+	     ;
+
+	return rv;
+}
+
+/* Return the instrument capabilities 2 */
+inst2_capability simdisp_capabilities2(inst *pp) {
+	inst2_capability rv = 0;
+
+	rv |= inst2_prog_trig;
+	rv |= inst2_keyb_trig;
+
+	return rv;
+}
+
+/* Set device measurement mode */
+inst_code simdisp_set_mode(inst *pp, inst_mode m)
+{
+	simdisp *p = (simdisp *)pp;
+	inst_mode mm;		/* Measurement mode */
+
+	/* The measurement mode portion of the mode */
+	mm = m & inst_mode_measurement_mask;
+
+	/* only display emission mode supported */
+	if (mm != inst_mode_emis_spot
+	 && mm != inst_mode_emis_disp) {
+		return inst_unsupported;
+	}
+
+	/* Spectral mode is not supported */
+	if (m & inst_mode_spectral)
+		return inst_unsupported;
+
+	p->mode = m;
+	return inst_ok;
+}
+
+/*
+ * set or reset an optional mode
+ */
+static inst_code
+simdisp_set_opt_mode(inst *pp, inst_opt_mode m, ...)
+{
+	simdisp *p = (simdisp *)pp;
+
+	/* Nothing to calibrate */
+	if (m == inst_opt_noautocalib)
+		return inst_ok;
+
+	/* Record the trigger mode */
+	if (m == inst_opt_trig_prog
+	 || m == inst_opt_trig_keyb) {
+		p->trig = m;
+		return inst_ok;
+	}
+	if (m == inst_opt_trig_return) {
+		p->trig_return = 1;
+		return inst_ok;
+	} else if (m == inst_opt_trig_no_return) {
+		p->trig_return = 0;
+		return inst_ok;
+	}
+
+	return inst_unsupported;
+}
+
+/* Constructor */
+extern simdisp *new_simdisp(icoms *icom, int debug, int verb)
+{
+	simdisp *p;
+	icmXYZNumber white, red, green, blue;
+	double br = 120.0;		/* Built in model brightness */
+
+	if ((p = (simdisp *)calloc(sizeof(simdisp),1)) == NULL)
+		error("simdisp: malloc failed!");
+
+	if (icom == NULL)
+		p->icom = new_icoms();
+	else
+		p->icom = icom;
+
+	p->debug = debug;
+	p->verb = verb;
+
+	p->init_coms         = simdisp_init_coms;
+	p->init_inst         = simdisp_init_inst;
+	p->capabilities      = simdisp_capabilities;
+	p->capabilities2     = simdisp_capabilities2;
+	p->set_mode          = simdisp_set_mode;
+	p->set_opt_mode      = simdisp_set_opt_mode;
+	p->read_sample       = simdisp_read_sample;
+	p->needs_calibration = simdisp_needs_calibration;
+	p->calibrate         = simdisp_calibrate;
+	p->interp_error      = simdisp_interp_error;
+	p->del               = simdisp_del;
+
+	p->config            = simdisp_config;
+	p->set_color         = simdisp_set_color;
+	p->get_time          = simdisp_get_time;
+
+	/* Default simulation parameters */
+	p->inttime  = 0.4;
+	p->noise    = 0.02;
+	p->latency  = 0.02;
+	p->settle   = 0.01;
+	p->udelay   = 0.06;
+	p->overhead = 0.05;
+	p->br       = 120.4;
+
+	/* Built in display model, somewhere between D50 and D65 */
+	white.X = br * 0.955;
+	white.Y = br * 1.00;
+	white.Z = br * 0.97;
+	red.X = br * 0.41;
+	red.Y = br * 0.21;
+	red.Z = br * 0.02;
+	green.X = br * 0.30;
+	green.Y = br * 0.55;
+	green.Z = br * 0.15;
+	blue.X = br * 0.15;
+	blue.Y = br * 0.10;
+	blue.Z = br * 0.97;
+	if (icmRGBprim2matrix(white, red, green, blue, p->mat))
+		error("simdisp: unexpectedly got singular matrix\n");
+
+	p->itype = instUnknown;		/* Until initalisation */
+
+	return p;
+}
+
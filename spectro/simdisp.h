@@ -0,0 +1,115 @@
+#ifndef SIMDISP_H
+
+/*
+ * Argyll Color Correction System
+ *
+ * Simulated display and colorimeter, for testing and
+ * tuning the display calibration and reading tools
+ * without a real display or instrument.
+ *
+ * Author: agent <agent@local>
+ * Date:   18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * The simulated instrument is an emissive colorimeter looking at
+ * a model of a display. The display is either an RGB ICC profile
+ * or a built in matrix/gamma model with flare and quantization.
+ *
+ * Timing is modelled as follows: a new color becomes visible
+ * after a latency, and then moves exponentially from the previous
+ * color with a settle time constant. Each reading first waits for the
+ * same fixed update delay that dispwin uses after setting a color,
+ * then integrates the (possibly still moving) display over the
+ * integration time, and adds noise of an amount that falls with
+ * the square root of the integration time.
+ *
+ * By default time is simulated, so that a full run takes no wall
+ * clock time, but the total simulated measurement time can be
+ * reported. In real time mode the delays are actually waited out,
+ * so that any host processing between setting a color and reading
+ * it is accounted for.
+ */
+
+#include "inst.h"
+
+/* Note: update simdisp_interp_error() and simdisp_interp_code() in simdisp.c */
+/* if anything of these #defines are added or subtracted */
+
+/* Fake Error codes */
+#define SIMDISP_INTERNAL_ERROR		0x61		/* Internal software error */
+#define SIMDISP_USER_ABORT		    0x65		/* User hit abort */
+#define SIMDISP_USER_TERM		   	0x66		/* User hit terminate */
+#define SIMDISP_USER_TRIG 		    0x67		/* User hit trigger */
+#define SIMDISP_USER_CMND		   	0x68		/* User hit command */
+
+/* Real error code */
+#define SIMDISP_OK   				0x00
+
+/* Internal errors */
+#define SIMDISP_NO_COMS   		    0x22
+#define SIMDISP_NOT_INITED  	    0x23
+#define SIMDISP_BAD_OPTION  	    0x24
+#define SIMDISP_BAD_PROFILE  	    0x25
+
+/* Simulated display & colorimeter object */
+struct _simdisp {
+	INST_OBJ_BASE
+
+	inst_mode mode;				/* Currently selected mode */
+
+	inst_opt_mode trig;			/* Reading trigger mode */
+	int trig_return;			/* Emit "\n" after trigger */
+
+	/* Simulation parameters */
+	double inttime;				/* Integration time in seconds */
+	double noise;				/* Y noise std. dev. in cd/m^2 for a 1 second integration */
+	double latency;				/* Delay before a new color starts to show, seconds */
+	double settle;				/* Display settle time constant, seconds */
+	double udelay;				/* Update delay waited after setting a color, seconds */
+	double overhead;			/* Instrument overhead per reading, seconds */
+	int realtime;				/* NZ to wait in real time rather than simulate it */
+
+	/* Display model */
+	icmFile *fp;				/* Display profile, NULL if built in model */
+	icc *icco;
+	icmLuBase *lu;
+	double br;					/* Profile brightness in cd/m^2 */
+	double mat[3][3];			/* Built in model matrix */
+
+	/* Display state */
+	double from[3];				/* XYZ color being changed from */
+	double to[3];				/* XYZ color being changed to */
+	double tchange;				/* Time the to[] color starts to show */
+	double tset;				/* Time the last color was set */
+	double clock;				/* Current simulated time in seconds */
+	unsigned int stime;			/* Real time starting msec */
+
+	/* Statistics */
+	int nread;					/* Number of readings taken */
+
+	/* Simulated display methods */
+
+	/* Configure the simulation from an option string (may be NULL), */
+	/* and the display profile (NULL for the built in model). */
+	/* Return inst error code */
+	inst_code (*config)(struct _simdisp *p, char *opts, char *profname);
+
+	/* Display a new device RGB color, after any RAMDAC */
+	void (*set_color)(struct _simdisp *p, double rgb[3]);
+
+	/* Return the number of readings taken, and the elapsed */
+	/* (simulated or real) time in seconds */
+	double (*get_time)(struct _simdisp *p, int *nread);
+
+}; typedef struct _simdisp simdisp;
+
+/* Constructor */
+extern simdisp *new_simdisp(icoms *icom, int debug, int verb);
+
+
+#define SIMDISP_H
+#endif /* SIMDISP_H */
@@ -37,6 +37,7 @@
 #include "icoms.h"
 #include "conv.h"
 #include "usbio.h"
+#include "serrec.h"
 
 #undef DEBUG
 
@@ -434,8 +435,11 @@ word_length	 word
 						);
 
 		/* And configure: */
-		tio.c_cc[VTIME] = 1;		/* 0.1 second timeout */
-		tio.c_cc[VMIN] = 64;		/* Comfortably less than _PF_MAX_INPUT */
+		/* We poll() before reading, so have read() return whatever has */
+		/* arrived immediately, rather than waiting for more characters */
+		/* or an inter-character timeout at the end of every reply. */
+		tio.c_cc[VTIME] = 0;
+		tio.c_cc[VMIN] = 0;
 
 		switch (p->fc) {
 			case fc_nc:
@@ -580,7 +584,8 @@ char *wbuf,
 double tout
 ) {
 	int len, wbytes;
-	long toc, i, top;		/* Timout count, counter, timeout period */
+	unsigned int stime, tmsec;	/* Start time, timeout in msec */
+	int tmo = 0;				/* Flag, timed out */
 	struct pollfd pa[2];		/* Poll array to monitor serial write and stdin */
 	struct termios origs, news;
 
@@ -610,17 +615,14 @@ double tout
 
 	/* Until timed out, aborted, or transmitted */
 	len = strlen(wbuf);
-	tout *= 1000.0;		/* Timout in msec */
+	tmsec = (unsigned int)(tout * 1000.0 + 0.5);	/* Timout in msec */
 	p->lerr = 0;
 
-	top = 100;						/* Timeout period in msecs */
-	toc = (int)(tout/top + 0.5);	/* Number of timout periods in timeout */
-	if (toc < 1)
-		toc = 1;
-
 	/* Until data is all written, we time out, or the user aborts */
-	for(i = toc; i > 0 && len > 0;) {
-		if (poll_x(pa, 2, top) > 0) {
+	for(stime = msec_time(); len > 0;) {
+		unsigned int etime = msec_time() - stime;
+
+		if (poll_x(pa, 2, etime < tmsec ? tmsec - etime : 0) > 0) {
 			if (pa[0].revents != 0) {
 				if (pa[0].revents != POLLOUT)
 					error("poll on serial out returned unexpected value 0x%x",pa[0].revents);
@@ -630,7 +632,7 @@ double tout
 					p->lerr |= ICOM_SERW;
 					break;
 				} else if (wbytes > 0) {
-					i = toc;
+					stime = msec_time();	/* Reset time */
 					len -= wbytes;
 					wbuf += wbytes;
 				}
@@ -650,11 +652,12 @@ double tout
 						break;
 				}
 			}
-		} else {
-			i--;		/* timeout (or error!) */
+		} else if ((msec_time() - stime) >= tmsec) {
+			tmo = 1;	/* timeout (or error!) */
+			break;
 		}
 	}
-	if (i <= 0) {		/* Timed out */
+	if (tmo) {		/* Timed out */
 		p->lerr |= ICOM_TO;
 	}
 
@@ -678,7 +681,9 @@ int ntc,			/* Number of terminating characters */
 double tout			/* Time out in seconds */
 ) {
 	int rbytes;
-	long j, toc, i, top;		/* Timout count, counter, timeout period */
+	long j;						/* Terminating character count */
+	unsigned int stime, tmsec;	/* Start time, timeout in msec */
+	int tmo = 0;				/* Flag, timed out */
 	struct pollfd pa[2];		/* Poll array to monitor serial read and stdin */
 	struct termios origs, news;
 	char *rrbuf = rbuf;		/* Start of return buffer */
@@ -692,7 +697,7 @@ double tout			/* Time out in seconds */
 
 #ifdef NEVER
 	/* The Prolific 2303 USB<->serial seems to choke on this, */
-	/* so we just put up with the 100msec delay at the end of each reply. */
+	/* so we count the terminating characters ourselves. */
 	if (tc != p->tc) {	/* Set the termination char */
 		struct termios tio;
 
@@ -731,28 +736,28 @@ double tout			/* Time out in seconds */
 	pa[1].revents = 0;
 
 	bsize--;	/* Allow space for null */
-	tout *= 1000.0;		/* Timout in msec */
+	tmsec = (unsigned int)(tout * 1000.0 + 0.5);	/* Timout in msec */
 	p->lerr = 0;
 
-	top = 100;						/* Timeout period in msecs */
-	toc = (int)(tout/top + 0.5);	/* Number of timout periods in timeout */
-	if (toc < 1)
-		toc = 1;
+	/* Until data is all read, we time out, or the user aborts. */
+	/* We return as soon as the last terminating character arrives, */
+	/* and the timeout is restarted whenever more data arrives. */
+	for(stime = msec_time(), j = 0; bsize > 1 && j < ntc ;) {
+		unsigned int etime = msec_time() - stime;
 
-	/* Until data is all read, we time out, or the user aborts */
-	for(i = toc, j = 0; i > 0 && bsize > 1 && j < ntc ;) {
-
-		if (poll_x(pa, 2, top) > 0) {
+		if (poll_x(pa, 2, etime < tmsec ? tmsec - etime : 0) > 0) {
 			if (pa[0].revents != 0) {
 				if (pa[0].revents != POLLIN &&  pa[0].revents != POLLPRI)
 					error("poll on serial in returned unexpected value 0x%x",pa[0].revents);
 
-				/* We have data to read from input */
-				if ((rbytes = read(p->fd, rbuf, bsize)) < 0) {
+				/* We have data to read from input. With VMIN = 0, a read */
+				/* of nothing after POLLIN is end of file (i.e. the device */
+				/* has gone away), and poll() would keep returning at once. */
+				if ((rbytes = read(p->fd, rbuf, bsize)) <= 0) {
 					p->lerr |= ICOM_SERR;
 					break;
-				} else if (rbytes > 0) {
-					i = toc;		/* Reset time */
+				} else {
+					stime = msec_time();	/* Reset time */
 					bsize -= rbytes;
 					while(rbytes--) {	/* Count termination characters */
 						if (*rbuf++ == tc)
@@ -775,13 +780,14 @@ double tout			/* Time out in seconds */
 						break;
 				}
 			}
-		} else {
-			i--;		/* We timed out (or error!) */
+		} else if ((msec_time() - stime) >= tmsec) {
+			tmo = 1;	/* We timed out (or error!) */
+			break;
 		}
 	}
 
 	*rbuf = '\000';
-	if (i <= 0) {			/* timed out */
+	if (tmo) {			/* timed out */
 		p->lerr |= ICOM_TO;
 	}
 	if (p->debug) fprintf(stderr,"icoms: About to return read '%s' ICOM err 0x%x\n",icoms_fix(rrbuf),p->lerr);
@@ -856,6 +862,9 @@ extern icoms *new_icoms() {
 	usb_set_usb_methods(p);
 	hid_set_hid_methods(p);
 
+	/* Wrap the serial methods with recording or replay, if enabled */
+	serrec_set_methods(p);
+
 	return p;
 }
 
@@ -34,6 +34,7 @@
 #include "icoms.h"
 #include "conv.h"
 #include "usbio.h"
+#include "usbrec.h"
 
 #include "usb.h"
 
@@ -806,7 +807,7 @@ int index,				/* 16 bit index (USB wIndex) */
 unsigned char *rwbuf,	/* Write or read buffer */
 int rwsize, 			/* Bytes to read or write */
 double tout) {
-	p->lerr = icoms_usb_control_th(p, requesttype, request, value, index, rwbuf, rwsize, tout,
+	p->lerr = p->usb_control_th(p, requesttype, request, value, index, rwbuf, rwsize, tout,
 		                                                                 p->debug, &p->cut, 1);
 	return p->lerr;
 }
@@ -931,7 +932,7 @@ icoms_usb_read(
 	int *bread,				/* Bytes read */
 	double tout				/* Timeout in seconds */
 ) {
-	p->lerr = icoms_usb_read_th(p, ep, rbuf, rsize, bread, tout, p->debug, &p->cut, 1);
+	p->lerr = p->usb_read_th(p, ep, rbuf, rsize, bread, tout, p->debug, &p->cut, 1);
 
 	return p->lerr;
 }
@@ -1040,7 +1041,7 @@ icoms_usb_write(
 	int *bwritten,			/* Bytes written */
 	double tout				/* Timeout in seconds */
 ) {
-	p->lerr = icoms_usb_write_th(p, ep, wbuf, wsize, bwritten, tout, p->debug, &p->cut, 1);
+	p->lerr = p->usb_write_th(p, ep, wbuf, wsize, bwritten, tout, p->debug, &p->cut, 1);
 	return p->lerr;
 }
 
@@ -1274,6 +1275,11 @@ icoms *p
 	p->usb_resetep    = icoms_usb_resetep;
 	p->usb_clearhalt  = icoms_usb_clearhalt;
 
+#ifdef ENABLE_USB
+	/* Wrap the above with recording or replay, if enabled */
+	usbrec_set_methods(p);
+#endif /* ENABLE_USB */
+
 	icoms_reset_uih(p);
 }
 
@@ -0,0 +1,531 @@
+
+/*
+ * Argyll Color Correction System
+ *
+ * USB traffic recording and replay.
+ *
+ * Author: agent <agent@local>
+ * Date:   18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * The recording is a text file, one operation per line:
+ *
+ *   I itype                                        Instrument type
+ *   C seq reqtype req value index size rv data     Control message
+ *   R seq ep bsize rv bread data                   Read
+ *   W seq ep wsize rv bwritten data                Write
+ *
+ * where rv is the ICOM error code in hex, data is the bytes read or
+ * written in hex (or "-" if none), and seq is the order in which the
+ * operations completed. Replay hands out each end points operations
+ * in turn, and an operation isn't completed until all those that
+ * completed before it in the recording have been, so that the
+ * relative timing of (say) a switch thread read and the main
+ * thread is reproduced.
+ *
+ * User interrupt codes are not recorded, since the keyboard
+ * is checked as normal during replay.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "copyright.h"
+#include "config.h"
+#include "numsup.h"
+#include "amutex.h"
+#include "xspect.h"
+#include "insttypes.h"
+#include "icoms.h"
+#include "conv.h"
+#include "usbio.h"
+#include "usbrec.h"
+#include "icomsrec.h"
+
+#ifdef ENABLE_USB
+
+#define USBREC_NQ 257			/* Number of replay queues, 0..255 end points + control */
+#define USBREC_CTRLQ 256		/* Control message queue */
+#define USBREC_EMPTYWAIT 50		/* msec to wait on an exhausted read queue */
+
+/* A recorded operation */
+typedef struct {
+	int type;				/* 'C', 'R' or 'W' */
+	int seq;				/* Completion order */
+	int ep;					/* End point, or control reqtype */
+	int req, value, index;	/* Control message parameters */
+	int size;				/* Requested size */
+	int rv;					/* Returned ICOM code */
+	int count;				/* Number of bytes transfered */
+	int dlen;				/* Number of data bytes */
+	unsigned char *data;	/* Data bytes */
+} usbrec_op;
+
+/* Per end point queue of operations */
+typedef struct {
+	usbrec_op *ops;
+	int n, _n;				/* Number used, allocated */
+	int next;				/* Next to replay */
+} usbrec_q;
+
+struct _usbrec {
+	int replay;				/* NZ if replaying, else recording */
+	char *fname;			/* File name */
+	FILE *fp;				/* Recording file */
+	int seq;				/* Next sequence number */
+	instType itype;			/* Replay instrument type */
+
+	/* Replay state */
+	usbrec_q q[USBREC_NQ];	/* Per end point queues */
+	char *played;			/* Flag per sequence number */
+	int nseq;				/* Number of sequence numbers */
+	int nsync;				/* Lowest sequence number not yet played */
+	int warned;				/* NZ if a mismatch has been reported */
+
+	amutex lock;
+
+	/* The methods we've wrapped */
+	instType (*is_usb_portno)(icoms *p, int port);
+	void (*set_usb_port)(icoms *p, int port, int config, int wr_ep, int rd_ep,
+	                     icomuflags usbflags, int retries);
+	int (*usb_control_th)(icoms *p, int requesttype, int request, int value, int index,
+	                      unsigned char *rwbuf, int rwsize, double tout, int debug,
+	                      int *cut, int checkabort);
+	int (*usb_read_th)(icoms *p, int ep, unsigned char *rbuf, int bsize, int *bread,
+	                   double tout, int debug, int *cut, int checkabort);
+	int (*usb_write_th)(icoms *p, int ep, unsigned char *wbuf, int bsize, int *bwritten,
+	                   double tout, int debug, int *cut, int checkabort);
+	void (*del)(icoms *p);
+}; typedef struct _usbrec usbrec;
+
+/* ---------------------------------------------------------------------- */
+/* Recording */
+
+static void rec_set_usb_port(icoms *p, int port, int config, int wr_ep, int rd_ep,
+                             icomuflags usbflags, int retries) {
+	usbrec *r = p->rec;
+	instType itype;
+
+	itype = r->is_usb_portno(p, port);
+	r->set_usb_port(p, port, config, wr_ep, rd_ep, usbflags, retries);
+
+	amutex_lock(r->lock);
+	fprintf(r->fp,"I %d\n",itype);
+	fflush(r->fp);
+	amutex_unlock(r->lock);
+}
+
+static int rec_usb_control_th(icoms *p, int requesttype, int request, int value, int index,
+                              unsigned char *rwbuf, int rwsize, double tout, int debug,
+                              int *cut, int checkabort) {
+	usbrec *r = p->rec;
+	int rv;
+
+	rv = r->usb_control_th(p, requesttype, request, value, index, rwbuf, rwsize,
+	                       tout, debug, cut, checkabort);
+
+	amutex_lock(r->lock);
+	fprintf(r->fp,"C %d %02x %02x %04x %04x %d %x",r->seq++, requesttype, request,
+	        value, index, rwsize, rv & ~ICOM_USERM);
+	icomsrec_hex(r->fp, rwbuf, rwsize);
+	fprintf(r->fp,"\n");
+	fflush(r->fp);
+	amutex_unlock(r->lock);
+
+	return rv;
+}
+
+static int rec_usb_read_th(icoms *p, int ep, unsigned char *rbuf, int bsize, int *breadp,
+                           double tout, int debug, int *cut, int checkabort) {
+	usbrec *r = p->rec;
+	int rv, bread = 0;
+
+	rv = r->usb_read_th(p, ep, rbuf, bsize, &bread, tout, debug, cut, checkabort);
+
+	amutex_lock(r->lock);
+	fprintf(r->fp,"R %d %02x %d %x %d",r->seq++, ep, bsize, rv & ~ICOM_USERM, bread);
+	icomsrec_hex(r->fp, rbuf, bread);
+	fprintf(r->fp,"\n");
+	fflush(r->fp);
+	amutex_unlock(r->lock);
+
+	if (breadp != NULL)
+		*breadp = bread;
+	return rv;
+}
+
+static int rec_usb_write_th(icoms *p, int ep, unsigned char *wbuf, int bsize, int *bwrittenp,
+                           double tout, int debug, int *cut, int checkabort) {
+	usbrec *r = p->rec;
+	int rv, bwritten = 0;
+
+	rv = r->usb_write_th(p, ep, wbuf, bsize, &bwritten, tout, debug, cut, checkabort);
+
+	amutex_lock(r->lock);
+	fprintf(r->fp,"W %d %02x %d %x %d",r->seq++, ep, bsize, rv & ~ICOM_USERM, bwritten);
+	icomsrec_hex(r->fp, wbuf, bsize);
+	fprintf(r->fp,"\n");
+	fflush(r->fp);
+	amutex_unlock(r->lock);
+
+	if (bwrittenp != NULL)
+		*bwrittenp = bwritten;
+	return rv;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Replay */
+
+/* Load the recording into the queues */
+static void rep_load(usbrec *r) {
+	FILE *fp;
+	char *buf = NULL, *hex;
+	int bsize = 0, lno = 0, i;
+
+	if ((fp = fopen(r->fname, "r")) == NULL)
+		error("usbrec: Can't open USB replay file '%s'",r->fname);
+
+	if ((hex = malloc(1)) == NULL)
+		error("usbrec: malloc failed");
+
+	while (icomsrec_line(fp, &buf, &bsize) != NULL) {
+		usbrec_op op;
+		usbrec_q *q;
+		int qi = 0;
+
+		lno++;
+		if (buf[0] == '\000' || buf[0] == '#')
+			continue;
+
+		free(hex);
+		if ((hex = malloc(strlen(buf) + 1)) == NULL)
+			error("usbrec: malloc failed");
+		memset(&op, 0, sizeof(op));
+		op.type = buf[0];
+
+		if (op.type == 'I') {
+			int itype;
+			if (sscanf(buf, "I %d", &itype) != 1)
+				error("usbrec: bad line %d of '%s'",lno,r->fname);
+			r->itype = (instType)itype;
+			continue;
+
+		} else if (op.type == 'C') {
+			if (sscanf(buf, "C %d %x %x %x %x %d %x %s", &op.seq, &op.ep, &op.req,
+			    &op.value, &op.index, &op.size, &op.rv, hex) != 8)
+				error("usbrec: bad line %d of '%s'",lno,r->fname);
+			op.count = op.dlen = icomsrec_unhex(&op.data, hex);
+			qi = USBREC_CTRLQ;
+
+		} else if (op.type == 'R' || op.type == 'W') {
+			char fmt[] = "? %d %x %d %x %d %s";
+			fmt[0] = (char)op.type;
+			if (sscanf(buf, fmt, &op.seq, &op.ep, &op.size, &op.rv, &op.count, hex) != 6)
+				error("usbrec: bad line %d of '%s'",lno,r->fname);
+			op.dlen = icomsrec_unhex(&op.data, hex);
+			qi = op.ep & 0xff;
+
+		} else {
+			error("usbrec: unknown line %d of '%s'",lno,r->fname);
+		}
+
+		if (op.seq < 0)
+			error("usbrec: bad sequence number on line %d of '%s'",lno,r->fname);
+		if (op.seq >= r->nseq)
+			r->nseq = op.seq + 1;
+
+		q = &r->q[qi];
+		if (q->n >= q->_n) {
+			q->_n = q->_n * 2 + 10;
+			if ((q->ops = (usbrec_op *)realloc(q->ops, q->_n * sizeof(usbrec_op))) == NULL)
+				error("usbrec: realloc failed");
+		}
+		q->ops[q->n++] = op;
+	}
+	free(hex);
+	free(buf);
+	fclose(fp);
+
+	if (r->itype == instUnknown)
+		error("usbrec: no instrument type in USB replay file '%s'",r->fname);
+
+	if ((r->played = (char *)calloc(r->nseq + 1, sizeof(char))) == NULL)
+		error("usbrec: calloc failed");
+
+	/* Sequence numbers that don't appear in the file count as played */
+	for (i = 0; i < r->nseq; i++)
+		r->played[i] = 1;
+	for (i = 0; i < USBREC_NQ; i++) {
+		int j;
+		for (j = 0; j < r->q[i].n; j++)
+			r->played[r->q[i].ops[j].seq] = 0;
+	}
+	for (r->nsync = 0; r->nsync < r->nseq && r->played[r->nsync]; r->nsync++)
+		;
+}
+
+/* Report a mismatch between the driver and the recording */
+static void rep_mismatch(usbrec *r, char *what, int ep) {
+	icomsrec_mismatch(&r->warned, "USB replay of '%s' differs from the recording at %s 0x%02x",
+	                  r->fname,what,ep);
+}
+
+/* Get the next operation from a queue, waiting until the operations */
+/* that completed before it have been replayed. */
+/* Return NULL if there is no next operation. */
+/* (Called and returns with the lock held) */
+static usbrec_op *rep_next(usbrec *r, int qi, double tout) {
+	usbrec_q *q = &r->q[qi];
+	usbrec_op *op;
+	unsigned int stime;
+
+	if (q->next >= q->n)
+		return NULL;
+	op = &q->ops[q->next];
+
+	/* Once the replay is out of step, don't try and keep order */
+	stime = msec_time();
+	while (!r->warned && op->seq > r->nsync
+	    && (msec_time() - stime) < (unsigned int)(tout * 1000.0 + 0.5)) {
+		amutex_unlock(r->lock);
+		msec_sleep(1);
+		amutex_lock(r->lock);
+	}
+	return op;
+}
+
+/* Mark an operation as done */
+/* (Called with the lock held) */
+static void rep_done(usbrec *r, int qi) {
+	usbrec_q *q = &r->q[qi];
+	usbrec_op *op = &q->ops[q->next++];
+
+	r->played[op->seq] = 1;
+	while (r->nsync < r->nseq && r->played[r->nsync])
+		r->nsync++;
+}
+
+/* Create the one replay path */
+static icompath **rep_get_paths(icoms *p) {
+	usbrec *r = p->rec;
+	char pname[400];
+
+	sprintf(pname,"replay (%s)", inst_name(r->itype));
+	return icomsrec_replay_path(p, pname, r->itype);
+}
+
+static instType rep_is_usb_portno(icoms *p, int port) {
+
+	if (p->paths == NULL)
+		p->get_paths(p);
+
+	if (port <= 0 || port > p->npaths)
+		error("icoms - set_usb_port: port number out of range!");
+
+	return p->rec->itype;
+}
+
+static void rep_set_usb_port(icoms *p, int port, int config, int wr_ep, int rd_ep,
+                             icomuflags usbflags, int retries) {
+
+	if (p->debug) fprintf(stderr,"icoms: replaying usb port %d\n",port);
+
+	rep_is_usb_portno(p, port);
+	p->port = port;
+	p->is_usb = 1;
+	p->cnfg = config;
+	p->wr_ep = wr_ep;
+	p->rd_ep = rd_ep;
+	p->uflags = usbflags;
+}
+
+static int rep_usb_control_th(icoms *p, int requesttype, int request, int value, int index,
+                              unsigned char *rwbuf, int rwsize, double tout, int debug,
+                              int *cut, int checkabort) {
+	usbrec *r = p->rec;
+	usbrec_op *op;
+	int rv;
+
+	amutex_lock(r->lock);
+	if ((op = rep_next(r, USBREC_CTRLQ, tout)) == NULL
+	 || op->ep != requesttype || op->req != request
+	 || op->value != value || op->index != index || op->size != rwsize
+	 || (!(requesttype & USB_ENDPOINT_IN)
+	   && (op->dlen != rwsize || (rwsize > 0 && memcmp(rwbuf, op->data, rwsize) != 0)))) {
+		rep_mismatch(r, "control", request);
+		amutex_unlock(r->lock);
+		return ICOM_USBW;
+	}
+	if ((requesttype & USB_ENDPOINT_IN) && op->count > 0)
+		memcpy(rwbuf, op->data, op->count < rwsize ? op->count : rwsize);
+	rv = op->rv;
+	rep_done(r, USBREC_CTRLQ);
+	amutex_unlock(r->lock);
+
+	if (debug) fprintf(stderr,"icoms: Replayed control %02x, %02x %04x %04x %04x ICOM err 0x%x\n",
+	                          requesttype, request, value, index, rwsize, rv);
+
+	return icomsrec_checkabort(p, rv, cut, checkabort);
+}
+
+static int rep_usb_read_th(icoms *p, int ep, unsigned char *rbuf, int bsize, int *breadp,
+                           double tout, int debug, int *cut, int checkabort) {
+	usbrec *r = p->rec;
+	usbrec_op *op;
+	int rv, qi = ep & 0xff;
+
+	if (breadp != NULL)
+		*breadp = 0;
+
+	amutex_lock(r->lock);
+	if ((op = rep_next(r, qi, tout)) == NULL) {
+		double wt = tout * 1000.0;
+		amutex_unlock(r->lock);
+
+		/* Nothing more was recorded, so act as if the instrument */
+		/* has nothing more to say. */
+		if (wt > USBREC_EMPTYWAIT)
+			wt = USBREC_EMPTYWAIT;
+		msec_sleep((unsigned int)wt);
+		if (debug) fprintf(stderr,"icoms: Replay read ep 0x%x exhausted\n",ep);
+		return icomsrec_checkabort(p, ICOM_TO, cut, checkabort);
+	}
+	if (op->type != 'R' || op->size != bsize) {
+		rep_mismatch(r, "read", ep);
+		amutex_unlock(r->lock);
+		return ICOM_USBR;
+	}
+	if (op->count > 0)
+		memcpy(rbuf, op->data, op->count < bsize ? op->count : bsize);
+	if (breadp != NULL)
+		*breadp = op->count;
+	rv = op->rv;
+	rep_done(r, qi);
+	amutex_unlock(r->lock);
+
+	if (debug) fprintf(stderr,"icoms: Replayed read ep 0x%x of %d bytes, ICOM err 0x%x\n",
+	                          ep, bsize, rv);
+
+	return icomsrec_checkabort(p, rv, cut, checkabort);
+}
+
+static int rep_usb_write_th(icoms *p, int ep, unsigned char *wbuf, int bsize, int *bwrittenp,
+                           double tout, int debug, int *cut, int checkabort) {
+	usbrec *r = p->rec;
+	usbrec_op *op;
+	int rv, qi = ep & 0xff;
+
+	if (bwrittenp != NULL)
+		*bwrittenp = 0;
+
+	amutex_lock(r->lock);
+	if ((op = rep_next(r, qi, tout)) == NULL
+	 || op->type != 'W' || op->size != bsize
+	 || op->dlen != bsize || (bsize > 0 && memcmp(wbuf, op->data, bsize) != 0)) {
+		rep_mismatch(r, "write", ep);
+		amutex_unlock(r->lock);
+		return ICOM_USBW;
+	}
+	if (bwrittenp != NULL)
+		*bwrittenp = op->count;
+	rv = op->rv;
+	rep_done(r, qi);
+	amutex_unlock(r->lock);
+
+	if (debug) fprintf(stderr,"icoms: Replayed write ep 0x%x of %d bytes, ICOM err 0x%x\n",
+	                          ep, bsize, rv);
+
+	return icomsrec_checkabort(p, rv, cut, checkabort);
+}
+
+static int rep_usb_resetep(icoms *p, int ep) {
+	return ICOM_OK;
+}
+
+static int rep_usb_clearhalt(icoms *p, int ep) {
+	return ICOM_OK;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Free the recording or replay state, and then the icoms */
+static void usbrec_del(icoms *p) {
+	usbrec *r = p->rec;
+	int i, j;
+
+	if (r->fp != NULL)
+		fclose(r->fp);
+	for (i = 0; i < USBREC_NQ; i++) {
+		for (j = 0; j < r->q[i].n; j++)
+			free(r->q[i].ops[j].data);
+		free(r->q[i].ops);
+	}
+	free(r->played);
+	free(r->fname);
+	amutex_del(r->lock);
+	p->rec = NULL;
+	p->del = r->del;
+	free(r);
+
+	p->del(p);
+}
+
+/* Wrap the USB icoms methods with recording or replay, */
+/* if either is enabled by the environment. */
+void usbrec_set_methods(icoms *p) {
+	usbrec *r;
+	char *rec, *rep;
+
+	rec = getenv("ARGYLL_USB_RECORD");
+	rep = getenv("ARGYLL_USB_REPLAY");
+
+	if ((rec == NULL || rec[0] == '\000')
+	 && (rep == NULL || rep[0] == '\000'))
+		return;
+
+	if ((r = (usbrec *)calloc(sizeof(usbrec), 1)) == NULL)
+		error("usbrec: calloc failed");
+	amutex_init(r->lock);
+
+	r->is_usb_portno  = p->is_usb_portno;
+	r->set_usb_port   = p->set_usb_port;
+	r->usb_control_th = p->usb_control_th;
+	r->usb_read_th    = p->usb_read_th;
+	r->usb_write_th   = p->usb_write_th;
+	r->del            = p->del;
+	p->rec = r;
+	p->del = usbrec_del;
+
+	if (rep != NULL && rep[0] != '\000') {
+		r->replay = 1;
+		if ((r->fname = strdup(rep)) == NULL)
+			error("usbrec: strdup failed");
+		rep_load(r);
+
+		p->get_paths      = rep_get_paths;
+		p->is_usb_portno  = rep_is_usb_portno;
+		p->set_usb_port   = rep_set_usb_port;
+		p->usb_control_th = rep_usb_control_th;
+		p->usb_read_th    = rep_usb_read_th;
+		p->usb_write_th   = rep_usb_write_th;
+		p->usb_resetep    = rep_usb_resetep;
+		p->usb_clearhalt  = rep_usb_clearhalt;
+	} else {
+		if ((r->fname = strdup(rec)) == NULL)
+			error("usbrec: strdup failed");
+		if ((r->fp = fopen(r->fname, "w")) == NULL)
+			error("usbrec: Can't create USB record file '%s'",r->fname);
+
+		p->set_usb_port   = rec_set_usb_port;
+		p->usb_control_th = rec_usb_control_th;
+		p->usb_read_th    = rec_usb_read_th;
+		p->usb_write_th   = rec_usb_write_th;
+	}
+}
+
+#endif /* ENABLE_USB */
@@ -0,0 +1,40 @@
+
+#ifndef USBREC_H
+
+/*
+ * Argyll Color Correction System
+ *
+ * USB traffic recording and replay.
+ *
+ * Author: agent <agent@local>
+ * Date:   18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * If ARGYLL_USB_RECORD is set to a file name, every USB control message,
+ * read and write an instrument driver makes is written to that file.
+ * If ARGYLL_USB_REPLAY is set to such a file, no real USB device is
+ * used, and each operation is instead answered from the recording.
+ * A single "Replay" port is offered, that reports the recorded
+ * instrument type, so that the unmodified instrument driver and
+ * its processing can be run (and timed or debugged) without the
+ * instrument being present.
+ *
+ * Replay is in order for each end point, so an instrument driver
+ * that reads from one end point in a separate thread still works.
+ * If the driver asks for something different to what was recorded,
+ * or writes different data, (ie. because its behaviour depends on the
+ * time or on saved calibration files), a warning is printed and the
+ * operation fails.
+ */
+
+/* Wrap the USB icoms methods with recording or replay, */
+/* if either is enabled by the environment. */
+/* (Called at the end of usb_set_usb_methods()) */
+void usbrec_set_methods(icoms *p);
+
+#define USBREC_H
+#endif /* USBREC_H */
@@ -0,0 +1,263 @@
+/*
+ * Argyll Color Correction System
+ *
+ * Test USB traffic recording and replay.
+ *
+ * Author: agent <agent@local>
+ * Date:   18/10/2026
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * A short scripted session with a simulated instrument is recorded,
+ * and then replayed. The recorded fixture usbrectest.rec is then
+ * replayed, and replayed again with the script writing different
+ * data, which the replay must detect.
+ *
+ * usbrectest -r file   records the script to file, to re-create
+ * the fixture.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "copyright.h"
+#include "config.h"
+#include "numsup.h"
+#include "xspect.h"
+#include "insttypes.h"
+#include "icoms.h"
+#include "conv.h"
+#include "usbio.h"
+#include "usbrec.h"
+
+#define WR_EP 0x01
+#define RD_EP 0x82
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Simulated instrument, used when recording */
+
+static int simrd = 0;		/* Number of reads made */
+
+static instType sim_is_usb_portno(icoms *p, int port) {
+	return instI1Pro;
+}
+
+static void sim_set_usb_port(icoms *p, int port, int config, int wr_ep, int rd_ep,
+                             icomuflags usbflags, int retries) {
+	p->port = port;
+	p->is_usb = 1;
+}
+
+static int sim_usb_control_th(icoms *p, int requesttype, int request, int value, int index,
+                              unsigned char *rwbuf, int rwsize, double tout, int debug,
+                              int *cut, int checkabort) {
+	int i;
+
+	if (requesttype & USB_ENDPOINT_IN) {
+		for (i = 0; i < rwsize; i++)
+			rwbuf[i] = (unsigned char)(request + value + i);
+	}
+	return ICOM_OK;
+}
+
+static int sim_usb_read_th(icoms *p, int ep, unsigned char *rbuf, int bsize, int *bread,
+                           double tout, int debug, int *cut, int checkabort) {
+	int i;
+
+	simrd++;
+	if (simrd == 3) {		/* Time out on the third read */
+		*bread = 0;
+		return ICOM_TO;
+	}
+	for (i = 0; i < bsize; i++)
+		rbuf[i] = (unsigned char)(simrd * 37 + i * 5);
+	*bread = bsize;
+	return ICOM_OK;
+}
+
+static int sim_usb_write_th(icoms *p, int ep, unsigned char *wbuf, int bsize, int *bwritten,
+                           double tout, int debug, int *cut, int checkabort) {
+	*bwritten = bsize;
+	return ICOM_OK;
+}
+
+static void sim_del(icoms *p) {
+	free(p);
+}
+
+/* Create an icoms for the simulated instrument, and set it up */
+/* for recording or replay according to the environment. */
+static icoms *new_test_icoms(void) {
+	icoms *p;
+
+	if ((p = (icoms *)calloc(sizeof(icoms), 1)) == NULL)
+		error("calloc failed");
+
+	p->is_usb_portno  = sim_is_usb_portno;
+	p->set_usb_port   = sim_set_usb_port;
+	p->usb_control_th = sim_usb_control_th;
+	p->usb_read_th    = sim_usb_read_th;
+	p->usb_write_th   = sim_usb_write_th;
+	p->del            = sim_del;
+
+	usbrec_set_methods(p);
+
+	return p;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Run the script, and check that the replies are those of */
+/* the simulated instrument. If alt is set, write different */
+/* data to what was recorded, and check that this fails. */
+/* Return nz on failure */
+static int run_script(icoms *p, int alt) {
+	unsigned char buf[64], wb[4] = { 0x10, 0x20, 0x30, 0x40 };
+	int i, rv, bread, bwritten, cut = 0;
+	int fail = 0;
+
+	simrd = 0;
+	p->set_usb_port(p, 1, 1, WR_EP, RD_EP, icomuf_none, 0);
+
+	/* Control read */
+	memset(buf, 0, sizeof(buf));
+	if ((rv = p->usb_control_th(p, USB_ENDPOINT_IN | 0x40, 0x01, 0x10, 0, buf, 8,
+	                            1.0, 0, &cut, 0)) != ICOM_OK) {
+		printf("Control read returned 0x%x\n",rv);
+		fail = 1;
+	}
+	for (i = 0; i < 8; i++) {
+		if (buf[i] != (unsigned char)(0x01 + 0x10 + i)) {
+			printf("Control read byte %d is 0x%02x\n",i,buf[i]);
+			fail = 1;
+			break;
+		}
+	}
+
+	/* Write, with different data if alt is set */
+	if (alt)
+		wb[2] = 0x31;
+	rv = p->usb_write_th(p, WR_EP, wb, 4, &bwritten, 1.0, 0, &cut, 0);
+	if (alt) {
+		if (rv != ICOM_USBW) {
+			printf("Write of different data returned 0x%x, expected 0x%x\n",rv,ICOM_USBW);
+			fail = 1;
+		}
+		return fail;
+	}
+	if (rv != ICOM_OK || bwritten != 4) {
+		printf("Write returned 0x%x, wrote %d\n",rv,bwritten);
+		fail = 1;
+	}
+
+	/* Two reads */
+	for (i = 1; i <= 2; i++) {
+		int j;
+
+		memset(buf, 0, sizeof(buf));
+		if ((rv = p->usb_read_th(p, RD_EP, buf, 16, &bread, 1.0, 0, &cut, 0)) != ICOM_OK
+		 || bread != 16) {
+			printf("Read %d returned 0x%x, read %d\n",i,rv,bread);
+			fail = 1;
+		}
+		for (j = 0; j < 16; j++) {
+			if (buf[j] != (unsigned char)(i * 37 + j * 5)) {
+				printf("Read %d byte %d is 0x%02x\n",i,j,buf[j]);
+				fail = 1;
+				break;
+			}
+		}
+	}
+
+	/* Control write */
+	buf[0] = 0xaa;
+	buf[1] = 0x55;
+	if ((rv = p->usb_control_th(p, 0x40, 0x02, 0x1234, 0x0001, buf, 2,
+	                            1.0, 0, &cut, 0)) != ICOM_OK) {
+		printf("Control write returned 0x%x\n",rv);
+		fail = 1;
+	}
+
+	/* A read that times out */
+	if ((rv = p->usb_read_th(p, RD_EP, buf, 16, &bread, 1.0, 0, &cut, 0)) != ICOM_TO
+	 || bread != 0) {
+		printf("Read 3 returned 0x%x, read %d, expected a time out\n",rv,bread);
+		fail = 1;
+	}
+
+	return fail;
+}
+
+int main(int argc, char *argv[]) {
+	static char recenv[600], repenv[600];
+	char *fixture = "usbrectest.rec";
+	char *tmpname = "usbrectest.tmp";
+	icoms *p;
+	int fail = 0;
+
+	if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+		sprintf(recenv, "ARGYLL_USB_RECORD=%.500s", argv[2]);
+		putenv(recenv);
+		p = new_test_icoms();
+		fail = run_script(p, 0);
+		p->del(p);
+		printf("Recorded '%s'\n",argv[2]);
+		return fail;
+	}
+	if (argc > 1)
+		fixture = argv[1];
+
+	printf("Starting USB record/replay test\n");
+
+	/* Record and replay */
+	sprintf(recenv, "ARGYLL_USB_RECORD=%s", tmpname);
+	putenv(recenv);
+	p = new_test_icoms();
+	if (run_script(p, 0)) {
+		printf("Recording failed\n");
+		fail = 1;
+	}
+	p->del(p);
+
+	sprintf(recenv, "ARGYLL_USB_RECORD=");
+	putenv(recenv);
+	sprintf(repenv, "ARGYLL_USB_REPLAY=%s", tmpname);
+	putenv(repenv);
+	p = new_test_icoms();
+	if (run_script(p, 0)) {
+		printf("Replay of the new recording failed\n");
+		fail = 1;
+	}
+	p->del(p);
+	remove(tmpname);
+
+	/* Replay the fixture */
+	sprintf(repenv, "ARGYLL_USB_REPLAY=%.500s", fixture);
+	putenv(repenv);
+	p = new_test_icoms();
+	if (run_script(p, 0)) {
+		printf("Replay of '%s' failed\n",fixture);
+		fail = 1;
+	}
+	p->del(p);
+
+	/* Replay the fixture, writing different data */
+	p = new_test_icoms();
+	if (run_script(p, 1)) {
+		printf("Replay of '%s' didn't detect different write data\n",fixture);
+		fail = 1;
+	}
+	p->del(p);
+
+	if (fail) {
+		printf("USB record/replay test FAILED\n");
+		return 1;
+	} else {
+		printf("USB record/replay test done OK\n");
+		return 0;
+	}
+}
+
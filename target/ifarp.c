@@ -24,10 +24,11 @@
    point "fills in" the gaps in the existing distribution, while starting
    from an existing point.
 
-   The performance is still not very good, as the inner loop involves
-   locating the nearest existing point, as well as converting from
-   device coordinates to perceptual space. If the powell search radius
-   is reduced too much the uniformity of the distribution suffers.
+   The inner loop involves locating the nearest existing point, as
+   well as converting from device coordinates to perceptual space.
+   The nearest point is found using an incrementaly built k-d tree
+   of the perceptual values. If the powell search radius is reduced
+   too much the uniformity of the distribution suffers.
 
  */
 
@@ -38,8 +39,7 @@
     biggest adjoing "gap", and this may speed things up by allowing us
     to reduce the powel search radius. 
 
-	Perhaps switching to a balltree indexing structure would speed up
-    nearest ppoint finding as well as providing a mechanism to quickly
+	Perhaps the k-d tree could also provide a mechanism to quickly
     locate the nearest "void".
 
 	Subsequent experience indicates that furthest distance in perceptual
@@ -81,12 +81,6 @@ static void dump_image_final(ifarp *s, int pcp);
 #define MAX_TRIES   30		/* Maximum itterations */
 
 
-/* nn functions */
-static double nearest(ifarp *s, double *q);
-static void init_nn(ifarp *s);
-static void add_nn(ifarp *s);
-static void del_nn(ifarp *s);
-
 /* ----------------------------------------------------- */
 /* Default convert the nodes device coordinates into approximate perceptual coordinates */
 static void
@@ -184,9 +178,10 @@ static double efunc(void *edata, double p[]) {
 	if ((rv = (ifarp_in_dev_gamut(s, p))) > 0.0) {
 		rv = rv * 500.0 + 500.0;		/* Discourage being out of gamut */
 	} else {
-		double v[MXTD];
+		double v[MXTD], dist;
 		s->percept(s->od, v, p);
-		rv = 500.0 - nearest(s, v);
+		s->nn->nearest(s->nn, &dist, v);
+		rv = 500.0 - sqrt(dist);
 	}
 //printf("~1 rv = %f from %f %f\n",rv,p[0],p[1]);
 	return rv;
@@ -258,9 +253,8 @@ s->nodes[s->np].p[1]);
 #endif
 
 	/* Add the node to our current list */
-	s->nodes[s->np].touch = s->tbase;
+	s->nn->add(s->nn, s->nodes[s->np].v, s->np);
 	s->np++;
-	add_nn(s);
 
 	return s->np;
 }
@@ -355,7 +349,6 @@ void *od				/* context for Perceptual function */
 	if (di > MXTD)
 		error ("ifarp: Can't handle di %d",di);
 	s->di = di;
-	s->tbase = 0;
 	
 	/* Initial alloc of nodes */
 	if ((s->nodes = (ifpnode *)malloc(s->inp * sizeof(ifpnode))) == NULL)
@@ -367,7 +360,6 @@ void *od				/* context for Perceptual function */
 		for (e = 0; e < di; e++)
 			s->nodes[s->np].p[e] = fxlist[i].p[e];
 		s->percept(s->od, s->nodes[i].v, s->nodes[i].p);
-		s->nodes[s->np].touch = s->tbase;
 		s->np++;
 	}
 
@@ -378,12 +370,13 @@ void *od				/* context for Perceptual function */
 		for (e = 0; e < di; e++)
 			s->nodes[s->np].p[e] = 0.0;		/* This is assumed to be in gamut */
 		s->percept(s->od, s->nodes[i].v, s->nodes[i].p);
-		s->nodes[s->np].touch = s->tbase;
 		s->np++;
 	}
 
 	/* Setup initial nearest point acceleration structure */
-	init_nn(s);
+	s->nn = new_kdtree(di, s->inp);
+	for (i = 0; i < s->np; i++)
+		s->nn->add(s->nn, s->nodes[i].v, i);
 
 	/* Create initial patches */
 // ~~99
@@ -404,414 +397,12 @@ void *od				/* context for Perceptual function */
 		printf("\n");
 
 	/* We're done with acceleration structure */
-	del_nn(s);
+	s->nn->del(s->nn);
+	s->nn = NULL;
 
 	return s;
 }
 
-/* --------------------------------------------------- */
-/* (This code is has been copied from gamut/gamut.c) */
-
-#ifdef DEBUG
-#define NN_INF 100000.0
-#else
-#define NN_INF 1e307
-#endif
-
-/* Given a point, */
-/* return the nearest existint test point. */
-static double
-nearest(
-ifarp *s,
-double *q		/* Target point location */
-) {
-	int e, i, k;
-	int di = s->di;
-	int wex[MXTD * 2];		/* Current window edge indexes */
-	double wed[MXTD * 2];	/* Current window edge distances */
-							/* Indexes are axis * 2 +0 for lower edge, */
-							/* +1 for upper edge of search box. */
-							/* We are comparing lower edge of search box */
-							/* with upper edge of bounding box etc. */ 
-
-//printf("~1 nearest called\n");
-
-	/* We have to find out which existing point the point will be nearest */
-
-	if ((s->tbase + di) < s->tbase) {	/* Overflow of touch count */
-		for (i = 0; i < s->np; i++)
-			s->sax[0][i]->touch = 0;		/* reset it in all the objects */
-		s->tbase = 0;
-	}
-	s->ttarget = s->tbase + di;		/* Target touch value */
-
-//printf("\n");
-//printf("Query point is %f %f\n",q[0], q[1]);
-
-	/* Find starting indexes within axis arrays */
-	for (e = 0; e < (2 * di); e++) {	/* For all axes min & max */
-		int f = e/2;			/* Axis */
-		int i0, i1, i2;			/* Search indexes */
-		double v0, v1, v2;		/* Box */
-		double qf, ww;
-
-		/* Binary search this edge */
-		qf = q[f]; 		/* strength reduced q[f] */
-
-//printf("\n");
-//printf("isearching axis %d %s for %f\n",f, e & 1 ? "max" : "min", qf);
-		i0 = 0;
-		i2 = s->np - 1;
-		v0 = s->sax[f][i0]->v[f];
-		v2 = s->sax[f][i2]->v[f];
-//printf("start points %d - %d, bound %f - %f\n",i0, i2, v0, v2);
-
-		if (qf <= v0) {
-			i2 = i0;
-			v2 = v0;
-		} else if (qf >= v2) {
-			i0 = i2;
-			v0 = v2;
-		} else {
-			do {
-				i1 = (i2 + i0)/2;		/* Trial point */
-				v1 = s->sax[f][i1]->v[f];	/* Value at trial */
-				if (v1 < qf) {
-					i0 = i1;			/* Take top half */
-					v0 = v1;
-				} else {
-					i2 = i1;			/* Take bottom half */
-					v2 = v1;
-				}
-//printf("current point %d - %d, bound %f - %f\n",i0, i2, v0, v2);
-			} while ((i2 - i0) > 1);
-		}
-
-		if (e & 1) {			/* Max side of window */
-			int tc;				/* total object count */
-
-			ww = v2 - qf;
-			wed[e] = fabs(ww) * ww;
-			wex[e] = i2;
-
-			/* Check that min and max together will cover at least s->np objects */
-			tc = s->np - i2 + wex[e ^ 1] + 1;
-//printf("got %d, expected %d\n",tc, s->np);
-
-			/* (I don't really understand why this works!) */
-			if (tc < s->np) {		/* We haven't accounted for all the objects */
-				int el = e ^ 1;		/* Low side sax */
-				int ti0, ti2;
-				double tv0, tv2;
-
-				ti0 = wex[el];
-				ti2 = i2;
-//printf("We have straddling objects, initial indexes are %d - %d\n",ti0, ti2);
-
-				/* While straddling objects remain undiscovered: */
-				while (tc < s->np) {
-					tv0 =  NN_INF;		/* Guard values */
-					tv2 = -NN_INF;
-
-					/* Increment low side until we find a straddler */
-					while (ti0 < (s->np-1)) {
-						ww = s->sax[f][++ti0]->v[f];	/* Position of the other end */
-						if (ww < qf) {
-//printf("found low object %d at index %d that straddles\n",s->sax[f][ti0]-s->nodes,ti0);
-							tv0 = qf - s->sax[f][ti0]->v[f];
-							break;
-						}
-					}
-
-					/* Decrement high side until we find a straddler */
-					while (ti2 > 0) {
-						ww = s->sax[f][--ti2]->v[f];	/* Position of the other end */
-						if (ww > qf) {
-//printf("found high object %d at index %d that straddles\n",s->sax[f][ti2]-s->nodes,ti2);
-							tv2 = s->sax[f][ti2]->v[f] - qf;
-							break;
-						}
-					}
-					/* Choose the closest */
-					if (tv0 > tv2) {
-						wed[el] = fabs(tv0) * tv0;
-						wex[el] = ti0;
-						tc++;
-					} else {
-						wed[e] = fabs(tv2) * tv2;
-						wex[e] = ti2;
-						tc++;
-					}
-				}
-//printf("After correction we have %d - %d\n",wex[e^1], wex[e]);
-			}
-		} else {				/* Min side of window */
-			ww = q[f] - v0;
-			wed[e] = fabs(ww) * ww;
-			wex[e] = i0;
-		}
-	}
-
-	/* Expand a di dimenstional cube centered on the target point, */
-	/* jumping to the next nearest point on any axis, discovering */
-	/* any bounding boxes that are within the expanding window */
-	/* by checking their touch count. */
-
-	/* The first point found establishes the initial best distance. */
-	/* When the window expands beyond the point where it can improve */
-	/* the best distance, stop */
-
-	{
-		double bw = 0.0;		/* Current window distance */
-		double bdist = NN_INF;	/* Best possible distance to an object outside the window */
-		int bix;				/* Index of best point */
-
-		/* Until we're done */
-		for (;;) {
-			int ee;				/* Axis & expanding box edge */
-			int ff;				/* Axis */
-			int ii;				/* Index of chosen point */
-			ifpnode *ob;		/* Current object */
-			unsigned int ctv;	/* Current touch value */
-//printf("\n");
-//printf("wwidth = %f, bdist = %f, window = %d-%d, %d-%d\n",
-//bw, bdist, wex[0], wex[1], wex[2], wex[3]);
-//printf("window edge distances are = %f-%f, %f-%f\n",
-//wed[0], wed[1], wed[2], wed[3]);
-
-			/* find next (smallest) window increment axis and direction */
-			ee = 0;
-			ii = wex[ee];
-			bw = wed[ee];
-			for (e = 1; e < (2 * di); e++) {
-				if (wed[e] < bw) {
-					ee = e;
-					ii = wex[e];
-					bw = wed[e];
-				}
-			}
-//printf("Next best is axisdir %d, object %d, axis index %d, best possible dist %f\n",
-//ee, s->sax[ee/2][ii] - s->nodes, ii, bw);
-
-			if (bw == NN_INF || bw > bdist) {
-				break;		/* Can't go any further, or further points will be worse */
-			}
-
-#ifdef ASSERTS
-if (ii < 0 || ii >= s->np) {
-printf("Assert: went out of bounds of sorted axis array\n");
-exit(0);
-}
-#endif
-			/* Chosen point on ee axis/direction, index ii */
-			ff = ee / 2;			/* Axis only */
-
-			ob = s->sax[ff][ii];
-
-			/* Touch value of current object */
-			ctv = ob->touch;
-
-			if (ctv < s->ttarget) {		/* Not been dealt with before */
-
-				/* Touch this new window boundary point */
-				ob->touch = ctv = ((ctv < s->tbase) ? s->tbase : ctv) + 1;
-
-//printf("New touch count on %d is %d, target %d\n",
-//ob - s->nodes, s->sax[ff][ii]->touch, s->ttarget);
-
-				/* Check the point out */
-				if (ctv == (s->tbase + di)) {	/* Is within window on all axes */
-					double tdist = 0.0;
-
-					/* Compute distance from query point to this object */
-					for (k = 0; k < di; k++) {
-						double tt = ob->v[k] - q[k];
-						tdist += tt * tt;
-					}
-					
-//printf("Got new best point %d, dist %f\n",ob-s->nodes,sqrt(tdist));
-					if (tdist < bdist) {	/* New closest distance */
-						bdist = tdist;
-						bix = ob - s->nodes;
-					}
-				}
-			}
-
-			/* Increment next window edge candidate, and figure new edge distance */
-			if (ee & 1) {					/* Top */
-				if (++wex[ee] >= s->np) {
-					wed[ee] = NN_INF;
-					wex[ee]--;
-				} else {
-					double ww = s->sax[ff][wex[ee]]->v[ff] - q[ff];
-					wed[ee] = fabs(ww) * ww;
-				}
-			} else {
-				if (--wex[ee] < 0) {
-					wed[ee] = NN_INF;
-					wex[ee]++;
-				} else {
-					double ww = q[ff] - s->sax[ff][wex[ee]]->v[ff];
-					wed[ee] = fabs(ww) * ww;
-				}
-			}
-		}
-
-		s->tbase += di;			/* Next touch */
-
-//printf("~1 returning closest to node %d distance %f\n",bix,sqrt(bdist));
-		return sqrt(bdist);	/* Return nearest distance */
-	}
-}
-
-
-/* Setup the nearest function acceleration structure */
-/* with the existing points */
-static void
-init_nn(
-ifarp *s
-) {
-	int di = s->di;
-	int i, k;
-	int np = s->np;		/* Existing number of points */
-
-//printf("~9 init_nn called\n");
-
-	s->tbase = 0;		/* Initialse touch flag */
-
-	/* Allocate the arrays spaces for intended number of points */
-	for (k = 0; k < di; k++) {
-		if ((s->sax[k] = (ifpnode **)malloc(sizeof(ifpnode *) * s->inp)) == NULL)
-			error("Failed to allocate sorted index array");
-	}
-
-	/* Add each existing test point to the axis lists. */
-	for (i = 0; i < np; i++) {
-		for (k = 0; k < di; k++)
-			s->sax[k][i] = &s->nodes[i];
-	}
-
-	/* Sort the axis arrays */
-	for (k = 0; k < di; k++) {
-			/* Sort nodes edge list */
-#define 	HEAP_COMPARE(A,B) (A->v[k] < B->v[k])
-			HEAPSORT(ifpnode *, &s->sax[k][0], np)
-#undef HEAP_COMPARE
-	}
-//printf("~9 init_nn done\n");
-}
-
-
-#ifdef NEVER		/* Slower but simpler version */
-
-/* Add the last point to the acceleration structure */
-static void
-add_nn(
-ifarp *s
-) {
-	int di = s->di;
-	int i, k;
-	int np = s->np;		/* Existing number of points */
-	int ap = np - 1;	/* Index of point ot add */
-
-//printf("~9 add_nn called with point ix %d, pos %f %f\n",ap, s->nodes[ap].v[0],s->nodes[ap].v[1]);
-
-	for (k = 0; k < di; k++) {
-		s->sax[k][ap] = &s->nodes[ap];
-	}
-
-	/* Sort the axis arrays */
-	for (k = 0; k < di; k++) {
-			/* Sort nodes edge list */
-#define 	HEAP_COMPARE(A,B) (A->v[k] < B->v[k])
-			HEAPSORT(ifpnode *, &s->sax[k][0], np)
-#undef HEAP_COMPARE
-	}
-}
-
-#else
-
-/* Add the last point to the acceleration structure */
-static void
-add_nn(
-ifarp *s
-) {
-	int di = s->di;
-	int e;
-	int np = s->np;		/* Existing number of points */
-	int ap = np - 1;	/* Index of point to add */
-
-//printf("~9 add_nn called with point ix %d, pos %f %f\n",ap, s->nodes[ap].v[0],s->nodes[ap].v[1]);
-
-	for (e = 0; e < di; e++) {	/* For all axes */
-		int i0, i1, i2;			/* Search indexes */
-		double v0, v1, v2;		/* Box */
-		double qf;
-
-		qf = s->nodes[ap].v[e];	/* value to be insertion sorted */
-
-//printf("isearching axis %d for %f\n",e, qf);
-
-		/* Find index of lowest value that is greater than target */
-		i0 = 0;
-		i2 = ap - 1;
-		v0 = s->sax[e][i0]->v[e];
-		v2 = s->sax[e][i2]->v[e];
-//printf("start points %d - %d, bound %f - %f\n",i0, i2, v0, v2);
-
-		if (qf <= v0) {
-			i1 = i0;
-		} else if (qf >= v2) {
-			i1 = ap;
-		} else {
-			do {
-				i1 = (i2 + i0)/2;			/* Trial point */
-				v1 = s->sax[e][i1]->v[e];	/* Value at trial */
-
-				if (qf > v1) {
-					i0 = i1;			/* Take top half */
-					v0 = v1;
-				} else { /* qf <= v1 */
-					i2 = i1;			/* Take bottom half */
-					v2 = v1;
-				}
-//printf("current point %d - %d, bound %f - %f\n",i0, i2, v0, v2);
-			} while ((i2 - i0) > 1);
-
-			i1 = i0;
-			v1 = s->sax[e][i1]->v[e];
-
-			/* Ensure we're > than target */
-			while (v1 <= qf) {
-				i1++;
-				if (i1 < ap)
-					v1 = s->sax[e][i1]->v[e];
-				else 
-					break;
-			}
-		}
-
-		/* Make room */
-		if (i1 < ap) {
-			memmove((void *)&s->sax[e][i1+1], (void *)&s->sax[e][i1], (ap - i1) * sizeof(ifpnode *));
-		}
-		/* Insert */
-		s->sax[e][i1] = &s->nodes[ap];
-	}
-}
-
-#endif
-
-/* Free everything to do with the nn */
-static void del_nn(ifarp *s) {
-	int di = s->di;
-	int k;
-
-	for (k = 0; k < di; k++) {
-		free (s->sax[k]);
-	}
-}
-
 /* =================================================== */
 
 #ifdef STANDALONE_TEST
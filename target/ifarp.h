@@ -21,8 +21,6 @@ struct _ifpnode {
 	int    fx;			/* nz if point is fixed (existing) */
 	double p[MXTD];		/* Device coordinate position */
 	double v[MXTD];		/* Subjective value (Labnnn..) */
-
-	unsigned int touch;	/* nn: Per value touch count */
 }; typedef struct _ifpnode ifpnode;
 
 
@@ -41,9 +39,7 @@ struct _ifarp {
 	void *od;		/* Opaque data for perceptual point */
 	
 	/* nn support */
-	ifpnode **sax[MXTD];	/* Sorted axis pointers, one for each direction */
-	unsigned int tbase;		/* Touch base value for this pass */
-	unsigned int ttarget;	/* Touch target value for this pass */
+	kdtree *nn;		/* Nearest point index of the perceptual values */
 
 /* public: */
 	/* Initialise, ready to read out all the points */
@@ -907,6 +907,35 @@ static int ofps_cc_percept(ofps *s, double *v, double *p) {
 	return clip;
 }
 
+/* Perceptual lookup that also returns the partial derivatives */
+/* dv[e][f] of v[f] with respect to p[e], using the perceptual cache. */
+/* Return nz if this isn't possible because there is no cache, */
+/* or because the point would be clipped. */
+static int ofps_cc_dpercept(ofps *s, double *v, double dv[MXPD][MXPD], double *p) {
+	co p1[MXPD+1], p2[MXPD+1];
+	double cp[MXPD];
+	int e, f, di = s->di;
+
+	if (s->pcache == NULL || ofps_clip_point(s, cp, p))
+		return 1;
+
+	for (e = 0; e < di; e++)
+		p1[0].p[e] = cp[e];
+	s->pcache->part_interp(s->pcache, p1, p2);
+
+	/* p2[di] is the value at the cell base, and the rest are */
+	/* the partial derivatives with their offsets from the base. */
+	for (f = 0; f < di; f++)
+		v[f] = p2[di].v[f];
+	for (e = 0; e < di; e++) {
+		for (f = 0; f < di; f++) {
+			dv[e][f] = p2[e].v[f];
+			v[f] += p2[e].v[f] * p2[e].p[0];
+		}
+	}
+	return 0;
+}
+
 /* --------------------------------------------------- */
 /* Vertex alloc/free support */
 
@@ -2119,6 +2148,97 @@ int dnsq_solver(	/* Return < 0 on abort */
 	return 0;
 }
 
+/* Calculate the Jacobian of dnsq_solver() at x[], */
+/* returning fjac[e][i] = d fvec[i] / d x[e]. */
+/* The eperr's are a simple function of the device and perceptual */
+/* distances, so given the partial derivatives of the perceptual */
+/* cache at x[] this needs only one cache lookup rather than di */
+/* calls of dnsq_solver() for a forward difference estimate. */
+int dnsq_solver_jac(	/* Return < 0 on abort */
+	void *fdata,	/* Opaque data pointer */
+	int n,			/* Dimensionality */
+	double *x,		/* Point to calculate Jacobian at (do not alter) */
+	double *fvec,	/* Function values at x (do not alter) */
+	double **fjac	/* Return n by n Jacobian in this array */
+) {
+	vopt_cx *cx = (vopt_cx *)fdata;
+	ofps *s = cx->s;
+	int i, k, e, f, di = s->di;
+	int nn_1 = cx->nn-1;
+	double sv[MXPD], dv[MXPD][MXPD];
+	double ge[MXPD+1][MXPD];	/* eperr gradient for each real node */
+	double tge[MXPD];			/* Average eperr gradient */
+
+	s->jaccount++;
+
+	if (ofps_cc_dpercept(s, sv, dv, x)) {
+		double tx[MXPD], tfvec[MXPD];
+
+		/* Fall back to a forward difference estimate, */
+		/* using the same step as dnsqe() would. */
+		for (e = 0; e < di; e++)
+			tx[e] = x[e];
+		for (e = 0; e < di; e++) {
+			double h = cx->srad * fabs(x[e]);
+			if (h == 0.0)
+				h = cx->srad;
+			tx[e] = x[e] + h;
+			if (dnsq_solver(fdata, n, tx, tfvec, 1) < 0)
+				return -1;
+			tx[e] = x[e];
+			for (i = 0; i < n; i++)
+				fjac[e][i] = (tfvec[i] - fvec[i])/h;
+		}
+		return 0;
+	}
+
+	/* Gradient of the eperr at each real node */
+	for (e = 0; e < di; e++)
+		tge[e] = 0.0;
+	for (k = 0; k < cx->nn; k++) {
+		double *np = cx->nds[k]->p, *nv = cx->nds[k]->v;
+		double dd[MXPD], pd[MXPD], ddist, pdist, tt;
+
+		for (ddist = pdist = 0.0, e = 0; e < di; e++) {
+			dd[e] = x[e] - np[e];
+			ddist += dd[e] * dd[e];
+			pd[e] = sv[e] - nv[e];
+			pdist += pd[e] * pd[e];
+		}
+		ddist = sqrt(ddist);
+		pdist = sqrt(pdist);
+
+		for (e = 0; e < di; e++) {
+			ge[k][e] = 0.0;
+			if (ddist > 0.0)
+				ge[k][e] += s->devd_wght * 100.0 * dd[e]/ddist;
+			if (pdist > 0.0) {
+				for (tt = 0.0, f = 0; f < di; f++)
+					tt += pd[f] * dv[e][f];
+				ge[k][e] += s->perc_wght * tt/pdist;
+			}
+			tge[e] += ge[k][e];
+		}
+	}
+	for (e = 0; e < di; e++)
+		tge[e] /= (double)cx->nn;
+
+	/* Rows matching the dnsq_solver() function values */
+	for (k = i = 0; k < cx->nn; k++) {
+		if (k != cx->on) {
+			for (e = 0; e < di; e++)
+				fjac[e][i] = tge[e] - ge[k][e];
+			i++;
+		}
+	}
+	for (k = 0; k < cx->nsp; k++) {
+		for (e = 0; e < di; e++)
+			fjac[e][nn_1 + k] = FGPMUL * cx->sp[k]->pe[e];
+	}
+
+	return 0;
+}
+
 /* Locate a vertex position that has the eperr from all the real nodes */
 /* being equal. Set eperr, eserr and subjective value v[] too. */ 
 /* vv->ceperr contains the current eperr that must be bettered. */
@@ -2374,7 +2494,7 @@ static int position_vtx(
 			maxfev = 500;
 		else
 			maxfev = 2 * tfev/tcalls; 
-		rv = dnsqe((void *)&cx, dnsq_solver, NULL, di, vv->p, cx.srad, fvec, 0.0, ftol, maxfev, 0);
+		rv = dnsqe((void *)&cx, dnsq_solver, dnsq_solver_jac, di, vv->p, cx.srad, fvec, 0.0, ftol, maxfev, 0);
 		if ((s->funccount - cfunccount) > 20) {
 //printf("More than 20: %d\n",s->funccount - cfunccount);
 		}
@@ -8233,6 +8353,7 @@ int nopstop				/* Debug - number of optimizations until diagnostic stop, -1 = no
 		fprintf(stderr,"Total vertex positions = %d\n",s->positions); 
 		fprintf(stderr,"Total dnsqs = %d\n",s->dnsqs); 
 		fprintf(stderr,"Total function calls = %d\n",s->funccount); 
+		fprintf(stderr,"Total jacobian calls = %d\n",s->jaccount); 
 		fprintf(stderr,"Average dnsqs/position = %.2f\n",s->dnsqs/(double)s->positions); 
 		fprintf(stderr,"Average function calls/dnsq = %.1f\n",s->funccount/(double)s->dnsqs); 
 		fprintf(stderr,"Maximum function calls/dnsq = %d\n",s->maxfunc); 
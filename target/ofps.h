@@ -342,6 +342,7 @@ struct _ofps {
 	int positions;	/* Number of calls to locate vertex */
 	int dnsqs;		/* Number of dnsq is called */
 	int funccount;	/* Number of times dnsq callback function is called */
+	int jaccount;	/* Number of times dnsq jacobian callback is called */
 	int maxfunc;	/* Maximum function count per dnsq */
 	int sucfunc;	/* Function count per sucessful dnsq */
 	int sucdnsq;	/* Number of sucessful dnsqs */
@@ -116,6 +116,7 @@
 #include "alphix.h"
 #include "rspl.h"
 #include "sort.h"
+#include "conv.h"
 
 #include <stdarg.h>
 
@@ -1258,6 +1259,367 @@ static int cmp_eperr(const void *p1, const void *p2) {
 
 #define SYMWT 1.3	/* Amount to discount direction delta E compared to spacers */
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Layout optimisation by several annealing chains at different */
+/* temperatures (parallel tempering). Each chain has its own copy of */
+/* the arrangement, and after each temperature step the chains at */
+/* adjacent temperatures may exchange temperatures. All the random */
+/* numbers come from rstreams seeded with the random start number, */
+/* stream c for chain c and stream PT_NCHAINS for the exchanges, so */
+/* the result only depends on the random start number, not on the */
+/* number of threads the chains are run on. */
+
+#define PT_NCHAINS 4		/* Number of annealing chains */
+
+/* A chains copy of the arrangement state of a color */
+struct _lcol {
+	col *c;					/* Color, or edge color */
+	int i;					/* cols list index, -1 for an edge color */
+	int ix;					/* random list index */
+	struct _lcol *nc[2];	/* Neigborhood colors */
+	struct _lcol *oc;		/* Opposite direction color */
+	double wnd;				/* Worst neigborhood contrast density */
+}; typedef struct _lcol lcol;
+
+/* Sort by worst neighborhood contrast, then index, */
+/* so that every color has a distinct place in the tree. */
+static int cmp_lwnd(const void *p1, const void *p2) {
+	lcol *l1 = (lcol *)p1, *l2 = (lcol *)p2;
+
+	if (l1->wnd != l2->wnd)
+		return l1->wnd < l2->wnd ? -1 : 1;
+	return l1->i == l2->i ? 0 : (l1->i < l2->i ? -1 : 1);
+}
+
+/* Annealing settings shared by all the chains */
+typedef struct {
+	int npat;				/* Number of test patches */
+	col *pcol;				/* 8 spacer colors */
+	int spacer;				/* Spacer code */
+	int usede;				/* NZ to use delta E rather than density */
+	int itlim;				/* Maximum tries at a temperature */
+	int suclim;				/* Number of successful changes before continuing */
+} ptset;
+
+/* An annealing chain */
+typedef struct {
+	ptset *s;
+	lcol *lc;				/* [npat] Chain copy of the colors */
+	lcol *ec;				/* [2 * npat] Edge colors before and after each patch */
+	aat_atree_t *stree;		/* Tree holding colors sorted by worst case contrast */
+	aat_atrav_t *aat_tr;	/* Tree accessor */
+	rstream *rs;			/* This chains random number stream */
+	double temp;			/* Current temperature */
+} ptchain;
+
+/* Return the worst case contrast of a color in its current place */
+static double pt_wnd(ptset *s, lcol *p) {
+	double wnd, tt;
+
+	wnd = setup_spacer(NULL, p->nc[0]->c, p->c, s->pcol, s->spacer, s->usede);
+	tt  = setup_spacer(NULL, p->c, p->nc[1]->c, s->pcol, s->spacer, s->usede);
+	if (tt < wnd)
+		wnd = tt;
+	if (p != p->oc) {
+		tt = SYMWT * density_difference(p->c, p->oc->c, s->usede);
+		if (tt < wnd)
+			wnd = tt;
+	}
+	return wnd;
+}
+
+/* Return the current worst case contrast of a chain */
+static double pt_worst(ptchain *ch) {
+	lcol *p;
+
+	if ((p = aat_atfirst(ch->aat_tr, ch->stree)) == NULL)
+		error("There seem to be no colors in the tree");
+	return p->wnd;
+}
+
+/* Run a chain for one temperature step */
+static int pt_step(void *cntx, int ix) {
+	ptchain *ch = (ptchain *)cntx + ix;
+	ptset *s = ch->s;
+	col *pcol = s->pcol;
+	int spacer = s->spacer, usede = s->usede;
+	int ii, nsuc = 0;
+
+	for (ii = 0; ii < s->itlim ; ii++) { 
+		lcol *p1, *p2, *tp0, *tp1;
+		double tt, de;
+		int t;
+
+		/* Chose another patch to try swapping worst with */
+		p1 = aat_atfirst(ch->aat_tr, ch->stree);	/* worst */
+		for (;;) {
+			t = (int)(ch->rs->d_rand(ch->rs, 0.0, 1.0) * s->npat);
+			if (t >= s->npat)
+				t = s->npat - 1;
+			p2 = &ch->lc[t];			/* Swap candidate */
+			if (p1 != p2 && p2 != p1->oc)
+				break;		/* Swap is not the worst or opposite */
+		}
+
+		/* Score just the places the two patches would be moving to */
+		/* Check p1 in p2's place */
+		de = setup_spacer(NULL, p2->nc[0]->c, p1->c, pcol, spacer, usede);
+		tt = setup_spacer(NULL, p1->c, p2->nc[1]->c, pcol, spacer, usede);
+		if (tt < de)
+			de = tt;
+		tt = SYMWT * density_difference(p2->oc->c, p1->c, usede);
+		if (tt < de)
+			de = tt;
+
+		/* Check p2 in p1's place */
+		tt = setup_spacer(NULL, p1->nc[0]->c, p2->c, pcol, spacer, usede);
+		if (tt < de)
+			de = tt;
+		tt = setup_spacer(NULL, p2->c, p1->nc[1]->c, pcol, spacer, usede);
+		if (tt < de)
+			de = tt;
+		tt = SYMWT * density_difference(p1->oc->c, p2->c, usede);
+		if (tt < de)
+			de = tt;
+
+		de = de - p1->wnd;		/* Increase in worst difference */
+
+		/* If this swap will improve things, or temp is high enough, */
+		/* then actually do the swap. */
+		if (de <= 0.0
+		 && ch->rs->d_rand(ch->rs, 0.0, 1.0) >= exp(de/ch->temp))
+			continue;
+
+		nsuc++;
+
+		/* Remove them from the tree */
+		if ((aat_aerase(ch->stree, (void *)p1)) == 0)
+			error("aat_aerase failed to find color  no %d", p1->i);
+		if ((aat_aerase(ch->stree, (void *)p2)) == 0)
+			error("aat_aerase failed to find color  no %d", p2->i);
+
+		/* Swap their places */
+		t = p1->ix; 
+		p1->ix = p2->ix; 
+		p2->ix = t;
+
+		/* Swap their neighbors, taking care */
+		/* of the situation if they are neigbors */
+		tp0 = p1->nc[0];
+		tp1 = p2->nc[0];
+		if (tp0 == p1)
+			tp0 = p2;
+		else if (tp0 == p2)
+			tp0 = p1;
+		if (tp1 == p1)
+			tp1 = p2;
+		else if (tp1 == p2)
+			tp1 = p1;
+		p2->nc[0] = tp0;
+		p1->nc[0] = tp1;
+
+		tp0 = p1->nc[1];
+		tp1 = p2->nc[1];
+		if (tp0 == p1)
+			tp0 = p2;
+		else if (tp0 == p2)
+			tp0 = p1;
+		if (tp1 == p1)
+			tp1 = p2;
+		else if (tp1 == p2)
+			tp1 = p1;
+		p2->nc[1] = tp0;
+		p1->nc[1] = tp1;
+
+		/* Swap their opposites (they cannot be opposites of each other) */
+		p1->oc->oc = p2;
+		p2->oc->oc = p1;
+		tp0 = p1->oc;
+		p1->oc = p2->oc;
+		p2->oc = tp0;
+
+		/* Reset backwards references */
+		p1->nc[0]->nc[1] = p1;
+		p1->nc[1]->nc[0] = p1;
+		p2->nc[0]->nc[1] = p2;
+		p2->nc[1]->nc[0] = p2;
+
+		/* re-compute contrast to neighbors */
+		p1->wnd = pt_wnd(s, p1);
+		p2->wnd = pt_wnd(s, p2);
+
+		/* (!!! We haven't recomputed the possible change in the ->oc's */
+		/* ->wnd due to it's opposite haveing changed. !!!) */
+
+		/* Add them back to the tree */
+		if ((aat_ainsert(ch->stree, (void *)p1)) == 0)
+			error("aat_ainsert color no %d failed",p1->i);
+		if ((aat_ainsert(ch->stree, (void *)p2)) == 0)
+			error("aat_ainsert color no %d failed",p2->i);
+
+		if (nsuc > s->suclim)
+			break;
+	}
+	return 0;
+}
+
+/* Optimise the patch order of the npat test colors, starting from */
+/* the current arrangement set up in cols[] and rix[], and return */
+/* the best arrangement found in cols[] and rix[]. */
+static void pt_anneal(
+int *rix,			/* Index lookup array */
+int npat,			/* Number of test patches */
+int rstart,			/* Random start number */
+int verb,			/* Verbose flag */
+col *cols,			/* Colors, with current nc[], oc, wnd and ix */
+col *pcol,			/* 8 spacer colors */
+int spacer,			/* Spacer code, 0 = None, 1 = b&w, 2 = colored */
+int usede			/* NZ to use delta E rather than density */
+) {
+	ptset s;
+	ptchain ch[PT_NCHAINS];
+	ptchain *tix[PT_NCHAINS];	/* Chain at each temperature, hottest first */
+	athreads *ths = NULL;
+	double temp, trate, tstart, tend, lrate;
+	rstream *xrs;				/* Random number stream for exchanges */
+	int nthr = system_ncpus();
+	int i, j, c;
+
+	if (nthr > PT_NCHAINS)
+		nthr = PT_NCHAINS;
+
+	s.npat = npat;
+	s.pcol = pcol;
+	s.spacer = spacer;
+	s.usede = usede;
+	s.suclim = npat;
+
+	if (spacer == 2) {	/* Colored spacer, don't optimise too hard */
+		tstart = 0.4;
+		tend   = 0.00001;
+		trate  = 0.87;
+		s.itlim = npat * 10;
+	} else {			/* No spacer or B&W spacer, do more optimisation */
+		tstart = 0.4;
+		tend   = 0.000005;
+		trate  = 0.95;
+		s.itlim = npat * 14;
+	}
+
+	/* The chains temperatures are spread over two steps of the */
+	/* original schedule, so that the schedule can cool twice as fast. */
+	lrate = pow(trate, 2.0/PT_NCHAINS);
+	trate = trate * trate;
+
+	/* Setup each chains copy of the arrangement */
+	for (c = 0; c < PT_NCHAINS; c++) {
+		ptchain *cp = &ch[c];
+
+		cp->s = &s;
+		if ((cp->rs = new_rstream((unsigned int)rstart, c)) == NULL)
+			error("Creating random number stream failed");
+		if ((cp->lc = (lcol *)malloc(sizeof(lcol) * npat)) == NULL
+		 || (cp->ec = (lcol *)calloc(2 * npat, sizeof(lcol))) == NULL)
+			error("Malloc of annealing chain failed");
+		if ((cp->stree = aat_anew(cmp_lwnd)) == NULL)
+			error("Allocating aat tree for colors failed");
+		if ((cp->aat_tr = aat_atnew()) == NULL)
+			error("aat_atnew returned NULL");
+
+		for (i = 0; i < npat; i++) {
+			lcol *lp = &cp->lc[i];
+			col *pp = &cols[i];
+
+			lp->c = pp;
+			lp->i = i;
+			lp->ix = pp->ix;
+			lp->oc = &cp->lc[pp->oc->i];
+			lp->wnd = pp->wnd;
+			for (j = 0; j < 2; j++) {
+				if (pp->nc[j] >= cols && pp->nc[j] < (cols + npat)) {
+					lp->nc[j] = &cp->lc[pp->nc[j]->i];
+				} else {		/* Edge color */
+					lcol *ep = &cp->ec[2 * i + j];
+					ep->c = pp->nc[j];
+					ep->i = -1;
+					ep->nc[1-j] = lp;
+					lp->nc[j] = ep;
+				}
+			}
+			if ((aat_ainsert(cp->stree, (void *)lp)) == 0)
+				error("aat_ainsert color %d failed",i);
+		}
+		tix[c] = cp;
+	}
+	if ((xrs = new_rstream((unsigned int)rstart, PT_NCHAINS)) == NULL)
+		error("Creating random number stream failed");
+	if (nthr > 1 && (ths = new_athreads(nthr)) == NULL)
+		error("Failed to create annealing threads");
+
+	for (temp = tstart; temp > tend; temp *= trate) {
+		double tc;
+
+		if (verb) {		/* Output percent intervals */
+			double pc;
+	
+			pc = (log(temp) - log(tstart))/(log(tend) - log(tstart));
+			printf("\r%2d%%",(int)(100.0 * pc+0.5)); fflush(stdout);
+		}
+
+		/* Run each chain for a step at its temperature */
+		for (tc = temp, c = 0; c < PT_NCHAINS; c++, tc *= lrate)
+			tix[c]->temp = tc;
+
+		if (ths != NULL) {
+			ths->run(ths, PT_NCHAINS, pt_step, (void *)ch);
+		} else {
+			for (c = 0; c < PT_NCHAINS; c++)
+				pt_step((void *)ch, c);
+		}
+
+		/* Offer to exchange the temperatures of adjacent chains, */
+		/* in a way that lets better arrangements move to colder ones. */
+		for (c = 0; c < (PT_NCHAINS-1); c++) {
+			double ea = pt_worst(tix[c]), eb = pt_worst(tix[c+1]);
+			double de = (ea - eb) * (1.0/tix[c+1]->temp - 1.0/tix[c]->temp);
+
+			if (de >= 0.0 || xrs->d_rand(xrs, 0.0, 1.0) < exp(de)) {
+				ptchain *tp = tix[c];
+				tix[c] = tix[c+1];
+				tix[c+1] = tp;
+			}
+		}
+	}
+
+	/* Return the best arrangement, preferring the colder chain */
+	for (j = PT_NCHAINS-1, c = PT_NCHAINS-2; c >= 0; c--) {
+		if (pt_worst(tix[c]) > pt_worst(tix[j]))
+			j = c;
+	}
+	for (i = 0; i < npat; i++) {
+		lcol *lp = &tix[j]->lc[i];
+		col *pp = &cols[i];
+
+		pp->ix = lp->ix;
+		rix[lp->ix] = i;
+		pp->nc[0] = lp->nc[0]->c;
+		pp->nc[1] = lp->nc[1]->c;
+		pp->oc = lp->oc->c;
+		pp->wnd = lp->wnd;
+	}
+
+	if (ths != NULL)
+		ths->del(ths);
+	xrs->del(xrs);
+	for (c = 0; c < PT_NCHAINS; c++) {
+		ch[c].rs->del(ch[c].rs);
+		aat_atdelete(ch[c].aat_tr);
+		aat_adelete(ch[c].stree);
+		free(ch[c].ec);
+		free(ch[c].lc);
+	}
+}
+
 /* Setup the randomised index. */
 /* The index only covers test sample patches, not TID or max/min/SID patches */
 void setup_randix(
@@ -1302,8 +1664,6 @@ int usede			/* NZ to use delta E rather than density */
 		col *mind;			/* Alias for maximum density */
 		aat_atree_t *stree;	/* Tree holding colors sorted by worst case contrast */
 		aat_atrav_t *aat_tr;	/* Tree accessor */
-		double temp, trate;	/* Annealing temperature & rate */
-		double tstart, tend;/* Annealing chedule range */
 
 		mind = &pcol[0];		/* White */
 		maxd = &pcol[7];		/* Black */
@@ -1423,195 +1783,21 @@ int usede			/* NZ to use delta E rather than density */
 			printf(" 0%%"); fflush(stdout);
 		}
 
-		if (spacer == 2) {	/* Colored spacer, don't optimise too hard */
-			tstart = 0.4;
-			tend   = 0.00001;
-			trate  = 0.87;
-		} else {			/* No spacer or B&W spacer, do more optimisation */
-			tstart = 0.4;
-			tend   = 0.000005;
-			trate  = 0.95;
-		}
-		/* Simulated anealing */
-		for (temp = tstart; temp > tend; temp *= trate) {
-
-			int ii, itlim;	/* Maximum passes at a temperature */
-			int nsuc = 0;	/* Number that succeed */
-			int suclim;		/* Number of successful changes before continuing */
-
-			if (spacer == 2) {	/* Colored spacer, don't optimise too hard */
-				itlim = npat * 10;
-				suclim = npat;
-			} else {
-				itlim = npat * 14;
-				suclim = npat;
-			}
-
-			if (verb) {		/* Output percent intervals */
-				double pc;
-	
-				pc = (log(temp) - log(tstart))/(log(tend) - log(tstart));
-				printf("\r%2d%%",(int)(100.0 * pc+0.5)); fflush(stdout);
-			}
-
-			/* Improve the ordering */
-			for (ii = 0; ii < itlim ; ii++) { 
-				col *p1, *p2;
-				double tt, de;
-
-				/* Chose another patch to try swapping worst with */
-				p1 = aat_atfirst(aat_tr, stree);	/* worst */
-				for (;;) {
-					tt = d_rand(0.0, 1.0);
-					p2 = &cols[(int)(tt * (npat-1.0))];	/* Swap candidate */
-					if (p1 != p2 && p2 != p1->oc)
-						break;		/* Swap is not the worst or opposite */
-				}
-
-				/* Check p1 in p2's place */
-				de = setup_spacer(NULL, p2->nc[0], p1, pcol, spacer, usede);
-				tt = setup_spacer(NULL, p1, p2->nc[1], pcol, spacer, usede);
-				if (tt < de)
-					de = tt;
-				tt = SYMWT * density_difference(p2->oc, p1, usede);
-				if (tt < de)
-					de = tt;
-
-				/* Check p2 in p1's place */
-				tt = setup_spacer(NULL, p1->nc[0], p2, pcol, spacer, usede);
-				if (tt < de)
-					de = tt;
-				tt = setup_spacer(NULL, p2, p1->nc[1], pcol, spacer, usede);
-				if (tt < de)
-					de = tt;
-				tt = SYMWT * density_difference(p1->oc, p2, usede);
-				if (tt < de)
-					de = tt;
-
-				de = de - p1->wnd;		/* Increase in worst difference */
-
-				/* If this swap will improve things, or temp is high enough, */
-				/* then actually do the swap. */
-				if (de > 0.0
-				   || d_rand(0.0, 1.0) < exp(de/temp)) {
-					int t;
-					col *tp0, *tp1;
-
-					nsuc++;
-
-//printf("~1 temp = %f, ii = %d, swapping %d and %d\n",temp,ii,p1->i, p2->i);
- 
-					/* Remove them from the tree */
-					if ((aat_aerase(stree, (void *)p1)) == 0)
-						error("aat_aerase failed to find color  no %d", p1->i);
-					if ((aat_aerase(stree, (void *)p2)) == 0)
-						error("aat_aerase failed to find color  no %d", p2->i);
-
-					/* Swap them in random index list */
-					rix[p1->ix] = p2->i; 
-					rix[p2->ix] = p1->i; 
-					t = p1->ix; 
-					p1->ix = p2->ix; 
-					p2->ix = t;
-
-					/* Swap their neighbors, taking care */
-					/* of the situation if they are neigbors */
-					tp0 = p1->nc[0];
-					tp1 = p2->nc[0];
-					if (tp0 == p1)
-						tp0 = p2;
-					else if (tp0 == p2)
-						tp0 = p1;
-					if (tp1 == p1)
-						tp1 = p2;
-					else if (tp1 == p2)
-						tp1 = p1;
-					p2->nc[0] = tp0;
-					p1->nc[0] = tp1;
-
-					tp0 = p1->nc[1];
-					tp1 = p2->nc[1];
-					if (tp0 == p1)
-						tp0 = p2;
-					else if (tp0 == p2)
-						tp0 = p1;
-					if (tp1 == p1)
-						tp1 = p2;
-					else if (tp1 == p2)
-						tp1 = p1;
-					p2->nc[1] = tp0;
-					p1->nc[1] = tp1;
-
-					/* Swap their opposites (they cannot be opposites of each other) */
-					p1->oc->oc = p2;
-					p2->oc->oc = p1;
-					tp0 = p1->oc;
-					p1->oc = p2->oc;
-					p2->oc = tp0;
-
-					/* Reset backwards references */
-					p1->nc[0]->nc[1] = p1;
-					p1->nc[1]->nc[0] = p1;
-					p2->nc[0]->nc[1] = p2;
-					p2->nc[1]->nc[0] = p2;
-
-					/* re-compute contrast to neighbors */
-					p1->wnd = setup_spacer(NULL, p1->nc[0], p1, pcol, spacer, usede);
-					tt      = setup_spacer(NULL, p1, p1->nc[1], pcol, spacer, usede);
-					if (tt < p1->wnd)
-						p1->wnd = tt;
-					if (p1 != p1->oc) {
-						tt = SYMWT * density_difference(p1, p1->oc, usede);
-						if (tt < p1->wnd)
-							p1->wnd = tt;
-					}
-
-					p2->wnd = setup_spacer(NULL, p2->nc[0], p2, pcol, spacer, usede);
-					tt      = setup_spacer(NULL, p2, p2->nc[1], pcol, spacer, usede);
-					if (tt < p2->wnd)
-						p2->wnd = tt;
-					if (p2 != p2->oc) {
-						tt = SYMWT * density_difference(p2, p2->oc, usede);
-						if (tt < p2->wnd)
-							p2->wnd = tt;
-					}
-
-					/* (!!! We haven't recomputed the possible change in the ->oc's */
-					/* ->wnd due to it's opposite haveing changed. !!!) */
-
-					/* Add them back to the tree */
-					if ((aat_ainsert(stree, (void *)p1)) == 0)
-						error("aat_ainsert color no %d failed",p1->i);
-					if ((aat_ainsert(stree, (void *)p2)) == 0)
-						error("aat_ainsert color no %d failed",p2->i);
-
-#ifdef NEVER
-printf("~1 current list = \n");
-for (cp = aat_atfirst(aat_tr, stree); cp != NULL; cp = aat_atnext(aat_tr))
-	printf("%d: %f\n",cp->i,cp->wnd);
-cp = aat_atfirst(aat_tr, stree);
-printf("~1 worst case contrast = %f, list index %d, id '%s', loc '%s'\n",
-cp->wnd, cp->i,cp->id,cp->loc);
-printf("~1 neighbor list index %d, id '%s', loc '%s'\n",
-cp->nc[0]->i,cp->nc[0]->id,cp->nc[0]->loc);
-printf("~1 neighbor list index %d, id '%s', loc '%s'\n",
-cp->nc[1]->i,cp->nc[1]->id,cp->nc[1]->loc);
-#endif
-
-					if (nsuc > suclim)
-						break;
-				}
-			}
-		}
+		/* Annealing chains */
+		pt_anneal(rix, npat, rstart, verb, cols, pcol, spacer, usede);
 
 		if (verb) {
 			double wrdc = 1e300;
-			if ((cp = aat_atfirst(aat_tr, stree)) == NULL)
-				error("There seem to be no colors in the tree");
+			double wnd = 1e300;
+
+			for (i = 0; i < npat; i++) {
+				if (cols[i].wnd < wnd)
+					wnd = cols[i].wnd;
+			}
 			if (usede)
-				printf("\r100%%\nAfter optimisation, worst delta E = %f\n", cp->wnd);
+				printf("\r100%%\nAfter optimisation, worst delta E = %f\n", wnd);
 			else
-				printf("\r100%%\nAfter optimisation, density contrast = %f\n", cp->wnd);
+				printf("\r100%%\nAfter optimisation, density contrast = %f\n", wnd);
 
 			/* Evaluate each strips direction confusion */
 			for (i = 0; ; i++) {
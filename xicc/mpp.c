@@ -1387,41 +1387,129 @@ static double DEsq(double aa, double bb) {
 #define dDE(aa) ((aa) > 0.008856451586 ? 38.666667 * pow((aa), -2.0/3.0) : 903.2962896)
 
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/* Model evaluation helpers */
+
+/* Compute the nn n-linear interpolation vertex weights */
+/* for the given transfer corrected device values. */
+/* The weights are built up one channel at a time, so */
+/* this takes nn rather than n * nn multiplies. */
+/* (Note that the weight of vertex k with channel m */
+/*  excluded is w[k] + w[k | (1 << m)], for k without bit m) */
+static void vweights(
+int n,			/* Number of channels */
+double *w,		/* Return [nn] vertex weights */
+double *tcnv	/* [n] Transfer corrected device values */
+) {
+	int m, k;
+
+	w[0] = 1.0;
+	for (m = 0; m < n; m++) {
+		int bm = 1 << m;
+		double t = tcnv[m];
+		double t1 = 1.0 - t;
+
+		for (k = 0; k < bm; k++) {
+			w[k | bm] = w[k] * t;
+			w[k] *= t1;
+		}
+	}
+}
+
+/* Interpolate the per channel shape values for band j */
+/* given the vertex weights. */
+static void shapeval(mpp *p, double *ww, int j, double *w) {
+	int m, k;
+
+	for (m = 0; m < p->n; m++) {
+		int bm = 1 << m;
+		double **sh = p->shape[m];
+		double vv = 0.0;
+
+		for (k = 0; k < p->nn; k++) {
+			if (k & bm)
+				continue;
+			vv += sh[k][j] * (w[k] + w[k | bm]);
+		}
+		ww[m] = vv;
+	}
+}
+
+/* Compute the partial derivatives of the interpolated */
+/* shape values ww[mo] wrt. the device value tcnv[m] */
+static void dshapeval(mpp *p, double dww[MPP_MXINKS][MPP_MXINKS], int j, double *w) {
+	int m, mo, k;
+
+	for (mo = 0; mo < p->n; mo++) {
+		int bo = 1 << mo;
+		double **sh = p->shape[mo];
+
+		for (m = 0; m < p->n; m++) {
+			int bm = 1 << m;
+			double vv = 0.0;
+
+			if (m == mo) {			/* Shape doesn't depend on its own channel */
+				dww[mo][m] = 0.0;
+				continue;
+			}
+			for (k = 0; k < p->nn; k++) {
+				if (k & bm)
+					continue;
+				vv += (sh[(k | bm) & ~bo][j] - sh[k & ~bo][j]) * (w[k] + w[k | bm]);
+			}
+			dww[mo][m] = vv;
+		}
+	}
+}
+
+/* Return the primary combination value for band j */
+/* given the vertex weights. */
+static double pcval(mpp *p, int j, double *w) {
+	double ov;
+	int k;
+
+	for (ov = 0.0, k = 0; k < p->nn; k++)
+		ov += p->pc[k][j] * w[k];
+
+	return ov;
+}
+
+/* Compute the partial derivatives of the primary */
+/* combination value for band j wrt. the device value tcnv[m] */
+static void dpcval(mpp *p, double *dov, int j, double *w) {
+	int m, k;
+
+	for (m = 0; m < p->n; m++) {
+		int bm = 1 << m;
+		double vv = 0.0;
+
+		for (k = 0; k < p->nn; k++) {
+			if (k & bm)
+				continue;
+			vv += (p->pc[k | bm][j] - p->pc[k][j]) * (w[k] + w[k | bm]);
+		}
+		dov[m] = vv;
+	}
+}
+
 /* Given a device value, return the given bands value */
 /* according to the current model. */
 static double bandval(mpp *p, int band, double *dev) {
 	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
-	double tcnv1[MPP_MXINKS];	/* 1.0 - Transfer curve corrected device values */
 	double ww[MPP_MXINKS];		/* Interpolated tweak params for each channel */
-	int m, k;
-	double ov;
+	double vw[MPP_MXCCOMB];		/* Interpolation vertex weights */
+	int m;
 	int j = band;
 
 	/* Compute the tranfer corrected device values */
-	for (m = 0; m < p->n; m++) {
+	for (m = 0; m < p->n; m++)
 		tcnv[m] = icxTransFunc(p->tc[m][j], p->cord, dev[m]);
-		tcnv1[m] = 1.0 - tcnv[m];
-	}
 
 	if (p->useshape) {
 
-		for (m = 0; m < p->n; m++)
-			ww[m] = 0.0;
-
 		/* Lookup the shape values */
-		for (k = 0; k < p->nn; k++) {		/* For each interp vertex */
-			double vv;
-	 		for (vv = 1.0, m = 0; m < p->n; m++) {	/* Compute weighting */
-				if (k & (1 << m))
-					vv *= tcnv[m];
-				else
-					vv *= tcnv1[m];
-			}
-			for (m = 0; m < p->n; m++) {
-				ww[m] += p->shape[m][k & ~(1<<m)][j] * vv;
-									/* Apply weighting to shape vertex value */
-			}
-		}
+		vweights(p->n, vw, tcnv);
+		shapeval(p, ww, j, vw);
 
 		/* Apply the shape values to adjust the primaries */
 		for (m = 0; m < p->n; m++) {
@@ -1433,23 +1521,13 @@ static double bandval(mpp *p, int band, double *dev) {
 				vv = (vv - gg * vv)/(1.0 - gg * vv);
 			}
 			tcnv[m] = vv;
-			tcnv1[m] = 1.0 - vv;
 		}
 	}
 
 	/* Compute the primary combination values */
-	for (ov = 0.0, k = 0; k < p->nn; k++) {
-		double vv = p->pc[k][j];
-		for (m = 0; m < p->n; m++) {
-			if (k & (1 << m))
-				vv *= tcnv[m];
-			else
-				vv *= tcnv1[m];
-		}
-		ov += vv;
-	}
+	vweights(p->n, vw, tcnv);
 
-	return ov;
+	return pcval(p, j, vw);
 }
 
 /* Given a device value, return the given bands value */
@@ -1464,59 +1542,20 @@ static double dbandval(mpp *p, double *dv, int band, double *dev) {
 	double dov[MPP_MXINKS];						/* Del of ov due to del in tcnv'[m] */
 
 	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
-	double tcnv1[MPP_MXINKS];	/* 1.0 - Transfer curve corrected device values */
 	double ww[MPP_MXINKS];		/* Interpolated tweak params for each channel */
-	int m, k;
+	double vw[MPP_MXCCOMB];		/* Interpolation vertex weights */
+	int m;
 	double ov;
 	int j = band;
 
 	/* Compute the tranfer corrected device values */
-	for (m = 0; m < p->n; m++) {
+	for (m = 0; m < p->n; m++)
 		tcnv[m] = icxdiTransFunc(p->tc[m][j], &dtcnv_ddev[m], p->cord, dev[m]);
-		tcnv1[m] = 1.0 - tcnv[m];
-		ww[m] = 0.0;
-	}
-
-	/* Lookup the shape values */
-	for (k = 0; k < p->nn; k++) {		/* For each interp vertex */
-		double vv;
- 		for (vv = 1.0, m = 0; m < p->n; m++) {	/* Compute weighting */
-			if (k & (1 << m))
-				vv *= tcnv[m];
-			else
-				vv *= tcnv1[m];
-		}
-		for (m = 0; m < p->n; m++) {
-			ww[m] += p->shape[m][k & ~(1<<m)][j] * vv;
-								/* Apply weighting to shape vertex value */
-		}
-	}
 
-	/* Compute del ww[m][m] for del tcnv[m] */
-	for (m = 0; m < p->n; m++) {			/* For each input channel were doing del of */
-		int mo;
-		for (mo = 0; mo < p->n; mo++)
-			dww_dtcnv[mo][m] = 0.0;
-		for (k = 0; k < p->nn; k++) {
-			int mm;
-			double vv = 1.0;
-			for (mm = 0; mm < p->n; mm++) {	/* Compute weight for node k */
-				if (m == mm)
-					continue;
-				if (k & (1 << mm))
-					vv *= tcnv[mm];
-				else
-					vv *= tcnv1[mm];
-			}
-			for (mo = 0; mo < p->n; mo++) {				/* For each output channel */
-				double vvv = vv * p->shape[mo][k & ~(1<<mo)][j];
-				if (k & (1 << m))
-					dww_dtcnv[mo][m] += vvv;
-				else
-					dww_dtcnv[mo][m] -= vvv;
-			}
-		}
-	}
+	/* Lookup the shape values, and del ww[m] for del tcnv[m] */
+	vweights(p->n, vw, tcnv);
+	shapeval(p, ww, j, vw);
+	dshapeval(p, dww_dtcnv, j, vw);
 
 	/* Apply the shape values to adjust the primaries */
 	for (m = 0; m < p->n; m++) {
@@ -1533,42 +1572,14 @@ static double dbandval(mpp *p, double *dv, int band, double *dev) {
 			dsv = (1.0 - gg)/(tt * tt);
 		}
 		tcnv[m] = sv;
-		tcnv1[m] = 1.0 - sv;
 		dtcnv_tc[m] = dsv;						/* del in tcnv[m] due to del in tcnv[m] */
 		dtcnv_ww[m] = (vv * vv - vv)/(tt * tt);	/* del in tcnv[m] due to del in ww[m] */
 	}
 
-	/* Compute the primary combination values */
-	for (ov = 0.0, k = 0; k < p->nn; k++) {
-		double vv = p->pc[k][j];
- 		for (m = 0; m < p->n; m++) {
-			if (k & (1 << m))
-				vv *= tcnv[m];
-			else
-				vv *= tcnv1[m];
-		}
-		ov += vv;
-	}
-
-	/* Compute del ov for del tcnv[m] */
-	for (m = 0; m < p->n; m++) {
-		for (dov[m] = 0.0, k = 0; k < p->nn; k++) {
-			int mm;
-			double vv = p->pc[k][j];
-			for (mm = 0; mm < p->n; mm++) {
-				if (m == mm)
-					continue;
-				if (k & (1 << mm))
-					vv *= tcnv[mm];
-				else
-					vv *= tcnv1[mm];
-			}
-			if (k & (1 << m))
-				dov[m] += vv;
-			else
-				dov[m] -= vv;
-		}
-	}
+	/* Compute the primary combination values, and del ov for del tcnv[m] */
+	vweights(p->n, vw, tcnv);
+	ov = pcval(p, j, vw);
+	dpcval(p, dov, j, vw);
 
 	/* Accumulate delta from input value to output */
 	for (m = 0;  m < p->n; m++) {
@@ -1815,8 +1826,8 @@ static double efunc2(void *adata, double pv[]) {
 	mpp *p = (mpp *)adata;
 	double smv, rv = 0.0;
 	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
-	double tcnv1[MPP_MXINKS];	/* 1.0 - Transfer curve corrected device values */
 	double ww[MPP_MXINKS];		/* Interpolated tweak params for each channel */
+	double vw[MPP_MXCCOMB];		/* Interpolation vertex weights */
 	int j = p->oba;				/* Band being optimised */
 	int i, m, k;
 
@@ -1826,30 +1837,14 @@ static double efunc2(void *adata, double pv[]) {
 		double ov;
 
 		/* Compute the tranfer corrected device values */
-		for (m = 0; m < p->n; m++) {
+		for (m = 0; m < p->n; m++)
 			tcnv[m] = icxTransFunc(&pv[m * p->cord], p->cord, c->nv[m]);
-			tcnv1[m] = 1.0 - tcnv[m];
-		}
 
 		if (p->useshape) {
 
-			for (m = 0; m < p->n; m++)
-				ww[m] = 0.0;
-
 			/* Lookup the shape values */
-			for (k = 0; k < p->nn; k++) {		/* For each interp vertex */
-				double vv;
-		 		for (vv = 1.0, m = 0; m < p->n; m++) {	/* Compute weighting */
-					if (k & (1 << m))
-						vv *= tcnv[m];
-					else
-						vv *= tcnv1[m];
-				}
-				for (m = 0; m < p->n; m++) {
-					ww[m] += p->shape[m][k & ~(1<<m)][j] * vv;
-										/* Apply weighting to shape vertex value */
-				}
-			}
+			vweights(p->n, vw, tcnv);
+			shapeval(p, ww, j, vw);
 
 			/* Apply the shape values to adjust the primaries */
 			for (m = 0; m < p->n; m++) {
@@ -1861,21 +1856,12 @@ static double efunc2(void *adata, double pv[]) {
 					vv = (vv - gg * vv)/(1.0 - gg * vv);
 				}
 				tcnv[m] = vv;
-				tcnv1[m] = 1.0 - vv;
 			}
 		}
 
 		/* Compute the primary combination values */
-		for (ov = 0.0, k = 0; k < p->nn; k++) {
-			double vv = p->pc[k][j];
-	 		for (m = 0; m < p->n; m++) {
-				if (k & (1 << m))
-					vv *= tcnv[m];
-				else
-					vv *= tcnv1[m];
-			}
-			ov += vv;
-		}
+		vweights(p->n, vw, tcnv);
+		ov = pcval(p, j, vw);
 
 		/* Compute the band value error */
 		ov = lDE(ov) - c->lband[j];
@@ -1915,8 +1901,8 @@ static double dfunc2(void *adata, double dv[], double pv[]) {
 	double dov[MPP_MXINKS];						/* Del of ov due to del in tcnv'[m] */
 	double ddov; 								/* Del in final ov due to del in raw ov */
 	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
-	double tcnv1[MPP_MXINKS];	/* 1.0 - Transfer curve corrected device values */
 	double ww[MPP_MXINKS];		/* Interpolated tweak params for each channel */
+	double vw[MPP_MXCCOMB];		/* Interpolation vertex weights */
 	int j = p->oba;			/* Band being optimised */
 	int i, m, k;
 
@@ -1925,16 +1911,13 @@ static double dfunc2(void *adata, double dv[], double pv[]) {
 
 	/* For each test point */
 	for (i = 0; i < p->nodp; i++) {
-		int mo;
 		mppcol *c = &p->cols[i];
 		double ov;
 
 		/* Compute the tranfer corrected device values */
 		/* and del in these values due to del in input parameters */
-		for (m = 0; m < p->n; m++) {
+		for (m = 0; m < p->n; m++)
 			tcnv[m] = icxdpTransFunc(&pv[m * p->cord], dtcnv_dpv[m], p->cord, c->nv[m]);
-			tcnv1[m] = 1.0 - tcnv[m];
-		}
 
 #ifdef NEVER
 {
@@ -1951,84 +1934,27 @@ for (m = 0; m < p->n; m++) {
 }
 }
 #endif
-		for (m = 0; m < p->n; m++)
-			ww[m] = 0.0;
 
-		/* Lookup the shape values */
-		for (k = 0; k < p->nn; k++) {		/* For each interp vertex */
-			double vv;
-	 		for (vv = 1.0, m = 0; m < p->n; m++) {	/* Compute weighting */
-				if (k & (1 << m))
-					vv *= tcnv[m];
-				else
-					vv *= tcnv1[m];
-			}
-			for (m = 0; m < p->n; m++) {
-				ww[m] += p->shape[m][k & ~(1<<m)][j] * vv;
-									/* Apply weighting to shape vertex value */
-			}
-		}
-
-		/* Compute del ww[m][m] for del tcnv[m] */
-		for (m = 0; m < p->n; m++) {			/* For each input channel were doing del of */
-			for (mo = 0; mo < p->n; mo++)
-				dww_dtcnv[mo][m] = 0.0;
-			for (k = 0; k < p->nn; k++) {
-				int mm;
-				double vv = 1.0;
-				for (mm = 0; mm < p->n; mm++) {	/* Compute weight for node k */
-					if (m == mm)
-						continue;
-					if (k & (1 << mm))
-						vv *= tcnv[mm];
-					else
-						vv *= tcnv1[mm];
-				}
-				for (mo = 0; mo < p->n; mo++) {				/* For each output channel */
-					double vvv = vv * p->shape[mo][k & ~(1<<mo)][j];
-					if (k & (1 << m))
-						dww_dtcnv[mo][m] += vvv;
-					else
-						dww_dtcnv[mo][m] -= vvv;
-				}
-			}
-		}
+		/* Lookup the shape values, and del ww[m] for del tcnv[m] */
+		vweights(p->n, vw, tcnv);
+		shapeval(p, ww, j, vw);
+		dshapeval(p, dww_dtcnv, j, vw);
 
 #ifdef NEVER
 {
 	int mm;
-	double tww[MPP_MXINKS][MPP_MXINKS];
+	double tvw[MPP_MXCCOMB];
+	double tww[MPP_MXINKS];
 
 	for (mm = 0; mm < p->n; mm++) {		/* For del in each input value */
 		tcnv[mm] += 1e-6;
-
-		for (m = 0; m < p->n; m++)
-			tww[m][mm] = 0.0;
-
-		/* Lookup the shape values */
-		for (k = 0; k < p->nn; k++) {		/* For each interp vertex */
-			double vv;
-	 		for (vv = 1.0, m = 0; m < p->n; m++) {	/* Compute weighting */
-				if (k & (1 << m))
-					vv *= tcnv[m];
-				else
-					vv *= (1.0 - tcnv[m]);
-			}
-			for (m = 0; m < p->n; m++) {
-				tww[m][mm] += p->shape[m][k & ~(1<<m)][j] * vv;
-									/* Apply weighting to shape vertex value */
-			}
-		}
-
+		vweights(p->n, tvw, tcnv);
+		shapeval(p, tww, j, tvw);
 		tcnv[mm] -= 1e-6;
-		for (m = 0; m < p->n; m++) {
-			tww[m][mm] = (tww[m][mm] - ww[m])/1e-6;
-		}
-	}
 
-	for (mm = 0; mm < p->n; mm++) {
 		for (m = 0; m < p->n; m++) {
-			printf("~1 ww[%d][%d] %f should be %f\n",mm, m, dww_dtcnv[mm][m],tww[mm][m]);
+			printf("~1 ww[%d][%d] %f should be %f\n",m, mm, dww_dtcnv[m][mm],
+			                                         (tww[m] - ww[m])/1e-6);
 		}
 	}
 }
@@ -2045,7 +1971,6 @@ for (m = 0; m < p->n; m++) {
 	}
 #endif /* NEVER */
 
-
 		/* Apply the shape values to adjust the primaries */
 		for (m = 0; m < p->n; m++) {
 			double gg = ww[m];				/* Curve adjustment */
@@ -2060,12 +1985,10 @@ for (m = 0; m < p->n; m++) {
 				dsv = (1.0 - gg)/(tt * tt);
 			}
 			tcnv[m] = sv;
-			tcnv1[m] = 1.0 - sv;
 			dtcnv_tc[m] = dsv;						/* del in tcnv[m] due to del in tcnv[m] */
 			dtcnv_ww[m] = (vv * vv - vv)/(tt * tt);	/* del in tcnv[m] due to del in ww[m] */
 		}
 
-
 #ifdef NEVER
 	/* Check derivatives */
 	for (m = 0; m < p->n; m++) {
@@ -2104,62 +2027,26 @@ for (m = 0; m < p->n; m++) {
 }
 #endif /* NEVER */
 
-		/* Compute the primary combination values */
-		for (ov = 0.0, k = 0; k < p->nn; k++) {
-			double vv = p->pc[k][j];
-	 		for (m = 0; m < p->n; m++) {
-				if (k & (1 << m))
-					vv *= tcnv[m];
-				else
-					vv *= tcnv1[m];
-			}
-			ov += vv;
-		}
-
-		/* Compute del ov for del tcnv[m] */
-		for (m = 0; m < p->n; m++) {
-			for (dov[m] = 0.0, k = 0; k < p->nn; k++) {
-				int mm;
-				double vv = p->pc[k][j];
-				for (mm = 0; mm < p->n; mm++) {
-					if (m == mm)
-						continue;
-					if (k & (1 << mm))
-						vv *= tcnv[mm];
-					else
-						vv *= tcnv1[mm];
-				}
-				if (k & (1 << m))
-					dov[m] += vv;
-				else
-					dov[m] -= vv;
-			}
-		}
+		/* Compute the primary combination values, and del ov for del tcnv[m] */
+		vweights(p->n, vw, tcnv);
+		ov = pcval(p, j, vw);
+		dpcval(p, dov, j, vw);
 
 #ifdef NEVER
 {
 	int mm;
+	double tvw[MPP_MXCCOMB];
 	double tdov[MPP_MXINKS];
 
 	for (mm = 0; mm < p->n; mm++) {
 		tcnv[mm] += 1e-6;
-
-		for (tdov[mm] = 0.0, k = 0; k < p->nn; k++) {
-			double vv = p->pc[k][j];
-	 		for (m = 0; m < p->n; m++) {
-				if (k & (1 << m))
-					vv *= tcnv[m];
-				else
-					vv *= (1.0 - tcnv[m]);
-			}
-			tdov[mm] += vv;
-		}
+		vweights(p->n, tvw, tcnv);
+		tdov[mm] = (pcval(p, j, tvw) - ov)/1e-6;
 		tcnv[mm] -= 1e-6;
-		tdov[mm] = (tdov[mm] - ov)/1e-6;
 	}
 
 	for (m = 0; m < p->n; m++) {
-		printf("~1 dov[%d] is %f should be %f\n",m, tdov[m], dov[m]);
+		printf("~1 dov[%d] is %f should be %f\n",m, dov[m], tdov[m]);
 	}
 }
 #endif /* NEVER */
@@ -2260,16 +2147,7 @@ static void sfunc3(mpp *p) {
 			c->tcnv[m] = icxTransFunc(p->tc[m][j], p->cord, c->nv[m]);
 
 		/* Compute combination values */
-		for (k = 0; k < p->nn; k++) {		/* For each interp vertex */
-			double vv;
-	 		for (vv = 1.0, m = 0; m < p->n; m++) {	/* Compute weighting */
-				if (k & (1 << m))
-					vv *= c->tcnv[m];
-				else
-					vv *= (1.0 - c->tcnv[m]);
-			}
-			pcnv[k] = vv;
-		}
+		vweights(p->n, pcnv, c->tcnv);
 
 		/* Compute shape weighting values */
 		for (k = 0; k < p->nnn2; k++) {
@@ -2289,8 +2167,8 @@ static double efunc3(void *adata, double pv[]) {
 	mpp *p = (mpp *)adata;
 	double smv, rv = 0.0;
 	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
-	double tcnv1[MPP_MXINKS];	/* 1.0 - Transfer curve corrected device values */
 	double ww[MPP_MXINKS];		/* Interpolated tweak params for each channel */
+	double vw[MPP_MXCCOMB];		/* Interpolation vertex weights */
 	int j = p->oba;			/* Band being optimised */
 	int n1 = p->n - 1;
 	int i, m, k;
@@ -2319,20 +2197,11 @@ static double efunc3(void *adata, double pv[]) {
 				vv = (vv - gg * vv)/(1.0 - gg * vv);
 			}
 			tcnv[m] = vv;
-			tcnv1[m] = 1.0 - vv;
 		}
 
 		/* Compute the primary combination values */
-		for (ov = 0.0, k = 0; k < p->nn; k++) {
-			double vv = p->pc[k][j];
-			for (m = 0; m < p->n; m++) {
-				if (k & (1 << m))
-					vv *= tcnv[m];
-				else
-					vv *= tcnv1[m];
-			}
-			ov += vv;
-		}
+		vweights(p->n, vw, tcnv);
+		ov = pcval(p, j, vw);
 
 		/* Compute the band value error */
 		ov = lDE(ov) - c->lband[j];
@@ -2363,8 +2232,8 @@ static double dfunc3(void *adata, double dv[], double pv[]) {
 	double dtcnv[MPP_MXINKS];	/* Derivative of transfer curve corrected device values */
 	double dov[MPP_MXINKS];		/* Derivative of output interpolation device values */
 	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
-	double tcnv1[MPP_MXINKS];	/* 1.0 - Transfer curve corrected device values */
 	double ww[MPP_MXINKS];		/* Interpolated tweak params for each channel */
+	double vw[MPP_MXCCOMB];		/* Interpolation vertex weights */
 	int j = p->oba;			/* Band being optimised */
 	int n1 = p->n - 1;
 	int i, m, k;
@@ -2398,42 +2267,15 @@ static double dfunc3(void *adata, double dv[], double pv[]) {
 				sv = (vv - gg * vv)/tt;
 			}
 			tcnv[m] = sv;
-			tcnv1[m] = 1.0 - sv;
 			dtcnv[m] = (vv * vv - vv)/(tt * tt);	/* del in tcnv[m] due to del in ww[m] */
 		}
 
-		/* Compute the primary combination values */
-		for (ov = 0.0, k = 0; k < p->nn; k++) {
-			double vv = p->pc[k][j];
-			for (m = 0; m < p->n; m++) {
-				if (k & (1 << m))
-					vv *= tcnv[m];
-				else
-					vv *= tcnv1[m];
-			}
-			ov += vv;
-		}
-
-		/* Compute del ov[m] for del tcnv[m] */
-		for (m = 0; m < p->n; m++) {
-			for (dov[m] = 0.0, k = 0; k < p->nn; k++) {
-				int mm;
-				double vv = p->pc[k][j];
-				for (mm = 0; mm < p->n; mm++) {
-					if (m == mm)
-						continue;
-					if (k & (1 << mm))
-						vv *= tcnv[mm];
-					else
-						vv *= tcnv1[mm];
-				}
-				if (k & (1 << m))
-					dov[m] += vv;
-				else
-					dov[m] -= vv;
-			}
-			dov[m] *= dtcnv[m];		/* del ov[m] due to del in ww[m] */
-		}
+		/* Compute the primary combination values, and del ov[m] for del ww[m] */
+		vweights(p->n, vw, tcnv);
+		ov = pcval(p, j, vw);
+		dpcval(p, dov, j, vw);
+		for (m = 0; m < p->n; m++)
+			dov[m] *= dtcnv[m];
 
 		/* Compute the band value error */
 		ddov = dDE(ov);
@@ -2505,38 +2347,22 @@ double *pv
 /* Setup test point data ready for efunc4 on the given oba */
 static void sfunc4(mpp *p) {
 	double tcnv[MPP_MXINKS];	/* Transfer curve corrected device values */
-	double tcnv1[MPP_MXINKS];	/* 1.0 - Transfer curve corrected device values */
 	double ww[MPP_MXINKS];		/* Interpolated tweak params for each channel */
+	double vw[MPP_MXCCOMB];		/* Interpolation vertex weights */
 	int j = p->oba;			/* Band being optimised */
-	int i, k, m;
+	int i, m;
 
 	/* Setup the correct per patch value fcnv values */
 	for (i = 0; i < p->nodp; i++) {
 		mppcol *c = &p->cols[i];
 
 		/* Compute the tranfer corrected device values */
-		for (m = 0; m < p->n; m++) {
-			tcnv[m] = icxTransFunc(p->tc[m][j], p->cord, c->nv[m]);
-			tcnv1[m] = 1.0 - tcnv[m];
-		}
-
 		for (m = 0; m < p->n; m++)
-			ww[m] = 0.0;
+			tcnv[m] = icxTransFunc(p->tc[m][j], p->cord, c->nv[m]);
 
 		/* Lookup the interpolated shape values */
-		for (k = 0; k < p->nn; k++) {		/* For each interp vertex */
-			double vv;
-	 		for (vv = 1.0, m = 0; m < p->n; m++) {	/* Compute weighting */
-				if (k & (1 << m))
-					vv *= tcnv[m];
-				else
-					vv *= tcnv1[m];
-			}
-			for (m = 0; m < p->n; m++) {
-				ww[m] += p->shape[m][k & ~(1<<m)][j] * vv;
-									/* Apply weighting to shape vertex value */
-			}
-		}
+		vweights(p->n, vw, tcnv);
+		shapeval(p, ww, j, vw);
 
 		/* Apply the shape values to adjust the primaries */
 		for (m = 0; m < p->n; m++) {
@@ -2548,20 +2374,10 @@ static void sfunc4(mpp *p) {
 				vv = (vv - gg * vv)/(1.0 - gg * vv);
 			}
 			tcnv[m] = vv;
-			tcnv1[m] = 1.0 - vv;
 		}
 
 		/* Compute the shape adjusted primary combination values */
-		for (k = 0; k < p->nn; k++) {
-			double vv;
-			for (vv = 1.0, m = 0; m < p->n; m++) {
-				if (k & (1 << m))
-					vv *= tcnv[m];
-				else
-					vv *= tcnv1[m];
-			}
-			c->pcnv[k] = vv;
-		}
+		vweights(p->n, c->pcnv, tcnv);
 	}
 }
 
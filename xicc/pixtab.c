@@ -0,0 +1,219 @@
+
+/*
+ * Table of the unique pixel values in a raster image.
+ *
+ * Author:  agent <agent@local>
+ * Date:    18/10/2026
+ * Version: 1.00
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "icc.h"
+#include "numlib.h"
+#include "conv.h"
+#include "pixtab.h"
+
+#define MIN_THR_VALS 256		/* Minimum number of values per conversion thread */
+
+/* Hash a pixel value */
+static unsigned int pt_hash(unsigned short *v, int nchan) {
+	unsigned int h = 2166136261u;
+	int e;
+
+	for (e = 0; e < nchan; e++) {
+		h = (h ^ v[e]) * 16777619u;
+		h ^= h >> 15;
+	}
+	return h;
+}
+
+/* Double the size of the hash table */
+static void pt_rehash(pixtab *p) {
+	unsigned int hsize = 2 * (p->hmask + 1), i, h;
+
+	free(p->hash);
+	if ((p->hash = (int *)malloc(sizeof(int) * hsize)) == NULL)
+		error("pixtab: malloc failed");
+	for (i = 0; i < hsize; i++)
+		p->hash[i] = -1;
+	p->hmask = hsize - 1;
+
+	for (i = 0; i < (unsigned int)p->nu; i++) {
+		for (h = pt_hash(p->vals + i * p->nchan, p->nchan) & p->hmask;
+		     p->hash[h] >= 0; h = (h + 1) & p->hmask)
+			;
+		p->hash[h] = i;
+	}
+}
+
+/* Copy the nchan used samples of pixel x into v[] */
+static void pt_getpix(unsigned short *v, void *buf, int bps, int spp, int x, int nchan) {
+	int e;
+
+	if (bps == 8) {
+		unsigned char *bp = (unsigned char *)buf + x * spp;
+		for (e = 0; e < nchan; e++)
+			v[e] = bp[e];
+	} else {
+		unsigned short *sp = (unsigned short *)buf + x * spp;
+		for (e = 0; e < nchan; e++)
+			v[e] = sp[e];
+	}
+}
+
+/* Return the hash slot for a value. It holds -1 if the value isn't present */
+static unsigned int pt_slot(pixtab *p, unsigned short *v) {
+	unsigned int h;
+
+	for (h = pt_hash(v, p->nchan) & p->hmask; p->hash[h] >= 0; h = (h + 1) & p->hmask) {
+		if (memcmp(p->vals + p->hash[h] * p->nchan, v, sizeof(unsigned short) * p->nchan) == 0)
+			break;
+	}
+	return h;
+}
+
+static void pt_add(pixtab *p, int *ix, void *buf, int bps, int spp, int width) {
+	unsigned short v[MAX_CHAN];
+	unsigned int h;
+	int x;
+
+	for (x = 0; x < width; x++) {
+		pt_getpix(v, buf, bps, spp, x, p->nchan);
+
+		h = pt_slot(p, v);
+		if (p->hash[h] >= 0) {
+			p->count[p->hash[h]]++;
+			if (ix != NULL)
+				ix[x] = p->hash[h];
+			continue;
+		}
+
+		/* A new value */
+		if (p->nu >= p->_nu) {
+			p->_nu = 2 * p->_nu + 1024;
+			if ((p->vals = (unsigned short *)realloc(p->vals,
+			                 sizeof(unsigned short) * p->_nu * p->nchan)) == NULL
+			 || (p->count = (unsigned int *)realloc(p->count,
+			                 sizeof(unsigned int) * p->_nu)) == NULL)
+				error("pixtab: realloc failed");
+		}
+		memcpy(p->vals + p->nu * p->nchan, v, sizeof(unsigned short) * p->nchan);
+		p->count[p->nu] = 1;
+		if (ix != NULL)
+			ix[x] = p->nu;
+		p->hash[h] = p->nu++;
+
+		/* Keep the hash table no more than half full */
+		if ((unsigned int)(2 * p->nu) > p->hmask)
+			pt_rehash(p);
+	}
+}
+
+/* A conversion threads share of the values */
+typedef struct {
+	pixtab *p;
+	void (*cvt)(void *cntx, double *out, unsigned short *in);
+	void *cntx;
+	int sp, ep;			/* Start and end + 1 value index */
+} ptjob;
+
+static int pt_worker(void *cntx, int ix) {
+	ptjob *jb = (ptjob *)cntx + ix;
+	pixtab *p = jb->p;
+	int i;
+
+	for (i = jb->sp; i < jb->ep; i++)
+		jb->cvt(jb->cntx, p->out + i * p->outn, p->vals + i * p->nchan);
+	return 0;
+}
+
+static void pt_convert(pixtab *p,
+                       void (*cvt)(void *cntx, double *out, unsigned short *in),
+                       void *cntx, int nthr) {
+	ptjob jb;
+	int i, n;
+
+	if (p->nconv >= p->nu)
+		return;
+
+	if ((p->out = (double *)realloc(p->out, sizeof(double) * p->_nu * p->outn)) == NULL)
+		error("pixtab: realloc failed");
+
+	jb.p = p;
+	jb.cvt = cvt;
+	jb.cntx = cntx;
+
+	/* Do the first one before starting any threads, so that */
+	/* anything the conversion sets up on first use is done. */
+	if (p->nconv == 0) {
+		jb.sp = 0;
+		jb.ep = 1;
+		pt_worker((void *)&jb, 0);
+		p->nconv = 1;
+	}
+
+	n = p->nu - p->nconv;
+	if (nthr > (n / MIN_THR_VALS))
+		nthr = n / MIN_THR_VALS;
+	if (nthr <= 1) {
+		jb.sp = p->nconv;
+		jb.ep = p->nu;
+		pt_worker((void *)&jb, 0);
+	} else {
+		ptjob *jbs;
+
+		if ((jbs = (ptjob *)malloc(sizeof(ptjob) * nthr)) == NULL)
+			error("pixtab: malloc failed");
+		for (i = 0; i < nthr; i++) {
+			jbs[i] = jb;
+			jbs[i].sp = p->nconv + (int)((double)n * i/nthr + 0.5);
+			jbs[i].ep = p->nconv + (int)((double)n * (i+1)/nthr + 0.5);
+		}
+		athreads_for(nthr, nthr, pt_worker, (void *)jbs);
+		free(jbs);
+	}
+	p->nconv = p->nu;
+}
+
+static void pt_del(pixtab *p) {
+	if (p != NULL) {
+		free(p->hash);
+		free(p->vals);
+		free(p->count);
+		free(p->out);
+		free(p);
+	}
+}
+
+/* Create an empty table for nchan channel values */
+/* that convert to outn channels. */
+pixtab *new_pixtab(int nchan, int outn) {
+	pixtab *p;
+	unsigned int i;
+
+	if (nchan < 1 || nchan > MAX_CHAN)
+		error("pixtab: can't handle %d channels",nchan);
+
+	if ((p = (pixtab *)calloc(1, sizeof(pixtab))) == NULL)
+		error("pixtab: calloc failed");
+
+	p->nchan = nchan;
+	p->outn = outn;
+
+	p->hmask = 4096 - 1;
+	if ((p->hash = (int *)malloc(sizeof(int) * (p->hmask + 1))) == NULL)
+		error("pixtab: malloc failed");
+	for (i = 0; i <= p->hmask; i++)
+		p->hash[i] = -1;
+
+	p->del = pt_del;
+	p->add = pt_add;
+	p->convert = pt_convert;
+
+	return p;
+}
@@ -0,0 +1,61 @@
+#ifndef PIXTAB_H
+#define PIXTAB_H
+
+/*
+ * Table of the unique pixel values in a raster image.
+ *
+ * Author:  agent <agent@local>
+ * Date:    18/10/2026
+ * Version: 1.00
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * Images typically have far fewer unique colors than pixels,
+ * so converting each unique value once (rather than every pixel)
+ * is a large saving when the conversion is an expensive color
+ * lookup. Each pixel added is given the index of its value, so
+ * that the converted pixels can still be used in their original
+ * order, where the result depends on it.
+ */
+
+struct _pixtab {
+
+/* Private: */
+	int *hash;					/* Open addressed hash of value indexes, -1 = empty */
+	unsigned int hmask;			/* Hash table size - 1 */
+	int _nu;					/* Allocated number of values */
+
+/* Public: */
+	int nchan;					/* Number of channels in a value */
+	int nu;						/* Number of unique values */
+	unsigned short *vals;		/* [nu * nchan] Raw pixel values */
+	unsigned int *count;		/* [nu] Number of pixels with each value */
+
+	int outn;					/* Number of converted output channels */
+	int nconv;					/* Number of values converted so far */
+	double *out;				/* [nconv * outn] Converted values */
+
+	/* Methods */
+	void (*del)(struct _pixtab *p);
+
+	/* Add a scanline of 8 or 16 bit pixels with spp samples per pixel, */
+	/* of which the first nchan are used. If ix != NULL, set ix[width] to */
+	/* the index of each pixels value. */
+	void (*add)(struct _pixtab *p, int *ix, void *buf, int bps, int spp, int width);
+
+	/* Convert any values not yet converted into p->out[], using nthr threads. */
+	/* cvt() must be safe to call from several threads at once. */
+	void (*convert)(struct _pixtab *p,
+	                void (*cvt)(void *cntx, double *out, unsigned short *in),
+	                void *cntx, int nthr);
+
+}; typedef struct _pixtab pixtab;
+
+/* Create an empty table for nchan channel values */
+/* that convert to outn channels. */
+pixtab *new_pixtab(int nchan, int outn);
+
+#endif /* PIXTAB_H */
@@ -39,6 +39,8 @@
 #include "gamut.h"
 #include "xicc.h"
 #include "sort.h"
+#include "conv.h"
+#include "pixtab.h"
 
 #undef NOCAMGAM_CLIP		/* No clip to CAM gamut before CAM lookup */
 #undef DEBUG				/* Dump filter cell contents */
@@ -84,11 +86,13 @@ void usage(void) {
 	fprintf(stderr,"         f:flare       Flare light %% of image luminance (default 1)\n");
 	fprintf(stderr,"         f:X:Y:Z       Flare color as XYZ (default media white)\n");
 	fprintf(stderr,"         f:x:y         Flare color as x, y\n");
+	fprintf(stderr," -j n          Use n threads (default number of processors)\n");
 	fprintf(stderr," -O outputfile Override the default output filename.\n");
 	exit(1);
 }
 
 #define GAMRES 10.0		/* Default surface resolution */
+#define PIXBLOCK 1000000	/* Number of pixels to convert at a time */
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
@@ -129,6 +133,66 @@ static void cvt_ICCLAB16_to_Lab(double *out, double *in) {
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
+/* Conversion of a raw pixel value to the gamut space. */
+/* This is shared read only between the conversion threads. */
+typedef struct {
+	int bps;						/* Bits per sample */
+	int nchan;						/* Number of channels */
+	int sign_mask;					/* Handling of encoding sign */
+	void (*cvt)(double *out, double *in);	/* TIFF conversion function, NULL if none */
+	icxLuBase *luo;					/* Profile lookup, NULL if none */
+	icc *icco;
+	icColorSpaceSignature outs;		/* Output space of luo */
+	icxcam *cam;					/* Lab to Jab CAM, NULL if none */
+} pixcvt;
+
+static void cvt_pixel(void *cntx, double *pcs, unsigned short *raw) {
+	pixcvt *c = (pixcvt *)cntx;
+	int i;
+	double in[MAX_CHAN], out[MAX_CHAN];
+
+	if (c->bps == 8) {
+		for (i = 0; i < c->nchan; i++) {
+			int v = raw[i];
+			if (c->sign_mask & (1 << i))		/* Treat input as signed */
+				v = (v & 0x80) ? v - 0x80 : v + 0x80;
+			in[i] = v/255.0;
+		}
+	} else {
+		for (i = 0; i < c->nchan; i++) {
+			int v = raw[i];
+			if (c->sign_mask & (1 << i))		/* Treat input as signed */
+				v = (v & 0x8000) ? v - 0x8000 : v + 0x8000;
+			in[i] = v/65535.0;
+		}
+	}
+	if (c->cvt != NULL) {	/* Undo TIFF encoding */
+		c->cvt(in, in);
+	}
+	/* ICC profile to convert RGB to Lab or Jab */
+	if (c->luo != NULL) {
+		if (c->luo->lookup(c->luo, out, in) > 1)
+			error ("%d, %s",c->icco->errc,c->icco->err);
+		
+		if (c->outs == icSigXYZData) {	/* Convert to Lab */
+			icmXYZ2Lab(&c->icco->header->illuminant, out, out);
+		}
+	/* Lab TIFF - may need to convert to Jab */
+	} else if (c->cam != NULL) {
+		icmLab2XYZ(&icmD50, out, in);
+		c->cam->XYZ_to_cam(c->cam, out, out);
+
+	} else {
+		for (i = 0; i < c->nchan; i++)
+			out[i] = in[i];
+	}
+	pcs[0] = out[0];
+	pcs[1] = out[1];
+	pcs[2] = out[2];
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
 /* Convert a TIFF Photometric tag to an ICC colorspace. */
 /* return 0 if not possible or applicable. */
 icColorSpaceSignature 
@@ -284,7 +348,7 @@ main(int argc, char *argv[]) {
 	int docusps = 0;
 	int filter = 0;
 	double filtperc = 100.0;
-	int rv = 0;
+	int nthr = system_ncpus();	/* Number of threads to use */
 
 	icc *icco = NULL;
 	xicc *xicco = NULL;
@@ -320,6 +384,12 @@ main(int argc, char *argv[]) {
 	uint16 extrasamples;						/* Extra "alpha" samples */
 	uint16 *extrainfo;							/* Info about extra samples */
 	int sign_mask;								/* Handling of encoding sign */
+	pixtab *pt = NULL;							/* Unique pixel values */
+	pixcvt pc;									/* Pixel value conversion */
+	int *pix = NULL;							/* Block of pixel value indexes */
+	int by, bh;									/* Block start line and height */
+	int nu;										/* Number of values before this image */
+	int lix = -1;								/* Last value index added to the gamut */
 
 	double gamres = GAMRES;				/* Surface resolution */
 	gamut *gam;
@@ -506,6 +576,14 @@ main(int argc, char *argv[]) {
 				filter = 1;
 			}
 
+			/* Number of threads */
+			else if (argv[fa][1] == 'j') {
+				fa = nfa;
+				if (na == NULL) usage();
+				if ((nthr = atoi(na)) < 1)
+					usage();
+			}
+
 			/* Output file name */
 			else if (argv[fa][1] == 'O') {
 				fa = nfa;
@@ -783,77 +861,82 @@ main(int argc, char *argv[]) {
 		}
 
 		/* - - - - - - - - - - - - - - - */
-		/* Process colors to translate */
-		/* (Should fix this to process a group of lines at a time ?) */
+		/* Process colors to translate. */
+		/* Each unique pixel value is only converted once, a block of */
+		/* lines at a time. The pixels are then added to the gamut */
+		/* in their original order, since the gamut surface depends on it. */
+
+		/* Values carry over from the previous image if it's the same format */
+		if (pt != NULL && (pc.bps != bitspersample || pc.nchan != (samplesperpixel-extrasamples)
+		                || pc.sign_mask != sign_mask || pc.cvt != cvt)) {
+			pt->del(pt);
+			pt = NULL;
+		}
+		if (pt == NULL) {
+			pc.bps = bitspersample;
+			pc.nchan = samplesperpixel-extrasamples;
+			pc.sign_mask = sign_mask;
+			pc.cvt = cvt;
+			pc.luo = luo;
+			pc.icco = icco;
+			pc.outs = outs;
+			pc.cam = cam;
+			pt = new_pixtab(pc.nchan, 3);
+			lix = -1;
+		}
+		nu = pt->nu;
+
+		if ((bh = PIXBLOCK/width) < 1)
+			bh = 1;
+		if (bh > height)
+			bh = height;
 
 		inbuf  = _TIFFmalloc(TIFFScanlineSize(rh));
+		if ((pix = (int *)malloc(sizeof(int) * width * bh)) == NULL)
+			error("malloc failed");
 
-		for (y = 0; y < height; y++) {
-
-			/* Read in the next line */
-			if (TIFFReadScanline(rh, inbuf, y, 0) < 0)
-				error ("Failed to read TIFF line %d",y);
-
-			/* Do floating point conversion */
-			for (x = 0; x < width; x++) {
-				int i;
-				double in[MAX_CHAN], out[MAX_CHAN];
-				
-				if (bitspersample == 8) {
-					for (i = 0; i < samplesperpixel; i++) {
-						int v = ((unsigned char *)inbuf)[x * samplesperpixel + i];
-						if (sign_mask & (1 << i))		/* Treat input as signed */
-							v = (v & 0x80) ? v - 0x80 : v + 0x80;
-						in[i] = v/255.0;
-					}
-				} else {
-					for (i = 0; i < samplesperpixel; i++) {
-						int v = ((unsigned short *)inbuf)[x * samplesperpixel + i];
-						if (sign_mask & (1 << i))		/* Treat input as signed */
-							v = (v & 0x8000) ? v - 0x8000 : v + 0x8000;
-						in[i] = v/65535.0;
-					}
-				}
-				if (cvt != NULL) {	/* Undo TIFF encoding */
-					cvt(in, in);
-				}
-				/* ICC profile to convert RGB to Lab or Jab */
-				if (luo != NULL) {
-//printf("~1 RGB in value = %f %f %f\n",in[0],in[1],in[2]);
-					if ((rv = luo->lookup(luo, out, in)) > 1)
-						error ("%d, %s",icco->errc,icco->err);
-//printf("~1 after luo = %f %f %f\n",out[0],out[1],out[2]);
-					
-					if (outs == icSigXYZData) {	/* Convert to Lab */
-						icmXYZ2Lab(&icco->header->illuminant, out, out);
-//printf("~1 after XYZ2Lab = %f %f %f\n",out[0],out[1],out[2]);
-					}
-				/* Lab TIFF - may need to convert to Jab */
-				} else if (cam != NULL) {
-//printf("~1 Lab in value = %f %f %f\n",in[0],in[1],in[2]);
-					icmLab2XYZ(&icmD50, out, in);
-//printf("~1 XYZ = %f %f %f\n",out[0],out[1],out[2]);
-					cam->XYZ_to_cam(cam, out, out);
-//printf("~1 Jab = %f %f %f\n",out[0],out[1],out[2]);
-
-				} else {
-//printf("~1 Lab value = %f %f %f\n",in[0],in[1],in[2]);
-					for (i = 0; i < samplesperpixel; i++)
-						out[i] = in[i];
-				}
+		for (by = 0; by < height; by += bh) {
+			int ey = by + bh;
+			if (ey > height)
+				ey = height;
+
+			for (y = by; y < ey; y++) {
 
-				for (i = 0; i < 3; i++) {
-					if (out[i] < apcsmin[i])
-						apcsmin[i] = out[i];
-					if (out[i] > apcsmax[i])
-						apcsmax[i] = out[i];
+				/* Read in the next line */
+				if (TIFFReadScanline(rh, inbuf, y, 0) < 0)
+					error ("Failed to read TIFF line %d",y);
+
+				pt->add(pt, pix + (y - by) * width, inbuf, bitspersample, samplesperpixel, width);
+			}
+
+			/* Convert any new values */
+			pt->convert(pt, cvt_pixel, (void *)&pc, nthr);
+
+			for (y = by; y < ey; y++) {
+				int *ix = pix + (y - by) * width;
+
+				for (x = 0; x < width; x++) {
+					double *out = pt->out + 3 * ix[x];
+					int i;
+
+					for (i = 0; i < 3; i++) {
+						if (out[i] < apcsmin[i])
+							apcsmin[i] = out[i];
+						if (out[i] > apcsmax[i])
+							apcsmax[i] = out[i];
+					}
+					if (filter)
+						add_fpixel(out);
+					else if (ix[x] != lix)		/* Repeating the last point has no effect */
+						gam->expand(gam, out);
+					lix = ix[x];
 				}
-				if (filter)
-					add_fpixel(out);
-				else
-					gam->expand(gam, out);
 			}
 		}
+		free(pix);
+
+		if (verb)
+			printf("There were %d new unique colors out of %d pixels\n\n",pt->nu - nu, width * height);
 
 		_TIFFfree(inbuf);
 
@@ -870,6 +953,9 @@ main(int argc, char *argv[]) {
 
 	if (filter)
 		del_filter();
+
+	if (pt != NULL)
+		pt->del(pt);
 	
 	/* Get White and Black points from the profile, and set them in the gamut. */
 	if (luo != NULL) {
@@ -0,0 +1,860 @@
+
+/************************************************/
+/* Benchmark the colour pipeline                */
+/************************************************/
+
+/* Author: agent <agent@local>
+ * Date:   18/10/2026
+ * Derived from revbench.c, Copyright 1999 - 2000 Graeme W. Gill
+ *
+ * This material is licenced under the GNU AFFERO GENERAL PUBLIC LICENSE Version 3 :-
+ * see the License.txt file for licencing details.
+ */
+
+/*
+ * A self contained set of micro and macro benchmarks of the
+ * core colour pipeline, using synthetic (but smooth and device like)
+ * RGB and CMYK models rather than real profiles or instruments,
+ * so that results are reproducible on any machine.
+ *
+ * Each benchmark reports its setup time, throughput, the
+ * 50/90/99 percentile and maximum per operation latency (measured
+ * over small batches of operations), and the peak resident set size
+ * of the process at the end of the benchmark. The results can be
+ * written as a JSON file for tracking regressions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#ifdef NT
+# include <windows.h>
+# include <psapi.h>
+#endif
+#ifdef UNIX
+# include <sys/time.h>
+# include <sys/resource.h>
+#endif
+#include "copyright.h"
+#include "config.h"
+#include "numlib.h"
+#include "rspl.h"
+#include "icc.h"
+#include "xicc.h"
+#include "gamut.h"
+#include "gammap.h"
+
+#define BATCH 64		/* Operations per latency sample */
+#define MXBENCH 40		/* Maximum number of benchmark results */
+#define NIP 10			/* Maximum rev_interp solutions */
+#define LIMITVAL 3.0	/* CMYK total ink limit */
+
+void usage(void) {
+	fprintf(stderr,"Benchmark the colour pipeline, Version %s\n",ARGYLL_VERSION_STR);
+	fprintf(stderr,"usage: xbench [options]\n");
+	fprintf(stderr," -v              Verbose\n");
+	fprintf(stderr," -q              Quick - fewer operations and smaller grids\n");
+	fprintf(stderr," -s seed         Random test point seed (default 1)\n");
+	fprintf(stderr," -b name         Only run benchmarks whose name contains name\n");
+	fprintf(stderr," -o file.json    Write the results to file.json\n");
+	exit(1);
+}
+
+/* ============================================================ */
+/* Timing and resource measurement */
+
+/* Return a high resolution wall clock time in seconds */
+static double bench_time(void) {
+#ifdef NT
+	LARGE_INTEGER f, c;
+	QueryPerformanceFrequency(&f);
+	QueryPerformanceCounter(&c);
+	return (double)c.QuadPart/(double)f.QuadPart;
+#else
+# if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+# else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6 * tv.tv_usec;
+# endif
+#endif
+}
+
+/* Return the peak resident set size of the process in Kbytes, */
+/* or -1 if it is not known */
+static long peak_rss(void) {
+#ifdef NT
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return (long)(pmc.PeakWorkingSetSize/1024);
+	return -1;
+#else
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return -1;
+# ifdef __APPLE__
+	return ru.ru_maxrss/1024;		/* OS X returns bytes */
+# else
+	return ru.ru_maxrss;
+# endif
+#endif
+}
+
+/* A benchmark result */
+typedef struct {
+	char name[40];		/* Benchmark name */
+	double setup;		/* Setup time in seconds */
+	int nops;			/* Number of operations timed */
+	double secs;		/* Total timed seconds */
+	double lat[4];		/* 50, 90, 99 percentile and maximum latency in seconds */
+	long rss;			/* Peak RSS in Kbytes after the benchmark */
+} bres;
+
+/* Benchmark run context */
+typedef struct {
+	int verb;			/* Verbose */
+	int quick;			/* Quick mode */
+	char *sel;			/* Benchmark selection substring, NULL for all */
+
+	bres res[MXBENCH];	/* Results so far */
+	int nres;
+
+	/* Current benchmark */
+	bres *cr;
+	double stime;		/* Start time of setup */
+	double bstime;		/* Start time of the current batch */
+	double *lat;		/* Latency samples */
+	int nlat, alat;
+} bctx;
+
+/* Return nz if the named benchmark should be run */
+static int b_want(bctx *b, char *name) {
+	if (b->sel != NULL && strstr(name, b->sel) == NULL)
+		return 0;
+	if (b->nres >= MXBENCH)
+		error("Too many benchmarks");
+	return 1;
+}
+
+/* Start a benchmark. Setup time is counted from here */
+static void b_begin(bctx *b, char *name) {
+	b->cr = &b->res[b->nres++];
+	memset(b->cr, 0, sizeof(bres));
+	strncpy(b->cr->name, name, 39);
+	b->nlat = 0;
+	if (b->verb)
+		printf("Running %s\n",name);
+	b->stime = bench_time();
+}
+
+/* Mark the end of setup */
+static void b_setup(bctx *b) {
+	b->cr->setup = bench_time() - b->stime;
+}
+
+/* Start a batch of operations */
+static void b_bstart(bctx *b) {
+	b->bstime = bench_time();
+}
+
+/* Finish a batch of nops operations */
+static void b_bend(bctx *b, int nops) {
+	double tt = bench_time() - b->bstime;
+
+	if (nops <= 0)
+		return;
+	b->cr->nops += nops;
+	b->cr->secs += tt;
+	if (b->nlat >= b->alat) {
+		b->alat = b->alat * 2 + 1000;
+		if ((b->lat = (double *)realloc(b->lat, b->alat * sizeof(double))) == NULL)
+			error("Malloc of latency samples failed");
+	}
+	b->lat[b->nlat++] = tt/nops;
+}
+
+static int cmpdbl(const void *a, const void *b) {
+	double aa = *(double *)a, bb = *(double *)b;
+	return aa < bb ? -1 : aa > bb ? 1 : 0;
+}
+
+/* Finish a benchmark */
+static void b_end(bctx *b) {
+	bres *r = b->cr;
+
+	if (b->nlat > 0) {
+		qsort(b->lat, b->nlat, sizeof(double), cmpdbl);
+		r->lat[0] = b->lat[(int)(0.50 * (b->nlat-1) + 0.5)];
+		r->lat[1] = b->lat[(int)(0.90 * (b->nlat-1) + 0.5)];
+		r->lat[2] = b->lat[(int)(0.99 * (b->nlat-1) + 0.5)];
+		r->lat[3] = b->lat[b->nlat-1];
+	}
+	r->rss = peak_rss();
+
+	printf("%-22s %9d ops %8.3f s %12.1f ops/s  p50 %9.3f p99 %9.3f usec  setup %7.3f s\n",
+	       r->name, r->nops, r->secs, r->secs > 0.0 ? r->nops/r->secs : 0.0,
+	       1e6 * r->lat[0], 1e6 * r->lat[2], r->setup);
+	fflush(stdout);
+}
+
+/* Write the results as JSON */
+static void write_json(bctx *b, char *fname, unsigned int seed) {
+	FILE *fp;
+	int i;
+
+	if ((fp = fopen(fname, "w")) == NULL)
+		error("Unable to open '%s' for writing",fname);
+
+	fprintf(fp,"{\n");
+	fprintf(fp,"  \"version\": \"%s\",\n",ARGYLL_VERSION_STR);
+	fprintf(fp,"  \"seed\": %u,\n",seed);
+	fprintf(fp,"  \"quick\": %s,\n",b->quick ? "true" : "false");
+	fprintf(fp,"  \"peak_rss_kb\": %ld,\n",peak_rss());
+	fprintf(fp,"  \"benchmarks\": [\n");
+	for (i = 0; i < b->nres; i++) {
+		bres *r = &b->res[i];
+		fprintf(fp,"    {\n");
+		fprintf(fp,"      \"name\": \"%s\",\n",r->name);
+		fprintf(fp,"      \"ops\": %d,\n",r->nops);
+		fprintf(fp,"      \"secs\": %.6f,\n",r->secs);
+		fprintf(fp,"      \"ops_per_sec\": %.3f,\n",r->secs > 0.0 ? r->nops/r->secs : 0.0);
+		fprintf(fp,"      \"lat_us\": { \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+		        1e6 * r->lat[0], 1e6 * r->lat[1], 1e6 * r->lat[2], 1e6 * r->lat[3]);
+		fprintf(fp,"      \"setup_secs\": %.6f,\n",r->setup);
+		fprintf(fp,"      \"peak_rss_kb\": %ld\n",r->rss);
+		fprintf(fp,"    }%s\n", i < (b->nres-1) ? "," : "");
+	}
+	fprintf(fp,"  ]\n");
+	fprintf(fp,"}\n");
+
+	if (fclose(fp) != 0)
+		error("Failed to close '%s'",fname);
+}
+
+/* ============================================================ */
+/* Synthetic device models */
+
+/* sRGB primaries, Bradford adapted to D50 */
+static double rgb2xyz[3][3] = {
+	{ 0.4361, 0.3851, 0.1431 },
+	{ 0.2225, 0.7169, 0.0606 },
+	{ 0.0139, 0.0971, 0.7141 }
+};
+
+/* Linear RGB to D50 Lab */
+static void lrgb_lab(double *out, double *in) {
+	double xyz[3];
+	int j;
+
+	for (j = 0; j < 3; j++)
+		xyz[j] = rgb2xyz[j][0] * in[0] + rgb2xyz[j][1] * in[1] + rgb2xyz[j][2] * in[2];
+	icmXYZ2Lab(&icmD50, out, xyz);
+}
+
+/* Gamma 2.2 display RGB -> Lab */
+static void rgb_lab(void *cntx, double *out, double *in) {
+	double lin[3];
+	int j;
+
+	for (j = 0; j < 3; j++) {
+		double vv = in[j] < 0.0 ? 0.0 : in[j] > 1.0 ? 1.0 : in[j];
+		lin[j] = pow(vv, 2.2);
+	}
+	lrgb_lab(out, lin);
+}
+
+/* Subtractive CMYK printer -> Lab, with dot gain and */
+/* unwanted absorptions. Paper is slightly less than perfect white. */
+static void cmyk_lab(void *cntx, double *out, double *in) {
+	static double abs[4][3] = {		/* Band absorption of each colorant */
+		{ 0.92, 0.20, 0.06 },
+		{ 0.10, 0.90, 0.18 },
+		{ 0.02, 0.08, 0.88 },
+		{ 0.88, 0.86, 0.84 }
+	};
+	double dv[4], lin[3];
+	int e, j;
+
+	for (e = 0; e < 4; e++) {
+		double vv = in[e] < 0.0 ? 0.0 : in[e] > 1.0 ? 1.0 : in[e];
+		dv[e] = vv + 0.18 * vv * (1.0 - vv);		/* Dot gain */
+	}
+	for (j = 0; j < 3; j++) {
+		lin[j] = 0.92;
+		for (e = 0; e < 4; e++)
+			lin[j] *= 1.0 - abs[e][j] * dv[e];
+		lin[j] += 0.004;							/* Surface reflection */
+	}
+	lrgb_lab(out, lin);
+}
+
+/* Device value total ink limit function */
+static double sum_limit(void *lcntx, double *in) {
+	int e;
+	double sum = 0.0;
+	for (e = 0; e < 4; e++)
+		sum += in[e];
+	return sum;
+}
+
+/* Lab <-> Lut PCS' (0..1) */
+static void lab_labp(double *out, double *in) {
+	out[0] = in[0]/100.0;
+	out[1] = (in[1] + 128.0)/255.0;
+	out[2] = (in[2] + 128.0)/255.0;
+}
+
+static void cmyk_labp(void *cntx, double *out, double *in) {
+	double lab[3];
+	cmyk_lab(cntx, lab, in);
+	lab_labp(out, lab);
+}
+
+static void labp_lab(void *cntx, double *out, double *in) {
+	out[0] = in[0] * 100.0;
+	out[1] = in[1] * 255.0 - 128.0;
+	out[2] = in[2] * 255.0 - 128.0;
+}
+
+/* Return an array of n random points in di dimensions, 0..1 */
+static double *rand_pts(int n, int di) {
+	double *rv;
+	int i;
+
+	if ((rv = (double *)malloc(n * di * sizeof(double))) == NULL)
+		error("Malloc of test points failed");
+	for (i = 0; i < (n * di); i++)
+		rv[i] = d_rand(0.0, 1.0);
+	return rv;
+}
+
+/* Create an rspl from one of the device models */
+static rspl *dev_rspl(int di, int res,
+                      void (*func)(void *cntx, double *out, double *in)) {
+	rspl *rr;
+	int e, gres[MXDI];
+	double vlow[3] = { 0.0, -128.0, -128.0 };
+	double vhigh[3] = { 100.0, 128.0, 128.0 };
+
+	for (e = 0; e < di; e++)
+		gres[e] = res;
+	if ((rr = new_rspl(RSPL_NOFLAGS, di, 3)) == NULL)
+		error("new_rspl failed");
+	rr->set_rspl(rr, 0, NULL, func, NULL, NULL, gres, vlow, vhigh);
+	return rr;
+}
+
+/* Create a gamut surface from one of the device models, */
+/* by sampling the device space surface. */
+static gamut *dev_gamut(int di, int res, double limit,
+                        void (*func)(void *cntx, double *out, double *in)) {
+	gamut *gam;
+	double in[4], out[3], white[3], black[3];
+	int m1, m2, e, c, x, y;
+	int pass;
+
+	if ((gam = new_gamut(0.0, 0, 0)) == NULL)
+		error("new_gamut failed");
+
+	/* Pass 0 expands the surface, pass 1 sets the cusps */
+	for (pass = 0; pass < 2; pass++) {
+		int rr = pass == 0 ? res : 2;
+
+		if (pass == 1)
+			gam->setcusps(gam, 0, NULL);
+
+		/* For each pair of dimensions, and every */
+		/* 0/1 combination of the remaining ones */
+		for (m1 = 0; m1 < di; m1++) {
+			for (m2 = m1 + 1; m2 < di; m2++) {
+				for (c = 0; c < (1 << di); c++) {
+					if (c & ((1 << m1) | (1 << m2)))
+						continue;
+					for (x = 0; x < rr; x++) {
+						for (y = 0; y < rr; y++) {
+							double sum = 0.0;
+							for (e = 0; e < di; e++)
+								in[e] = (c >> e) & 1 ? 1.0 : 0.0;
+							in[m1] = x/(rr - 1.0);
+							in[m2] = y/(rr - 1.0);
+							for (e = 0; e < di; e++)
+								sum += in[e];
+							if (limit > 0.0 && sum > limit) {
+								for (e = 0; e < di; e++)
+									in[e] *= limit/sum;
+							}
+							func(NULL, out, in);
+							if (pass == 0)
+								gam->expand(gam, out);
+							else
+								gam->setcusps(gam, 1, out);
+						}
+					}
+				}
+			}
+		}
+		if (pass == 1)
+			gam->setcusps(gam, 2, NULL);
+	}
+
+	for (e = 0; e < di; e++)
+		in[e] = di == 3 ? 1.0 : 0.0;
+	func(NULL, white, in);
+	for (e = 0; e < di; e++)
+		in[e] = di == 3 ? 0.0 : 1.0;
+	if (limit > 0.0) {
+		for (e = 0; e < di; e++)
+			in[e] *= limit/di;
+	}
+	func(NULL, black, in);
+	gam->setwb(gam, white, black, black);
+
+	return gam;
+}
+
+/* ============================================================ */
+/* The benchmarks */
+
+/* Forward rspl interpolation */
+static void bench_interp(bctx *b, char *name, int di, int res, int nops,
+                         void (*func)(void *cntx, double *out, double *in)) {
+	rspl *rr;
+	double *pts;
+	co tp;
+	int i, j, e;
+
+	if (!b_want(b, name))
+		return;
+	b_begin(b, name);
+	rr = dev_rspl(di, res, func);
+	pts = rand_pts(nops, di);
+	b_setup(b);
+
+	for (i = 0; i < nops; i += BATCH) {
+		b_bstart(b);
+		for (j = i; j < nops && j < (i + BATCH); j++) {
+			for (e = 0; e < di; e++)
+				tp.p[e] = pts[j * di + e];
+			rr->interp(rr, &tp);
+		}
+		b_bend(b, j - i);
+	}
+	b_end(b);
+	free(pts);
+	rr->del(rr);
+}
+
+/* Reverse CMYK rspl interpolation. If clip is set, the targets */
+/* are mostly out of gamut, and nearest clipping is used. */
+static void bench_rev(bctx *b, char *name, int res, int nops, int clip) {
+	rspl *rr;
+	double *pts;
+	co tp[NIP];
+	int auxm[4] = { 0, 0, 0, 1 };
+	int i, j, e;
+
+	if (!b_want(b, name))
+		return;
+	b_begin(b, name);
+	rr = dev_rspl(4, res, cmyk_lab);
+	rr->rev_set_limit(rr, sum_limit, NULL, LIMITVAL);
+	pts = rand_pts(nops, 4);
+	for (i = 0; i < nops; i++) {
+		double *pp = pts + i * 4;
+		if (clip) {		/* Push outside the device gamut */
+			pp[0] = 100.0 * pp[0];
+			pp[1] = 256.0 * pp[1] - 128.0;
+			pp[2] = 256.0 * pp[2] - 128.0;
+		} else {		/* Something in gamut */
+			double dev[4];
+			for (e = 0; e < 4; e++)
+				dev[e] = pp[e] * LIMITVAL/4.0;
+			cmyk_lab(NULL, pp, dev);
+		}
+	}
+	/* Create the reverse acceleration structures as part of setup */
+	for (e = 0; e < 3; e++)
+		tp[0].v[e] = pts[e];
+	tp[0].p[3] = 0.5;
+	rr->rev_interp(rr, RSPL_AUXLOCUS, NIP, auxm, NULL, tp);
+	b_setup(b);
+
+	for (i = 0; i < nops; i += BATCH) {
+		b_bstart(b);
+		for (j = i; j < nops && j < (i + BATCH); j++) {
+			for (e = 0; e < 3; e++)
+				tp[0].v[e] = pts[j * 4 + e];
+			tp[0].p[3] = 0.5;
+			if (rr->rev_interp(rr, clip ? RSPL_NEARCLIP | RSPL_WILLCLIP : RSPL_AUXLOCUS,
+			                   NIP, clip ? NULL : auxm, NULL, tp) == 0)
+				error("rev_interp failed");
+		}
+		b_bend(b, j - i);
+	}
+	b_end(b);
+	free(pts);
+	rr->del(rr);
+}
+
+/* icc Lut16 CMYK->Lab lookup, using the n-linear or simplex interpolator */
+static void bench_icclut(bctx *b, char *name, int nops, int sx) {
+	icc *icco;
+	icmLut *wo;
+	double *pts;
+	double tv1[MAX_CHAN], tv2[MAX_CHAN];
+	int i, j;
+
+	if (!b_want(b, name))
+		return;
+	b_begin(b, name);
+	if ((icco = new_icc()) == NULL)
+		error("new_icc failed");
+	icco->header->deviceClass = icSigOutputClass;
+	icco->header->colorSpace = icSigCmykData;
+	icco->header->pcs = icSigLabData;
+	icco->header->renderingIntent = icRelativeColorimetric;
+	if ((wo = (icmLut *)icco->add_tag(icco, icSigAToB1Tag, icSigLut16Type)) == NULL)
+		error("add_tag failed: %d, %s",icco->errc,icco->err);
+	wo->inputChan = 4;
+	wo->outputChan = 3;
+	wo->clutPoints = b->quick ? 9 : 17;
+	wo->inputEnt = 256;
+	wo->outputEnt = 4096;
+	wo->allocate((icmBase *)wo);
+	if (wo->set_tables(wo, ICM_CLUT_SET_EXACT, NULL, icSigCmykData, icSigLabData,
+	                   NULL, NULL, NULL, cmyk_labp, NULL, NULL, labp_lab) != 0)
+		error("set_tables failed: %d, %s",icco->errc,icco->err);
+	pts = rand_pts(nops, 4);
+	b_setup(b);
+
+	for (i = 0; i < nops; i += BATCH) {
+		b_bstart(b);
+		for (j = i; j < nops && j < (i + BATCH); j++) {
+			wo->lookup_input(wo, tv1, pts + j * 4);
+			if (sx)
+				wo->lookup_clut_sx(wo, tv2, tv1);
+			else
+				wo->lookup_clut_nl(wo, tv2, tv1);
+			wo->lookup_output(wo, tv1, tv2);
+		}
+		b_bend(b, j - i);
+	}
+	b_end(b);
+	free(pts);
+	icco->del(icco);
+}
+
+/* CIECAM02 forward and reverse conversions */
+static void bench_cam(bctx *b, char *name, int nops, int rev) {
+	icxcam *cam;
+	double *pts;
+	double out[3];
+	double wxyz[3] = { 0.9642, 1.0, 0.8249 };
+	int i, j;
+
+	if (!b_want(b, name))
+		return;
+	b_begin(b, name);
+	if ((cam = new_icxcam(cam_CIECAM02)) == NULL)
+		error("new_icxcam failed");
+	cam->set_view(cam, vc_average, wxyz, 34.0, 0.2, 0.0, 0.01, wxyz, 0, 0);
+	pts = rand_pts(nops, 3);
+	for (i = 0; i < nops; i++) {
+		double *pp = pts + 3 * i, lab[3], xyz[3];
+		rgb_lab(NULL, lab, pp);
+		icmLab2XYZ(&icmD50, xyz, lab);
+		if (rev)
+			cam->XYZ_to_cam(cam, pp, xyz);
+		else
+			icmCpy3(pp, xyz);
+	}
+	b_setup(b);
+
+	for (i = 0; i < nops; i += BATCH) {
+		b_bstart(b);
+		for (j = i; j < nops && j < (i + BATCH); j++) {
+			if (rev)
+				cam->cam_to_XYZ(cam, out, pts + 3 * j);
+			else
+				cam->XYZ_to_cam(cam, out, pts + 3 * j);
+		}
+		b_bend(b, j - i);
+	}
+	b_end(b);
+	free(pts);
+	cam->del(cam);
+}
+
+/* fit_rspl of a noisy scattered RGB->Lab data set. */
+/* Each operation is a complete fit. */
+static void bench_fit(bctx *b, char *name, int res, int npts, int nops) {
+	rspl *rr;
+	co *dp;
+	int gres[MXDI];
+	double vlow[3] = { 0.0, -128.0, -128.0 };
+	double vhigh[3] = { 100.0, 128.0, 128.0 };
+	int i, e;
+
+	if (!b_want(b, name))
+		return;
+	b_begin(b, name);
+	if ((dp = (co *)malloc(npts * sizeof(co))) == NULL)
+		error("Malloc of fit points failed");
+	for (i = 0; i < npts; i++) {
+		for (e = 0; e < 3; e++)
+			dp[i].p[e] = d_rand(0.0, 1.0);
+		rgb_lab(NULL, dp[i].v, dp[i].p);
+		for (e = 0; e < 3; e++)
+			dp[i].v[e] += 0.3 * norm_rand();
+	}
+	for (e = 0; e < 3; e++)
+		gres[e] = res;
+	b_setup(b);
+
+	for (i = 0; i < nops; i++) {
+		b_bstart(b);
+		if ((rr = new_rspl(RSPL_NOFLAGS, 3, 3)) == NULL)
+			error("new_rspl failed");
+		rr->fit_rspl(rr, 0, dp, npts, NULL, NULL, gres, vlow, vhigh, 1.0, NULL, NULL);
+		rr->del(rr);
+		b_bend(b, 1);
+	}
+	b_end(b);
+	free(dp);
+}
+
+/* Gamut surface creation, and radial & nearest surface queries */
+static void bench_gamut(bctx *b, int nops) {
+	gamut *gam;
+	double *pts;
+	double out[3];
+	int i, j, k;
+	int res = b->quick ? 9 : 17;
+
+	if (b_want(b, "gamut_expand")) {
+		b_begin(b, "gamut_expand");
+		pts = rand_pts(nops, 4);
+		b_setup(b);
+		gam = new_gamut(0.0, 0, 0);
+		for (i = 0; i < nops; i += BATCH) {
+			b_bstart(b);
+			for (j = i; j < nops && j < (i + BATCH); j++) {
+				double *pp = pts + j * 4, lab[3];
+				/* Put one device value at a surface */
+				k = j % 4;
+				pp[k] = (j/4) & 1 ? 1.0 : 0.0;
+				cmyk_lab(NULL, lab, pp);
+				gam->expand(gam, lab);
+			}
+			b_bend(b, j - i);
+		}
+		b_end(b);
+		gam->del(gam);
+		free(pts);
+	}
+
+	/* The gamut is triangulated on the first query */
+	gam = dev_gamut(4, res, LIMITVAL, cmyk_lab);
+	if (b_want(b, "gamut_triangulate")) {
+		double lab[3] = { 50.0, 0.0, 0.0 };
+		b_begin(b, "gamut_triangulate");
+		b_setup(b);
+		b_bstart(b);
+		gam->radial(gam, out, lab);
+		b_bend(b, 1);
+		b_end(b);
+	}
+
+	pts = rand_pts(nops, 3);
+	for (i = 0; i < nops; i++) {
+		double *pp = pts + 3 * i;
+		pp[0] = 100.0 * pp[0];
+		pp[1] = 200.0 * pp[1] - 100.0;
+		pp[2] = 200.0 * pp[2] - 100.0;
+	}
+	if (b_want(b, "gamut_radial")) {
+		b_begin(b, "gamut_radial");
+		b_setup(b);
+		for (i = 0; i < nops; i += BATCH) {
+			b_bstart(b);
+			for (j = i; j < nops && j < (i + BATCH); j++)
+				gam->radial(gam, out, pts + 3 * j);
+			b_bend(b, j - i);
+		}
+		b_end(b);
+	}
+	if (b_want(b, "gamut_nearest")) {
+		b_begin(b, "gamut_nearest");
+		b_setup(b);
+		for (i = 0; i < nops; i += BATCH) {
+			b_bstart(b);
+			for (j = i; j < nops && j < (i + BATCH); j++)
+				gam->nearest(gam, out, pts + 3 * j);
+			b_bend(b, j - i);
+		}
+		b_end(b);
+	}
+	free(pts);
+	gam->del(gam);
+}
+
+/* Gamut mapping creation (dominated by nearsmth), and application */
+static void bench_gammap(bctx *b, int nops) {
+	gamut *sgam, *dgam;
+	gammap *map = NULL;
+	icxGMappingIntent gmi;
+	double *pts;
+	double out[3];
+	int i, j;
+	int res = b->quick ? 9 : 17;
+
+	if (!b_want(b, "gammap_create") && !b_want(b, "gammap_domap"))
+		return;
+
+	sgam = dev_gamut(3, res, 0.0, rgb_lab);
+	dgam = dev_gamut(4, res, LIMITVAL, cmyk_lab);
+
+	memset(&gmi, 0, sizeof(gmi));
+	gmi.usecas = 0;
+	gmi.usemap = 1;
+	gmi.greymf = 1.0;
+	gmi.glumwcpf = 1.0;
+	gmi.glumwexf = 1.0;
+	gmi.glumbcpf = 1.0;
+	gmi.glumbexf = 1.0;
+	gmi.glumknf = 0.7;
+	gmi.gamcpf = 1.0;
+	gmi.gamexf = 0.0;
+	gmi.gamcknf = 0.1;
+	gmi.gamxknf = 0.1;
+	gmi.gampwf = 1.0;
+	gmi.gamswf = 0.0;
+	gmi.satenh = 0.0;
+	gmi.desc = "xbench";
+
+	if ((i = b_want(b, "gammap_create")) != 0) {
+		b_begin(b, "gammap_create");
+		b_setup(b);
+		b_bstart(b);
+	}
+	if ((map = new_gammap(0, sgam, NULL, dgam, &gmi, 0, 0, 0, 0,
+	                      b->quick ? 9 : 17, NULL, NULL, NULL)) == NULL)
+		error("new_gammap failed");
+	if (i) {
+		b_bend(b, 1);
+		b_end(b);
+	}
+
+	if (b_want(b, "gammap_domap")) {
+		b_begin(b, "gammap_domap");
+		pts = rand_pts(nops, 3);
+		for (i = 0; i < nops; i++)
+			rgb_lab(NULL, pts + 3 * i, pts + 3 * i);
+		b_setup(b);
+		for (i = 0; i < nops; i += BATCH) {
+			b_bstart(b);
+			for (j = i; j < nops && j < (i + BATCH); j++)
+				map->domap(map, out, pts + 3 * j);
+			b_bend(b, j - i);
+		}
+		b_end(b);
+		free(pts);
+	}
+	map->del(map);
+	sgam->del(sgam);
+	dgam->del(dgam);
+}
+
+/* ============================================================ */
+
+int
+main(int argc, char *argv[]) {
+	int fa, nfa;
+	bctx b;
+	unsigned int seed = 1;
+	char *oname = NULL;
+	int nops;
+
+	error_program = "xbench";
+	memset(&b, 0, sizeof(bctx));
+
+	/* Process the arguments */
+	for(fa = 1;fa < argc;fa++) {
+		nfa = fa;					/* skip to nfa if next argument is used */
+		if (argv[fa][0] == '-') {	/* Look for any flags */
+			char *na = NULL;		/* next argument after flag, null if none */
+
+			if (argv[fa][2] != '\000')
+				na = &argv[fa][2];		/* next is directly after flag */
+			else {
+				if ((fa+1) < argc) {
+					if (argv[fa+1][0] != '-') {
+						nfa = fa + 1;
+						na = argv[nfa];		/* next is seperate non-flag argument */
+					}
+				}
+			}
+
+			if (argv[fa][1] == '?')
+				usage();
+
+			else if (argv[fa][1] == 'v')
+				b.verb = 1;
+
+			else if (argv[fa][1] == 'q')
+				b.quick = 1;
+
+			else if (argv[fa][1] == 's') {
+				fa = nfa;
+				if (na == NULL) usage();
+				seed = (unsigned int)atoi(na);
+				if (seed == 0)
+					seed = 1;
+
+			} else if (argv[fa][1] == 'b') {
+				fa = nfa;
+				if (na == NULL) usage();
+				b.sel = na;
+
+			} else if (argv[fa][1] == 'o') {
+				fa = nfa;
+				if (na == NULL) usage();
+				oname = na;
+
+			} else
+				usage();
+		} else
+			break;
+	}
+
+	/* Make the test points (and fit noise) reproducible */
+	rand32(seed);
+
+	nops = b.quick ? 20000 : 200000;
+
+	bench_interp(&b, "rspl_interp_3d", 3, 33, nops * 5, rgb_lab);
+	bench_interp(&b, "rspl_interp_4d", 4, 17, nops * 5, cmyk_lab);
+	bench_rev(&b, "rspl_rev_exact", b.quick ? 9 : 17, nops/20, 0);
+	bench_rev(&b, "rspl_rev_clip", b.quick ? 9 : 17, nops/40, 1);
+	bench_icclut(&b, "icc_lut16_nl", nops * 2, 0);
+	bench_icclut(&b, "icc_lut16_sx", nops * 2, 1);
+	bench_cam(&b, "cam02_fwd", nops, 0);
+	bench_cam(&b, "cam02_bwd", nops, 1);
+	bench_fit(&b, "fit_rspl_9", 9, 1000, b.quick ? 1 : 3);
+	bench_fit(&b, "fit_rspl_17", 17, 2000, 1);
+	if (!b.quick)
+		bench_fit(&b, "fit_rspl_33", 33, 4000, 1);
+	bench_gamut(&b, nops);
+	bench_gammap(&b, nops);
+
+	if (oname != NULL)
+		write_json(&b, oname, seed);
+
+	free(b.lat);
+	return 0;
+}
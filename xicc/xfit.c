@@ -61,6 +61,7 @@
 #include "copyright.h"
 #include "config.h"
 #include "numlib.h"
+#include "conv.h"
 #include "icc.h"
 #include "rspl.h"
 #include "xicc.h"
@@ -86,6 +87,8 @@
 #define MAXITS 2000			/* Shaper number of itterations before giving up */
 #define PDDEL  1e-6			/* Fake partial derivative del */
 
+#define MIN_THR_PNTS 500	/* Minimum number of data points per evaluation thread */
+
 /* Weights for shaper in/out curve parameters, to minimise unconstrained "wiggles" */
 #define SHAPE_WEIGHT	1.0		/* Overal shaper weight contribution - err on side of smoothness */
 #define SHAPE_HW01		0.1		/* 0 & 1 harmonic weights */
@@ -680,25 +683,18 @@ static void xfitprog(void *pdata, int perc) {
 
 int xfitfunc_trace = 1;
 
-/* Shaper+Matrix optimisation function handed to powell() */
-/* We simply minimize the total delta E squared, consistent with smoothness */
-static double xfitfunc(void *edata, double *v) {
-	xfit *p = (xfit *)edata;
-	double tw = 0.0;				/* Total weight */
-	double ev = 0.0, rv, smv;
+/* Evaluate the error of each data point in share ix of p->nthr for */
+/* xfitfunc(), putting the delta E squared ^ CURVEPOW into p->pdel[]. */
+static int xfit_pnts(void *cntx, int ix) {
+	xfit *p = (xfit *)cntx;
 	double tin[MXDI], out[MXDO];
 	int di = p->di;
 	int fdi = p->fdi;
+	int sp = (int)((double)p->nodp * ix/p->nthr + 0.5);
+	int ep = (int)((double)p->nodp * (ix+1)/p->nthr + 0.5);
 	int i, e, f;
 
-	/* Copy the parameters being optimised into xfit structure */
-	for (i = 0; i < p->opt_cnt; i++) { 
-//printf("~1 param %d = %f\n",i,v[i]);
-		p->v[p->opt_off + i] = v[i];
-	}
-
-	/* For all our data points */
-	for (i = 0; i < p->nodp; i++) {
+	for (i = sp; i < ep; i++) {
 		double del;
 
 		/* Apply input shaper channel curves */
@@ -733,8 +729,46 @@ static double xfitfunc(void *edata, double *v) {
 		}
 		if (CURVEPOW > 1.0)
 			del = pow(del, CURVEPOW);
+		p->pdel[i] = del;
+	}
+	return 0;
+}
+
+/* Run xfit_pnts() or dxfit_pnts() over all the data points, */
+/* spreading them across p->nthr threads. */
+static void xfit_run(xfit *p, int (*func)(void *cntx, int ix)) {
+	int i;
+
+	if (p->ths != NULL) {
+		p->ths->run(p->ths, p->nthr, func, (void *)p);
+	} else {
+		for (i = 0; i < p->nthr; i++)
+			func((void *)p, i);
+	}
+}
+
+/* Shaper+Matrix optimisation function handed to powell() */
+/* We simply minimize the total delta E squared, consistent with smoothness */
+static double xfitfunc(void *edata, double *v) {
+	xfit *p = (xfit *)edata;
+	double tw = 0.0;				/* Total weight */
+	double ev = 0.0, rv, smv;
+	int i;
+
+	/* Copy the parameters being optimised into xfit structure */
+	for (i = 0; i < p->opt_cnt; i++) { 
+//printf("~1 param %d = %f\n",i,v[i]);
+		p->v[p->opt_off + i] = v[i];
+	}
+
+	/* Evaluate all our data points */
+	xfit_run(p, xfit_pnts);
+
+	/* Sum them in point order, so that the result doesn't */
+	/* depend on how they were shared between the threads. */
+	for (i = 0; i < p->nodp; i++) {
 		tw += p->rpoints[i].w;
-		ev += p->rpoints[i].w * del;
+		ev += p->rpoints[i].w * p->pdel[i];
 	}
 
 	/* Normalise error to be an average delta E squared */
@@ -755,16 +789,40 @@ fprintf(stdout,"~1(sm %f, ev %f)xfitfunc returning %f\n",smv,ev,rv);
 	return rv;
 }
 
-/* Shaper+Matrix optimisation function with partial derivatives, */
-/* handed to conjgrad() */
-static double dxfitfunc(void *edata, double *dv, double *v) {
-	xfit *p = (xfit *)edata;
-	double tw = 0.0;				/* Total weight */
-	double ev = 0.0, rv, smv;
-	double tin[MXDI], out[MXDO];
+/* Set p->dix[] to the index of each partial derivative that dxfit_pnts() */
+/* computes for each data point, in the order it puts them in p->pdav[]. */
+static void dxfit_index(xfit *p) {
+	int di = p->di;
+	int fdi = p->fdi;
+	int k, ee, ff;
 
-	double dav[MXPARMS];				/* Overall del due to del param vals */
-	double sdav[MXPARMS];				/* Overall del due to del smooth param vals */
+	p->ndav = 0;
+	if (p->opt_msk & oc_i) {
+		for (ee = 0; ee < di; ee++) {
+			for (k = 0; k < p->iluord[ee]; k++)
+				p->dix[p->ndav++] = p->shp_offs[ee] + k;
+		}
+	}
+	if (p->opt_msk & oc_m) {
+		for (ff = 0; ff < fdi; ff++) {
+			for (ee = 0; ee < (1 << di); ee++)
+				p->dix[p->ndav++] = p->mat_off + ff * (1 << di) + ee;
+		}
+	}
+	if (p->opt_msk & oc_o) {
+		for (ff = 0; ff < fdi; ff++) {
+			for (k = 0; k < p->oluord[ff]; k++)
+				p->dix[p->ndav++] = p->out_offs[ff] + k;
+		}
+	}
+}
+
+/* Evaluate the error and the weighted partial derivatives of each */
+/* data point in a range for dxfitfunc(), putting the delta E squared */
+/* ^ CURVEPOW into p->pdel[], and the partial derivatives into p->pdav[]. */
+static int dxfit_pnts(void *cntx, int ix) {
+	xfit *p = (xfit *)cntx;
+	double tin[MXDI], out[MXDO];
 
 	double dtin_iv[MXDI * MXLUORD];		/* Del in itrans out due to del itrans param vals */
 	double dmato_mv[1 << MXDI];			/* Del in mat out due to del in matrix param vals */
@@ -776,22 +834,13 @@ static double dxfitfunc(void *edata, double *dv, double *v) {
 
 	int di = p->di;
 	int fdi = p->fdi;
+	int sp = (int)((double)p->nodp * ix/p->nthr + 0.5);
+	int ep = (int)((double)p->nodp * (ix+1)/p->nthr + 0.5);
 	int i, jj, k, e, ee, f, ff;
 
-	/* Copy the parameters being optimised into xfit structure */
-	for (i = 0; i < p->opt_cnt; i++) {
-//printf("~1 param %d = %f\n",i,v[i]);
-		p->v[p->opt_off + i] = v[i];
-	}
-
-	/* Zero the accumulated partial derivatives */
-	/* We compute deriv for all parameters (not just current optimised) */
-	for (i = 0; i < p->tot_cnt; i++)
-		dav[i] = 0.0;
-
-	/* For all our data points */
-	for (i = 0; i < p->nodp; i++) {
+	for (i = sp; i < ep; i++) {
 		double del;
+		double *dav = p->pdav + i * p->ndav;	/* This points partial derivatives */
 
 		/* Apply input channel curves */
 		for (e = 0; e < di; e++)
@@ -848,12 +897,10 @@ static double dxfitfunc(void *edata, double *dv, double *v) {
 					dout_de[0][f] *= dadj;
 			}
 		}
+		p->pdel[i] = del;
 
-		/* Accumulate total weighted delta E squared */
-		tw += p->rpoints[i].w;
-		ev += p->rpoints[i].w * del;
-
-		/* Compute and accumulate partial difference values for each parameter value */
+		/* Compute the weighted partial difference values for each parameter */
+		/* value, in the same order as dxfit_index(). */
 		if (p->opt_msk & oc_i) {
 			/* Input transfer parameters */
 			for (ee = 0; ee < di; ee++) {				/* Parameter input chanel */
@@ -866,7 +913,7 @@ static double dxfitfunc(void *edata, double *dv, double *v) {
 						vv += dout_de[0][ff] * dout_mato[ff]
 						    * dmato_tin[ff * di + ee] * dtin_iv[jj];
 					}
-					dav[p->shp_off + jj] += p->rpoints[i].w * vv;
+					*dav++ = p->rpoints[i].w * vv;
 				}
 			}
 		}
@@ -876,10 +923,9 @@ static double dxfitfunc(void *edata, double *dv, double *v) {
 			for (ff = 0; ff < fdi; ff++) {				/* Parameter output chanel */
 				for (ee = 0; ee < (1 << di); ee++) {	/* Matrix input combination chanel */
 					double vv = 0.0;
-					jj = ff * (1 << di) + ee;			/* Matrix Parameter index */
 
 					vv += dout_de[0][ff] * dout_mato[ff] * dmato_mv[ee];
-					dav[p->mat_off + jj] += p->rpoints[i].w * vv;
+					*dav++ = p->rpoints[i].w * vv;
 				}
 			}
 		}
@@ -892,11 +938,51 @@ static double dxfitfunc(void *edata, double *dv, double *v) {
 					jj = p->out_offs[ff] - p->out_off + k;	/* Overall output trans param */
 
 					vv += dout_de[0][ff] * dout_ov[jj];
-					dav[p->out_off + jj] += p->rpoints[i].w * vv;
+					*dav++ = p->rpoints[i].w * vv;
 				}
 			}
 		}
 	}
+	return 0;
+}
+
+/* Shaper+Matrix optimisation function with partial derivatives, */
+/* handed to conjgrad() */
+static double dxfitfunc(void *edata, double *dv, double *v) {
+	xfit *p = (xfit *)edata;
+	double tw = 0.0;				/* Total weight */
+	double ev = 0.0, rv, smv;
+
+	double dav[MXPARMS];				/* Overall del due to del param vals */
+	double sdav[MXPARMS];				/* Overall del due to del smooth param vals */
+	int i, k;
+
+	/* Copy the parameters being optimised into xfit structure */
+	for (i = 0; i < p->opt_cnt; i++) {
+//printf("~1 param %d = %f\n",i,v[i]);
+		p->v[p->opt_off + i] = v[i];
+	}
+
+	/* Zero the accumulated partial derivatives */
+	/* We compute deriv for all parameters (not just current optimised) */
+	for (i = 0; i < p->tot_cnt; i++)
+		dav[i] = 0.0;
+
+	/* Evaluate all our data points */
+	dxfit_index(p);
+	xfit_run(p, dxfit_pnts);
+
+	/* Accumulate total weighted delta E squared and partial derivatives */
+	/* in point order, so that the result doesn't depend on how they */
+	/* were shared between the threads. */
+	for (i = 0; i < p->nodp; i++) {
+		double *pdav = p->pdav + i * p->ndav;
+
+		tw += p->rpoints[i].w;
+		ev += p->rpoints[i].w * p->pdel[i];
+		for (k = 0; k < p->ndav; k++)
+			dav[p->dix[k]] += pdav[k];
+	}
 
 	/* Normalise error to be an average delta E squared */
 	ev /= tw;
@@ -1474,6 +1560,32 @@ int xfit_fit(
 	if ((p->sa = (double *)calloc(p->tot_cnt, sizeof(double))) == NULL)
 		return 1;
 
+	/* Allocate space for the per data point results */
+	if (p->pdel != NULL)
+		free(p->pdel);
+	if (p->pdav != NULL)
+		free(p->pdav);
+	if ((p->pdel = (double *)malloc(nodp * sizeof(double))) == NULL)
+		return 1;
+	if ((p->pdav = (double *)malloc(nodp * p->tot_cnt * sizeof(double))) == NULL)
+		return 1;
+
+	/* Start the threads used to evaluate the points, keeping */
+	/* them for all the optimisation function calls. */
+	p->nthr = p->mxthr;
+	if (p->nthr > (nodp / MIN_THR_PNTS))
+		p->nthr = nodp / MIN_THR_PNTS;
+	if (p->nthr < 1)
+		p->nthr = 1;
+	if (p->ths != NULL && p->ths->nthr != p->nthr) {
+		p->ths->del(p->ths);
+		p->ths = NULL;
+	}
+	if (p->nthr > 1 && p->ths == NULL) {
+		if ((p->ths = new_athreads(p->nthr)) == NULL)
+			return 1;
+	}
+
 	/* Setup initial white point abs->rel conversions */
 	if ((p->flags & XFIT_OUT_WP_REL) != 0) { 
 		icmXYZNumber _wp;
@@ -2394,12 +2506,19 @@ static void xfit_del(xfit *p) {
 		free(p->piv);
 	if (p->uerrv != NULL)
 		free(p->uerrv);
+	if (p->pdel != NULL)
+		free(p->pdel);
+	if (p->pdav != NULL)
+		free(p->pdav);
+	if (p->ths != NULL)
+		p->ths->del(p->ths);
 	free(p);
 }
 
 /* Create a transform fitting object */
 /* return NULL on error */
 xfit *new_xfit(
+int nthr			/* Maximum number of threads to evaluate the points with */
 ) {
 	xfit *p;
 
@@ -2415,6 +2534,10 @@ xfit *new_xfit(
 	p->invoutcurve = xfit_invoutcurve;
 	p->del = xfit_del;
 
+	if (nthr <= 0)
+		nthr = system_ncpus();
+	p->mxthr = nthr;
+
 	return p;
 }
 
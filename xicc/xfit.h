@@ -84,6 +84,8 @@ struct _xfit {
 							/* callback to convert in or out value to fit metric squared */
 	double (*to_dde2)(void *cntx, double dout[2][MXDIDO], double *in1, double *in2);
 							/* Same, but with partial derivatives */
+							/* These are called from several threads at once, so they */
+							/* must be re-entrant, and not modify cntx2. */
 
 	int iluord[MXDI];		/* Input Shaper order actualy used (must be <= MXLUORD) */
 	int oluord[MXDO];		/* Output Shaper order actualy used (must be <= MXLUORD) */
@@ -139,6 +141,15 @@ struct _xfit {
 	double *sa;				/* Search area */
 	int opt_ch;				/* Channel being optimized */
 
+	/* Per data point evaluation results, summed in point order */
+	int mxthr;				/* Maximum number of threads to evaluate the points with */
+	int nthr;				/* Number of threads actually used */
+	struct _athreads *ths;	/* Worker threads, kept between evaluations */
+	double *pdel;			/* [nodp] Delta E squared of each point */
+	double *pdav;			/* [nodp * ndav] Weighted partial derivatives of each point */
+	int ndav;				/* Number of partial derivatives per point */
+	int dix[MXPARMS];		/* Parameter index of each per point partial derivative */
+
 	/* Methods */
 	void (*del)(struct _xfit *p);
 
@@ -189,7 +200,7 @@ struct _xfit {
 
 }; typedef struct _xfit xfit;
 
-xfit *new_xfit();
+xfit *new_xfit(int nthr);
 
 #endif /* XFIT_H */
 
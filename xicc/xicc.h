@@ -191,6 +191,9 @@ struct _xicc {
 	int nodel_cal;		/* Flag, nz if cal was provided externally and shouldn't be deleted */
 
 	/* Public: */
+	int nthr;			/* Maximum number of threads to use when creating lookups, */
+						/* 0 for the number of processors (default) */
+
 	void                 (*del)(struct _xicc *p);
 
 	/* "use" flags */
@@ -468,7 +471,19 @@ struct _icxLuLut {
 	/* Auxiliary parameter flags, non-zero for inputs that will be */
 	/* used as auxiliary parameters the rspl input */
 	/* dimensionality exceeds the output dimension (i.e. CMYK->Lab) */
-	int auxm[MXDI];	
+	int auxm[MXDI];
+
+	/* Coarse PCS' grid cache of the auxiliary locus, used to skip */
+	/* the rev_locus() search when an absolute aux target is well inside it. */
+	/* (Built by the first inv_clut_aux() that can use it, so that every */
+	/* lookup takes the same path, and freed when the ink limit changes. */
+	/* Like the rspl reverse cache, it isn't locked, since inverse lookups */
+	/* on one object aren't made from several threads at once.) */
+	int     klc_res;				/* Grid resolution, 0 if not built, -1 if failed */
+	double  klc_min[MXDO];			/* PCS' range covered by the grid */
+	double  klc_max[MXDO];
+	double *klc_lo, *klc_hi;		/* [cell * di + e] conservative input space locus */
+									/* range of each cell, lo > hi if no locus */
 
 	/* Auxiliar linearization function - NULL if none */
  	/* Only the used auxiliary chanels need be calculated. */
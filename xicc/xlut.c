@@ -78,11 +78,15 @@
 #undef CHECK_ILIMIT				/* [Undef] Do sanity checks on meeting ink limit */
 #undef WARN_CLUT_CLIPPING		/* [Undef] Print warning if setting clut clips */
 #undef DISABLE_KCURVE_FILTER	/* [Undef] don't filter the Kcurve */
+#undef DISABLE_KLCACHE			/* [Undef] don't use the aux locus cache in inv_clut_aux */
 
 #define SHP_SMOOTH 1.0	/* Input shaper curve smoothing */
 #define OUT_SMOOTH1 1.0	/* Output shaper curve smoothing for L*, X,Y,Z */
 #define OUT_SMOOTH2 1.0	/* Output shaper curve smoothing for a*, b* */
 
+#define KLC_RES 13		/* Aux locus cache PCS' grid resolution */
+#define KLC_MARG 0.01	/* Margin inside cached locus needed to use fast path */
+
 /*
  * TTBD:
  *
@@ -831,6 +835,254 @@ static double icxKcurve(double L, icxInkCurve *c) {
 #define DBK(xxx) 
 #endif
 
+/* Return the normalised L* (0.0 - 1.0 over Lmin to Lmax) that */
+/* drives the L based inking rules, given a PCS' value. */
+static double icxLuLut_inkL(icxLuLut *p, double *in) {
+	double tin[MAX_CHAN], L;
+
+	/* If we've got a mergeclut, then the PCS' is the same as the */
+	/* effective PCS, and we need to convert to native PCS */
+	if (p->mergeclut) {
+		p->mergeclut = 0;					/* Hack to be able to use inv_out_abs() */
+		icxLuLut_inv_out_abs(p, tin, in);
+		p->mergeclut = 1;
+
+	} else {
+		/* Convert native PCS' to native PCS values */
+		p->output(p, tin, in);	
+	}
+
+	/* Figure out Luminance number */
+	if (p->natos == icSigXYZData) {
+		icmXYZ2Lab(&icmD50, tin, tin);
+	} else if (p->natos != icSigLabData) {	/* Hmm. that's unexpected */
+		error("Assert: xlut K locus, unexpected native pcs of 0x%x\n",p->natos);
+	}
+	L = 0.01 * tin[0];
+	DBR(("inv_clut_aux: aux from Luminance, raw L = %f\n",L));
+
+	/* Normalise L to its possible range from min to max */
+	L = (L - p->Lmin)/(p->Lmax - p->Lmin);
+	DBR(("inv_clut_aux: Normalize L = %f\n",L));
+
+	return L;
+}
+
+/* ---------------------------------------------------------- */
+/* Auxiliary locus cache.                                     */
+/* Many B2A table and link inverse lookups use an inking rule */
+/* whose aux (K) target doesn't depend on the locus extent, */
+/* and only needs clipping to it. If the target is well inside */
+/* the locus, the rev_locus() search can be skipped. The locus */
+/* extent is sampled on a coarse PCS' grid, and a conservative */
+/* range for each grid cell kept. Since this is only an estimate, */
+/* the fast path result is verified, and the full search is */
+/* done if the aux target wasn't met exactly. */
+
+/* Free the aux locus cache */
+static void icxLuLut_del_klcache(icxLuLut *p) {
+	if (p->klc_lo != NULL)
+		free(p->klc_lo);
+	p->klc_lo = NULL;
+	if (p->klc_hi != NULL)
+		free(p->klc_hi);
+	p->klc_hi = NULL;
+	p->klc_res = 0;
+}
+
+/* Create the aux locus cache. Return nz on error. */
+static int icxLuLut_init_klcache(icxLuLut *p) {
+	rspl *s = p->clutTable;
+	int di = s->di, fdi = s->fdi;
+	int res = KLC_RES;
+	int e, f, i, j;
+	int nv, nc;				/* Number of vertexes and cells */
+	int coff[1 << MXDO];	/* Vertex offset of each cell corner */
+	double *vlo, *vhi;		/* Per vertex locus range */
+	DCOUNT(gc, MXDO, fdi, 0, 0, res);
+
+	icxLuLut_del_klcache(p);
+
+	for (nv = 1, nc = 1, f = 0; f < fdi; f++) {
+		nv *= res;
+		nc *= res-1;
+	}
+
+	if ((vlo = (double *)malloc(sizeof(double) * nv * di)) == NULL)
+		return 1;
+	if ((vhi = (double *)malloc(sizeof(double) * nv * di)) == NULL) {
+		free(vlo);
+		return 1;
+	}
+	if ((p->klc_lo = (double *)malloc(sizeof(double) * nc * di)) == NULL
+	 || (p->klc_hi = (double *)malloc(sizeof(double) * nc * di)) == NULL) {
+		free(vlo);
+		free(vhi);
+		icxLuLut_del_klcache(p);
+		return 1;
+	}
+
+	s->get_out_range(s, p->klc_min, p->klc_max);
+
+	/* Sample the locus at each grid vertex */
+	DC_INIT(gc);
+	for (i = 0; !DC_DONE(gc); i++) {
+		co pp[1];
+		double min[MXDI], max[MXDI];
+
+		for (f = 0; f < fdi; f++)
+			pp[0].v[f] = p->klc_min[f] + gc[f]/(res-1.0) * (p->klc_max[f] - p->klc_min[f]);
+
+		if (s->rev_locus(s, p->auxm, pp, min, max) == 0) {
+			for (e = 0; e < di; e++) {
+				vlo[i * di + e] = 1e60;
+				vhi[i * di + e] = -1e60;
+			}
+		} else {
+			/* Convert the locus from input' -> input space */
+			for (e = 0; e < di; e++) {
+				co tc;
+				if (p->auxm[e] != 0) {
+					tc.p[0] = min[e];
+					p->revinputTable[e]->interp(p->revinputTable[e], &tc);
+					vlo[i * di + e] = tc.v[0];
+					tc.p[0] = max[e];
+					p->revinputTable[e]->interp(p->revinputTable[e], &tc);
+					vhi[i * di + e] = tc.v[0];
+				}
+			}
+		}
+		DC_INC(gc);
+	}
+
+	/* Offsets to the corners of a cell */
+	for (j = 0; j < (1 << fdi); j++) {
+		int off, stride;
+		for (off = 0, stride = 1, f = 0; f < fdi; f++, stride *= res) {
+			if (j & (1 << f))
+				off += stride;
+		}
+		coff[j] = off;
+	}
+
+	/* The cell range is the intersection of its corner ranges */
+	{
+		DCOUNT(cc, MXDO, fdi, 0, 0, res-1);
+
+		DC_INIT(cc);
+		for (i = 0; !DC_DONE(cc); i++) {
+			int bv, stride;
+			for (bv = 0, stride = 1, f = 0; f < fdi; f++, stride *= res)
+				bv += cc[f] * stride;
+
+			for (e = 0; e < di; e++) {
+				double lo = -1e60, hi = 1e60;
+				if (p->auxm[e] == 0)
+					continue;
+				for (j = 0; j < (1 << fdi); j++) {
+					if (vlo[(bv + coff[j]) * di + e] > lo)
+						lo = vlo[(bv + coff[j]) * di + e];
+					if (vhi[(bv + coff[j]) * di + e] < hi)
+						hi = vhi[(bv + coff[j]) * di + e];
+				}
+				p->klc_lo[i * di + e] = lo;
+				p->klc_hi[i * di + e] = hi;
+			}
+			DC_INC(cc);
+		}
+	}
+	free(vlo);
+	free(vhi);
+
+	p->klc_res = res;
+	return 0;
+}
+
+/* Return nz if the input space aux target tv[] is safely */
+/* inside the cached locus for the PCS' value in[]. */
+static int icxLuLut_klcache_inside(icxLuLut *p, double *tv, double *in) {
+	int di = p->clutTable->di, fdi = p->clutTable->fdi;
+	int res = p->klc_res;
+	int e, f, ix, stride;
+
+	for (ix = 0, stride = 1, f = 0; f < fdi; f++, stride *= (res-1)) {
+		double rr = p->klc_max[f] - p->klc_min[f];
+		int gi;
+		if (rr <= 0.0)
+			return 0;
+		gi = (int)floor((in[f] - p->klc_min[f])/rr * (res-1.0));
+		if (gi < 0 || gi >= (res-1))
+			return 0;
+		ix += gi * stride;
+	}
+
+	for (e = 0; e < di; e++) {
+		if (p->auxm[e] != 0) {
+			if (tv[e] < (p->klc_lo[ix * di + e] + KLC_MARG)
+			 || tv[e] > (p->klc_hi[ix * di + e] - KLC_MARG))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/* Compute the auxiliary target in input space for inking rules */
+/* that don't depend on the locus extent (before clipping to the locus). */
+/* Return nz if the target is locus relative. */
+static int icxLuLut_abs_auxtarg(
+icxLuLut *p,
+double *tv,		/* Return aux target values */
+double *out,	/* Aux value or locus target input if auxt == NULL */
+double *auxt,	/* If not NULL, the aux target override */
+double *in		/* PCS' value being inverted */
+) {
+	int e, ee;
+	int di = p->clutTable->di;
+
+	if (auxt != NULL) {
+		for (ee = e = 0; e < di; e++) {
+			if (p->auxm[e] != 0)
+				tv[e] = auxt[ee++];
+		}
+	} else if (p->ink.k_rule == icxKvalue) {
+		for (e = 0; e < di; e++) {
+			if (p->auxm[e] != 0)
+				tv[e] = out[e];
+		}
+	} else if (p->ink.k_rule == icxKluma5k) {
+		double rv = icxKcurve(icxLuLut_inkL(p, in), &p->ink.c);
+		for (e = 0; e < di; e++) {
+			if (p->auxm[e] != 0)
+				tv[e] = rv;
+		}
+	} else if (p->ink.k_rule == icxKl5lk) {
+		double L, rv, rv2;
+
+		L = icxLuLut_inkL(p, in);
+		rv = icxKcurve(L, &p->ink.c);
+		rv2 = icxKcurve(L, &p->ink.x);
+		if (rv2 < rv) {
+			double tt;
+			tt = rv;
+			rv = rv2;
+			rv2 = tt;
+		}
+		for (e = 0; e < di; e++) {
+			if (p->auxm[e] != 0) {
+				double iv = out[e];
+				if (iv < rv)
+					iv = rv;
+				else if (iv > rv2)
+					iv = rv2;
+				tv[e] = iv;
+			}
+		}
+	} else {
+		return 1;		/* icxKlocus, icxKluma5, icxKl5l */
+	}
+	return 0;
+}
+
 /* Do output'->input' lookup with aux details. */
 /* Note that out[] will be used as the inking value if icxKrule is */
 /* icxKvalue, icxKlocus, icxKl5l or icxKl5lk, and that the auxiliar values, PCS ranges */
@@ -880,6 +1132,10 @@ double *in		/* Function input values to invert (== clut output' values) */
 
 	if (p->clutTable->di > fdi) {	/* ie. CMYK->Lab, there will be ambiguity */
 		double min[MXDI], max[MXDI];	/* Auxiliary locus range */
+		int fast = 0;					/* NZ if cached locus fast path was used */
+#ifndef DISABLE_KLCACHE
+		double tv[MXDI];				/* Absolute aux target */
+#endif
 
 #ifdef NEVER	/* Examine how many segments there are */
 		{	/* ie. CMYK->Lab, there will be ambiguity */
@@ -915,229 +1171,262 @@ double *in		/* Function input values to invert (== clut output' values) */
 		}
 #endif /* NEVER */
 
-		/* Compute auxiliary locus on the fly. This is in dev' == input' space. */
-		nsoln = p->clutTable->rev_locus(
-			p->clutTable,	/* rspl object */
-			p->auxm,		/* Auxiliary mask */
-			pp,				/* Input target and output solutions */
-			min, max);		/* Returned locus of valid auxiliary values */
-		
-		if (nsoln == 0) {
-			xflags |= RSPL_WILLCLIP;	/* No valid locus, so we expect to have to clip */
-#ifdef DEBUG_RLUT
-			printf("inv_clut_aux: no valid locus, expect clip\n");
-#endif
+#ifndef DISABLE_KLCACHE
+		/* If the aux target doesn't depend on the locus extent, and it is */
+		/* well inside the cached locus, skip the locus search. */
+		if (auxr == NULL && fdi == 3
+		 && icxLuLut_abs_auxtarg(p, tv, out, auxt, in) == 0) {
 
-		} else {  /* Got a valid locus */
+			/* Build the cache before the first lookup that can use it, */
+			/* so that the results don't depend on the order of lookups. */
+			if (p->klc_res == 0 && icxLuLut_init_klcache(p) != 0)
+				p->klc_res = -1;		/* Don't try again */
 
-			/* Convert the locuses from input' -> input space */
-			for (e = 0; e < p->clutTable->di; e++) {
-				co tc;
-				/* (Is speed more important than precision ?) */
-				if (p->auxm[e] != 0) {
-					tc.p[0] = min[e];
-					p->revinputTable[e]->interp(p->revinputTable[e], &tc);
-					min[e] = tc.v[0];
-					tc.p[0] = max[e];
-					p->revinputTable[e]->interp(p->revinputTable[e], &tc);
-					max[e] = tc.v[0];
-				}
-			}
+			if (p->klc_res > 0 && icxLuLut_klcache_inside(p, tv, in)) {
 
-			if (auxr != NULL) {		/* Report the locus range */
-				int ee = 0;
+				/* Convert the aux target from input to input' space */
 				for (e = 0; e < p->clutTable->di; e++) {
-					if (p->auxm[e] != 0) {
-						auxr[ee++] = min[e];
-						auxr[ee++] = max[e];
+					co tc;
+					if (p->auxm[e] != 0)  {
+						tc.p[0] = tv[e];
+						p->inputTable[e]->interp(p->inputTable[e], &tc);
+						pp[0].p[e] = tv[e] = tc.v[0];
 					}
 				}
-			}
 
-			if (auxt != NULL) {		/* overiding auxiliary target */
-				int ee = 0;
-				for (e = 0; e < p->clutTable->di; e++) {
-					if (p->auxm[e] != 0) {
-						double iv = auxt[ee++];
-						if (iv < min[e])
-							iv = min[e];
-						else if (iv > max[e])
-							iv = max[e];
-						pp[0].p[e] = iv;
-					}
-				}
-				DBR(("inv_clut_aux: aux %f from auxt[] %f\n",pp[0].p[3],auxt[0]))
-			} else if (p->ink.k_rule == icxKvalue) {
-				/* Implement the auxiliary inking rule */
-				/* Target auxiliary values are provided in out[] K value */
-				for (e = 0; e < p->clutTable->di; e++) {
-					if (p->auxm[e] != 0) {
-						double iv = out[e];		/* out[] holds aux target value */
-						if (iv < min[e])
-							iv = min[e];
-						else if (iv > max[e])
-							iv = max[e];
-						pp[0].p[e] = iv;
-					}
-				}
-				DBR(("inv_clut_aux: aux %f from out[0] K target %f min %f max %f\n",pp[0].p[3],out[3],min[3],max[3]))
-			} else if (p->ink.k_rule == icxKlocus) {
-				/* Set target auxliary input values from values in out[] and locus */
-				for (e = 0; e < p->clutTable->di; e++) {
-					if (p->auxm[e] != 0) {
-						double ii, iv;
-						ii = out[e];							/* Input ink locus */
-						iv = min[e] + ii * (max[e] - min[e]);	/* Output ink from locus */
-						if (iv < min[e])
-							iv = min[e];
-						else if (iv > max[e])
-							iv = max[e];
-						pp[0].p[e] = iv;
+				nsoln = p->clutTable->rev_interp(
+					p->clutTable, 	/* rspl object */
+					RSPL_MAXAUX | RSPL_EXACTAUX | flags,
+					MAX_INVSOLN, 	/* Maxumum solutions to return */
+					p->auxm, 		/* Auxiliary input chanel mask */
+					cdir,			/* Clip vector direction and length */
+					pp);			/* Input target and output solutions */
+
+				/* The cached locus is only an estimate, so check that we */
+				/* got exact solutions that met the aux target. If so, the */
+				/* full search would have come to exactly the same result. */
+				if (!(nsoln & RSPL_DIDCLIP) && (nsoln & RSPL_NOSOLNS) > 0) {
+					fast = 1;
+					for (i = 0; i < (nsoln & RSPL_NOSOLNS); i++) {
+						for (e = 0; e < p->clutTable->di; e++) {
+							if (p->auxm[e] != 0 && fabs(pp[i].p[e] - tv[e]) > 1e-6)
+								fast = 0;
+						}
 					}
 				}
-				DBR(("inv_clut_aux: aux %f from out[0] locus %f min %f max %f\n",pp[0].p[3],out[3],min[3],max[3]))
-			} else { /* p->ink.k_rule == icxKluma5 || icxKluma5k || icxKl5l || icxKl5lk */
-				/* Auxiliaries are driven by a rule and the output values */
-				double tin[MAX_CHAN], rv, L;
-
-				/* If we've got a mergeclut, then the PCS' is the same as the */
-				/* effective PCS, and we need to convert to native PCS */
-				if (p->mergeclut) {
-					p->mergeclut = 0;					/* Hack to be able to use inv_out_abs() */
-					icxLuLut_inv_out_abs(p, tin, in);
-					p->mergeclut = 1;
-
+				if (fast) {
+					DBR(("inv_clut_aux: cached locus fast path, aux %f\n",pp[0].p[3]))
 				} else {
-					/* Convert native PCS' to native PCS values */
-					p->output(p, tin, in);	
-				}
-
-				/* Figure out Luminance number */
-				if (p->natos == icSigXYZData) {
-					icmXYZ2Lab(&icmD50, tin, tin);
-				} else if (p->natos != icSigLabData) {	/* Hmm. that's unexpected */
-					error("Assert: xlut K locus, unexpected native pcs of 0x%x\n",p->natos);
+					for (f = 0; f < fdi; f++)
+						pp[0].v[f] = in[f];		/* Restore target value */
 				}
-				L = 0.01 * tin[0];
-				DBR(("inv_clut_aux: aux from Luminance, raw L = %f\n",L));
+			}
+		}
+#endif /* !DISABLE_KLCACHE */
 
-				/* Normalise L to its possible range from min to max */
-				L = (L - p->Lmin)/(p->Lmax - p->Lmin);
-				DBR(("inv_clut_aux: Normalize L = %f\n",L));
+		if (!fast) {
 
-				/* Convert L to curve value */
-				rv = icxKcurve(L, &p->ink.c);
-				DBR(("inv_clut_aux: icxKurve lookup returns = %f\n",rv));
+			/* Compute auxiliary locus on the fly. This is in dev' == input' space. */
+			nsoln = p->clutTable->rev_locus(
+				p->clutTable,	/* rspl object */
+				p->auxm,		/* Auxiliary mask */
+				pp,				/* Input target and output solutions */
+				min, max);		/* Returned locus of valid auxiliary values */
+		
+			if (nsoln == 0) {
+				xflags |= RSPL_WILLCLIP;	/* No valid locus, so we expect to have to clip */
+#ifdef DEBUG_RLUT
+				printf("inv_clut_aux: no valid locus, expect clip\n");
+#endif
 
-				if (p->ink.k_rule == icxKluma5) {	/* Curve is locus value */
+			} else {  /* Got a valid locus */
 
-					/* Set target black as K fraction within locus */
+				/* Convert the locuses from input' -> input space */
+				for (e = 0; e < p->clutTable->di; e++) {
+					co tc;
+					/* (Is speed more important than precision ?) */
+					if (p->auxm[e] != 0) {
+						tc.p[0] = min[e];
+						p->revinputTable[e]->interp(p->revinputTable[e], &tc);
+						min[e] = tc.v[0];
+						tc.p[0] = max[e];
+						p->revinputTable[e]->interp(p->revinputTable[e], &tc);
+						max[e] = tc.v[0];
+					}
+				}
 
+				if (auxr != NULL) {		/* Report the locus range */
+					int ee = 0;
 					for (e = 0; e < p->clutTable->di; e++) {
 						if (p->auxm[e] != 0) {
-							pp[0].p[e] = min[e] + rv * (max[e] - min[e]);
+							auxr[ee++] = min[e];
+							auxr[ee++] = max[e];
 						}
 					}
-					DBR(("inv_clut_aux: aux %f from locus %f min %f max %f\n",pp[0].p[3],rv,min[3],max[3]))
-
-				} else if (p->ink.k_rule == icxKluma5k) {	/* Curve is K value */
+				}
 
+				if (auxt != NULL) {		/* overiding auxiliary target */
+					int ee = 0;
 					for (e = 0; e < p->clutTable->di; e++) {
 						if (p->auxm[e] != 0) {
-							double iv = rv;
-							if (iv < min[e])			/* Clip to locus */
+							double iv = auxt[ee++];
+							if (iv < min[e])
 								iv = min[e];
 							else if (iv > max[e])
 								iv = max[e];
 							pp[0].p[e] = iv;
 						}
 					}
-					DBR(("inv_clut_aux: aux %f from out[0] K target %f min %f max %f\n",pp[0].p[3],rv,min[3],max[3]))
+					DBR(("inv_clut_aux: aux %f from auxt[] %f\n",pp[0].p[3],auxt[0]))
+				} else if (p->ink.k_rule == icxKvalue) {
+					/* Implement the auxiliary inking rule */
+					/* Target auxiliary values are provided in out[] K value */
+					for (e = 0; e < p->clutTable->di; e++) {
+						if (p->auxm[e] != 0) {
+							double iv = out[e];		/* out[] holds aux target value */
+							if (iv < min[e])
+								iv = min[e];
+							else if (iv > max[e])
+								iv = max[e];
+							pp[0].p[e] = iv;
+						}
+					}
+					DBR(("inv_clut_aux: aux %f from out[0] K target %f min %f max %f\n",pp[0].p[3],out[3],min[3],max[3]))
+				} else if (p->ink.k_rule == icxKlocus) {
+					/* Set target auxliary input values from values in out[] and locus */
+					for (e = 0; e < p->clutTable->di; e++) {
+						if (p->auxm[e] != 0) {
+							double ii, iv;
+							ii = out[e];							/* Input ink locus */
+							iv = min[e] + ii * (max[e] - min[e]);	/* Output ink from locus */
+							if (iv < min[e])
+								iv = min[e];
+							else if (iv > max[e])
+								iv = max[e];
+							pp[0].p[e] = iv;
+						}
+					}
+					DBR(("inv_clut_aux: aux %f from out[0] locus %f min %f max %f\n",pp[0].p[3],out[3],min[3],max[3]))
+				} else { /* p->ink.k_rule == icxKluma5 || icxKluma5k || icxKl5l || icxKl5lk */
+					/* Auxiliaries are driven by a rule and the output values */
+					double rv, L;
 
-				} else { /* icxKl5l || icxKl5lk */
-					/* Create second curve, and use input locus to */
-					/* blend between */
+					L = icxLuLut_inkL(p, in);
 
-					double rv2;		/* Upper limit */
+					/* Convert L to curve value */
+					rv = icxKcurve(L, &p->ink.c);
+					DBR(("inv_clut_aux: icxKurve lookup returns = %f\n",rv));
 
-					/* Convert L to max curve value */
-					rv2 = icxKcurve(L, &p->ink.x);
+					if (p->ink.k_rule == icxKluma5) {	/* Curve is locus value */
 
-					if (rv2 < rv) {		/* Ooops - better swap. */
-						double tt;
-						tt = rv;
-						rv = rv2;
-						rv2 = tt;
-					}
+						/* Set target black as K fraction within locus */
 
-					for (e = 0; e < p->clutTable->di; e++) {
-						if (p->auxm[e] != 0) {
-							if (p->ink.k_rule == icxKl5l) {
-								double ii;
-								ii = out[e];				/* Input K locus */
-								if (ii < 0.0)
-									ii = 0.0;
-								else if (ii > 1.0)
-									ii = 1.0;
-								ii = (1.0 - ii) * rv + ii * rv2;/* Blend between locus rule curves */
-								/* Out ink from output locus */
-								pp[0].p[e] = min[e] + ii * (max[e] - min[e]);
-							} else {
-								double iv;
-								iv = out[e];				/* Input K level */
-								if (iv < rv)				/* Constrain to curves */
-									iv = rv;
-								else if (iv > rv2)
-									iv = rv2;
-								pp[0].p[e] = iv; 
+						for (e = 0; e < p->clutTable->di; e++) {
+							if (p->auxm[e] != 0) {
+								pp[0].p[e] = min[e] + rv * (max[e] - min[e]);
 							}
 						}
+						DBR(("inv_clut_aux: aux %f from locus %f min %f max %f\n",pp[0].p[3],rv,min[3],max[3]))
+
+					} else if (p->ink.k_rule == icxKluma5k) {	/* Curve is K value */
+
+						for (e = 0; e < p->clutTable->di; e++) {
+							if (p->auxm[e] != 0) {
+								double iv = rv;
+								if (iv < min[e])			/* Clip to locus */
+									iv = min[e];
+								else if (iv > max[e])
+									iv = max[e];
+								pp[0].p[e] = iv;
+							}
+						}
+						DBR(("inv_clut_aux: aux %f from out[0] K target %f min %f max %f\n",pp[0].p[3],rv,min[3],max[3]))
+
+					} else { /* icxKl5l || icxKl5lk */
+						/* Create second curve, and use input locus to */
+						/* blend between */
+
+						double rv2;		/* Upper limit */
+
+						/* Convert L to max curve value */
+						rv2 = icxKcurve(L, &p->ink.x);
+
+						if (rv2 < rv) {		/* Ooops - better swap. */
+							double tt;
+							tt = rv;
+							rv = rv2;
+							rv2 = tt;
+						}
+
+						for (e = 0; e < p->clutTable->di; e++) {
+							if (p->auxm[e] != 0) {
+								if (p->ink.k_rule == icxKl5l) {
+									double ii;
+									ii = out[e];				/* Input K locus */
+									if (ii < 0.0)
+										ii = 0.0;
+									else if (ii > 1.0)
+										ii = 1.0;
+									ii = (1.0 - ii) * rv + ii * rv2;/* Blend between locus rule curves */
+									/* Out ink from output locus */
+									pp[0].p[e] = min[e] + ii * (max[e] - min[e]);
+								} else {
+									double iv;
+									iv = out[e];				/* Input K level */
+									if (iv < rv)				/* Constrain to curves */
+										iv = rv;
+									else if (iv > rv2)
+										iv = rv2;
+									pp[0].p[e] = iv; 
+								}
+							}
+						}
+						DBR(("inv_clut_aux: aux %f from 2 curves\n",pp[0].p[3]))
 					}
-					DBR(("inv_clut_aux: aux %f from 2 curves\n",pp[0].p[3]))
 				}
-			}
 
-			/* Convert to input/dev aux target to input'/dev' space for rspl inversion */
-			for (e = 0; e < p->clutTable->di; e++) {
-				double tv, bv = 0.0, bd = 1e6;
-				co tc;
-				if (p->auxm[e] != 0)  {
-					tv = pp[0].p[e];
-					/* Clip to overall locus range (belt and braces) */
-					if (tv < min[e])
-						tv = min[e];
-					if (tv > max[e])
-						tv = max[e];
-					tc.p[0] = tv;
-					p->inputTable[e]->interp(p->inputTable[e], &tc);
-					pp[0].p[e] = tc.v[0];
+				/* Convert to input/dev aux target to input'/dev' space for rspl inversion */
+				for (e = 0; e < p->clutTable->di; e++) {
+					double tv, bv = 0.0, bd = 1e6;
+					co tc;
+					if (p->auxm[e] != 0)  {
+						tv = pp[0].p[e];
+						/* Clip to overall locus range (belt and braces) */
+						if (tv < min[e])
+							tv = min[e];
+						if (tv > max[e])
+							tv = max[e];
+						tc.p[0] = tv;
+						p->inputTable[e]->interp(p->inputTable[e], &tc);
+						pp[0].p[e] = tc.v[0];
+					}
 				}
-			}
 
-			xflags |= RSPL_EXACTAUX;	/* Since we confine aux to locus */
+				xflags |= RSPL_EXACTAUX;	/* Since we confine aux to locus */
 
 #ifdef DEBUG_RLUT
-			printf("inv_clut_aux computed aux values ");
-			for (e = 0; e < p->clutTable->di; e++) {
-				if (p->auxm[e] != 0)
-					printf("%d: %f ",e,pp[0].p[e]);
-			}
-			printf("\n");
+				printf("inv_clut_aux computed aux values ");
+				for (e = 0; e < p->clutTable->di; e++) {
+					if (p->auxm[e] != 0)
+						printf("%d: %f ",e,pp[0].p[e]);
+				}
+				printf("\n");
 #endif /* DEBUG_RLUT */
-		}
+			}
 
-		/* Find reverse solution with target auxiliaries */
-		/* We choose the closest aux at or above the target */
-		/* to try and avoid glitches near black due to */
-		/* possible forked black locuses. */
-		nsoln = p->clutTable->rev_interp(
-			p->clutTable, 	/* rspl object */
-			RSPL_MAXAUX | flags | xflags,	/* Combine all the flags */
-			MAX_INVSOLN, 	/* Maxumum solutions to return */
-			p->auxm, 		/* Auxiliary input chanel mask */
-			cdir,			/* Clip vector direction and length */
-			pp);			/* Input target and output solutions */
-							/* returned solutions in pp[0..retval-1].p[] */
+			/* Find reverse solution with target auxiliaries */
+			/* We choose the closest aux at or above the target */
+			/* to try and avoid glitches near black due to */
+			/* possible forked black locuses. */
+			nsoln = p->clutTable->rev_interp(
+				p->clutTable, 	/* rspl object */
+				RSPL_MAXAUX | flags | xflags,	/* Combine all the flags */
+				MAX_INVSOLN, 	/* Maxumum solutions to return */
+				p->auxm, 		/* Auxiliary input chanel mask */
+				cdir,			/* Clip vector direction and length */
+				pp);			/* Input target and output solutions */
+								/* returned solutions in pp[0..retval-1].p[] */
+		}
 
 	} else {
 		DBR(("inv_clut_aux needs no aux value\n"))
@@ -1594,6 +1883,8 @@ icxLuBase *pp
 	if (p->absxyzlu != NULL)
 		p->absxyzlu->del(p->absxyzlu);
 
+	icxLuLut_del_klcache(p);
+
 	free(p);
 }
 
@@ -1722,6 +2013,9 @@ int       setLminmax	/* Figure the L locus for inking rule */
     	p->ink.tlimit = -1.0;		/* Turn ink limit off if not effective */
     if (devchan < 4 || p->ink.klimit < 0.0 || p->ink.klimit >= 1.0)
     	p->ink.klimit = -1.0;		/* Turn black limit off if not effective */
+
+	/* Any cached aux locus is no longer valid */
+	icxLuLut_del_klcache(p);
 	
 	/* Set the ink limit information for any reverse interpolation. */
 	/* Calling this will clear the reverse interpolaton cache. */
@@ -2933,7 +3227,7 @@ int                quality			/* Quality metric, 0..3 */
 
 		optcomb tcomb = oc_ipo;	/* Create all by default */
 
-		if ((xf = CAT2(new_, xfit)()) == NULL) {
+		if ((xf = CAT2(new_, xfit)(xicp->nthr)) == NULL) {
 			p->pp->errc = 2;
 			sprintf(p->pp->err,"Creation of xfit object failed");
 			p->del((icxLuBase *)p);